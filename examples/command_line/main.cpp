@@ -45,6 +45,27 @@ static void process_card_detect_int() {
     }
 }
 
+#if FF_USE_FREESCAN
+// Count the free clusters in the background, a chunk at a time,
+// so that "info" (f_getfree) doesn't have to read the whole FAT at once
+static void process_free_scan() {
+    static BYTE buf[8 * FF_MAX_SS];
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *sd_card_p = sd_get_by_num(i);
+        if (!sd_card_p || !sd_card_p->state.mounted)
+            continue;
+        FATFS *fs_p = &sd_card_p->state.fatfs;
+        if (fs_p->scan_clst >= fs_p->n_fatent)  // Done
+            continue;
+        DWORD nclst;
+        FRESULT fr = f_freescan(sd_get_drive_prefix(sd_card_p), buf, sizeof buf, &nclst);
+        if (FR_OK != fr)
+            DBG_PRINTF("f_freescan error: %s (%d)\n", FRESULT_str(fr), fr);
+        return;  // One chunk for each pass of the Super Loop
+    }
+}
+#endif
+
 // If the card is physically removed, unmount the filesystem:
 static void card_detect_callback(uint gpio, uint32_t events) {
     (void)events;
@@ -103,6 +124,9 @@ int main() {
         }
         if (card_det_int_pend)
             process_card_detect_int();
+#if FF_USE_FREESCAN
+        process_free_scan();
+#endif
         int cRxedChar = getchar_timeout_us(0);
         /* Get the character from terminal */
         if (PICO_ERROR_TIMEOUT != cRxedChar)
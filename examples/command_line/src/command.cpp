@@ -210,6 +210,20 @@ static void run_info(const size_t argc, const char *argv[]) {
     // Report format
     printf("\nFilesystem type: %s\n", fs_type_string(fs_p->fs_type));
 
+#if FF_USE_FREESCAN
+    // Report free space in each part of the volume, once the free cluster scan is done
+    if (fs_p->scan_clst >= fs_p->n_fatent) {
+        printf("Free space by part of the volume (%%):");
+        DWORD left = fs_p->n_fatent - 2;
+        for (size_t i = 0; i < FF_FREESCAN_REGIONS && left; ++i) {
+            DWORD n = left < fs_p->scan_rsize ? left : fs_p->scan_rsize;
+            printf(" %lu", (unsigned long)(100ULL * fs_p->scan_rfree[i] / n));
+            left -= n;
+        }
+        printf("\n");
+    }
+#endif
+
     // Report Partition Starting Offset
     // uint64_t offs = fs_p->volbase;
     // printf("Partition Starting Offset: %llu sectors (%llu bytes)\n",
@@ -224,6 +238,21 @@ static void run_info(const size_t argc, const char *argv[]) {
            fs_p->csize,
            (uint64_t)sd_card_p->state.fatfs.csize * FF_MAX_SS);
 }
+static void run_stats(const size_t argc, const char *argv[]) {
+    bool reset = argc && 0 == strcmp(argv[argc - 1], "reset");
+    const char *arg = chk_dflt_log_drv(reset ? argc - 1 : argc, argv);
+    if (!arg)
+        return;
+    sd_card_t *sd_card_p = sd_get_by_drive_prefix(arg);
+    if (!sd_card_p) {
+        printf("Unknown logical drive id: \"%s\"\n", arg);
+        return;
+    }
+    if (reset)
+        sd_stats_reset(sd_card_p);
+    else
+        sd_stats_dump(sd_card_p, printf);
+}
 static void run_format(const size_t argc, const char *argv[]) {
     const char *arg = chk_dflt_log_drv(argc, argv);
     if (!arg)
@@ -259,19 +288,14 @@ static void run_format(const size_t argc, const char *argv[]) {
     */
 
     /* Attempt to align partition to SD card segment (AU) */
-    size_t au_size_bytes;
-    bool ok = sd_allocation_unit(sd_card_p, &au_size_bytes);
-    if (!ok || !au_size_bytes)
-        au_size_bytes = 4194304; // Default to 4 MiB
-    UINT n_align = au_size_bytes / sd_block_size;
-
     MKFS_PARM opt = {
         FM_ANY,  /* Format option (FM_FAT, FM_FAT32, FM_EXFAT and FM_SFD) */
         2,       /* Number of FATs */
-        n_align, /* Data area alignment (sector) */
+        4194304 / sd_block_size, /* Data area alignment (sector): default to 4 MiB */
         0,       /* Number of root directory entries */
         0        /* Cluster size (byte) */
     };
+    sd_au_mkfs_parm(sd_card_p, &opt);
     /* Format the drive */
     FRESULT fr = f_mkfs(arg, &opt, 0, FF_MAX_SS * 2);
     if (FR_OK != fr) printf("f_mkfs error: %s (%d)\n", FRESULT_str(fr), fr);
@@ -664,6 +688,12 @@ static cmd_def_t cmds[] = {
     {"info", run_info, 
     "info [<drive#:>]:\n"
       " Print information about an SD card"},
+    {"stats", run_stats,
+    "stats [<drive#:>] [reset]:\n"
+      " Print the I/O statistics of an SD card:\n"
+      " command, retry and CRC error counts, and the latency of reads, writes and syncs.\n"
+      " reset Clears the statistics.\n"
+      "\te.g.: stats 0: reset"},
     {"cd", run_cd,
      "cd <path>:\n"
      " Changes the current directory of the logical drive.\n"
@@ -0,0 +1,228 @@
+/* hw_config.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Configuration for running on a Linux host: RAM "SD cards" (SD_IF_RAM).
+
+Drive 0: a card with a latency model roughly like an SPI attached card
+    at 25 MHz. Calibrate the numbers against `bench` on real hardware
+    before drawing conclusions from the projected throughput.
+    It has submission rings (see sd_ring.h), for the ring test.
+Drive 1: an ideal card (no modeled latency), for functional tests.
+Drive 2: like drive 0, with a write queue (see sd_wr_queue.h).
+Drive 3: like drive 0, with a sector cache (see sd_cache.h) and an init cache (see sd_init_cache.h).
+Drive 4: two cards like drive 0, striped (see RAID/sd_card_stripe.h).
+Drive 5: two cards like drive 0, mirrored (see RAID/sd_card_mirror.h),
+    with Card Detect on GPIOs 20 and 21 (present unless a test pulls them low).
+Drive 6: a card like drive 0, behind a fault injector (see FAULT/sd_card_fault.h).
+    The tests set the rules.
+Drive 7: a card like drive 0, with a write queue and a sector cache,
+    and Card Detect on GPIO 22, managed by sd_hotplug.h.
+*/
+
+#include <assert.h>
+//
+#include "hw_config.h"
+#include "sd_cache.h"
+#include "sd_hotplug.h"
+#include "sd_init_cache.h"
+#include "sd_ring.h"
+#include "sd_wr_queue.h"
+
+#define SPI_CARD_LATENCY {                                                   \
+        .cmd17_us = 300,     /* Access time */                               \
+        .cmd18_us = 300,                                                     \
+        .cmd24_us = 40,                                                      \
+        .cmd25_us = 40,                                                      \
+        .cmd12_us = 40,                                                      \
+        .block_rd_us = 170,  /* 514 bytes at 25 MHz, plus per block overhead */ \
+        .block_wr_us = 170,                                                  \
+        .busy_wr_us = 250,                                                   \
+        .init_us = 50000,    /* CMD0, CMD8, and ACMD41 polling */             \
+        .reg_us = 100        /* CMD9, CMD10, or ACMD13 */                     \
+    }
+
+/* RAM Interfaces */
+static sd_ram_if_t ram_ifs[] = {
+    {   // ram_ifs[0]
+        .sectors = 64 * 1024 * 1024 / 512,  // 64 MiB
+        .latency = SPI_CARD_LATENCY
+    },
+    {   // ram_ifs[1]
+        .sectors = 16 * 1024 * 1024 / 512  // 16 MiB
+    },
+    {   // ram_ifs[2]
+        .sectors = 64 * 1024 * 1024 / 512,  // 64 MiB
+        .latency = SPI_CARD_LATENCY
+    },
+    {   // ram_ifs[3]
+        .sectors = 64 * 1024 * 1024 / 512,  // 64 MiB
+        .latency = SPI_CARD_LATENCY
+    },
+    {   // ram_ifs[4]
+        .sectors = 16 * 1024 * 1024 / 512,  // 16 MiB
+        .latency = SPI_CARD_LATENCY
+    }
+};
+
+/* The members of the striped drive 4 */
+static sd_ram_if_t stripe_ram_ifs[] = {
+    {.sectors = 32 * 1024 * 1024 / 512, .latency = SPI_CARD_LATENCY},
+    {.sectors = 32 * 1024 * 1024 / 512, .latency = SPI_CARD_LATENCY}
+};
+static sd_card_t stripe_cards[] = {
+    {.type = SD_IF_RAM, .ram_if_p = &stripe_ram_ifs[0]},
+    {.type = SD_IF_RAM, .ram_if_p = &stripe_ram_ifs[1]}
+};
+static sd_card_t *stripe_members[] = {&stripe_cards[0], &stripe_cards[1]};
+static sd_stripe_if_t stripe_if = {
+    .members = stripe_members,
+    .num_members = count_of(stripe_members),
+    .stripe_sectors = 64  // 32 KiB
+};
+
+/* The members of the mirrored drive 5 */
+static sd_ram_if_t mirror_ram_ifs[] = {
+    {.sectors = 16 * 1024 * 1024 / 512, .latency = SPI_CARD_LATENCY},
+    {.sectors = 16 * 1024 * 1024 / 512, .latency = SPI_CARD_LATENCY}
+};
+static sd_card_t mirror_cards[] = {
+    {   .type = SD_IF_RAM,
+        .ram_if_p = &mirror_ram_ifs[0],
+        .use_card_detect = true,
+        .card_detect_gpio = 20,
+        .card_detected_true = 1,
+        .card_detect_use_pull = true,
+        .card_detect_pull_hi = true
+    },
+    {   .type = SD_IF_RAM,
+        .ram_if_p = &mirror_ram_ifs[1],
+        .use_card_detect = true,
+        .card_detect_gpio = 21,
+        .card_detected_true = 1,
+        .card_detect_use_pull = true,
+        .card_detect_pull_hi = true
+    }
+};
+static uint32_t mirror_dirty_bitmap[64];  // 2048 regions of 8 KiB
+static sd_mirror_if_t mirror_if = {
+    .members = {&mirror_cards[0], &mirror_cards[1]},
+    .dirty_bitmap = mirror_dirty_bitmap,
+    .dirty_bitmap_words = count_of(mirror_dirty_bitmap)
+};
+
+/* The card behind drive 6 */
+static sd_ram_if_t fault_ram_if = {
+    .sectors = 16 * 1024 * 1024 / 512,
+    .latency = SPI_CARD_LATENCY
+};
+static sd_card_t fault_card = {
+    .type = SD_IF_RAM,
+    .ram_if_p = &fault_ram_if
+};
+static sd_fault_if_t fault_if = {
+    .member = &fault_card,
+    .seed = 1
+};
+
+static sd_ring_t ring;
+
+static sd_wr_queue_t wr_queue = {.deadline_ms = 500};
+
+static sd_cache_line_t cache_lines[16 * 4];
+static sd_cache_t cache = {
+    .lines = cache_lines,
+    .sets = 16,
+    .ways = 4
+};
+
+static sd_init_cache_entry_t init_cache_entries[4];
+static sd_init_cache_t init_cache = {
+    .entries = init_cache_entries,
+    .num_entries = count_of(init_cache_entries)
+};
+
+/* For drive 7 */
+static sd_wr_queue_t hotplug_wr_queue = {.deadline_ms = 500};
+static sd_cache_line_t hotplug_cache_lines[4 * 4];
+static sd_cache_t hotplug_cache = {
+    .lines = hotplug_cache_lines,
+    .sets = 4,
+    .ways = 4
+};
+static sd_hotplug_t hotplug = {.mount = true};
+
+/* Hardware Configuration of the SD Card "objects"
+    These correspond to SD card sockets
+*/
+static sd_card_t sd_cards[] = {  // One for each SD card
+    {   // sd_cards[0]
+        .type = SD_IF_RAM,
+        .ram_if_p = &ram_ifs[0],
+        .ring_p = &ring
+    },
+    {   // sd_cards[1]
+        .type = SD_IF_RAM,
+        .ram_if_p = &ram_ifs[1]
+    },
+    {   // sd_cards[2]
+        .type = SD_IF_RAM,
+        .ram_if_p = &ram_ifs[2],
+        .wr_queue_p = &wr_queue
+    },
+    {   // sd_cards[3]
+        .type = SD_IF_RAM,
+        .ram_if_p = &ram_ifs[3],
+        .cache_p = &cache,
+        .init_cache_p = &init_cache
+    },
+    {   // sd_cards[4]
+        .type = SD_IF_STRIPE,
+        .stripe_if_p = &stripe_if
+    },
+    {   // sd_cards[5]
+        .type = SD_IF_MIRROR,
+        .mirror_if_p = &mirror_if
+    },
+    {   // sd_cards[6]
+        .type = SD_IF_FAULT,
+        .fault_if_p = &fault_if
+    },
+    {   // sd_cards[7]
+        .type = SD_IF_RAM,
+        .ram_if_p = &ram_ifs[4],
+        .use_card_detect = true,
+        .card_detect_gpio = 22,
+        .card_detected_true = 1,
+        .card_detect_use_pull = true,
+        .card_detect_pull_hi = true,
+        .wr_queue_p = &hotplug_wr_queue,
+        .cache_p = &hotplug_cache,
+        .hotplug_p = &hotplug
+    }
+};
+
+/* ********************************************************************** */
+
+size_t sd_get_num() { return count_of(sd_cards); }
+
+sd_card_t *sd_get_by_num(size_t num) {
+    assert(num < sd_get_num());
+    if (num < sd_get_num()) {
+        return &sd_cards[num];
+    } else {
+        return NULL;
+    }
+}
+
+/* [] END OF FILE */
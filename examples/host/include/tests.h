@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+//
+#include "f_util.h"
+#include "my_debug.h"
+
+/* In a test function (returning bool): fail the test, with a message, unless pred holds */
+#define CHECK(pred)                                           \
+    do {                                                      \
+        if (!(pred)) {                                        \
+            EMSG_PRINTF("check failed: %s\n", #pred);         \
+            return false;                                     \
+        }                                                     \
+    } while (0)
+/* ... unless the FatFs call fr succeeds */
+#define CHECK_FR(fr)                                                        \
+    do {                                                                    \
+        FRESULT const fr_ = (fr);                                           \
+        if (FR_OK != fr_) {                                                 \
+            EMSG_PRINTF("%s: %s (%d)\n", #fr, FRESULT_str(fr_), fr_);       \
+            return false;                                                   \
+        }                                                                   \
+    } while (0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    // From examples/command_line/tests
+    int lliot(size_t pnum);
+    void bench(char const* logdrv);
+    // Host tests
+    bool mount(const char *drive);
+    bool remount(const char *drive);
+    /* Reads the FAT (or exFAT allocation bitmap) on the card a sector at a time */
+    typedef struct fat_reader_t {
+        FATFS const *fs_p;
+        BYTE sector[FF_MAX_SS];
+        LBA_t loaded;
+        bool valid;
+    } fat_reader_t;
+    // Whether the cluster is free on the card. Returns false if the read fails.
+    bool cluster_is_free(fat_reader_t *r_p, DWORD clst, bool *is_free_p);
+    bool ram_card_test(void);
+    bool async_test(void);
+    bool fs_test(void);
+    bool wr_queue_test(void);
+    bool cache_test(void);
+    bool read_ahead_test(void);
+    bool trim_test(void);
+    bool au_test(void);
+    bool stats_test(void);
+    bool stripe_test(void);
+    bool mirror_test(void);
+    bool ring_test(void);
+    bool io_core_test(void);
+    bool fault_test(void);
+    bool hotplug_test(void);
+    bool init_cache_test(void);
+    bool free_scan_test(void);
+    bool free_map_test(void);
+    bool fat_cache_test(void);
+    bool fast_seek_test(void);
+    bool dir_cache_test(void);
+    bool busy_yield_test(void);
+    bool crc_sniff_test(void);
+#ifdef __cplusplus
+}
+#endif
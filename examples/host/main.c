@@ -0,0 +1,216 @@
+/* main.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Run tests and benchmarks against RAM "SD cards" on a Linux host.
+
+Usage: host_test [-r] [-i image_file] test...
+
+By default, time is virtual: it only advances by the latency modeled in the
+RAM driver, so reported throughputs are projections for the modeled card
+and results are deterministic. -r uses the real clock instead.
+-i backs drive 0 with a memory mapped image file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sd_ram_image.h"
+//
+#include "tests.h"
+
+bool mount(const char *drive) {
+    sd_card_t *sd_card_p = sd_get_by_drive_prefix(drive);
+    if (!sd_card_p) return false;
+    FATFS *fs_p = &sd_card_p->state.fatfs;
+    FRESULT fr = f_mount(fs_p, drive, 1);
+    if (FR_NO_FILESYSTEM == fr) {
+        IMSG_PRINTF("Formatting %s\n", drive);
+        fr = f_mkfs(drive, 0, 0, FF_MAX_SS * 2);
+        if (FR_OK == fr) fr = f_mount(fs_p, drive, 1);
+    }
+    if (FR_OK != fr) {
+        EMSG_PRINTF("f_mount(%s) error: %s (%d)\n", drive, FRESULT_str(fr), fr);
+        return false;
+    }
+    sd_card_p->state.mounted = true;
+    return true;
+}
+
+/* Unmount and mount again, so that FatFs starts over from what is on the card */
+bool remount(const char *drive) {
+    sd_card_t *sd_card_p = sd_get_by_drive_prefix(drive);
+    CHECK(sd_card_p);
+    CHECK_FR(f_unmount(drive));
+    CHECK_FR(f_mount(&sd_card_p->state.fatfs, drive, 1));
+    return true;
+}
+
+bool cluster_is_free(fat_reader_t *r_p, DWORD clst, bool *is_free_p) {
+    FATFS const *fs_p = r_p->fs_p;
+    LBA_t sect;
+    size_t ofs;
+    if (FS_EXFAT == fs_p->fs_type) {
+        sect = fs_p->bitbase + (clst - 2) / 8 / FF_MAX_SS;
+        ofs = (clst - 2) / 8 % FF_MAX_SS;
+    } else {
+        size_t const esize = FS_FAT16 == fs_p->fs_type ? 2 : 4;
+        sect = fs_p->fatbase + clst * esize / FF_MAX_SS;
+        ofs = clst * esize % FF_MAX_SS;
+    }
+    if (!r_p->valid || sect != r_p->loaded) {
+        CHECK(RES_OK == disk_read(fs_p->pdrv, r_p->sector, sect, 1));
+        r_p->loaded = sect;
+        r_p->valid = true;
+    }
+    BYTE const *p = r_p->sector + ofs;
+    if (FS_EXFAT == fs_p->fs_type)
+        *is_free_p = !(*p & (1 << (clst - 2) % 8));
+    else if (FS_FAT16 == fs_p->fs_type)
+        *is_free_p = !(p[0] | p[1]);
+    else
+        *is_free_p = !(p[0] | p[1] << 8 | p[2] << 16 | (p[3] & 0x0F) << 24);
+    return true;
+}
+
+static bool run_diskio(void) {
+    // !DESTRUCTIVE!
+    return 0 == lliot(1);
+}
+static bool run_ram_card(void) { return ram_card_test(); }
+static bool run_async(void) { return async_test(); }
+static bool run_fs(void) { return fs_test(); }
+static bool run_wr_queue(void) { return wr_queue_test(); }
+static bool run_cache(void) { return cache_test(); }
+static bool run_read_ahead(void) { return read_ahead_test(); }
+static bool run_trim(void) { return trim_test(); }
+static bool run_au(void) { return au_test(); }
+static bool run_stats(void) { return stats_test(); }
+static bool run_stripe(void) { return stripe_test(); }
+static bool run_mirror(void) { return mirror_test(); }
+static bool run_ring(void) { return ring_test(); }
+static bool run_io_core(void) { return io_core_test(); }
+static bool run_fault(void) { return fault_test(); }
+static bool run_hotplug(void) { return hotplug_test(); }
+static bool run_init_cache(void) { return init_cache_test(); }
+static bool run_free_scan(void) { return free_scan_test(); }
+static bool run_free_map(void) { return free_map_test(); }
+static bool run_fat_cache(void) { return fat_cache_test(); }
+static bool run_fast_seek(void) { return fast_seek_test(); }
+static bool run_dir_cache(void) { return dir_cache_test(); }
+static bool run_busy_yield(void) { return busy_yield_test(); }
+static bool run_crc_sniff(void) { return crc_sniff_test(); }
+static bool run_bench(void) {
+    if (!mount("0:")) return false;
+    bench("0:");
+    f_unmount("0:");
+    return true;
+}
+
+static struct {
+    char const *const command;
+    bool (*const function)(void);
+    char const *const help;
+} tests[] = {
+    {"diskio", run_diskio, "Low Level I/O Driver Test (FatFs app4) on drive 1"},
+    {"ram_card", run_ram_card, "RAM driver multiple block emulation and latency model"},
+    {"async", run_async, "Non-blocking block device API (sd_async.h)"},
+    {"fs", run_fs, "FatFs and ff_stdio round trip on drive 1"},
+    {"wr_queue", run_wr_queue, "Write queue (sd_wr_queue.h): drive 0 vs. drive 2"},
+    {"cache", run_cache, "Sector cache (sd_cache.h): drive 0 vs. drive 3"},
+    {"read_ahead", run_read_ahead, "Read-ahead (sd_read_ahead.h) for small sequential reads on drive 0"},
+    {"trim", run_trim, "TRIM (CTRL_TRIM) and erase_blocks on drives 1, 2, and 3"},
+    {"au", run_au, "Allocation unit: GET_BLOCK_SIZE, AU aligned format and TRIM on drive 1"},
+    {"stats", run_stats, "I/O statistics and latency histograms (sd_stats.h) on drive 0"},
+    {"stripe", run_stripe, "Striped (RAID-0) drive 4: block placement, erase, FAT volume, and overlap"},
+    {"mirror", run_mirror, "Mirrored (RAID-1) drive 5: read balancing, card removal, and resync"},
+    {"ring", run_ring, "Submission rings (sd_ring.h) on drive 0, with a thread for each core"},
+    {"io_core", run_io_core, "Dedicated I/O core (sd_io_core.h) for drive 1, with a thread for core 1"},
+    {"fault", run_fault, "Fault injection (FAULT/sd_card_fault.h) on drive 6: recovery time and data integrity"},
+    {"hotplug", run_hotplug, "Card removal and insertion (sd_hotplug.h) on drive 7"},
+    {"init_cache", run_init_cache, "Init cache (sd_init_cache.h) on drive 3: cold start to first write"},
+    {"free_scan", run_free_scan, "Free cluster count a chunk at a time (f_freescan) on drive 0: FAT16, FAT32, exFAT"},
+    {"free_map", run_free_map, "Free cluster map (FF_USE_FREEMAP) for allocation on a nearly full drive 0"},
+    {"fat_cache", run_fat_cache, "FAT cache (FF_FATCACHE_LINES): seek and delete of a big file on drive 0"},
+    {"fast_seek", run_fast_seek, "Automatic fast seek (fast_seek.h) in big, fragmented files on drive 0"},
+    {"dir_cache", run_dir_cache, "Directory cache (FF_DIRCACHE_SLOTS): f_open in a directory of 10,000 entries on drive 0"},
+    {"busy_yield", run_busy_yield, "Work in sd_busy_yield while drive 0 programs written blocks"},
+    {"crc_sniff", run_crc_sniff, "DMA sniffer CRC16 (emulated) against crc16() on random blocks"},
+    {"bench", run_bench, "Throughput and latency benchmark on drive 0 (modeled SPI card)"},
+};
+
+static void usage(void) {
+    printf("Usage: host_test [-r] [-i image_file] test...\n"
+           "\t-r: use the real clock instead of the virtual clock\n"
+           "\t-i: back drive 0 with a memory mapped image file\n"
+           "Tests:\n");
+    for (size_t i = 0; i < count_of(tests); ++i)
+        printf("\t%s: %s\n", tests[i].command, tests[i].help);
+}
+
+int main(int argc, char *argv[]) {
+    bool virtual_clock = true;
+    const char *image = NULL;
+    int argi = 1;
+    for (; argi < argc && '-' == argv[argi][0]; ++argi) {
+        if (0 == strcmp(argv[argi], "-r")) {
+            virtual_clock = false;
+        } else if (0 == strcmp(argv[argi], "-i") && argi + 1 < argc) {
+            image = argv[++argi];
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (argi == argc) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    host_clock_set_virtual(virtual_clock);
+    if (image && !sd_ram_image_map(sd_get_by_num(0)->ram_if_p, image,
+                                   sd_get_by_num(0)->ram_if_p->sectors))
+        return EXIT_FAILURE;
+    sd_init_driver();
+
+    int rc = EXIT_SUCCESS;
+    for (; argi < argc; ++argi) {
+        size_t i = 0;
+        for (; i < count_of(tests); ++i)
+            if (0 == strcmp(argv[argi], tests[i].command)) break;
+        if (i == count_of(tests)) {
+            printf("%s: unknown test\n", argv[argi]);
+            usage();
+            return EXIT_FAILURE;
+        }
+        bool ok = tests[i].function();
+        printf("%s: %s\n", tests[i].command, ok ? "PASSED" : "FAILED");
+        if (!ok) rc = EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *sd_card_p = sd_get_by_num(i);
+        sd_card_p->sync(sd_card_p);
+        sd_card_p->deinit(sd_card_p);
+    }
+    if (image) sd_ram_image_unmap(sd_get_by_num(0)->ram_if_p);
+    return rc;
+}
+/* [] END OF FILE */
@@ -0,0 +1,117 @@
+/* async_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the non-blocking block device API (sd_async.h)
+on the RAM driver, natively and through the synchronous fallback.
+Expects the virtual clock. */
+
+#include <stdlib.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_async.h"
+#include "sd_card.h"
+//
+#include "tests.h"
+
+static int callbacks;
+static void *callback_context;
+
+static void on_done(sd_io_req_t *req_p) {
+    ++callbacks;
+    callback_context = req_p->context;
+}
+
+bool async_test(void) {
+    CHECK(host_clock_is_virtual());
+    sd_card_t *sd_card_p = sd_get_by_num(0);  // The drive with a latency model
+    CHECK(sd_card_p && SD_IF_RAM == sd_card_p->type);
+    CHECK(0 == (disk_initialize(0) & STA_NOINIT));
+    sd_ram_latency_t const *lat_p = &sd_card_p->ram_if_p->latency;
+
+    static uint8_t wbuf[8 * 512], rbuf[8 * 512];
+    for (size_t i = 0; i < sizeof wbuf; ++i) wbuf[i] = rand();
+
+    /* Write, and wait for it */
+    sd_io_req_t req = {0};
+    CHECK(sd_write_blocks_async(sd_card_p, &req, wbuf, 1000, 8) == SD_BLOCK_DEVICE_ERROR_NONE);
+    CHECK(sd_io_wait(&req) == SD_BLOCK_DEVICE_ERROR_NONE);
+    CHECK(req.done);
+    CHECK(sd_card_p->sync(sd_card_p) == SD_BLOCK_DEVICE_ERROR_NONE);
+
+    /* Read: completes exactly when the modeled time has passed */
+    int ctx;
+    memset(&req, 0, sizeof req);
+    req.callback = on_done;
+    req.context = &ctx;
+    callbacks = 0;
+    uint64_t const io_us = lat_p->cmd18_us + 8 * lat_p->block_rd_us + lat_p->cmd12_us;
+    uint64_t start = time_us_64();
+    CHECK(sd_read_blocks_async(sd_card_p, &req, rbuf, 1000, 8) == SD_BLOCK_DEVICE_ERROR_NONE);
+    CHECK(time_us_64() == start);  // Did not block
+    CHECK(!sd_io_poll(&req));
+    sleep_us(io_us - 1);
+    CHECK(!sd_io_poll(&req));
+    CHECK(0 == callbacks);
+    sleep_us(1);
+    CHECK(sd_io_poll(&req));
+    CHECK(sd_io_poll(&req));  // Stays complete
+    CHECK(SD_BLOCK_DEVICE_ERROR_NONE == req.status);
+    CHECK(1 == callbacks);
+    CHECK(&ctx == callback_context);
+    CHECK(0 == memcmp(wbuf, rbuf, sizeof rbuf));
+
+    /* I/O overlaps with computation */
+    uint64_t const cpu_us = io_us / 2;
+    memset(&req, 0, sizeof req);
+    start = time_us_64();
+    CHECK(sd_read_blocks_async(sd_card_p, &req, rbuf, 1000, 8) == SD_BLOCK_DEVICE_ERROR_NONE);
+    sleep_us(cpu_us);  // Stand-in for useful work
+    CHECK(sd_io_wait(&req) == SD_BLOCK_DEVICE_ERROR_NONE);
+    CHECK(time_us_64() - start == io_us);
+
+    /* Requests that cannot be started */
+    memset(&req, 0, sizeof req);
+    CHECK(sd_read_blocks_async(sd_card_p, &req, rbuf, sd_card_p->state.sectors - 1, 2) ==
+          SD_BLOCK_DEVICE_ERROR_PARAMETER);
+    CHECK(sd_read_blocks_async(sd_card_p, &req, rbuf, 0, 0) == SD_BLOCK_DEVICE_ERROR_PARAMETER);
+    // The card was not left locked
+    CHECK(sd_card_p->read_blocks(sd_card_p, rbuf, 0, 1) == SD_BLOCK_DEVICE_ERROR_NONE);
+
+    /* Synchronous fallback, for drivers without start_io (SPI) */
+    sd_card_p = sd_get_by_num(1);
+    CHECK(0 == (disk_initialize(1) & STA_NOINIT));
+    sd_card_t saved = *sd_card_p;
+    sd_card_p->start_io = NULL;
+    sd_card_p->poll_io = NULL;
+    memset(&req, 0, sizeof req);
+    req.callback = on_done;
+    callbacks = 0;
+    bool ok = sd_write_blocks_async(sd_card_p, &req, wbuf, 10, 8) == SD_BLOCK_DEVICE_ERROR_NONE &&
+              sd_io_poll(&req) && SD_BLOCK_DEVICE_ERROR_NONE == req.status && 1 == callbacks;
+    memset(rbuf, 0, sizeof rbuf);
+    memset(&req, 0, sizeof req);
+    ok = ok && sd_read_blocks_async(sd_card_p, &req, rbuf, 10, 8) == SD_BLOCK_DEVICE_ERROR_NONE &&
+         sd_io_wait(&req) == SD_BLOCK_DEVICE_ERROR_NONE && 0 == memcmp(wbuf, rbuf, sizeof rbuf);
+    sd_card_p->start_io = saved.start_io;
+    sd_card_p->poll_io = saved.poll_io;
+    CHECK(ok);
+
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,93 @@
+/* au_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the use of the allocation unit (AU) reported in the SD Status:
+GET_BLOCK_SIZE, AU aligned formatting (sd_au_mkfs_parm), and AU aligned TRIM.
+Gives drive 1 a 512 KiB AU for the duration. */
+
+#include <string.h>
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "tests.h"
+
+enum { AU_SIZE_512K = 0x6, AU_SECTORS = 512 * 1024 / 512 };
+
+static bool with_au(sd_card_t *sd_card_p) {
+    sd_ram_if_state_t *st_p = &sd_card_p->ram_if_p->state;
+
+    size_t au_bytes = 0;
+    CHECK(sd_allocation_unit(sd_card_p, &au_bytes));
+    CHECK(AU_SECTORS * 512 == au_bytes);
+    DWORD bs = 0;
+    CHECK(disk_ioctl(1, GET_BLOCK_SIZE, &bs) == RES_OK);
+    CHECK(AU_SECTORS == bs);
+
+    /* TRIM erases whole AUs only */
+    uint64_t const blocks_erased = st_p->blocks_erased;
+    LBA_t range[2] = {100, AU_SECTORS + 100};
+    CHECK(disk_ioctl(1, CTRL_TRIM, range) == RES_OK);
+    CHECK(st_p->blocks_erased == blocks_erased);
+    range[1] = 2 * AU_SECTORS + 100;
+    CHECK(disk_ioctl(1, CTRL_TRIM, range) == RES_OK);
+    CHECK(st_p->blocks_erased - blocks_erased == AU_SECTORS);
+
+    /* The data area and the clusters line up with the AUs */
+    MKFS_PARM opt;
+    CHECK(sd_au_mkfs_parm(sd_card_p, &opt));
+    CHECK(AU_SECTORS == opt.align);
+    CHECK(32 * 1024 == opt.au_size);
+    static BYTE work[FF_MAX_SS * 2];
+    CHECK_FR(f_mkfs("1:", &opt, work, sizeof work));
+    CHECK(mount("1:"));
+    FATFS *fs_p = &sd_card_p->state.fatfs;
+    IMSG_PRINTF("Data base sector: %llu, cluster size: %u sectors\n",
+                (unsigned long long)fs_p->database, fs_p->csize);
+    CHECK(0 == fs_p->database % AU_SECTORS);
+    CHECK(32 * 1024 / 512 == fs_p->csize);
+    CHECK_FR(f_unmount("1:"));
+    sd_card_p->state.mounted = false;
+    return true;
+}
+
+bool au_test(void) {
+    CHECK(0 == (disk_initialize(1) & STA_NOINIT));
+    sd_card_t *sd_card_p = sd_get_by_num(1);
+
+    /* AU_SIZE 0: not defined */
+    size_t au_bytes = 1;
+    CHECK(sd_allocation_unit(sd_card_p, &au_bytes));
+    CHECK(0 == au_bytes);
+    DWORD bs = 0;
+    CHECK(disk_ioctl(1, GET_BLOCK_SIZE, &bs) == RES_OK);
+    CHECK(1 == bs);
+    MKFS_PARM opt;
+    CHECK(!sd_au_mkfs_parm(sd_card_p, &opt));
+
+    /* A card with an AU (the AU is read once per initialization) */
+    sd_card_p->ram_if_p->au_size = AU_SIZE_512K;
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    CHECK(0 == (disk_initialize(1) & STA_NOINIT));
+    bool ok = with_au(sd_card_p);
+    sd_card_p->ram_if_p->au_size = 0;
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    CHECK(0 == (disk_initialize(1) & STA_NOINIT));
+    return ok;
+}
+/* [] END OF FILE */
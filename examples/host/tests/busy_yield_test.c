@@ -0,0 +1,97 @@
+/* busy_yield_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* On drive 0 (modeled SPI card), write single blocks back to back, so that each
+write waits for the card to finish programming the one before: first with nothing
+to do meanwhile, then with an sd_busy_yield that does some work (a little at a
+time, like tud_task()) each time it is called. Check that the work overlaps the
+programming, and the busy wait statistics (sd_stats.h). */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sd_stats.h"
+//
+#include "tests.h"
+
+enum { DRV = 0, WRITES = 64, WORK_US = 10 };
+
+/* Overrides the (weak) default for all of the tests; only works during this one */
+static bool working;
+static uint32_t calls;
+static uint64_t work_us;
+
+void sd_busy_yield(sd_card_t *sd_card_p) {
+    (void)sd_card_p;
+    if (!working) return;
+    ++calls;
+    busy_wait_us_32(WORK_US);
+    work_us += WORK_US;
+}
+
+static bool write_blocks(uint64_t *us_p) {
+    static BYTE buf[512];
+    uint64_t const t0 = time_us_64();
+    for (unsigned i = 0; i < WRITES; ++i) {
+        memset(buf, i, sizeof buf);
+        CHECK(RES_OK == disk_write(DRV, buf, 2000 + 2 * i, 1));  // Not in a row
+    }
+    CHECK(RES_OK == disk_ioctl(DRV, CTRL_SYNC, 0));  // Waits for the last one
+    *us_p = time_us_64() - t0;
+    return true;
+}
+
+bool busy_yield_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    sd_card_t *sd_card_p = sd_get_by_num(DRV);
+    sd_ram_latency_t const *lat_p = &sd_card_p->ram_if_p->latency;
+    static sd_stats_t stats;
+
+    /* Nothing to do meanwhile */
+    sd_stats_reset(sd_card_p);
+    uint64_t idle_us;
+    CHECK(write_blocks(&idle_us));
+    sd_stats_get(sd_card_p, &stats);
+    CHECK(WRITES == stats.busy_waits);
+    CHECK(lat_p->busy_wr_us == stats.busy_max_us);
+    CHECK((uint64_t)WRITES * lat_p->busy_wr_us == stats.busy_wait_us);
+    CHECK(WRITES == stats.ops[SD_STATS_WRITE_SINGLE].blocks);
+
+    /* With work to do */
+    sd_stats_reset(sd_card_p);
+    working = true;
+    uint64_t busy_us;
+    bool const ok = write_blocks(&busy_us);
+    working = false;
+    CHECK(ok);
+    sd_stats_get(sd_card_p, &stats);
+    IMSG_PRINTF("%d single block writes: %llu us; with %llu us of work in %lu calls of "
+                "sd_busy_yield: %llu us; busy %llu us per block written, max %lu us\n",
+                WRITES, (unsigned long long)idle_us, (unsigned long long)work_us,
+                (unsigned long)calls, (unsigned long long)busy_us,
+                (unsigned long long)(stats.busy_wait_us / WRITES),
+                (unsigned long)stats.busy_max_us);
+    CHECK(WRITES == stats.busy_waits);
+    CHECK(work_us >= (uint64_t)WRITES * lat_p->busy_wr_us / 8);  // Called between polls
+    CHECK(busy_us <= idle_us + WRITES * WORK_US);  // Late by one call at most, each time
+    CHECK(stats.busy_max_us < lat_p->busy_wr_us + WORK_US);
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,123 @@
+/* cache_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the sector cache (sd_cache.h) with a metadata heavy workload,
+comparing drive 0 (no cache) with drive 3 (same latency model, with a cache).
+Expects the virtual clock. */
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_cache.h"
+#include "sd_card.h"
+//
+#include "tests.h"
+
+enum { FILES = 20 };
+
+/* Deep directories and many small files */
+static bool workload(const char *drive, uint64_t *elapsed_p, uint64_t *blocks_rd_p) {
+    sd_card_t *sd_card_p = sd_get_by_drive_prefix(drive);
+    CHECK(sd_card_p);
+    uint64_t const blocks_rd = sd_card_p->ram_if_p->state.blocks_rd;
+    uint64_t const start = time_us_64();
+    char path[64];
+    snprintf(path, sizeof path, "%s/cache_test", drive);
+    for (int level = 0; level <= 4; ++level) {
+        if (level) strcat(path, "/sub");
+        FRESULT fr = f_mkdir(path);
+        CHECK(FR_OK == fr || FR_EXIST == fr);
+    }
+    size_t const dir_len = strlen(path);
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path + dir_len, sizeof path - dir_len, "/file%d.txt", i);
+        FIL fil;
+        CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS));
+        UINT bw;
+        CHECK_FR(f_write(&fil, path, strlen(path), &bw));
+        CHECK_FR(f_close(&fil));
+    }
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path + dir_len, sizeof path - dir_len, "/file%d.txt", i);
+        FILINFO fno;
+        CHECK_FR(f_stat(path, &fno));
+        CHECK(fno.fsize == strlen(path));
+    }
+    DWORD fre_clust;
+    FATFS *fs_p;
+    CHECK_FR(f_getfree(drive, &fre_clust, &fs_p));
+    *elapsed_p = time_us_64() - start;
+    *blocks_rd_p = sd_card_p->ram_if_p->state.blocks_rd - blocks_rd;
+    return true;
+}
+
+static bool check_files(const char *drive) {
+    char path[64];
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path, sizeof path, "%s/cache_test/sub/sub/sub/sub/file%d.txt", drive, i);
+        static char buf[64];
+        FIL fil;
+        CHECK_FR(f_open(&fil, path, FA_READ));
+        UINT br;
+        CHECK_FR(f_read(&fil, buf, sizeof buf, &br));
+        CHECK_FR(f_close(&fil));
+        CHECK(br == strlen(path) && 0 == memcmp(buf, path, br));
+    }
+    return true;
+}
+
+bool cache_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(mount("0:"));
+    CHECK(mount("3:"));
+    sd_card_t *sd_card_p = sd_get_by_drive_prefix("3:");
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    CHECK(c_p);
+
+    uint64_t direct_us, direct_rd, cached_us, cached_rd;
+    CHECK(workload("0:", &direct_us, &direct_rd));
+    CHECK(workload("3:", &cached_us, &cached_rd));
+    IMSG_PRINTF("Metadata workload: %llu us, %llu blocks read without cache; "
+                "%llu us, %llu blocks read with cache\n",
+                direct_us, direct_rd, cached_us, cached_rd);
+    IMSG_PRINTF("Cache hits/misses: FAT %lu/%lu, dir %lu/%lu, data %lu/%lu; %lu write backs\n",
+                c_p->hits[SD_CACHE_FAT], c_p->misses[SD_CACHE_FAT],
+                c_p->hits[SD_CACHE_DIR], c_p->misses[SD_CACHE_DIR],
+                c_p->hits[SD_CACHE_DATA], c_p->misses[SD_CACHE_DATA], c_p->write_backs);
+    CHECK(c_p->hits[SD_CACHE_FAT] && c_p->hits[SD_CACHE_DIR]);
+    // f_getfree reads the whole FAT, which is bigger than the cache
+    CHECK(2 * cached_rd < direct_rd);
+    CHECK(3 * cached_us < 2 * direct_us);
+
+    /* Everything reaches the card at sync */
+    CHECK_FR(f_unmount("3:"));
+    CHECK(disk_ioctl(3, CTRL_SYNC, 0) == RES_OK);
+    for (uint32_t i = 0; i < c_p->sets * c_p->ways; ++i)
+        CHECK(!c_p->lines[i].valid || !c_p->lines[i].dirty);
+    sd_cache_invalidate(sd_card_p);
+    CHECK(mount("3:"));
+    CHECK(check_files("3:"));
+    CHECK(check_files("0:"));
+
+    CHECK_FR(f_unmount("3:"));
+    CHECK_FR(f_unmount("0:"));
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,85 @@
+/* crc_sniff_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* The SPI driver can have the DMA sniffer compute the CRC16 of data blocks
+(spi_t::use_dma_sniffer_crc), preloading it with the CRC16 of the bytes of a block
+that arrived with the start token (crc16_update). There is no sniffer here, so
+emulate one, a bit at a time, as the datasheet describes it, and check it against
+crc16() (table driven, 8 bytes at a time) on random blocks, with the block split
+where the driver would split it, and at any alignment. */
+
+#include <string.h>
+//
+#include "crc.h"
+#include "my_debug.h"
+//
+#include "tests.h"
+
+enum { BLOCK = 512, BLOCKS = 1000, BURST = 8 };
+
+/* The sniffer in CRC-16-CCITT mode (SNIFF_CTRL.CALC 0x2), for 8 bit transfers,
+without byte swap, output reverse or inversion: each byte goes into the accumulator
+MSB first, with the polynomial 0x1021; the CRC is the low 16 bits. */
+static uint32_t sniff(uint32_t acc, uint8_t const *data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            bool const feedback = ((acc >> 15) ^ (data[i] >> bit)) & 1;
+            acc = (acc << 1) & 0xFFFF;
+            if (feedback) acc ^= 0x1021;
+        }
+    }
+    return acc;
+}
+
+static uint32_t xorshift32(void) {
+    static uint32_t x = 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+bool crc_sniff_test(void) {
+    static uint8_t mem[BLOCK + 8];
+
+    /* Known values: CRC-16/XMODEM check, and a block of ones (SD specification) */
+    uint8_t const check[] = "123456789";
+    CHECK(0x31C3 == crc16(check, 9));
+    CHECK(0x31C3 == sniff(0, check, 9));
+    memset(mem, 0xFF, BLOCK);
+    CHECK(0x7FA1 == crc16(mem, BLOCK));
+    CHECK(0x7FA1 == sniff(0, mem, BLOCK));
+
+    for (unsigned i = 0; i < BLOCKS; ++i) {
+        uint8_t *block = mem + i % 8;  // crc16 does the unaligned bytes one at a time
+        for (size_t j = 0; j < BLOCK; ++j) block[j] = (uint8_t)xorshift32();
+        uint16_t const crc = crc16(block, BLOCK);
+
+        /* The whole block, as in a write (the sniffer on the TX channel) */
+        CHECK(crc == sniff(0, block, BLOCK));
+
+        /* A read: up to a burst less one of the block comes with the start token
+        (sd_wait_token), and the DMA reads the rest */
+        size_t const got = i % BURST;
+        CHECK(crc == sniff(crc16_update(0, block, got), block + got, BLOCK - got));
+
+        /* Anywhere else */
+        size_t const split = xorshift32() % (BLOCK + 1);
+        CHECK(crc == crc16_update(crc16(block, split), block + split, BLOCK - split));
+        CHECK(crc == sniff(sniff(0, block, split), block + split, BLOCK - split));
+    }
+    IMSG_PRINTF("%d random blocks: the sniffer emulation matches crc16()\n", BLOCKS);
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,146 @@
+/* dir_cache_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* With the directory cache (FF_DIRCACHE_SLOTS), on drive 0 (modeled SPI card), in a
+directory of 10,000 entries: compare the (modeled) time and reads that f_open takes
+when the name has to be looked for from the top of the directory against when the
+cache has it; then check that removed, renamed and new entries (and long names in
+another case) are found, or not, as they should be. */
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+//
+#include "tests.h"
+
+enum { DRV = 0, ENTRIES = 10000, OPENS = 16 };
+
+static sd_ram_if_state_t *ram_p;
+static BYTE buf[8 * FF_MAX_SS];
+
+static uint32_t reads(void) { return ram_p->cmd17_cnt + ram_p->cmd18_cnt; }
+
+static char const *name(unsigned i) {
+    static char path[32];
+    snprintf(path, sizeof path, "0:/data/f%05u.dat", i);
+    return path;
+}
+
+static bool create(char const *path) {
+    FIL fil;
+    CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_NEW));
+    CHECK_FR(f_close(&fil));
+    return true;
+}
+
+/* Open (and close) OPENS files spread over the directory, the last one included */
+static bool open_some(uint64_t *us_p, uint32_t *reads_p) {
+    FIL fil;
+    uint32_t const r0 = reads();
+    uint64_t const t0 = time_us_64();
+    for (unsigned i = 1; i <= OPENS; ++i) {
+        CHECK_FR(f_open(&fil, name(i * ENTRIES / OPENS - 1), FA_READ));
+        CHECK_FR(f_close(&fil));
+    }
+    *us_p = time_us_64() - t0;
+    *reads_p = reads() - r0;
+    return true;
+}
+
+static FRESULT open_close(char const *path) {
+    FIL fil;
+    FRESULT fr = f_open(&fil, path, FA_READ);
+    if (FR_OK == fr) fr = f_close(&fil);
+    return fr;
+}
+
+bool dir_cache_test(void) {
+    CHECK(FF_DIRCACHE_SLOTS > 0);
+    CHECK(host_clock_is_virtual());
+    CHECK(sd_init_driver());
+    sd_card_t *sd_card_p = sd_get_by_num(DRV);
+    ram_p = &sd_card_p->ram_if_p->state;
+    FATFS *fs_p = &sd_card_p->state.fatfs;
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    MKFS_PARM const opt = {.fmt = FM_FAT, .au_size = 4096};
+    CHECK_FR(f_mkfs("0:", &opt, buf, sizeof buf));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    sd_card_p->state.mounted = true;
+
+    CHECK_FR(f_mkdir("0:/data"));
+    for (unsigned i = 0; i < ENTRIES; ++i) CHECK(create(name(i)));
+
+    /* From the top of the directory: the cache is empty after a remount */
+    CHECK_FR(f_unmount("0:"));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    uint64_t scan_us, cached_us;
+    uint32_t scan_reads, cached_reads;
+    CHECK(open_some(&scan_us, &scan_reads));
+    /* And again, from the cache */
+    CHECK(open_some(&cached_us, &cached_reads));
+    IMSG_PRINTF("%d entries, %d f_opens: reading the directory %llu us (%lu reads), "
+                "from the cache %llu us (%lu reads)\n",
+                ENTRIES, OPENS, (unsigned long long)scan_us, (unsigned long)scan_reads,
+                (unsigned long long)cached_us, (unsigned long)cached_reads);
+    CHECK(cached_reads <= 2 * OPENS);  // The sector in the root directory and the one in /data
+    CHECK(cached_us * 20 < scan_us);
+
+    /* A new entry is in the cache from the start */
+    CHECK(create("0:/data/new.dat"));
+    uint32_t r0 = reads();
+    CHECK_FR(open_close("0:/data/new.dat"));
+    CHECK(reads() - r0 <= 2);
+
+    /* Removed and renamed entries are forgotten */
+    char const *path = name(ENTRIES / OPENS - 1);
+    CHECK_FR(f_unlink(path));
+    CHECK(FR_NO_FILE == open_close(path));
+    path = name(2 * ENTRIES / OPENS - 1);
+    CHECK_FR(f_rename(path, "0:/data/renamed.dat"));
+    CHECK(FR_NO_FILE == open_close(path));
+    CHECK_FR(open_close("0:/data/renamed.dat"));
+    CHECK(create(path));  // Where the first one was (the first free entry)
+    CHECK_FR(open_close(path));
+
+    /* Long names are looked up without regard to case */
+    CHECK(create("0:/data/A rather long file name.txt"));
+    r0 = reads();
+    CHECK_FR(open_close("0:/data/a RATHER long FILE name.TXT"));
+    CHECK(reads() - r0 <= 3);  // Its entries may span two sectors
+
+    /* Everything else is still where it was */
+    CHECK_FR(f_unmount("0:"));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    DIR dir;
+    FILINFO fno;
+    unsigned n = 0;
+    CHECK_FR(f_opendir(&dir, "0:/data"));
+    while (FR_OK == f_readdir(&dir, &fno) && fno.fname[0]) ++n;
+    CHECK_FR(f_closedir(&dir));
+    CHECK(n == ENTRIES + 2);  // One removed; new, renamed and the long name added
+    CHECK_FR(open_close(name(ENTRIES - 1)));
+    CHECK_FR(open_close("0:/data/renamed.dat"));
+
+    CHECK_FR(f_unmount("0:"));
+    sd_card_p->state.mounted = false;
+    return true;
+}
+/* [] END OF FILE */
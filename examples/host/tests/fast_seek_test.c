@@ -0,0 +1,199 @@
+/* fast_seek_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* On drive 0 (modeled SPI card), with two big files written in interleaved pieces (so
+that each has many fragments), compare random seeks with f_lseek, which follows the
+cluster chain, against ff_fseek, which creates a link map (fast_seek.h) at the first
+seek; then check that the map keeps up with the file as it is extended (contiguous,
+and with a new fragment) and truncated, and that the data is right throughout. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "fast_seek.h"
+#include "ff.h"
+#include "ff_stdio.h"
+#include "hw_config.h"
+#include "my_debug.h"
+//
+#include "tests.h"
+
+enum {
+    DRV = 0,
+    PIECE = 1024 * 1024,
+    PIECES = 24,  // For each of the two files
+    SEEKS = 32
+};
+
+static sd_ram_if_state_t *ram_p;
+static DWORD buf[8 * FF_MAX_SS / sizeof(DWORD)];
+static DWORD sector[FF_MAX_SS / sizeof(DWORD)];
+
+static uint32_t reads(void) { return ram_p->cmd17_cnt + ram_p->cmd18_cnt; }
+
+/* Each DWORD has its file offset, and the file's tag */
+static void fill(DWORD tag, FSIZE_t ofs, DWORD *p, size_t n) {
+    for (size_t i = 0; i < n / sizeof(DWORD); ++i) p[i] = tag ^ (DWORD)(ofs + i * sizeof(DWORD));
+}
+static bool append(FF_FILE *fp, DWORD tag, size_t size) {
+    for (size_t done = 0; done < size; done += sizeof buf) {
+        fill(tag, f_size(fp), buf, sizeof buf);
+        CHECK(1 == ff_fwrite(buf, sizeof buf, 1, fp));
+    }
+    return true;
+}
+static bool check_sector(DWORD tag, FSIZE_t ofs) {
+    for (size_t i = 0; i < count_of(sector); ++i) CHECK(sector[i] == (tag ^ (DWORD)(ofs + i * sizeof(DWORD))));
+    return true;
+}
+
+/* Sector aligned pseudo-random offsets */
+static FSIZE_t offset(unsigned i, FSIZE_t size) {
+    uint32_t x = 2654435761u * (i + 1);
+    return (FSIZE_t)(x % (uint32_t)(size / FF_MAX_SS)) * FF_MAX_SS;
+}
+
+/* Read the whole file through a FIL without a map, and check it */
+static bool check_file(char const *path, DWORD tag, FSIZE_t size) {
+    FIL fil;
+    UINT br;
+    CHECK_FR(f_open(&fil, path, FA_READ));
+    CHECK(f_size(&fil) == size);
+    for (FSIZE_t ofs = 0; ofs < size; ofs += sizeof sector) {
+        CHECK_FR(f_read(&fil, sector, sizeof sector, &br));
+        CHECK(br == sizeof sector);
+        CHECK(check_sector(tag, ofs));
+    }
+    CHECK_FR(f_close(&fil));
+    return true;
+}
+
+bool fast_seek_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(sd_init_driver());
+    sd_card_t *sd_card_p = sd_get_by_num(DRV);
+    ram_p = &sd_card_p->ram_if_p->state;
+    FATFS *fs_p = &sd_card_p->state.fatfs;
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    MKFS_PARM const opt = {.fmt = FM_FAT32, .au_size = 512};
+    CHECK_FR(f_mkfs("0:", &opt, buf, sizeof buf));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    sd_card_p->state.mounted = true;
+
+    /* Two files, a piece at a time each */
+    FF_FILE *a_p = ff_fopen("0:/a.bin", "w");
+    FF_FILE *b_p = ff_fopen("0:/b.bin", "w");
+    CHECK(a_p && b_p);
+    for (int i = 0; i < PIECES; ++i) {
+        CHECK(append(a_p, 0xA0000000, PIECE));
+        CHECK(append(b_p, 0xB0000000, PIECE));
+    }
+    CHECK(0 == ff_fclose(b_p));
+    CHECK(0 == ff_fclose(a_p));
+    FSIZE_t const size = (FSIZE_t)PIECES * PIECE;
+
+    /* Random seeks following the chain */
+    CHECK_FR(f_unmount("0:"));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    FIL fil;
+    UINT br;
+    CHECK_FR(f_open(&fil, "0:/a.bin", FA_READ));
+    uint32_t r0 = reads();
+    uint64_t t0 = time_us_64();
+    for (unsigned i = 0; i < SEEKS; ++i) {
+        FSIZE_t const ofs = offset(i, size);
+        CHECK_FR(f_lseek(&fil, ofs));
+        CHECK_FR(f_read(&fil, sector, sizeof sector, &br));
+        CHECK(check_sector(0xA0000000, ofs));
+    }
+    uint64_t const chain_us = time_us_64() - t0;
+    uint32_t const chain_reads = reads() - r0;
+    CHECK_FR(f_close(&fil));
+
+    /* And with the map */
+    CHECK_FR(f_unmount("0:"));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    fast_seek_stats_t stats0, stats;
+    fast_seek_get_stats(&stats0);
+    a_p = ff_fopen("0:/a.bin", "r+");
+    CHECK(a_p);
+    CHECK(0 == ff_fseek(a_p, (int)offset(0, size), FF_SEEK_SET));  // Creates the map
+    fast_seek_get_stats(&stats);
+    CHECK(stats.maps_created == stats0.maps_created + 1);
+    CHECK(a_p->cltbl);
+    DWORD const fragments = (a_p->cltbl[0] - 2) / 2;
+    CHECK(fragments >= PIECES);
+    r0 = reads();
+    t0 = time_us_64();
+    for (unsigned i = 0; i < SEEKS; ++i) {
+        FSIZE_t const ofs = offset(i, size);
+        CHECK(0 == ff_fseek(a_p, (int)ofs, FF_SEEK_SET));
+        CHECK(1 == ff_fread(sector, sizeof sector, 1, a_p));
+        CHECK(check_sector(0xA0000000, ofs));
+    }
+    uint64_t const map_us = time_us_64() - t0;
+    uint32_t const map_reads = reads() - r0;
+    IMSG_PRINTF("%lu clusters in %lu fragments: %d random seeks and reads "
+                "following the chain %llu us (%lu reads), with the map %llu us (%lu reads)\n",
+                (unsigned long)(size / FF_MAX_SS / fs_p->csize), (unsigned long)fragments, SEEKS,
+                (unsigned long long)chain_us, (unsigned long)chain_reads,
+                (unsigned long long)map_us, (unsigned long)map_reads);
+    CHECK(SEEKS == map_reads);  // Only the data
+    CHECK(map_us * 10 < chain_us);
+
+    /* Extended with a new fragment (b.bin is in the way): fast seek mode is left,
+    and the map is created again at the next seek */
+    CHECK(0 == ff_fseek(a_p, 0, FF_SEEK_END));
+    CHECK(append(a_p, 0xA0000000, 64 * 1024));
+    CHECK(!a_p->cltbl);
+    CHECK(0 == ff_fseek(a_p, (int)(size + 32 * 1024), FF_SEEK_SET));
+    CHECK(a_p->cltbl);
+    CHECK((a_p->cltbl[0] - 2) / 2 == fragments + 1);
+    CHECK(1 == ff_fread(sector, sizeof sector, 1, a_p));
+    CHECK(check_sector(0xA0000000, size + 32 * 1024));
+
+    /* Extended in a row: the map grows with the file */
+    CHECK(0 == ff_fseek(a_p, 0, FF_SEEK_END));
+    CHECK(append(a_p, 0xA0000000, 64 * 1024));
+    CHECK(a_p->cltbl);
+    CHECK((a_p->cltbl[0] - 2) / 2 == fragments + 1);
+    CHECK(0 == ff_fseek(a_p, (int)(size + 96 * 1024), FF_SEEK_SET));
+    CHECK(1 == ff_fread(sector, sizeof sector, 1, a_p));
+    CHECK(check_sector(0xA0000000, size + 96 * 1024));
+    FSIZE_t const size2 = size + 128 * 1024;
+    CHECK(f_size(a_p) == size2);
+
+    /* Truncated, then extended again: the freed clusters are not written through the map */
+    CHECK(0 == ff_fseek(a_p, PIECE / 2, FF_SEEK_SET));
+    CHECK(0 == ff_seteof(a_p));
+    CHECK(!a_p->cltbl);
+    CHECK(append(a_p, 0xA0000000, PIECE));
+    CHECK(0 == ff_fseek(a_p, PIECE, FF_SEEK_SET));
+    CHECK(1 == ff_fread(sector, sizeof sector, 1, a_p));
+    CHECK(check_sector(0xA0000000, PIECE));
+    FSIZE_t const size3 = f_size(a_p);
+    CHECK(0 == ff_fclose(a_p));
+    fast_seek_get_stats(&stats);
+    CHECK(0 == stats.chunks_used);  // Back in the pool
+
+    CHECK(check_file("0:/a.bin", 0xA0000000, size3));
+    CHECK(check_file("0:/b.bin", 0xB0000000, size));
+    CHECK_FR(f_unmount("0:"));
+    sd_card_p->state.mounted = false;
+    return true;
+}
+/* [] END OF FILE */
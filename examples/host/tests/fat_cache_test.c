@@ -0,0 +1,167 @@
+/* fat_cache_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* With the FAT cache (FF_FATCACHE_LINES), on drive 0 (modeled SPI card): count the
+commands and (modeled) time it takes to seek through a big file's cluster chain and
+to delete it, against a sector at a time in the window; check that both FATs come
+out the same, and, on a FAT12 volume (entries that straddle sectors), that the data
+comes back after a remount. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+//
+#include "tests.h"
+
+enum { DRV = 0, BIG_CLUSTERS = 32768 };
+
+static sd_card_t *sd_card_p;
+static sd_ram_if_state_t *ram_p;
+static FATFS *fs_p;
+static BYTE buf[8 * FF_MAX_SS];
+
+static uint32_t reads(void) { return ram_p->cmd17_cnt + ram_p->cmd18_cnt; }
+static uint32_t writes(void) { return ram_p->cmd24_cnt + ram_p->cmd25_cnt; }
+
+/* The 2nd FAT is a copy of the 1st */
+static bool mirrored(void) {
+    static BYTE fat1[FF_MAX_SS], fat2[FF_MAX_SS];
+    CHECK(2 == fs_p->n_fats);
+    for (LBA_t i = 0; i < fs_p->fsize; ++i) {
+        CHECK(RES_OK == disk_read(DRV, fat1, fs_p->fatbase + i, 1));
+        CHECK(RES_OK == disk_read(DRV, fat2, fs_p->fatbase + fs_p->fsize + i, 1));
+        CHECK(!memcmp(fat1, fat2, sizeof fat1));
+    }
+    return true;
+}
+
+static bool seek_and_delete(void) {
+    MKFS_PARM const opt = {.fmt = FM_FAT32, .n_fat = 2, .au_size = 512};
+    CHECK_FR(f_mkfs("0:", &opt, buf, sizeof buf));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    sd_card_p->state.mounted = true;
+    FIL fil;
+    CHECK_FR(f_open(&fil, "0:/big.bin", FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK_FR(f_expand(&fil, (FSIZE_t)BIG_CLUSTERS * FF_MAX_SS, 1));
+    CHECK_FR(f_close(&fil));
+    CHECK(mirrored());
+
+    /* Seek to the end: the chain is followed through the FAT from the start */
+    CHECK(remount("0:"));
+    CHECK_FR(f_open(&fil, "0:/big.bin", FA_READ));
+    DWORD const fat_sectors = BIG_CLUSTERS / (FF_MAX_SS / 4) + 1;
+    uint32_t const r0 = reads();
+    uint64_t t0 = time_us_64();
+    CHECK_FR(f_lseek(&fil, f_size(&fil) - 1));
+    uint64_t const seek_us = time_us_64() - t0;
+    uint32_t const seek_reads = reads() - r0;
+    CHECK(seek_reads <= fat_sectors / FF_FATCACHE_SPAN + 2);
+    /* And back to the middle, and to the end again */
+    t0 = time_us_64();
+    CHECK_FR(f_lseek(&fil, f_size(&fil) / 2));
+    CHECK_FR(f_lseek(&fil, f_size(&fil) - 1));
+    uint64_t const reseek_us = time_us_64() - t0;
+    CHECK_FR(f_close(&fil));
+
+    /* Delete: both FATs are written a run of sectors at a time */
+    uint32_t const w0 = writes();
+    t0 = time_us_64();
+    CHECK_FR(f_unlink("0:/big.bin"));
+    uint64_t const delete_us = time_us_64() - t0;
+    uint32_t const delete_writes = writes() - w0;
+    CHECK(delete_writes <= 2 * (fat_sectors / FF_FATCACHE_SPAN + 2) + 4);
+    CHECK(mirrored());
+    DWORD nclst;
+    FATFS *p;
+    CHECK_FR(f_getfree("0:", &nclst, &p));
+    CHECK(nclst == fs_p->n_fatent - 3);  // All but the root directory
+
+    /* What a sector at a time would have cost: a read for each FAT sector on the seek,
+    and a read and two writes (2 FATs) for each on the delete */
+    sd_ram_latency_t const *lat_p = &sd_card_p->ram_if_p->latency;
+    uint64_t const rd_us = lat_p->cmd17_us + lat_p->block_rd_us;
+    uint64_t const wr_us = lat_p->cmd24_us + lat_p->block_wr_us + lat_p->busy_wr_us;
+    IMSG_PRINTF("%lu FAT sectors, %d per cache line: seek %llu us in %lu reads "
+                "(a sector at a time: %llu us), seek back and forth %llu us, "
+                "delete %llu us in %lu writes (a sector at a time: %llu us)\n",
+                (unsigned long)fat_sectors, FF_FATCACHE_SPAN, (unsigned long long)seek_us,
+                (unsigned long)seek_reads, (unsigned long long)(fat_sectors * rd_us),
+                (unsigned long long)reseek_us, (unsigned long long)delete_us,
+                (unsigned long)delete_writes,
+                (unsigned long long)(fat_sectors * (rd_us + 2 * wr_us)));
+    CHECK(seek_us < fat_sectors * rd_us);
+    CHECK(delete_us < fat_sectors * (rd_us + 2 * wr_us));
+    return true;
+}
+
+/* FAT12: entries straddle sector boundaries, and lines may end at the end of the FAT */
+static bool fat12(void) {
+    MKFS_PARM const opt = {.fmt = FM_FAT, .n_fat = 2, .au_size = 32768};
+    CHECK_FR(f_mkfs("0:", &opt, buf, sizeof buf));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    CHECK(FS_FAT12 == fs_p->fs_type);
+    FIL fil;
+    UINT bw, br;
+    char path[16];
+    for (int i = 0; i < 8; ++i) {  // Interleaved, so that the chains are fragmented
+        for (int j = 0; j < 4; ++j) {
+            snprintf(path, sizeof path, "0:/f%d.bin", j);
+            CHECK_FR(f_open(&fil, path, FA_WRITE | FA_OPEN_APPEND));
+            memset(buf, 'a' + i + j, sizeof buf);
+            for (int k = 0; k < 8; ++k) {
+                CHECK_FR(f_write(&fil, buf, sizeof buf, &bw));
+                CHECK(bw == sizeof buf);
+            }
+            CHECK_FR(f_close(&fil));
+        }
+    }
+    CHECK_FR(f_unlink("0:/f1.bin"));
+    CHECK(mirrored());
+    CHECK(remount("0:"));
+    for (int j = 0; j < 4; j += 2) {
+        snprintf(path, sizeof path, "0:/f%d.bin", j);
+        CHECK_FR(f_open(&fil, path, FA_READ));
+        for (int i = 0; i < 8; ++i) {
+            for (int k = 0; k < 8; ++k) {
+                CHECK_FR(f_read(&fil, buf, sizeof buf, &br));
+                CHECK(br == sizeof buf);
+                CHECK(buf[0] == 'a' + i + j && buf[sizeof buf - 1] == 'a' + i + j);
+            }
+        }
+        CHECK_FR(f_close(&fil));
+    }
+    return true;
+}
+
+bool fat_cache_test(void) {
+    CHECK(FF_FATCACHE_LINES > 0);
+    CHECK(host_clock_is_virtual());
+    CHECK(sd_init_driver());
+    sd_card_p = sd_get_by_num(DRV);
+    ram_p = &sd_card_p->ram_if_p->state;
+    fs_p = &sd_card_p->state.fatfs;
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    CHECK(seek_and_delete());
+    CHECK(fat12());
+    CHECK_FR(f_unmount("0:"));
+    sd_card_p->state.mounted = false;
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,205 @@
+/* fault_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Inject faults on drive 6 (FAULT/sd_card_fault.h) under FatFs, recover the way an
+application would (close, reopen, and try again; or remount), and check what it costs
+in (modeled) time and that the data comes through intact. Expects the virtual clock. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "tests.h"
+
+enum { FAULT_DRV = 6, ATTEMPTS = 10 };
+#define PATH "6:/fault.bin"
+
+static BYTE data[64 * 1024], buf[sizeof data];
+static sd_card_t *sd_card_p;
+
+static void set_rule(sd_fault_rule_t *rule_p) {
+    sd_card_p->fault_if_p->rules = rule_p;
+    sd_card_p->fault_if_p->num_rules = rule_p ? 1 : 0;
+    sd_fault_reset(sd_card_p);
+}
+
+static uint32_t injected(sd_fault_kind_t kind) {
+    return sd_card_p->fault_if_p->state.injected[kind];
+}
+
+/* One try at writing (or reading and checking) the file */
+static FRESULT write_file(void) {
+    FIL fil;
+    UINT bw;
+    FRESULT fr = f_open(&fil, PATH, FA_WRITE | FA_CREATE_ALWAYS);
+    if (FR_OK != fr) return fr;
+    fr = f_write(&fil, data, sizeof data, &bw);
+    if (FR_OK == fr && bw != sizeof data) fr = FR_DENIED;
+    FRESULT fr2 = f_close(&fil);
+    // A failed close leaves the file open (and locked); with FF_FATCACHE_LINES, it is
+    // where the FAT is written back. Closing it again writes what is still pending.
+    if (FR_OK != fr2) f_close(&fil);
+    return FR_OK != fr ? fr : fr2;
+}
+static FRESULT read_file(void) {
+    FIL fil;
+    UINT br;
+    memset(buf, 0, sizeof buf);
+    FRESULT fr = f_open(&fil, PATH, FA_READ);
+    if (FR_OK != fr) return fr;
+    fr = f_read(&fil, buf, sizeof buf, &br);
+    f_close(&fil);
+    if (FR_OK == fr && (br != sizeof buf || memcmp(data, buf, sizeof buf))) fr = FR_INT_ERR;
+    return fr;
+}
+
+/* Try up to ATTEMPTS times. Reports the failed tries and the time it all took. */
+static FRESULT with_retries(FRESULT (*op)(void), unsigned *failures_p, uint64_t *us_p) {
+    uint64_t const t0 = time_us_64();
+    FRESULT fr = FR_OK;
+    *failures_p = 0;
+    for (unsigned i = 0; i < ATTEMPTS; ++i) {
+        fr = op();
+        if (FR_OK == fr) break;
+        ++*failures_p;
+    }
+    *us_p = time_us_64() - t0;
+    return fr;
+}
+
+static bool busy(uint64_t base_wr_us) {
+    sd_fault_rule_t rule = {.kind = SD_FAULT_BUSY, .ops = SD_FAULT_ON_WRITE,
+                            .last_lba = UINT32_MAX, .rate_ppm = 1000000,
+                            .max_fires = 10, .time_us = 100 * 1000};
+    set_rule(&rule);
+    unsigned failures;
+    uint64_t us;
+    CHECK_FR(with_retries(write_file, &failures, &us));
+    IMSG_PRINTF("10 busy extensions of 100 ms: write took %llu us (vs. %llu us)\n",
+                (unsigned long long)us, (unsigned long long)base_wr_us);
+    CHECK(0 == failures);
+    CHECK(10 == injected(SD_FAULT_BUSY));
+    CHECK(us >= 1000 * 1000 && us < 2 * base_wr_us + 1000 * 1000);
+    set_rule(NULL);
+    CHECK_FR(read_file());
+    return true;
+}
+
+static bool crc(void) {
+    sd_fault_rule_t rule = {.kind = SD_FAULT_CRC, .ops = SD_FAULT_ON_READ,
+                            .last_lba = UINT32_MAX, .rate_ppm = 300000, .max_fires = 5};
+    set_rule(&rule);
+    unsigned failures;
+    uint64_t us;
+    CHECK_FR(with_retries(read_file, &failures, &us));
+    IMSG_PRINTF("Read CRC errors: %lu injected, %u failed tries, %llu us to recover\n",
+                (unsigned long)injected(SD_FAULT_CRC), failures, (unsigned long long)us);
+    CHECK(injected(SD_FAULT_CRC) > 0);
+    CHECK(failures == injected(SD_FAULT_CRC));  // Each one costs a try
+    set_rule(NULL);
+    return true;
+}
+
+static bool timeout(uint64_t base_rd_us) {
+    sd_fault_rule_t rule = {.kind = SD_FAULT_TIMEOUT, .ops = SD_FAULT_ON_READ,
+                            .last_lba = UINT32_MAX, .rate_ppm = 1000000,
+                            .max_fires = 3, .time_us = 500 * 1000};
+    set_rule(&rule);
+    unsigned failures;
+    uint64_t us;
+    CHECK_FR(with_retries(read_file, &failures, &us));
+    IMSG_PRINTF("3 read timeouts of 500 ms: %llu us to recover (vs. %llu us)\n",
+                (unsigned long long)us, (unsigned long long)base_rd_us);
+    CHECK(3 == failures);
+    // The timeouts dominate
+    CHECK(us >= 3 * 500 * 1000 && us < 3 * 500 * 1000 + 4 * base_rd_us);
+    set_rule(NULL);
+    return true;
+}
+
+static bool write_reject(void) {
+    for (size_t i = 0; i < sizeof data; ++i) data[i] = i * 13 + 1;  // New contents
+    sd_fault_rule_t rule = {.kind = SD_FAULT_WRITE_REJECT, .ops = SD_FAULT_ON_WRITE,
+                            .last_lba = UINT32_MAX, .rate_ppm = 1000000, .max_fires = 2};
+    set_rule(&rule);
+    unsigned failures;
+    uint64_t us;
+    CHECK_FR(with_retries(write_file, &failures, &us));
+    IMSG_PRINTF("Write rejects: %u failed tries, %llu us to recover\n", failures,
+                (unsigned long long)us);
+    CHECK(2 == injected(SD_FAULT_WRITE_REJECT));
+    CHECK(failures > 0);
+    set_rule(NULL);
+    CHECK_FR(read_file());
+    DWORD fre_clust;
+    FATFS *fs_p;
+    CHECK_FR(f_getfree("6:", &fre_clust, &fs_p));
+    return true;
+}
+
+static bool removal(void) {
+    sd_fault_rule_t rule = {.kind = SD_FAULT_REMOVAL, .ops = SD_FAULT_ON_READ,
+                            .last_lba = UINT32_MAX, .rate_ppm = 1000000, .max_fires = 1};
+    set_rule(&rule);
+    CHECK(FR_OK != read_file());
+    CHECK(disk_status(FAULT_DRV) & STA_NOINIT);
+    CHECK(FR_OK != read_file());  // Still gone
+    CHECK(disk_initialize(FAULT_DRV) & STA_NOINIT);
+
+    uint64_t const t0 = time_us_64();
+    sd_fault_insert(sd_card_p);
+    CHECK_FR(f_unmount("6:"));
+    CHECK(mount("6:"));
+    CHECK_FR(read_file());
+    IMSG_PRINTF("Reinsertion: remount and read in %llu us\n",
+                (unsigned long long)(time_us_64() - t0));
+    set_rule(NULL);
+    return true;
+}
+
+bool fault_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(0 == (disk_initialize(FAULT_DRV) & STA_NOINIT));
+    sd_card_p = sd_get_by_num(FAULT_DRV);
+    CHECK(SD_IF_FAULT == sd_card_p->type);
+    set_rule(NULL);
+    CHECK(mount("6:"));
+
+    /* Baseline */
+    for (size_t i = 0; i < sizeof data; ++i) data[i] = i * 7 + 3;
+    uint64_t t0 = time_us_64();
+    CHECK_FR(write_file());
+    uint64_t const base_wr_us = time_us_64() - t0;
+    t0 = time_us_64();
+    CHECK_FR(read_file());
+    uint64_t const base_rd_us = time_us_64() - t0;
+
+    CHECK(busy(base_wr_us));
+    CHECK(crc());
+    CHECK(timeout(base_rd_us));
+    CHECK(write_reject());
+    CHECK(removal());
+
+    CHECK_FR(f_unmount("6:"));
+    sd_card_p->state.mounted = false;
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,219 @@
+/* free_map_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* On a nearly full volume on drive 0 (modeled SPI card), where the only free clusters
+are behind a big file, compare the (modeled) time to allocate a file there
+with the free cluster map (FF_USE_FREEMAP) still unknown, and with the map filled in
+by the free cluster scan: exact (a bit for each cluster) on FAT16 and exFAT, and a
+summary (a bit for each group of clusters) on FAT32. Check the map against the FAT.
+Also allocate, on FAT32, between f_freescan chunks, when the only free clusters are in
+the part of a group that the scan has not reached yet. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+//
+#include "tests.h"
+
+enum { DRV = 0, SMALL_FILES = 64 };
+
+static sd_card_t *sd_card_p;
+static FATFS *fs_p;
+static BYTE buf[8 * FF_MAX_SS];
+
+static bool map_bit(DWORD clst) {
+    DWORD const b = (clst - 2) >> fs_p->map_shift;
+    return fs_p->fmap[b / 8] & (1 << b % 8);
+}
+
+/* Every free cluster is in a group marked as such; and, if exact, only those */
+static bool check_map(void) {
+    static fat_reader_t reader;
+    reader = (fat_reader_t){.fs_p = fs_p};
+    for (DWORD clst = 2; clst < fs_p->n_fatent; ++clst) {
+        bool is_free;
+        CHECK(cluster_is_free(&reader, clst, &is_free));
+        if (is_free) CHECK(map_bit(clst));
+        if (fs_p->map_exact) CHECK(is_free == map_bit(clst));
+    }
+    return true;
+}
+
+static bool write_file(char const *path, size_t size) {
+    FIL fil;
+    UINT bw;
+    CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS));
+    memset(buf, 0x5A, sizeof buf);
+    for (size_t done = 0; done < size; done += bw) {
+        size_t const n = size - done < sizeof buf ? size - done : sizeof buf;
+        CHECK_FR(f_write(&fil, buf, n, &bw));
+        CHECK(bw == n);
+    }
+    CHECK_FR(f_close(&fil));
+    return true;
+}
+
+static bool expand_file(char const *path, DWORD clusters) {
+    FIL fil;
+    CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK_FR(f_expand(&fil, (FSIZE_t)clusters * fs_p->csize * FF_MAX_SS, 1));
+    CHECK_FR(f_close(&fil));
+    return true;
+}
+
+static bool small_files(char prefix, bool create) {
+    char path[16];
+    for (int i = 0; i < SMALL_FILES; ++i) {
+        snprintf(path, sizeof path, "0:/%c%02d.bin", prefix, i);
+        if (create) {
+            CHECK(write_file(path, 1));
+        } else {
+            CHECK_FR(f_unlink(path));
+        }
+    }
+    return true;
+}
+
+/* Write a file of `clusters`, and return the time and where it went */
+static bool timed_write(DWORD clusters, uint64_t *us_p, DWORD *sclust_p) {
+    uint64_t const t0 = time_us_64();
+    CHECK(write_file("0:/new.bin", (size_t)clusters * fs_p->csize * FF_MAX_SS));
+    *us_p = time_us_64() - t0;
+    FIL fil;
+    CHECK_FR(f_open(&fil, "0:/new.bin", FA_READ));
+    *sclust_p = fil.obj.sclust;
+    CHECK_FR(f_close(&fil));
+    return true;
+}
+
+static bool with_format(BYTE fmt, DWORD au_size, char const *name) {
+    MKFS_PARM const opt = {.fmt = fmt, .au_size = au_size};
+    CHECK_FR(f_mkfs("0:", &opt, buf, sizeof buf));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    sd_card_p->state.mounted = true;
+
+    /* Small files (A), a big file, more small files (B), and a file that fills the rest */
+    CHECK(small_files('A', true));
+    DWORD nclst;
+    FATFS *p;
+    CHECK_FR(f_getfree("0:", &nclst, &p));
+    CHECK(expand_file("0:/big.bin", nclst * 4 / 5));
+    CHECK(small_files('B', true));
+    CHECK_FR(f_getfree("0:", &nclst, &p));
+    CHECK(expand_file("0:/fill.bin", nclst - 8));
+    CHECK(small_files('B', false));  // The free clusters are behind the big file
+    CHECK(check_map());
+
+    /* Before: the map is unknown after a mount */
+    CHECK(remount("0:"));
+    CHECK(!fs_p->map_exact);
+    uint64_t before_us, after_us;
+    DWORD before_clst, after_clst;
+    CHECK(timed_write(SMALL_FILES / 2, &before_us, &before_clst));
+    CHECK_FR(f_unlink("0:/new.bin"));
+
+    /* After: the scan has filled in the map */
+    CHECK(remount("0:"));
+    do {
+        CHECK_FR(f_freescan("0:", buf, sizeof buf, &nclst));
+    } while (0xFFFFFFFF == nclst);
+    CHECK((fs_p->map_shift == 0) == fs_p->map_exact);
+    CHECK(check_map());
+    CHECK(timed_write(SMALL_FILES / 2, &after_us, &after_clst));
+    if (FS_FAT32 != fs_p->fs_type)  // (On FAT32, FSInfo has moved the next free hint)
+        CHECK(before_clst == after_clst);  // Same place
+    CHECK(after_us < before_us);
+    CHECK(check_map());
+    IMSG_PRINTF("%s, %lu clusters, %u per bit: writing a %d cluster file behind a big one: "
+                "%llu us with the map unknown, %llu us with the map\n",
+                name, (unsigned long)(fs_p->n_fatent - 2), 1u << fs_p->map_shift,
+                SMALL_FILES / 2, (unsigned long long)before_us, (unsigned long long)after_us);
+
+    /* f_expand finds room for a contiguous file, or knows that there is none */
+    CHECK_FR(f_unlink("0:/new.bin"));
+    CHECK(small_files('A', false));
+    FIL fil;
+    CHECK_FR(f_open(&fil, "0:/contig.bin", FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK(FR_DENIED == f_expand(&fil, (FSIZE_t)(SMALL_FILES + 1) * fs_p->csize * FF_MAX_SS, 1));
+    CHECK_FR(f_close(&fil));
+    CHECK(expand_file("0:/contig.bin", 8));  // (Between the directory's clusters on FAT32)
+    CHECK_FR(f_unlink("0:/fill.bin"));
+    CHECK(write_file("0:/tail.bin", 100 * 1024));
+    CHECK(check_map());
+    return true;
+}
+
+/* On FAT32, with a group of clusters for each bit, the scan a FAT sector at a time
+stops partway into a group: allocate when the only free clusters are in the rest of it */
+static bool partly_scanned_group(void) {
+    MKFS_PARM const opt = {.fmt = FM_FAT32, .au_size = 512};
+    CHECK_FR(f_mkfs("0:", &opt, buf, sizeof buf));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    CHECK(fs_p->map_shift > 0);
+    DWORD const per_sect = FF_MAX_SS / 4;  // FAT entries in a sector: the scan's first chunk is 2..per_sect - 1
+    DWORD const gs = 2 + ((per_sect - 1 - 2) & ~((1UL << fs_p->map_shift) - 1));  // The group it ends in
+    DWORD const ge = gs + (1UL << fs_p->map_shift);
+    CHECK(gs < per_sect && per_sect < ge);
+
+    /* Everything in use, but for per_sect..ge - 1 (the root directory is cluster 2) */
+    FIL fil;
+    CHECK(expand_file("0:/a.bin", per_sect - 3));
+    CHECK(expand_file("0:/b.bin", ge - per_sect));
+    CHECK_FR(f_open(&fil, "0:/b.bin", FA_READ));
+    CHECK(per_sect == fil.obj.sclust);
+    CHECK_FR(f_close(&fil));
+    DWORD nclst;
+    FATFS *p;
+    CHECK_FR(f_getfree("0:", &nclst, &p));
+    CHECK(expand_file("0:/fill.bin", nclst));
+    CHECK_FR(f_unlink("0:/b.bin"));
+
+    CHECK(remount("0:"));
+    CHECK_FR(f_freescan("0:", NULL, 0, &nclst));  // One FAT sector
+    CHECK(0xFFFFFFFF == nclst && per_sect == fs_p->scan_clst);
+    CHECK(map_bit(per_sect));  // Not scanned yet, so it might be free
+    CHECK(write_file("0:/new.bin", fs_p->csize * FF_MAX_SS));
+    CHECK_FR(f_open(&fil, "0:/new.bin", FA_READ));
+    CHECK(per_sect == fil.obj.sclust);
+    CHECK_FR(f_close(&fil));
+    do {
+        CHECK_FR(f_freescan("0:", NULL, 0, &nclst));
+    } while (0xFFFFFFFF == nclst);
+    CHECK(ge - per_sect - 1 == nclst);
+    CHECK(check_map());
+    return true;
+}
+
+bool free_map_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(sd_init_driver());
+    sd_card_p = sd_get_by_num(DRV);
+    fs_p = &sd_card_p->state.fatfs;
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    CHECK(with_format(FM_FAT, 2048, "FAT16"));
+    CHECK(with_format(FM_EXFAT, 4096, "exFAT"));
+    CHECK(with_format(FM_FAT32, 512, "FAT32"));
+    CHECK(fs_p->map_shift > 0);  // The summary
+    CHECK(partly_scanned_group());
+    CHECK_FR(f_unmount("0:"));
+    sd_card_p->state.mounted = false;
+    return true;
+}
+/* [] END OF FILE */
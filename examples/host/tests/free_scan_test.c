@@ -0,0 +1,199 @@
+/* free_scan_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Count the free clusters on drive 0 (modeled SPI card) with f_freescan, a chunk
+at a time, while files are created and deleted in between, on FAT16, FAT32, and
+exFAT volumes; check the count and the counts for each region against the FAT
+(or allocation bitmap) read directly, and compare the (modeled) time of f_getfree
+after a mount, with and without the scan having been done in the background. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+//
+#include "tests.h"
+
+enum { DRV = 0, CHUNK_SECTORS = 8 };
+
+static sd_card_t *sd_card_p;
+static FATFS *fs_p;
+static BYTE buf[CHUNK_SECTORS * FF_MAX_SS];
+
+/* Reference: count the free clusters in the FAT or bitmap on the card,
+in total and in each region */
+static bool count_free(DWORD *total_p, DWORD rfree[FF_FREESCAN_REGIONS]) {
+    memset(rfree, 0, FF_FREESCAN_REGIONS * sizeof rfree[0]);
+    *total_p = 0;
+    static fat_reader_t reader;
+    reader = (fat_reader_t){.fs_p = fs_p};
+    for (DWORD clst = 2; clst < fs_p->n_fatent; ++clst) {
+        bool is_free;
+        CHECK(cluster_is_free(&reader, clst, &is_free));
+        if (is_free) {
+            ++*total_p;
+            ++rfree[(clst - 2) / fs_p->scan_rsize];
+        }
+    }
+    return true;
+}
+
+static bool write_file(char const *path, size_t size) {
+    FIL fil;
+    UINT bw;
+    CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS));
+    memset(buf, 0x5A, sizeof buf);
+    for (size_t done = 0; done < size; done += bw) {
+        size_t const n = size - done < sizeof buf ? size - done : sizeof buf;
+        CHECK_FR(f_write(&fil, buf, n, &bw));
+        CHECK(bw == n);
+    }
+    CHECK_FR(f_close(&fil));
+    return true;
+}
+
+static bool with_format(BYTE fmt, DWORD au_size, char const *name) {
+    MKFS_PARM const opt = {.fmt = fmt, .au_size = au_size};
+    CHECK_FR(f_mkfs("0:", &opt, buf, sizeof buf));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    sd_card_p->state.mounted = true;
+
+    // Some files, with holes between them
+    char path[32];
+    for (int i = 0; i < 16; ++i) {
+        snprintf(path, sizeof path, "0:/f%02d.bin", i);
+        CHECK(write_file(path, (size_t)(i + 1) * 64 * 1024));
+    }
+    for (int i = 0; i < 16; i += 3) {
+        snprintf(path, sizeof path, "0:/f%02d.bin", i);
+        CHECK_FR(f_unlink(path));
+    }
+
+    /* Before: f_getfree after a mount reads the whole FAT (unless FSInfo says) */
+    CHECK(remount("0:"));
+    DWORD ref, rfree[FF_FREESCAN_REGIONS];
+    CHECK(count_free(&ref, rfree));
+    DWORD nclst;
+    FATFS *p;
+    uint64_t t0 = time_us_64();
+    CHECK_FR(f_getfree("0:", &nclst, &p));
+    uint64_t const getfree_us = time_us_64() - t0;
+    CHECK(nclst == ref);
+    if (FS_FAT32 == fs_p->fs_type) {  // The count came from FSInfo
+        CHECK(0 == getfree_us);
+    } else {
+        CHECK(!memcmp(rfree, fs_p->scan_rfree, sizeof rfree));
+    }
+
+    /* After: f_freescan in the background, with changes between the chunks */
+    CHECK(remount("0:"));
+    uint64_t scan_us = 0;
+    size_t chunks = 0;
+    int changes = 0;
+    do {
+        t0 = time_us_64();
+        CHECK_FR(f_freescan("0:", buf, sizeof buf, &nclst));
+        scan_us += time_us_64() - t0;
+        ++chunks;
+        switch (chunks % 4) {
+            case 1:  // Freed on both sides of the scan
+                snprintf(path, sizeof path, "0:/f%02d.bin", 1 + changes);
+                if (FR_OK == f_unlink(path)) ++changes;
+                break;
+            case 3:  // Allocated on both sides of the scan
+                snprintf(path, sizeof path, "0:/n%02d.bin", changes);
+                CHECK(write_file(path, 300 * 1024));
+                break;
+        }
+    } while (0xFFFFFFFF == nclst);
+    CHECK(changes > 0);
+    t0 = time_us_64();
+    CHECK_FR(f_getfree("0:", &nclst, &p));  // (There may have been a change after the last chunk)
+    CHECK(time_us_64() == t0);  // Instant
+    CHECK(count_free(&ref, rfree));
+    CHECK(nclst == ref);
+    CHECK(!memcmp(rfree, fs_p->scan_rfree, sizeof rfree));
+
+    /* And it is kept up to date */
+    CHECK(write_file("0:/after1.bin", 200 * 1024));
+    CHECK(write_file("0:/after2.bin", 100 * 1024));
+    CHECK_FR(f_unlink("0:/after1.bin"));
+    CHECK_FR(f_getfree("0:", &nclst, &p));
+    CHECK(count_free(&ref, rfree));
+    CHECK(nclst == ref);
+    CHECK(!memcmp(rfree, fs_p->scan_rfree, sizeof rfree));
+
+    IMSG_PRINTF("%s, %lu clusters: f_getfree after mount %llu us; "
+                "f_freescan %llu us in %zu chunks, then f_getfree 0 us\n",
+                name, (unsigned long)(fs_p->n_fatent - 2), (unsigned long long)getfree_us,
+                (unsigned long long)scan_us, chunks);
+    if (FS_FAT32 != fs_p->fs_type) {
+        // (With FF_FATCACHE_LINES, f_getfree reads the FAT a cache line at a time too)
+        CHECK(FF_FATCACHE_LINES ? scan_us <= getfree_us : scan_us < getfree_us);
+    }
+    return true;
+}
+
+/* A stale free count in FSInfo is believed at mount, and corrected by the scan */
+static bool stale_fsinfo(void) {
+    CHECK(FS_FAT32 == fs_p->fs_type);
+    CHECK_FR(f_unmount("0:"));
+    static BYTE sector[FF_MAX_SS];
+    LBA_t const fsi = fs_p->volbase + 1;
+    CHECK(RES_OK == disk_read(DRV, sector, fsi, 1));
+    DWORD const bogus = 1234;
+    memcpy(sector + 488, &bogus, sizeof bogus);  // FSI_Free_Count
+    CHECK(RES_OK == disk_write(DRV, sector, fsi, 1));
+    CHECK_FR(f_mount(fs_p, "0:", 1));
+    DWORD nclst;
+    FATFS *p;
+    CHECK_FR(f_getfree("0:", &nclst, &p));
+    CHECK(bogus == nclst);
+    do {
+        CHECK_FR(f_freescan("0:", buf, sizeof buf, &nclst));
+    } while (0xFFFFFFFF == nclst);
+    DWORD ref, rfree[FF_FREESCAN_REGIONS];
+    CHECK(count_free(&ref, rfree));
+    CHECK(nclst == ref);
+    CHECK_FR(f_getfree("0:", &nclst, &p));
+    CHECK(nclst == ref);
+    // The correction reaches FSInfo at the next sync
+    CHECK(write_file("0:/sync.bin", 1));
+    CHECK(RES_OK == disk_read(DRV, sector, fsi, 1));
+    DWORD on_disk;
+    memcpy(&on_disk, sector + 488, sizeof on_disk);
+    CHECK(on_disk == fs_p->free_clst);
+    return true;
+}
+
+bool free_scan_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(sd_init_driver());
+    sd_card_p = sd_get_by_num(DRV);
+    fs_p = &sd_card_p->state.fatfs;
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    CHECK(with_format(FM_FAT, 2048, "FAT16"));
+    CHECK(with_format(FM_EXFAT, 512, "exFAT"));
+    CHECK(with_format(FM_FAT32, 512, "FAT32"));
+    CHECK(stale_fsinfo());
+    CHECK_FR(f_unmount("0:"));
+    sd_card_p->state.mounted = false;
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,101 @@
+/* fs_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Round trip through FatFs and the ff_stdio layer on a RAM card */
+
+#include <stdlib.h>
+#include <string.h>
+//
+#include "f_util.h"
+#include "ff.h"
+#include "ff_stdio.h"
+#include "my_debug.h"
+//
+#include "tests.h"
+
+static const char drive[] = "1:";
+
+/* Write a file in odd sized pieces, then read it back in different odd sized pieces */
+static bool round_trip(const char *path, size_t size, unsigned seed) {
+    static BYTE buf[4099];
+    FIL fil;
+    CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS));
+    srand(seed);
+    for (size_t done = 0; done < size;) {
+        size_t n = 1 + rand() % sizeof buf;
+        if (n > size - done) n = size - done;
+        for (size_t i = 0; i < n; ++i) buf[i] = (BYTE)(done + i) ^ (BYTE)seed;
+        UINT bw;
+        CHECK_FR(f_write(&fil, buf, n, &bw));
+        CHECK(bw == n);
+        done += n;
+    }
+    CHECK_FR(f_close(&fil));
+
+    FILINFO fno;
+    CHECK_FR(f_stat(path, &fno));
+    CHECK(fno.fsize == size);
+
+    CHECK_FR(f_open(&fil, path, FA_READ));
+    for (size_t done = 0; done < size;) {
+        size_t n = 1 + rand() % sizeof buf;
+        UINT br;
+        CHECK_FR(f_read(&fil, buf, n, &br));
+        CHECK(br == (n < size - done ? n : size - done));
+        for (size_t i = 0; i < br; ++i) CHECK(buf[i] == ((BYTE)(done + i) ^ (BYTE)seed));
+        done += br;
+    }
+    CHECK_FR(f_close(&fil));
+    return true;
+}
+
+bool fs_test(void) {
+    CHECK(mount(drive));
+    CHECK_FR(f_chdrive(drive));
+
+    DWORD fre_clust_before;
+    FATFS *fs_p;
+    CHECK_FR(f_getfree(drive, &fre_clust_before, &fs_p));
+
+    FRESULT fr = f_mkdir("/fs_test");
+    CHECK(FR_OK == fr || FR_EXIST == fr);
+    CHECK(round_trip("/fs_test/small.bin", 1000, 1));
+    CHECK(round_trip("/fs_test/big.bin", 3 * 1024 * 1024 + 17, 2));
+
+    /* ff_stdio */
+    FF_FILE *file_p = ff_fopen("/fs_test/stdio.txt", "w");
+    CHECK(file_p);
+    static const char text[] = "The quick brown fox jumps over the lazy dog.\n";
+    CHECK(ff_fwrite(text, 1, strlen(text), file_p) == strlen(text));
+    CHECK(0 == ff_fclose(file_p));
+    file_p = ff_fopen("/fs_test/stdio.txt", "r");
+    CHECK(file_p);
+    char line[64];
+    CHECK(ff_fgets(line, sizeof line, file_p));
+    CHECK(0 == strcmp(line, text));
+    CHECK(0 == ff_fclose(file_p));
+
+    CHECK_FR(f_unlink("/fs_test/small.bin"));
+    CHECK_FR(f_unlink("/fs_test/big.bin"));
+    CHECK_FR(f_unlink("/fs_test/stdio.txt"));
+    CHECK_FR(f_unlink("/fs_test"));
+
+    DWORD fre_clust_after;
+    CHECK_FR(f_getfree(drive, &fre_clust_after, &fs_p));
+    CHECK(fre_clust_after == fre_clust_before);
+
+    CHECK_FR(f_unmount(drive));
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,163 @@
+/* hotplug_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Pull and reinsert the card of drive 7 (its Card Detect is GPIO 22), with contact bounce,
+and check that sd_hotplug.h takes the volume down and brings it back up, drops the
+queued and cached sectors, and tells the subscribers; and that, in between,
+asking whether the card is ready costs nothing. Expects the virtual clock. */
+
+#include <string.h>
+//
+#include "hardware/gpio.h"
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_cache.h"
+#include "sd_hotplug.h"
+#include "sd_wr_queue.h"
+//
+#include "tests.h"
+
+enum { HOTPLUG_DRV = 7, CD_GPIO = 22 };
+#define PATH "7:/hotplug.txt"
+static char const text[] = "Still here after the swap\n";
+
+static sd_card_t *sd_card_p;
+static BYTE sector[512];
+static sd_hotplug_event_t events[8];
+static size_t num_events;
+
+static void on_event(sd_card_t *card_p, sd_hotplug_event_t event, void *context) {
+    (void)context;
+    if (card_p == sd_card_p && num_events < count_of(events)) events[num_events++] = event;
+}
+
+/* Wait out the debounce, then let the manager run */
+static void settle(void) {
+    sleep_ms(SD_HOTPLUG_DEBOUNCE_MS);
+    sd_hotplug_task();
+}
+
+static bool check_file(void) {
+    FIL fil;
+    char buf[sizeof text] = {0};
+    UINT br;
+    CHECK_FR(f_open(&fil, PATH, FA_READ));
+    CHECK_FR(f_read(&fil, buf, sizeof buf, &br));
+    CHECK_FR(f_close(&fil));
+    CHECK(br == sizeof text - 1 && !memcmp(buf, text, br));
+    return true;
+}
+
+/* The first bring up finds no file system; format, and try again */
+static bool first_insertion(void) {
+    settle();
+    CHECK(1 == num_events && SD_HOTPLUG_FAILED == events[0]);
+    CHECK(!sd_hotplug_ready(sd_card_p));
+    static BYTE work[FF_MAX_SS * 2];
+    CHECK_FR(f_mkfs("7:", 0, work, sizeof work));
+    sd_hotplug_rescan(sd_card_p);
+    sd_hotplug_task();
+    CHECK(2 == num_events && SD_HOTPLUG_READY == events[1]);
+    CHECK(sd_hotplug_ready(sd_card_p) && sd_card_p->state.mounted);
+
+    FIL fil;
+    UINT bw;
+    CHECK_FR(f_open(&fil, PATH, FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK_FR(f_write(&fil, text, sizeof text - 1, &bw));
+    CHECK_FR(f_close(&fil));
+    return check_file();
+}
+
+static bool removal(void) {
+    // Leave a written sector in RAM, not yet on the card
+    memset(sector, 0xA5, sizeof sector);
+    CHECK(RES_OK == disk_write(HOTPLUG_DRV, sector, 10000, 1));
+
+    size_t const n = num_events;
+    uint64_t const t0 = time_us_64();
+    gpio_put(CD_GPIO, 0);  // Pull the card, with a bounce
+    sleep_ms(2);
+    gpio_put(CD_GPIO, 1);
+    sleep_ms(3);
+    gpio_put(CD_GPIO, 0);
+    CHECK(!sd_hotplug_ready(sd_card_p));  // At once
+    sd_hotplug_task();                    // Still bouncing: nothing to do yet
+    CHECK(time_us_64() - t0 == 5000);     // Neither the interrupts nor the task touched the card
+    CHECK(n == num_events);
+
+    settle();
+    CHECK(n + 1 == num_events && SD_HOTPLUG_REMOVED == events[n]);
+    CHECK(!sd_card_p->state.mounted);
+    CHECK(0 == sd_card_p->wr_queue_p->count);
+    for (uint32_t i = 0; i < sd_card_p->cache_p->sets * sd_card_p->cache_p->ways; ++i)
+        CHECK(!sd_card_p->cache_p->lines[i].valid);
+    FILINFO fno;
+    CHECK(FR_OK != f_stat(PATH, &fno));
+
+    // With the socket empty, the task has nothing to do, and costs nothing
+    uint64_t const t1 = time_us_64();
+    for (int i = 0; i < 100; ++i) {
+        sd_hotplug_task();
+        CHECK(!sd_hotplug_ready(sd_card_p));
+    }
+    CHECK(time_us_64() == t1);
+    return true;
+}
+
+static bool insertion(void) {
+    size_t const n = num_events;
+    gpio_put(CD_GPIO, 1);
+    settle();
+    CHECK(n + 1 == num_events && SD_HOTPLUG_READY == events[n]);
+    CHECK(sd_hotplug_ready(sd_card_p) && sd_card_p->state.mounted);
+    // The sector written before the removal never made it
+    CHECK(RES_OK == disk_read(HOTPLUG_DRV, sector, 10000, 1));
+    CHECK(0xA5 != sector[0]);
+    return check_file();
+}
+
+/* Out and back in, quicker than the debounce: it might be another card, so remount */
+static bool swap(void) {
+    size_t const n = num_events;
+    gpio_put(CD_GPIO, 0);
+    sleep_ms(20);
+    gpio_put(CD_GPIO, 1);
+    settle();
+    CHECK(n + 2 == num_events);
+    CHECK(SD_HOTPLUG_REMOVED == events[n] && SD_HOTPLUG_READY == events[n + 1]);
+    CHECK(sd_hotplug_ready(sd_card_p));
+    return check_file();
+}
+
+bool hotplug_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(sd_init_driver());
+    sd_card_p = sd_get_by_num(HOTPLUG_DRV);
+    CHECK(sd_card_p->hotplug_p);
+    CHECK(sd_hotplug_subscribe(on_event, NULL));
+    CHECK(first_insertion());
+    CHECK(removal());
+    CHECK(insertion());
+    CHECK(swap());
+    CHECK(1 == sd_card_p->hotplug_p->failures);
+    CHECK(3 == sd_card_p->hotplug_p->insertions && 2 == sd_card_p->hotplug_p->removals);
+    sd_hotplug_unsubscribe(on_event, NULL);
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,172 @@
+/* init_cache_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Measure (modeled) time from a cold start to the first write on drive 3,
+without and with its init cache (sd_init_cache.h) kept across the "reset"
+in a stand-in for flash; and check that a garbled image or another card
+just makes for a miss, and that the AU is read from the card only once. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_cache.h"
+#include "sd_init_cache.h"
+//
+#include "tests.h"
+
+enum { DRV = 3 };
+
+static sd_card_t *sd_card_p;
+static sd_init_cache_t *ic_p;
+
+/* Stand-in for a flash sector */
+static uint8_t flash[4 * sizeof(sd_init_cache_entry_t)];
+static bool flash_written;
+
+static bool flash_load(void *buffer, size_t size) {
+    if (!flash_written || size > sizeof flash) return false;
+    memcpy(buffer, flash, size);
+    return true;
+}
+static bool flash_save(void const *buffer, size_t size) {
+    if (size > sizeof flash) return false;
+    memcpy(flash, buffer, size);
+    flash_written = true;
+    return true;
+}
+
+/* Power cycle: the card needs initializing, and RAM is lost */
+static void reset(void) {
+    f_unmount("3:");
+    sd_card_p->state.mounted = false;
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_cache_invalidate(sd_card_p);
+    memset(ic_p->entries, 0xA5, ic_p->num_entries * sizeof ic_p->entries[0]);
+    ic_p->loaded = false;
+}
+
+/* From a cold start to the first write reaching the card */
+static bool cold_start(uint64_t *us_p) {
+    uint64_t const t0 = time_us_64();
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    CHECK(mount("3:"));
+    FIL fil;
+    UINT bw;
+    CHECK_FR(f_open(&fil, "3:/log.txt", FA_WRITE | FA_OPEN_APPEND));
+    CHECK_FR(f_write(&fil, "boot\n", 5, &bw));
+    CHECK_FR(f_close(&fil));
+    *us_p = time_us_64() - t0;
+    return true;
+}
+
+bool init_cache_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(sd_init_driver());
+    sd_card_p = sd_get_by_num(DRV);
+    ic_p = sd_card_p->init_cache_p;
+    CHECK(ic_p && ic_p->num_entries * sizeof ic_p->entries[0] <= sizeof flash);
+    sd_ram_if_state_t *ram_p = &sd_card_p->ram_if_p->state;
+    ic_p->load = flash_load;
+    ic_p->save = flash_save;
+
+    /* Format, if need be, and create the file, so that neither counts */
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    CHECK(mount("3:"));
+    uint64_t us;
+    CHECK(cold_start(&us));
+
+    /* Without the cache: nothing in flash */
+    flash_written = false;
+    reset();
+    uint32_t cmd9 = ram_p->cmd9_cnt;
+    uint64_t without_us, with_us;
+    CHECK(cold_start(&without_us));
+    CHECK(ram_p->cmd9_cnt == cmd9 + 1);
+    CHECK(flash_written);
+
+    /* With the cache loaded from flash */
+    reset();
+    uint32_t const hits = ic_p->hits;
+    CHECK(cold_start(&with_us));
+    CHECK(ic_p->hits == hits + 1);
+    CHECK(ram_p->cmd9_cnt == cmd9 + 1);  // CMD9 skipped
+    CHECK(sd_card_p->state.sectors == sd_card_p->ram_if_p->sectors);
+    IMSG_PRINTF("Cold start to first write: %llu us without the init cache, %llu us with\n",
+                (unsigned long long)without_us, (unsigned long long)with_us);
+    CHECK(with_us + sd_card_p->ram_if_p->latency.reg_us == without_us);
+
+    /* The AU is read once, and then comes from the cache for every TRIM */
+    uint32_t const acmd13 = ram_p->acmd13_cnt;
+    for (int i = 0; i < 3; ++i) {
+        FIL fil;
+        UINT bw;
+        static BYTE buf[64 * 1024];
+        CHECK_FR(f_open(&fil, "3:/trim.bin", FA_WRITE | FA_CREATE_ALWAYS));
+        CHECK_FR(f_write(&fil, buf, sizeof buf, &bw));
+        CHECK_FR(f_close(&fil));
+        CHECK_FR(f_unlink("3:/trim.bin"));  // CTRL_TRIM
+    }
+    CHECK(ram_p->acmd13_cnt == acmd13 + 1);
+    reset();  // The AU survives the reset too
+    CHECK(cold_start(&us));
+    size_t au_bytes;
+    CHECK(sd_allocation_unit(sd_card_p, &au_bytes));
+    CHECK(ram_p->acmd13_cnt == acmd13 + 1);
+
+    /* A garbled image is a miss */
+    flash[offsetof(sd_init_cache_entry_t, sectors)] ^= 1;
+    for (size_t i = 1; i < ic_p->num_entries; ++i)  // Any other entries, too
+        flash[i * sizeof(sd_init_cache_entry_t) + offsetof(sd_init_cache_entry_t, CSD)] ^= 1;
+    reset();
+    cmd9 = ram_p->cmd9_cnt;
+    CHECK(cold_start(&us));
+    CHECK(ram_p->cmd9_cnt == cmd9 + 1);
+    CHECK(sd_card_p->state.sectors == sd_card_p->ram_if_p->sectors);
+
+    /* So is another card, and it takes the place of the least recently used */
+    uint32_t const psn = sd_card_p->ram_if_p->psn;
+    for (uint32_t i = 1; i <= ic_p->num_entries; ++i) {
+        sd_card_p->ram_if_p->psn = 1000 + i;
+        sd_card_p->state.m_Status |= STA_NOINIT;
+        cmd9 = ram_p->cmd9_cnt;
+        CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+        CHECK(ram_p->cmd9_cnt == cmd9 + 1);
+    }
+    sd_card_p->ram_if_p->psn = psn;  // The first card was evicted
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    cmd9 = ram_p->cmd9_cnt;
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    CHECK(ram_p->cmd9_cnt == cmd9 + 1);
+    sd_card_p->ram_if_p->psn = 1000 + ic_p->num_entries;  // The last one was not
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    cmd9 = ram_p->cmd9_cnt;
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    CHECK(ram_p->cmd9_cnt == cmd9);
+
+    sd_card_p->ram_if_p->psn = psn;
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    CHECK(0 == (disk_initialize(DRV) & STA_NOINIT));
+    CHECK_FR(f_unmount("3:"));
+    sd_card_p->state.mounted = false;
+    ic_p->load = NULL;
+    ic_p->save = NULL;
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,104 @@
+/* io_core_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the dedicated I/O core (sd_io_core.h), with a thread standing in for core 1:
+FatFs on core 0 through messages to core 1, and asynchronous messages with callbacks. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_io_core.h"
+//
+#include "tests.h"
+
+enum { MSGS = 3 * SD_IO_CORE_SLOTS };  // More than can be outstanding
+
+static BYTE wbuf[MSGS * 512], rbuf[MSGS * 512];
+static volatile int callbacks[2];  // By the core that ran the callback
+
+static void on_done(sd_io_msg_t *msg_p) {
+    (void)msg_p;
+    ++callbacks[get_core_num()];
+}
+
+/* FatFs, all of its diskio calls sent to core 1 */
+static bool file(void) {
+    for (size_t i = 0; i < sizeof wbuf; ++i) wbuf[i] = i * 7 + 3;
+    uint32_t const handled = sd_io_core_handled();
+    CHECK(mount("1:"));
+    FIL fil;
+    UINT bw, br;
+    CHECK_FR(f_open(&fil, "1:/io_core.bin", FA_WRITE | FA_CREATE_ALWAYS));
+    CHECK_FR(f_write(&fil, wbuf, sizeof wbuf, &bw));
+    CHECK(bw == sizeof wbuf);
+    CHECK_FR(f_close(&fil));
+    CHECK_FR(f_open(&fil, "1:/io_core.bin", FA_READ));
+    CHECK_FR(f_read(&fil, rbuf, sizeof rbuf, &br));
+    CHECK(br == sizeof rbuf);
+    CHECK_FR(f_close(&fil));
+    CHECK(!memcmp(wbuf, rbuf, sizeof wbuf));
+    CHECK_FR(f_unmount("1:"));
+    sd_get_by_num(1)->state.mounted = false;
+    CHECK(sd_io_core_handled() - handled > 4);
+    return true;
+}
+
+/* Raw blocks, one message per block, more than fit at once */
+static bool async(void) {
+    static sd_io_msg_t msgs[MSGS];
+    CHECK(disk_write(1, wbuf, 5000, MSGS) == RES_OK);
+    memset(rbuf, 0, sizeof rbuf);
+    memset((void *)callbacks, 0, sizeof callbacks);
+    for (unsigned i = 0; i < MSGS; ++i) {
+        msgs[i] = (sd_io_msg_t){.op = SD_IO_MSG_READ,
+                                .pdrv = 1,
+                                .rd_buffer = rbuf + i * 512,
+                                .sector = 5000 + i,
+                                .count = 1,
+                                .callback = on_done};
+        sd_io_core_send(&msgs[i]);
+    }
+    for (unsigned i = 0; i < MSGS; ++i) {
+        while (!msgs[i].done) tight_loop_contents();
+        CHECK(RES_OK == msgs[i].result);
+    }
+    CHECK(!memcmp(wbuf, rbuf, sizeof wbuf));
+    CHECK(0 == callbacks[0] && MSGS == callbacks[1]);
+    return true;
+}
+
+bool io_core_test(void) {
+    CHECK(sd_init_driver());
+    CHECK(!sd_io_core_running());
+    sd_io_core_start();
+    CHECK(sd_io_core_running());
+    CHECK(sd_io_core_offload());  // We are core 0
+    CHECK(0 == (disk_initialize(1) & STA_NOINIT));
+    CHECK(file());
+    CHECK(async());
+    sd_io_core_stop();
+    CHECK(!sd_io_core_running());
+    CHECK(!sd_io_core_offload());
+    uint32_t const handled = sd_io_core_handled();
+    CHECK(disk_read(1, rbuf, 5000, 1) == RES_OK);  // Directly, now
+    CHECK(handled == sd_io_core_handled());
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,169 @@
+/* mirror_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the mirrored (RAID-1) drive 5 (RAID/sd_card_mirror.h):
+writes land on both members, large reads are shared out and overlap,
+and a member that is pulled (by its Card Detect GPIO), swapped, or rebuilt
+is brought back up to date by sd_mirror_resync. Expects the virtual clock. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "tests.h"
+
+enum { MIRROR_DRV = 5, N = 256 };
+
+static BYTE buf[N * 512];
+
+/* Each block holds its LBA plus a tag */
+static void fill(LBA_t lba, UINT count, uint32_t tag) {
+    for (UINT i = 0; i < count; ++i) {
+        uint32_t v = lba + i + tag;
+        for (size_t j = 0; j < 512; j += sizeof v) memcpy(buf + i * 512 + j, &v, sizeof v);
+    }
+}
+
+static bool holds(sd_card_t *card_p, LBA_t lba, UINT count, uint32_t tag) {
+    memset(buf, 0, sizeof buf);
+    CHECK(card_p->read_blocks(card_p, buf, lba, count) == SD_BLOCK_DEVICE_ERROR_NONE);
+    for (UINT i = 0; i < count; ++i) {
+        uint32_t v = lba + i + tag;
+        for (size_t j = 0; j < 512; j += sizeof v) CHECK(!memcmp(buf + i * 512 + j, &v, sizeof v));
+    }
+    return true;
+}
+
+static bool write_sync(LBA_t lba, UINT count, uint32_t tag) {
+    fill(lba, count, tag);
+    CHECK(disk_write(MIRROR_DRV, buf, lba, count) == RES_OK);
+    CHECK(disk_ioctl(MIRROR_DRV, CTRL_SYNC, 0) == RES_OK);
+    return true;
+}
+
+/* Run sd_mirror_resync, a few regions at a time, until both members are online */
+static bool resync(sd_card_t *sd_card_p) {
+    for (unsigned i = 0; i < 10000; ++i)
+        if (sd_mirror_resync(sd_card_p, 16)) return true;
+    EMSG_PRINTF("resync did not finish\n");
+    return false;
+}
+
+static bool both_hold(sd_card_t *sd_card_p, LBA_t lba, UINT count, uint32_t tag) {
+    for (unsigned k = 0; k < 2; ++k)
+        CHECK(holds(sd_card_p->mirror_if_p->members[k], lba, count, tag));
+    return true;
+}
+
+/* Large reads from both members take about half the time of drive 0 */
+static bool balance(sd_card_t *sd_card_p) {
+    sd_mirror_if_state_t *st_p = &sd_card_p->mirror_if_p->state;
+    CHECK(0 == (disk_initialize(0) & STA_NOINIT));
+    uint32_t const reads0 = st_p->reads[0], reads1 = st_p->reads[1];
+    uint64_t t0 = time_us_64();
+    CHECK(disk_read(0, buf, 0, N) == RES_OK);
+    uint64_t const rd0 = time_us_64() - t0;
+    t0 = time_us_64();
+    CHECK(disk_read(MIRROR_DRV, buf, 0, N) == RES_OK);
+    uint64_t const rd5 = time_us_64() - t0;
+    IMSG_PRINTF("%d blocks: drive 0: read %llu us; mirrored: read %llu us\n", N,
+                (unsigned long long)rd0, (unsigned long long)rd5);
+    CHECK(st_p->reads[0] > reads0 && st_p->reads[1] > reads1);
+    CHECK(rd5 * 10 < rd0 * 7);
+    return true;
+}
+
+/* Pull member 1, write degraded, put it back, and resync */
+static bool removal(sd_card_t *sd_card_p) {
+    sd_mirror_if_state_t *st_p = &sd_card_p->mirror_if_p->state;
+    sd_card_t *m1_p = sd_card_p->mirror_if_p->members[1];
+
+    gpio_put(m1_p->card_detect_gpio, 0);
+    CHECK(write_sync(1000, N, 7));
+    CHECK(SD_MIRROR_OFFLINE == st_p->member_state[1]);
+    CHECK(SD_MIRROR_ONLINE == st_p->member_state[0]);
+    CHECK(st_p->dirty_regions > 0);
+    CHECK(holds(sd_card_p, 1000, N, 7));  // Served by member 0
+    CHECK(!sd_mirror_resync(sd_card_p, 16));  // Still out
+
+    gpio_put(m1_p->card_detect_gpio, 1);
+    uint32_t const dirty = st_p->dirty_regions;
+    uint32_t const resynced = st_p->regions_resynced;
+    CHECK(!sd_mirror_resync(sd_card_p, 0));  // Rejoins, nothing copied yet
+    CHECK(SD_MIRROR_RESYNC == st_p->member_state[1]);
+    CHECK(dirty == st_p->dirty_regions);
+    CHECK(write_sync(2000, 8, 9));  // Writes go to a resyncing member too
+    CHECK(resync(sd_card_p));
+    CHECK(0 == st_p->dirty_regions);
+    CHECK(st_p->regions_resynced - resynced == dirty);  // Only the dirty regions
+    CHECK(both_hold(sd_card_p, 1000, N, 7));
+    CHECK(both_hold(sd_card_p, 2000, 8, 9));
+    return true;
+}
+
+/* A different card in the socket gets everything */
+static bool swap(sd_card_t *sd_card_p) {
+    sd_mirror_if_state_t *st_p = &sd_card_p->mirror_if_p->state;
+    sd_card_t *m1_p = sd_card_p->mirror_if_p->members[1];
+
+    gpio_put(m1_p->card_detect_gpio, 0);
+    CHECK(!sd_mirror_resync(sd_card_p, 16));
+    CHECK(SD_MIRROR_OFFLINE == st_p->member_state[1]);
+    m1_p->ram_if_p->psn = 0x5A5A5A5A;  // Another serial number in the CID
+    gpio_put(m1_p->card_detect_gpio, 1);
+    CHECK(!sd_mirror_resync(sd_card_p, 0));
+    CHECK(st_p->regions == st_p->dirty_regions);
+    CHECK(resync(sd_card_p));
+    CHECK(both_hold(sd_card_p, 0, N, 0));
+    CHECK(both_hold(sd_card_p, 1000, N, 7));
+    return true;
+}
+
+/* sd_mirror_rebuild copies everything to member 0 */
+static bool rebuild(sd_card_t *sd_card_p) {
+    sd_mirror_if_state_t *st_p = &sd_card_p->mirror_if_p->state;
+    sd_card_t *m0_p = sd_card_p->mirror_if_p->members[0];
+
+    CHECK(m0_p->write_blocks(m0_p, (uint8_t[512]){0}, 1005, 1) == SD_BLOCK_DEVICE_ERROR_NONE);
+    sd_mirror_rebuild(sd_card_p, 0);
+    CHECK(SD_MIRROR_RESYNC == st_p->member_state[0]);
+    CHECK(st_p->regions == st_p->dirty_regions);
+    CHECK(holds(sd_card_p, 1000, N, 7));  // Served by member 1 meanwhile
+    CHECK(resync(sd_card_p));
+    CHECK(both_hold(sd_card_p, 1000, N, 7));
+    return true;
+}
+
+bool mirror_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(0 == (disk_initialize(MIRROR_DRV) & STA_NOINIT));
+    sd_card_t *sd_card_p = sd_get_by_num(MIRROR_DRV);
+    CHECK(SD_IF_MIRROR == sd_card_p->type);
+    CHECK(16 * 1024 * 1024 / 512 == sd_card_p->get_num_sectors(sd_card_p));
+    CHECK(sd_mirror_resync(sd_card_p, 16));  // In sync from the start
+
+    CHECK(write_sync(0, N, 0));
+    CHECK(both_hold(sd_card_p, 0, N, 0));
+    CHECK(balance(sd_card_p));
+    CHECK(removal(sd_card_p));
+    CHECK(swap(sd_card_p));
+    CHECK(rebuild(sd_card_p));
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,94 @@
+/* ram_card_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the RAM driver's emulation of multiple block writes
+and its latency model, through the FatFs disk I/O API.
+Expects the virtual clock. */
+
+#include <stdlib.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "tests.h"
+
+static const BYTE pdrv = 0;  // The drive with a latency model
+
+bool ram_card_test(void) {
+    sd_card_t *sd_card_p = sd_get_by_num(pdrv);
+    CHECK(sd_card_p && SD_IF_RAM == sd_card_p->type);
+    CHECK(0 == (disk_initialize(pdrv) & STA_NOINIT));
+    sd_ram_if_t *ram_if_p = sd_card_p->ram_if_p;
+    sd_ram_latency_t const *lat_p = &ram_if_p->latency;
+    CHECK(host_clock_is_virtual());
+    CHECK(disk_ioctl(pdrv, CTRL_SYNC, 0) == RES_OK);
+
+    static BYTE wbuf[16 * 512], rbuf[16 * 512];
+    for (size_t i = 0; i < sizeof wbuf; ++i) wbuf[i] = rand();
+
+    /* Two contiguous multiple block writes are one CMD25 */
+    sd_ram_if_state_t before = ram_if_p->state;
+    uint64_t start = time_us_64();
+    CHECK(disk_write(pdrv, wbuf, 100, 8) == RES_OK);
+    CHECK(disk_write(pdrv, wbuf + 8 * 512, 108, 8) == RES_OK);
+    CHECK(disk_ioctl(pdrv, CTRL_SYNC, 0) == RES_OK);
+    uint64_t elapsed = time_us_64() - start;
+    CHECK(ram_if_p->state.cmd25_cnt == before.cmd25_cnt + 1);
+    CHECK(ram_if_p->state.cmd12_cnt == before.cmd12_cnt + 1);
+    CHECK(ram_if_p->state.blocks_wr == before.blocks_wr + 16);
+    // Each block waits for the previous one to be programmed, and so does the stop
+    uint64_t expected = lat_p->cmd25_us + 16 * lat_p->block_wr_us + 16 * lat_p->busy_wr_us +
+                        lat_p->cmd12_us;
+    CHECK(elapsed == expected);
+    CHECK(ram_if_p->state.modeled_us - before.modeled_us == expected);
+
+    /* Multiple block read */
+    before = ram_if_p->state;
+    start = time_us_64();
+    CHECK(disk_read(pdrv, rbuf, 100, 16) == RES_OK);
+    elapsed = time_us_64() - start;
+    CHECK(0 == memcmp(wbuf, rbuf, sizeof rbuf));
+    CHECK(ram_if_p->state.cmd18_cnt == before.cmd18_cnt + 1);
+    CHECK(elapsed == lat_p->cmd18_us + 16 * lat_p->block_rd_us + lat_p->cmd12_us);
+
+    /* A single block read ends an open multiple block write */
+    before = ram_if_p->state;
+    CHECK(disk_write(pdrv, wbuf, 200, 2) == RES_OK);
+    CHECK(disk_read(pdrv, rbuf, 201, 1) == RES_OK);
+    CHECK(0 == memcmp(wbuf + 512, rbuf, 512));
+    CHECK(ram_if_p->state.cmd25_cnt == before.cmd25_cnt + 1);
+    CHECK(ram_if_p->state.cmd12_cnt == before.cmd12_cnt + 1);
+    CHECK(ram_if_p->state.cmd17_cnt == before.cmd17_cnt + 1);
+
+    /* Single block write */
+    before = ram_if_p->state;
+    CHECK(disk_write(pdrv, wbuf, 300, 1) == RES_OK);
+    CHECK(ram_if_p->state.cmd24_cnt == before.cmd24_cnt + 1);
+
+    /* Out of range */
+    LBA_t n = 0;
+    CHECK(disk_ioctl(pdrv, GET_SECTOR_COUNT, &n) == RES_OK);
+    CHECK(n == ram_if_p->sectors);
+    CHECK(disk_read(pdrv, rbuf, n - 1, 2) == RES_PARERR);
+    CHECK(disk_write(pdrv, wbuf, n, 1) == RES_PARERR);
+    CHECK(disk_read(pdrv, rbuf, n - 1, 1) == RES_OK);
+
+    return true;
+}
+/* [] END OF FILE */
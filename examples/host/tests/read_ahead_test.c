@@ -0,0 +1,125 @@
+/* read_ahead_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the read-ahead (sd_read_ahead.h) with a streaming reader
+that reads a file in small pieces and does some work on each piece,
+on drive 0 without and then with read-ahead.
+Expects the virtual clock. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sd_read_ahead.h"
+//
+#include "tests.h"
+
+static const char path[] = "0:/read_ahead.bin";
+enum { FILE_SIZE = 256 * 1024, PIECE = 100, WORK_US = 50 };
+
+static bool stream(uint64_t *elapsed_p) {
+    FIL fil;
+    CHECK_FR(f_open(&fil, path, FA_READ));
+    uint64_t const start = time_us_64();
+    static BYTE buf[PIECE];
+    for (size_t done = 0; done < FILE_SIZE;) {
+        UINT br;
+        CHECK_FR(f_read(&fil, buf, sizeof buf, &br));
+        CHECK(br);
+        for (UINT i = 0; i < br; ++i) CHECK(buf[i] == (BYTE)((done + i) * 7));
+        done += br;
+        sleep_us(WORK_US);  // Stand-in for processing the data
+    }
+    *elapsed_p = time_us_64() - start;
+    CHECK_FR(f_close(&fil));
+    return true;
+}
+
+bool read_ahead_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(mount("0:"));
+    sd_card_t *sd_card_p = sd_get_by_drive_prefix("0:");
+    CHECK(!sd_card_p->read_ahead_p);
+
+    FIL fil;
+    CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS));
+    static BYTE buf[4096];
+    for (size_t done = 0; done < FILE_SIZE; done += sizeof buf) {
+        for (size_t i = 0; i < sizeof buf; ++i) buf[i] = (BYTE)((done + i) * 7);
+        UINT bw;
+        CHECK_FR(f_write(&fil, buf, sizeof buf, &bw));
+    }
+    CHECK_FR(f_close(&fil));
+
+    sd_ram_if_state_t *st_p = &sd_card_p->ram_if_p->state;
+    uint32_t cmds = st_p->cmd17_cnt + st_p->cmd18_cnt;
+    uint64_t plain_us;
+    CHECK(stream(&plain_us));
+    uint32_t const plain_cmds = st_p->cmd17_cnt + st_p->cmd18_cnt - cmds;
+
+    /* Attach a read-ahead to drive 0 */
+    static uint8_t ra_buf[16 * 512] __attribute__((aligned(4)));
+    static sd_read_ahead_t read_ahead = {.buffer = ra_buf, .sectors = 16};
+    mutex_init(&read_ahead.mutex);  // Done by sd_init_driver for configured cards
+    sd_card_p->read_ahead_p = &read_ahead;
+
+    cmds = st_p->cmd17_cnt + st_p->cmd18_cnt;
+    uint64_t ra_us;
+    bool ok = stream(&ra_us);
+    uint32_t const ra_cmds = st_p->cmd17_cnt + st_p->cmd18_cnt - cmds;
+    sd_read_ahead_invalidate(sd_card_p);
+    sd_card_p->read_ahead_p = NULL;
+    CHECK(ok);
+
+    IMSG_PRINTF("Streaming %d byte reads: %llu us, %lu commands without read-ahead; "
+                "%llu us, %lu commands with read-ahead\n",
+                PIECE, plain_us, plain_cmds, ra_us, ra_cmds);
+    IMSG_PRINTF("Read-ahead: %lu prefetches, %lu sectors prefetched, %lu hit, %lu wasted\n",
+                read_ahead.prefetches, read_ahead.sectors_prefetched, read_ahead.sectors_hit,
+                read_ahead.sectors_wasted);
+    CHECK(4 * ra_cmds < plain_cmds);
+    CHECK(3 * ra_us < 2 * plain_us);
+    CHECK(read_ahead.sectors_hit >= FILE_SIZE / 512 - read_ahead.prefetches);
+    CHECK(read_ahead.sectors_wasted <= read_ahead.sectors);
+
+    /* Writes invalidate what they overlap */
+    CHECK_FR(f_open(&fil, path, FA_READ | FA_WRITE));
+    read_ahead.sectors_wasted = 0;
+    sd_card_p->read_ahead_p = &read_ahead;
+    UINT br, bw;
+    CHECK_FR(f_read(&fil, buf, 1024, &br));
+    CHECK_FR(f_read(&fil, buf, 512, &br));   // Sequential: prefetch
+    CHECK(read_ahead.buf_count);
+    memset(buf, 0xA5, 512);
+    CHECK_FR(f_write(&fil, buf, 512, &bw));  // Into the read-ahead buffer
+    CHECK_FR(f_sync(&fil));
+    CHECK(!read_ahead.buf_count);
+    CHECK(read_ahead.sectors_wasted);
+    CHECK_FR(f_lseek(&fil, 1536));
+    memset(buf, 0, 512);
+    CHECK_FR(f_read(&fil, buf, 512, &br));
+    for (size_t i = 0; i < 512; ++i) CHECK(0xA5 == buf[i]);
+    CHECK_FR(f_close(&fil));
+    sd_read_ahead_invalidate(sd_card_p);
+    sd_card_p->read_ahead_p = NULL;
+
+    CHECK_FR(f_unmount("0:"));
+    return true;
+}
+/* [] END OF FILE */
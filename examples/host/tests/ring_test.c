@@ -0,0 +1,148 @@
+/* ring_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the submission rings (sd_ring.h) on drive 0, with two threads standing in
+for the two cores: core 1 owns the card and also submits requests of its own,
+and core 0 submits requests and reaps their completions. Expects the virtual clock. */
+
+#include <pthread.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sd_ring.h"
+//
+#include "tests.h"
+
+enum { REQS = 64, BLOCKS = 4 };
+
+static uint8_t bufs[SD_RING_CORES][REQS][BLOCKS * 512];
+static sd_io_req_t reqs[SD_RING_CORES][REQS];
+static int callbacks[SD_RING_CORES];  // By the core that ran the callback
+static volatile bool stop;
+
+static void on_done(sd_io_req_t *req_p) {
+    (void)req_p;
+    ++callbacks[get_core_num()];
+}
+
+/* Core n uses LBAs n * 10000 + ... */
+static void fill(unsigned core, unsigned i) {
+    for (size_t j = 0; j < sizeof bufs[core][i]; j += sizeof(uint32_t)) {
+        uint32_t v = core << 24 | i << 16 | j;
+        memcpy(&bufs[core][i][j], &v, sizeof v);
+    }
+}
+
+/* Submit all of the requests of this core, reaping as needed. Returns the failures. */
+static int run(sd_card_t *sd_card_p, sd_io_op_t op, bool owner) {
+    unsigned const core = get_core_num();
+    int failures = 0;
+    unsigned submitted = 0, reaped = 0;
+    while (reaped < REQS) {
+        if (owner) sd_ring_service(sd_card_p);
+        if (submitted < REQS) {
+            sd_io_req_t *req_p = &reqs[core][submitted];
+            memset(req_p, 0, sizeof *req_p);
+            req_p->callback = on_done;
+            uint32_t const lba = core * 10000 + submitted * BLOCKS;
+            block_dev_err_t rc;
+            if (SD_IO_WRITE == op) {
+                fill(core, submitted);
+                rc = sd_ring_write_blocks(sd_card_p, req_p, bufs[core][submitted], lba, BLOCKS);
+            } else {
+                memset(bufs[core][submitted], 0, sizeof bufs[core][submitted]);
+                rc = sd_ring_read_blocks(sd_card_p, req_p, bufs[core][submitted], lba, BLOCKS);
+            }
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rc) ++submitted;
+        }
+        sd_io_req_t *req_p = sd_ring_reap(sd_card_p);
+        if (req_p) {
+            if (SD_BLOCK_DEVICE_ERROR_NONE != req_p->status) ++failures;
+            ++reaped;
+        } else {
+            tight_loop_contents();
+        }
+    }
+    return failures;
+}
+
+static bool check(unsigned core) {
+    static uint8_t expected[BLOCKS * 512];
+    for (unsigned i = 0; i < REQS; ++i) {
+        memcpy(expected, bufs[core][i], sizeof expected);
+        fill(core, i);
+        CHECK(!memcmp(expected, bufs[core][i], sizeof expected));
+    }
+    return true;
+}
+
+static void *core1(void *arg) {
+    sd_card_t *sd_card_p = arg;
+    host_set_core_num(1);
+    static int failures;
+    failures = run(sd_card_p, SD_IO_WRITE, true) + run(sd_card_p, SD_IO_READ, true);
+    while (!stop) sd_ring_service(sd_card_p);
+    return &failures;
+}
+
+bool ring_test(void) {
+    CHECK(host_clock_is_virtual());
+    sd_card_t *sd_card_p = sd_get_by_num(0);
+    CHECK(sd_card_p->ring_p);
+    CHECK(0 == (disk_initialize(0) & STA_NOINIT));
+    CHECK(0 == get_core_num());
+
+    /* Nobody is servicing the ring yet: it fills up */
+    sd_io_req_t early[SD_RING_DEPTH + 1];
+    static uint8_t block[512];
+    memset(early, 0, sizeof early);
+    for (unsigned i = 0; i < SD_RING_DEPTH; ++i)
+        CHECK(sd_ring_read_blocks(sd_card_p, &early[i], block, 0, 1) == SD_BLOCK_DEVICE_ERROR_NONE);
+    CHECK(sd_ring_read_blocks(sd_card_p, &early[SD_RING_DEPTH], block, 0, 1) ==
+          SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK);
+    CHECK(!sd_ring_reap(sd_card_p));
+
+    memset(callbacks, 0, sizeof callbacks);
+    stop = false;
+    uint32_t const serviced = sd_card_p->ring_p->serviced;
+    pthread_t thread;
+    CHECK(0 == pthread_create(&thread, NULL, core1, sd_card_p));
+
+    for (unsigned i = 0; i < SD_RING_DEPTH; ++i)
+        CHECK(sd_ring_wait(sd_card_p, &early[i]) == SD_BLOCK_DEVICE_ERROR_NONE);
+    int failures = run(sd_card_p, SD_IO_WRITE, false);
+    sd_io_req_t sync_req = {0};
+    CHECK(sd_ring_sync(sd_card_p, &sync_req) == SD_BLOCK_DEVICE_ERROR_NONE);
+    CHECK(sd_ring_wait(sd_card_p, &sync_req) == SD_BLOCK_DEVICE_ERROR_NONE);
+    failures += run(sd_card_p, SD_IO_READ, false);
+
+    int *core1_failures;
+    stop = true;
+    CHECK(0 == pthread_join(thread, (void **)&core1_failures));
+    CHECK(0 == failures);
+    CHECK(0 == *core1_failures);
+    CHECK(check(0));
+    CHECK(check(1));
+    // Each core ran the callbacks of its own requests
+    CHECK(2 * REQS == callbacks[0] && 2 * REQS == callbacks[1]);
+    CHECK(sd_card_p->ring_p->serviced - serviced == SD_RING_DEPTH + 1 + 4 * REQS);
+    CHECK(!sd_ring_service(sd_card_p));  // Idle
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,120 @@
+/* stats_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the per-card I/O statistics (sd_stats.h) against the RAM driver's
+latency model on drive 0. With the virtual clock, the measured latencies
+are exactly the modeled ones. */
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "diskio.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_async.h"
+#include "sd_card.h"
+#include "sd_stats.h"
+//
+#include "tests.h"
+
+static unsigned bucket(uint32_t us) { return us ? 32 - __builtin_clz(us) : 0; }
+
+static bool hist_consistent(sd_stats_t const *s_p) {
+    for (unsigned op = 0; op < SD_STATS_NUM_OPS; ++op) {
+        uint32_t sum = 0;
+        for (unsigned b = 0; b < SD_STATS_BUCKETS; ++b) sum += s_p->ops[op].hist[b];
+        CHECK(sum == s_p->ops[op].count);
+        CHECK(s_p->ops[op].total_us >= (uint64_t)s_p->ops[op].max_us);
+    }
+    return true;
+}
+
+bool stats_test(void) {
+    CHECK(0 == (disk_initialize(0) & STA_NOINIT));
+    sd_card_t *sd_card_p = sd_get_by_num(0);
+    sd_ram_latency_t const *lat_p = &sd_card_p->ram_if_p->latency;
+    sd_stats_reset(sd_card_p);
+    static BYTE buf[8 * 512];
+    memset(buf, 0x3C, sizeof buf);
+    static sd_stats_t stats;
+
+    /* Single block read: CMD17 */
+    CHECK(disk_read(0, buf, 1000, 1) == RES_OK);
+    sd_stats_get(sd_card_p, &stats);
+    sd_stats_op_stats_t const *s_p = &stats.ops[SD_STATS_READ_SINGLE];
+    uint32_t const rd1_us = lat_p->cmd17_us + lat_p->block_rd_us;
+    CHECK(1 == s_p->count && 1 == s_p->blocks && 0 == s_p->errors);
+    CHECK(rd1_us == s_p->max_us);
+    CHECK(1 == s_p->hist[bucket(rd1_us)]);
+    CHECK(1 == stats.commands);
+
+    /* Multiple block read: CMD18 and CMD12 */
+    CHECK(disk_read(0, buf, 2000, 8) == RES_OK);
+    sd_stats_get(sd_card_p, &stats);
+    s_p = &stats.ops[SD_STATS_READ_MULTI];
+    uint32_t const rd8_us = lat_p->cmd18_us + 8 * lat_p->block_rd_us + lat_p->cmd12_us;
+    CHECK(1 == s_p->count && 8 == s_p->blocks);
+    CHECK(rd8_us == s_p->max_us);
+    CHECK(1 == s_p->hist[bucket(rd8_us)]);
+    CHECK(1 == stats.stop_transmissions);
+
+    /* Two multiple block writes, the second continuing the first (one CMD25),
+    each block waits for the previous one to be programmed */
+    CHECK(disk_write(0, buf, 3000, 4) == RES_OK);
+    CHECK(disk_write(0, buf + 4 * 512, 3004, 4) == RES_OK);
+    sd_stats_get(sd_card_p, &stats);
+    s_p = &stats.ops[SD_STATS_WRITE_MULTI];
+    CHECK(2 == s_p->count && 8 == s_p->blocks);
+    CHECK(0 == stats.ops[SD_STATS_WRITE_SINGLE].count);
+    CHECK(stats.busy_wait_us >= 7 * (uint64_t)(lat_p->busy_wr_us - lat_p->block_wr_us));
+
+    /* Sync stops the open write */
+    CHECK(disk_ioctl(0, CTRL_SYNC, 0) == RES_OK);
+    sd_stats_get(sd_card_p, &stats);
+    CHECK(1 == stats.ops[SD_STATS_SYNC].count && 0 == stats.ops[SD_STATS_SYNC].blocks);
+    CHECK(2 == stats.stop_transmissions);
+
+    /* A non-blocking read is timed from its start to its completion */
+    sd_io_req_t req;
+    memset(&req, 0, sizeof req);
+    CHECK(sd_read_blocks_async(sd_card_p, &req, buf, 4000, 2) == SD_BLOCK_DEVICE_ERROR_NONE);
+    sd_stats_get(sd_card_p, &stats);  // Doesn't wait for the card, which is busy
+    CHECK(1 == stats.ops[SD_STATS_READ_MULTI].count);
+    CHECK(sd_io_wait(&req) == SD_BLOCK_DEVICE_ERROR_NONE);
+    sd_stats_get(sd_card_p, &stats);
+    s_p = &stats.ops[SD_STATS_READ_MULTI];
+    CHECK(2 == s_p->count && 10 == s_p->blocks);
+    CHECK(s_p->total_us >= rd8_us + lat_p->cmd18_us + 2 * lat_p->block_rd_us + lat_p->cmd12_us);
+
+    /* CMD17; CMD18, CMD12; CMD25; CMD12; CMD18, CMD12 */
+    CHECK(7 == stats.commands);
+    CHECK(0 == stats.retries && 0 == stats.crc_errors);
+
+    /* Errors are counted too */
+    CHECK(sd_card_p->read_blocks(sd_card_p, buf, sd_card_p->state.sectors, 1) !=
+          SD_BLOCK_DEVICE_ERROR_NONE);
+    sd_stats_get(sd_card_p, &stats);
+    CHECK(2 == stats.ops[SD_STATS_READ_SINGLE].count);
+    CHECK(1 == stats.ops[SD_STATS_READ_SINGLE].errors);
+    CHECK(hist_consistent(&stats));
+
+    sd_stats_dump(sd_card_p, printf);
+
+    sd_stats_reset(sd_card_p);
+    sd_stats_get(sd_card_p, &stats);
+    static sd_stats_t const zero;
+    CHECK(0 == memcmp(&stats, &zero, sizeof stats));
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,150 @@
+/* stripe_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the striped (RAID-0) drive 4 (RAID/sd_card_stripe.h):
+the placement of the blocks on the members, erase, a FAT volume on it,
+and that transfers to the two members overlap. Expects the virtual clock. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "tests.h"
+
+enum { STRIPE_DRV = 4, N = 300 };
+
+static BYTE buf[N * 512];
+
+/* Each block holds its LBA */
+static void fill(LBA_t lba, UINT count) {
+    for (UINT i = 0; i < count; ++i) {
+        uint32_t v = lba + i;
+        for (size_t j = 0; j < 512; j += sizeof v) memcpy(buf + i * 512 + j, &v, sizeof v);
+    }
+}
+
+static bool holds(BYTE const *block, uint32_t v) {
+    for (size_t j = 0; j < 512; j += sizeof v)
+        if (memcmp(block + j, &v, sizeof v)) return false;
+    return true;
+}
+
+static bool placement(sd_card_t *sd_card_p) {
+    sd_stripe_if_t const *if_p = sd_card_p->stripe_if_p;
+    uint32_t const ss = if_p->stripe_sectors;
+
+    fill(50, N);  // Unaligned at both ends
+    CHECK(disk_write(STRIPE_DRV, buf, 50, N) == RES_OK);
+    CHECK(disk_ioctl(STRIPE_DRV, CTRL_SYNC, 0) == RES_OK);
+    memset(buf, 0, sizeof buf);
+    CHECK(disk_read(STRIPE_DRV, buf, 50, N) == RES_OK);
+    for (UINT i = 0; i < N; ++i) CHECK(holds(buf + i * 512, 50 + i));
+
+    /* Block l is on member (l / ss) % n, at (l / ss) / n * ss + l % ss */
+    static BYTE block[512];
+    for (uint32_t lba = 50; lba < 50 + N; lba += 17) {
+        uint32_t const stripe = lba / ss;
+        sd_card_t *member_p = if_p->members[stripe % if_p->num_members];
+        uint32_t const member_lba = stripe / if_p->num_members * ss + lba % ss;
+        CHECK(member_p->read_blocks(member_p, block, member_lba, 1) == SD_BLOCK_DEVICE_ERROR_NONE);
+        CHECK(holds(block, lba));
+    }
+
+    /* Erase, unaligned */
+    LBA_t range[2] = {60, 60 + 200 - 1};
+    CHECK(disk_ioctl(STRIPE_DRV, CTRL_TRIM, range) == RES_OK);
+    CHECK(disk_read(STRIPE_DRV, buf, 50, N) == RES_OK);
+    for (UINT i = 0; i < N; ++i) {
+        uint32_t const lba = 50 + i;
+        CHECK(holds(buf + i * 512, 60 <= lba && lba < 260 ? 0 : lba));
+    }
+    return true;
+}
+
+/* Time a write and a read of count blocks */
+static bool time_io(BYTE pdrv, UINT count, uint64_t *wr_us, uint64_t *rd_us) {
+    uint64_t t0 = time_us_64();
+    CHECK(disk_write(pdrv, buf, 0, count) == RES_OK);
+    CHECK(disk_ioctl(pdrv, CTRL_SYNC, 0) == RES_OK);
+    *wr_us = time_us_64() - t0;
+    t0 = time_us_64();
+    CHECK(disk_read(pdrv, buf, 0, count) == RES_OK);
+    *rd_us = time_us_64() - t0;
+    return true;
+}
+
+/* Two members like drive 0 take about half the time of drive 0 */
+static bool bandwidth(void) {
+    CHECK(0 == (disk_initialize(0) & STA_NOINIT));
+    uint64_t wr0, rd0, wr4, rd4;
+    CHECK(time_io(0, 256, &wr0, &rd0));
+    CHECK(time_io(STRIPE_DRV, 256, &wr4, &rd4));
+    IMSG_PRINTF("256 blocks: drive 0: write %llu us, read %llu us; "
+                "striped: write %llu us, read %llu us\n",
+                (unsigned long long)wr0, (unsigned long long)rd0,
+                (unsigned long long)wr4, (unsigned long long)rd4);
+    CHECK(wr4 * 10 < wr0 * 6);
+    CHECK(rd4 * 10 < rd0 * 6);
+    return true;
+}
+
+static bool volume(void) {
+    static BYTE work[FF_MAX_SS * 2];
+    CHECK_FR(f_mkfs("4:", 0, work, sizeof work));
+    CHECK(mount("4:"));
+    DWORD fre_clust;
+    FATFS *fs_p;
+    CHECK_FR(f_getfree("4:", &fre_clust, &fs_p));
+    // Two 32 MiB members
+    uint64_t const bytes = (uint64_t)(fs_p->n_fatent - 2) * fs_p->csize * 512;
+    CHECK(bytes > 60ull * 1024 * 1024 && bytes <= 64ull * 1024 * 1024);
+
+    FIL fil;
+    fill(0, N);
+    CHECK_FR(f_open(&fil, "4:/stripe.bin", FA_WRITE | FA_CREATE_ALWAYS));
+    UINT bw;
+    CHECK_FR(f_write(&fil, buf, sizeof buf, &bw));
+    CHECK(bw == sizeof buf);
+    CHECK_FR(f_close(&fil));
+    memset(buf, 0, sizeof buf);
+    CHECK_FR(f_open(&fil, "4:/stripe.bin", FA_READ));
+    UINT br;
+    CHECK_FR(f_read(&fil, buf, sizeof buf, &br));
+    CHECK(br == sizeof buf);
+    CHECK_FR(f_close(&fil));
+    for (UINT i = 0; i < N; ++i) CHECK(holds(buf + i * 512, i));
+    CHECK_FR(f_unmount("4:"));
+    sd_get_by_num(STRIPE_DRV)->state.mounted = false;
+    return true;
+}
+
+bool stripe_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(0 == (disk_initialize(STRIPE_DRV) & STA_NOINIT));
+    sd_card_t *sd_card_p = sd_get_by_num(STRIPE_DRV);
+    CHECK(SD_IF_STRIPE == sd_card_p->type);
+    CHECK(2 * 32 * 1024 * 1024 / 512 == sd_card_p->get_num_sectors(sd_card_p));
+    CHECK(placement(sd_card_p));
+    CHECK(bandwidth());
+    CHECK(volume());
+    return true;
+}
+/* [] END OF FILE */
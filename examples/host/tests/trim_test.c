@@ -0,0 +1,135 @@
+/* trim_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check TRIM (CTRL_TRIM) and erase_blocks:
+freeing clusters on drive 1 erases them, and an erase drops the erased sectors
+held in the sector cache (drive 3) and the write queue (drive 2). */
+
+#include <string.h>
+//
+#include "diskio.h"
+#include "f_util.h"
+#include "ff.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_cache.h"
+#include "sd_card.h"
+#include "sd_wr_queue.h"
+//
+#include "tests.h"
+
+enum { FILE_SIZE = 64 * 1024 };
+
+static bool all_zero(BYTE pdrv, LBA_t sector, UINT count) {
+    static BYTE buf[512];
+    for (UINT i = 0; i < count; ++i) {
+        CHECK(disk_read(pdrv, buf, sector + i, 1) == RES_OK);
+        for (size_t j = 0; j < sizeof buf; ++j) CHECK(0 == buf[j]);
+    }
+    return true;
+}
+
+/* Deleting a file erases its clusters */
+static bool unlink_trims(void) {
+    static const char drive[] = "1:";
+    static const char path[] = "1:/trim_test.bin";
+    CHECK(mount(drive));
+    sd_card_t *sd_card_p = sd_get_by_drive_prefix(drive);
+    sd_ram_if_state_t *st_p = &sd_card_p->ram_if_p->state;
+
+    static BYTE buf[FILE_SIZE];
+    memset(buf, 0xA5, sizeof buf);
+    FIL fil;
+    CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS));
+    UINT bw;
+    CHECK_FR(f_write(&fil, buf, sizeof buf, &bw));
+    CHECK(bw == sizeof buf);
+    FATFS *fs_p = fil.obj.fs;
+    LBA_t const first = fs_p->database + (LBA_t)fs_p->csize * (fil.obj.sclust - 2);
+    CHECK_FR(f_close(&fil));
+    CHECK(!all_zero(1, first, 1));
+
+    uint32_t const cmd38_cnt = st_p->cmd38_cnt;
+    uint64_t const blocks_erased = st_p->blocks_erased;
+    CHECK_FR(f_unlink(path));
+    CHECK(st_p->cmd38_cnt > cmd38_cnt);
+    CHECK(st_p->blocks_erased - blocks_erased >= FILE_SIZE / 512);
+    CHECK(all_zero(1, first, FILE_SIZE / 512));  // Contiguous on a fresh volume
+
+    /* The AU is read from the SD Status (ACMD13) once per initialization, not for each TRIM */
+    uint32_t const acmd13_cnt = st_p->acmd13_cnt;
+    for (int i = 0; i < 3; ++i) {
+        CHECK_FR(f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS));
+        CHECK_FR(f_write(&fil, buf, sizeof buf, &bw));
+        CHECK_FR(f_close(&fil));
+        CHECK_FR(f_unlink(path));
+    }
+    CHECK(st_p->acmd13_cnt == acmd13_cnt);
+    sd_card_p->state.m_Status |= STA_NOINIT;  // As after a card change
+    CHECK(0 == (disk_initialize(1) & STA_NOINIT));
+    size_t au_bytes;
+    CHECK(sd_allocation_unit(sd_card_p, &au_bytes));
+    CHECK(sd_allocation_unit(sd_card_p, &au_bytes));
+    CHECK(st_p->acmd13_cnt == acmd13_cnt + 1);
+
+    CHECK_FR(f_unmount(drive));
+    sd_card_p->state.mounted = false;
+    return true;
+}
+
+static bool trim(BYTE pdrv, LBA_t start, LBA_t end) {
+    LBA_t range[2] = {start, end};
+    CHECK(disk_ioctl(pdrv, CTRL_TRIM, range) == RES_OK);
+    return true;
+}
+
+/* An erase drops pending writes to the erased sectors */
+static bool layers_drop_erased(void) {
+    static BYTE buf[512];
+    memset(buf, 0x5A, sizeof buf);
+
+    CHECK(0 == (disk_initialize(3) & STA_NOINIT));
+    sd_cache_t *c_p = sd_get_by_num(3)->cache_p;
+    CHECK(c_p);
+    CHECK(disk_write(3, buf, 100, 1) == RES_OK);  // A dirty line
+    CHECK(disk_write(3, buf, 102, 1) == RES_OK);
+    uint32_t const write_backs = c_p->write_backs;
+    CHECK(trim(3, 100, 101));
+    CHECK(disk_ioctl(3, CTRL_SYNC, 0) == RES_OK);
+    CHECK(c_p->write_backs == write_backs + 1);  // Only sector 102
+    CHECK(all_zero(3, 100, 2));
+    CHECK(!all_zero(3, 102, 1));
+
+    CHECK(0 == (disk_initialize(2) & STA_NOINIT));
+    sd_wr_queue_t *q_p = sd_get_by_num(2)->wr_queue_p;
+    CHECK(q_p);
+    CHECK(disk_write(2, buf, 200, 1) == RES_OK);
+    CHECK(disk_write(2, buf, 300, 1) == RES_OK);
+    CHECK(disk_write(2, buf, 201, 1) == RES_OK);
+    CHECK(3 == q_p->count);
+    CHECK(trim(2, 200, 201));
+    CHECK(1 == q_p->count);
+    CHECK(300 == q_p->lba[0]);
+    CHECK(disk_ioctl(2, CTRL_SYNC, 0) == RES_OK);
+    CHECK(all_zero(2, 200, 2));
+    CHECK(!all_zero(2, 300, 1));
+    return true;
+}
+
+bool trim_test(void) {
+    CHECK(unlink_trims());
+    CHECK(layers_drop_erased());
+    return true;
+}
+/* [] END OF FILE */
@@ -0,0 +1,145 @@
+/* wr_queue_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check the write queue (sd_wr_queue.h) through the FatFs disk I/O API,
+comparing drive 0 (no queue) with drive 2 (same latency model, with a queue).
+Expects the virtual clock. */
+
+#include <stdlib.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sd_wr_queue.h"
+//
+#include "tests.h"
+
+enum { FAT_LBA = 50, DIR_LBA = 60, DATA_LBA = 1000, ITERATIONS = 64 };
+
+/* Log append pattern: each data sector is followed by FAT and directory updates */
+static bool log_append(BYTE pdrv, uint64_t *elapsed_p) {
+    static BYTE buf[512];
+    uint64_t start = time_us_64();
+    for (unsigned i = 0; i < ITERATIONS; ++i) {
+        memset(buf, i, sizeof buf);
+        CHECK(disk_write(pdrv, buf, DATA_LBA + i, 1) == RES_OK);
+        buf[0] = 'F';
+        CHECK(disk_write(pdrv, buf, FAT_LBA, 1) == RES_OK);
+        buf[0] = 'D';
+        CHECK(disk_write(pdrv, buf, DIR_LBA, 1) == RES_OK);
+    }
+    CHECK(disk_ioctl(pdrv, CTRL_SYNC, 0) == RES_OK);
+    *elapsed_p = time_us_64() - start;
+    return true;
+}
+
+/* Wraps drive 2's write_blocks, to fail writes that start at BAD_LBA */
+enum { BAD_LBA = 5000 };
+static block_dev_err_t (*real_write_blocks)(sd_card_t *, const uint8_t *, uint32_t, uint32_t);
+static block_dev_err_t failing_write_blocks(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                            uint32_t ulSectorNumber, uint32_t blockCnt) {
+    if (BAD_LBA == ulSectorNumber) return SD_BLOCK_DEVICE_ERROR_WRITE;
+    return real_write_blocks(sd_card_p, buffer, ulSectorNumber, blockCnt);
+}
+
+static bool same_contents(BYTE a, BYTE b, LBA_t sector, UINT count) {
+    static BYTE abuf[ITERATIONS * 512], bbuf[ITERATIONS * 512];
+    CHECK(count <= ITERATIONS);
+    CHECK(disk_read(a, abuf, sector, count) == RES_OK);
+    CHECK(disk_read(b, bbuf, sector, count) == RES_OK);
+    CHECK(0 == memcmp(abuf, bbuf, count * 512));
+    return true;
+}
+
+bool wr_queue_test(void) {
+    CHECK(host_clock_is_virtual());
+    CHECK(0 == (disk_initialize(0) & STA_NOINIT));
+    CHECK(0 == (disk_initialize(2) & STA_NOINIT));
+    sd_card_t *direct_p = sd_get_by_num(0);
+    sd_card_t *queued_p = sd_get_by_num(2);
+    CHECK(!direct_p->wr_queue_p);
+    sd_wr_queue_t *q_p = queued_p->wr_queue_p;
+    CHECK(q_p);
+    sd_ram_if_state_t *direct_st_p = &direct_p->ram_if_p->state;
+    sd_ram_if_state_t *queued_st_p = &queued_p->ram_if_p->state;
+
+    /* Same result, fewer commands, less time */
+    uint32_t const direct_cmds = direct_st_p->cmd24_cnt + direct_st_p->cmd25_cnt;
+    uint32_t const queued_cmds = queued_st_p->cmd24_cnt + queued_st_p->cmd25_cnt;
+    uint64_t direct_us, queued_us;
+    CHECK(log_append(0, &direct_us));
+    CHECK(log_append(2, &queued_us));
+    CHECK(0 == q_p->count);
+    CHECK(same_contents(0, 2, DATA_LBA, ITERATIONS));
+    CHECK(same_contents(0, 2, FAT_LBA, 1));
+    CHECK(same_contents(0, 2, DIR_LBA, 1));
+    CHECK(direct_st_p->cmd24_cnt + direct_st_p->cmd25_cnt - direct_cmds == 3 * ITERATIONS);
+    // Each flush of the full queue: one run of data sectors, and the FAT and directory sectors
+    uint32_t const flushes = (ITERATIONS + SD_WR_QUEUE_SECTORS - 3) / (SD_WR_QUEUE_SECTORS - 2);
+    CHECK(queued_st_p->cmd24_cnt + queued_st_p->cmd25_cnt - queued_cmds <= 3 * flushes);
+    IMSG_PRINTF("Log append: %llu us direct, %llu us queued\n", direct_us, queued_us);
+    CHECK(2 * queued_us < direct_us);
+
+    /* A read of a queued sector sees the new data */
+    static BYTE wbuf[SD_WR_QUEUE_SECTORS * 512], rbuf[SD_WR_QUEUE_SECTORS * 512];
+    for (size_t i = 0; i < sizeof wbuf; ++i) wbuf[i] = rand();
+    CHECK(disk_write(2, wbuf, 2000, 2) == RES_OK);
+    CHECK(2 == q_p->count);
+    CHECK(disk_read(2, rbuf, 1990, 1) == RES_OK);  // Elsewhere
+    CHECK(2 == q_p->count);
+    CHECK(disk_read(2, rbuf, 2001, 1) == RES_OK);
+    CHECK(0 == q_p->count);
+    CHECK(0 == memcmp(wbuf + 512, rbuf, 512));
+
+    /* Big writes go straight to the card */
+    uint32_t const transfers = q_p->transfers;
+    CHECK(disk_write(2, wbuf, 3000, 1) == RES_OK);
+    CHECK(disk_write(2, wbuf, 3001, SD_WR_QUEUE_SECTORS) == RES_OK);
+    CHECK(0 == q_p->count);
+    CHECK(q_p->transfers == transfers + 1);  // The flush of the one queued sector
+    CHECK(disk_read(2, rbuf, 3001, SD_WR_QUEUE_SECTORS) == RES_OK);
+    CHECK(0 == memcmp(wbuf, rbuf, sizeof rbuf));
+
+    /* Deadline */
+    CHECK(disk_write(2, wbuf, 4000, 1) == RES_OK);
+    CHECK(sd_wr_queue_poll(queued_p) == SD_BLOCK_DEVICE_ERROR_NONE);
+    CHECK(1 == q_p->count);
+    sleep_ms(q_p->deadline_ms);
+    CHECK(sd_wr_queue_poll(queued_p) == SD_BLOCK_DEVICE_ERROR_NONE);
+    CHECK(0 == q_p->count);
+
+    /* A failing run: the runs after it are still written, and the flush reports the error */
+    CHECK(disk_write(2, wbuf, BAD_LBA, 2) == RES_OK);
+    CHECK(disk_write(2, wbuf + 1024, BAD_LBA + 1000, 2) == RES_OK);
+    CHECK(4 == q_p->count);
+    real_write_blocks = queued_p->write_blocks;
+    queued_p->write_blocks = failing_write_blocks;
+    DRESULT const dr = disk_ioctl(2, CTRL_SYNC, 0);
+    queued_p->write_blocks = real_write_blocks;
+    CHECK(RES_OK != dr);
+    CHECK(0 == q_p->count);
+    CHECK(disk_read(2, rbuf, BAD_LBA + 1000, 2) == RES_OK);
+    CHECK(0 == memcmp(wbuf + 1024, rbuf, 1024));
+
+    /* Out of range writes are refused up front */
+    CHECK(disk_write(2, wbuf, queued_p->state.sectors - 1, 2) == RES_PARERR);
+    CHECK(0 == q_p->count);
+
+    return true;
+}
+/* [] END OF FILE */
@@ -26,6 +26,7 @@ See https://oshwlab.com/carlk3/rpi-pico-sd-card-expansion-module-1
 */
 
 #include "hw_config.h"
+#include "sd_hotplug.h"
 
 /*
 Pins CLK_gpio, D1_gpio, D2_gpio, and D3_gpio are at offsets from pin D0_gpio.
@@ -95,6 +96,10 @@ static sd_sdio_if_t sdio_if = {
 #endif
 };
 
+// The card is brought up in the background (see sd_hotplug.h).
+// It is exported over USB as is, so don't mount it here.
+static sd_hotplug_t hotplug = {.mount = false};
+
 // Hardware Configuration of the SD Card socket "object"
 static sd_card_t sd_card = {    
     .type = SD_IF_SDIO,
@@ -102,7 +107,8 @@ static sd_card_t sd_card = {
     // SD Card detect:
     .use_card_detect = true,
     .card_detect_gpio = 9,  
-    .card_detected_true = 0  // What the GPIO read returns when a card is present.
+    .card_detected_true = 0,  // What the GPIO read returns when a card is present.
+    .hotplug_p = &hotplug
 };
 
 /* ********************************************************************** */
@@ -13,6 +13,8 @@
 // FatFS includes for reading scripts from SD card
 #include "ff.h"
 #include "diskio.h"
+#include "sd_card.h"
+#include "sd_hotplug.h"
 
 //--------------------------------------------------------------------+
 // Configuration
@@ -362,11 +364,15 @@ int main(void) {
     tud_init(BOARD_TUD_RHPORT);
     stdio_init_all();
     
+    // Arms the Card Detect interrupt; sd_hotplug_task brings the card up
+    sd_init_driver();
+
     printf("Device initialized. Waiting for USB connection...\n");
     
     // Main loop
     while (true) {
         tud_task();
+        sd_hotplug_task();
         
         // Check button press
         if (!gpio_get(TRIGGER_BUTTON_PIN)) {
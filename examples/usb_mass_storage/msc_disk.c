@@ -46,7 +46,9 @@
 #include <pico/stdlib.h>
 //
 #include "diskio.h" /* Declarations of disk functions */
+#include "hw_config.h"
 #include "my_debug.h"
+#include "sd_hotplug.h"
 
 static bool ejected = false;  // FIXME: should be LUN specific
 
@@ -86,6 +88,9 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16
  */
 bool tud_msc_test_unit_ready_cb(uint8_t lun) {
     TRACE_PRINTF("%s(lun=%d)\n", __func__, lun);
+    sd_card_t *sd_card_p = sd_get_by_num(lun);
+    if (sd_card_p && sd_card_p->hotplug_p)
+        return sd_hotplug_ready(sd_card_p);  // Kept up to date by sd_hotplug_task
     DSTATUS ds = disk_initialize(lun);
     return (!(STA_NOINIT & ds) && !(STA_NODISK & ds));
 }
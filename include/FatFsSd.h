@@ -22,6 +22,7 @@ specific language governing permissions and limitations under the License.
 //
 #include "FatFsSd_C.h"
 //
+#include "fast_seek.h"
 #include "util.h"
 
 namespace FatFsNs {
@@ -57,9 +58,14 @@ class SdCard {
     static FRESULT mkfs(const TCHAR* path, const MKFS_PARM* opt, void* work, UINT len) { /* Create a FAT volume */
         return f_mkfs(path, opt, work, len);
     }
-    /* Create a FAT volume: format with defaults */
-    FRESULT format() {
+    /* Create a FAT volume: format with defaults,
+    or, if au_aligned, with the data area and clusters aligned on the
+    card's allocation unit (see sd_au_mkfs_parm) if the card reports it */
+    FRESULT format(bool au_aligned = false) {
         const char* name = get_name();
+        MKFS_PARM opt;
+        if (au_aligned && sd_au_mkfs_parm(m_sd_card_p, &opt))
+            return mkfs(name, &opt, 0, FF_MAX_SS * 2);
         return mkfs(name, 0, 0, FF_MAX_SS * 2);
     }
     static FRESULT fdisk(BYTE pdrv, const LBA_t ptbl[], void* work) { /* Divide a physical drive into some partitions */
@@ -133,10 +139,13 @@ class File {
         close();
     }
     FRESULT open(const TCHAR* path, BYTE mode) { /* Open or create a file */
+        fast_seek_release(&fil);
         return f_open(&fil, path, mode);
     }
     FRESULT close() { /* Close an open file object */
-        return f_close(&fil);
+        FRESULT fr = f_close(&fil);
+        fast_seek_release(&fil);
+        return fr;
     }
     FRESULT read(void* buff, UINT btr, UINT* br) { /* Read data from the file */
         return f_read(&fil, buff, btr, br);
@@ -144,15 +153,17 @@ class File {
     FRESULT write(const void* buff, UINT btw, UINT* bw) { /* Write data to the file */
         return f_write(&fil, buff, btw, bw);
     }
-    FRESULT lseek(FSIZE_t ofs) { /* Move file pointer of the file object */
-        return f_lseek(&fil, ofs);
+    /* Move file pointer of the file object. For a big file, the first seek
+    creates a link map for fast seeks (see fast_seek.h). */
+    FRESULT lseek(FSIZE_t ofs) {
+        return fast_seek_lseek(&fil, ofs);
     }
     /* Prepares or allocates a contiguous data area to the file: */
     FRESULT expand(uint64_t file_size) { 
             return f_expand(&fil, file_size, 1);
     }
     FRESULT truncate() { /* Truncate the file */
-        return f_truncate(&fil);
+        return fast_seek_truncate(&fil);
     }
     FRESULT sync() { /* Flush cached data of the writing file */
         return f_sync(&fil);
@@ -1100,6 +1100,133 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 
+#if FF_FATCACHE_LINES
+/*-----------------------------------------------------------------------*/
+/* FAT cache - Sectors of the FAT, a line of contiguous sectors at a time */
+/*-----------------------------------------------------------------------*/
+
+#if !FF_FS_READONLY
+static FRESULT fc_flush (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs,		/* Filesystem object */
+	UINT ln			/* Line to write back */
+)
+{
+	DWORD dm = fs->fc_dirty[ln];
+	LBA_t sect;
+	BYTE *p;
+	UINT s, n;
+
+
+	for (s = 0; dm != 0; s += n) {	/* Write each run of changed sectors in the line */
+		for ( ; !(dm & 1); dm >>= 1) s++;
+		for (n = 0; dm & 1; dm >>= 1) n++;
+		sect = fs->fc_sect[ln] + s;
+		p = fs->fc_buf[ln] + s * SS(fs);
+		if (disk_write(fs->pdrv, p, sect, n) != RES_OK) return FR_DISK_ERR;
+		if (fs->n_fats == 2 && disk_write(fs->pdrv, p, sect + fs->fsize, n) != RES_OK) return FR_DISK_ERR;	/* Reflect it to 2nd FAT */
+	}
+	fs->fc_dirty[ln] = 0;
+	return FR_OK;
+}
+
+
+static FRESULT fc_sync (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	FRESULT res = FR_OK;
+	UINT ln;
+
+
+	for (ln = 0; res == FR_OK && ln < FF_FATCACHE_LINES; ln++) {
+		if (fs->fc_dirty[ln]) res = fc_flush(fs, ln);
+	}
+	return res;
+}
+
+
+static void fc_overlay (
+	FATFS* fs,		/* Filesystem object */
+	BYTE* buf,		/* Sectors read from the disk */
+	LBA_t sect,		/* First sector in the buffer */
+	UINT n			/* Number of sectors in the buffer */
+)
+{
+	UINT ln, i;
+	LBA_t s;
+
+
+	for (ln = 0; ln < FF_FATCACHE_LINES; ln++) {	/* Changed sectors in the cache are newer than the disk */
+		for (i = 0; i < FF_FATCACHE_SPAN; i++) {
+			s = fs->fc_sect[ln] + i;
+			if ((fs->fc_dirty[ln] & (DWORD)1 << i) && s >= sect && s < sect + n) {
+				memcpy(buf + (s - sect) * SS(fs), fs->fc_buf[ln] + i * SS(fs), SS(fs));
+			}
+		}
+	}
+}
+#endif
+
+
+static BYTE* fc_sector (	/* Pointer to the sector data in the cache (null:disk error) */
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect,		/* Sector in the 1st FAT */
+	UINT wr			/* 1:The sector is to be changed */
+)
+{
+	LBA_t top;
+	UINT ln, i, n;
+
+
+	top = fs->fatbase + (sect - fs->fatbase) / FF_FATCACHE_SPAN * FF_FATCACHE_SPAN;	/* First sector of the line */
+	for (ln = i = 0; i < FF_FATCACHE_LINES && fs->fc_sect[i] != top; i++) {
+		if (fs->fc_used[i] < fs->fc_used[ln]) ln = i;	/* Least recently used line */
+	}
+	if (i < FF_FATCACHE_LINES) {	/* Hit */
+		ln = i;
+	} else {						/* Miss: read the line in place of the least recently used one */
+#if !FF_FS_READONLY
+		if (fs->fc_dirty[ln] && fc_flush(fs, ln) != FR_OK) return 0;
+#endif
+		n = FF_FATCACHE_SPAN;
+		if (top + n > fs->fatbase + fs->fsize) n = (UINT)(fs->fatbase + fs->fsize - top);	/* Not past the end of the FAT */
+		fs->fc_sect[ln] = 0;
+		if (disk_read(fs->pdrv, fs->fc_buf[ln], top, n) != RES_OK) return 0;
+		fs->fc_sect[ln] = top;
+	}
+	fs->fc_used[ln] = ++fs->fc_clock;
+	i = (UINT)(sect - top);
+#if !FF_FS_READONLY
+	if (wr) {
+		fs->fc_dirty[ln] |= (DWORD)1 << i;
+		if (fs->winsect == sect) fs->winsect = (LBA_t)0 - 1;	/* A copy in the window would be stale */
+	}
+#endif
+	return fs->fc_buf[ln] + i * SS(fs);
+}
+#endif
+
+
+static BYTE* fat_sector (	/* Pointer to the sector data (null:disk error) */
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect,		/* Sector in the 1st FAT */
+	UINT wr			/* 1:The sector is to be changed */
+)
+{
+#if FF_FATCACHE_LINES
+	return fc_sector(fs, sect, wr);
+#else
+	if (move_window(fs, sect) != FR_OK) return 0;
+#if !FF_FS_READONLY
+	if (wr) fs->wflag = 1;
+#endif
+	return fs->win;
+#endif
+}
+
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Synchronize filesystem and data on the storage                        */
@@ -1112,7 +1239,12 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 	FRESULT res;
 
 
+#if FF_FATCACHE_LINES
+	res = fc_sync(fs);
+	if (res == FR_OK) res = sync_window(fs);
+#else
 	res = sync_window(fs);
+#endif
 	if (res == FR_OK) {
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {	/* FAT32: Update FSInfo sector if needed */
 			/* Create FSInfo structure */
@@ -1165,6 +1297,7 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 {
 	UINT wc, bc;
 	DWORD val;
+	BYTE *p;
 	FATFS *fs = obj->fs;
 
 
@@ -1177,21 +1310,21 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 		switch (fs->fs_type) {
 		case FS_FAT12 :
 			bc = (UINT)clst; bc += bc / 2;
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc = fs->win[bc++ % SS(fs)];		/* Get 1st byte of the entry */
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc |= fs->win[bc % SS(fs)] << 8;	/* Merge 2nd byte of the entry */
+			if ((p = fat_sector(fs, fs->fatbase + (bc / SS(fs)), 0)) == 0) break;
+			wc = p[bc++ % SS(fs)];		/* Get 1st byte of the entry */
+			if ((p = fat_sector(fs, fs->fatbase + (bc / SS(fs)), 0)) == 0) break;
+			wc |= p[bc % SS(fs)] << 8;	/* Merge 2nd byte of the entry */
 			val = (clst & 1) ? (wc >> 4) : (wc & 0xFFF);	/* Adjust bit position */
 			break;
 
 		case FS_FAT16 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 2))) != FR_OK) break;
-			val = ld_word(fs->win + clst * 2 % SS(fs));		/* Simple WORD array */
+			if ((p = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 2)), 0)) == 0) break;
+			val = ld_word(p + clst * 2 % SS(fs));		/* Simple WORD array */
 			break;
 
 		case FS_FAT32 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-			val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
+			if ((p = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 4)), 0)) == 0) break;
+			val = ld_dword(p + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
 			break;
 #if FF_FS_EXFAT
 		case FS_EXFAT :
@@ -1211,8 +1344,8 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 					if (obj->n_frag != 0) {	/* Is it on the growing edge? */
 						val = 0x7FFFFFFF;	/* Generate EOC */
 					} else {
-						if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-						val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x7FFFFFFF;
+						if ((p = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 4)), 0)) == 0) break;
+						val = ld_dword(p + clst * 4 % SS(fs)) & 0x7FFFFFFF;
 					}
 					break;
 				}
@@ -1231,6 +1364,142 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 
 
 
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+/*-----------------------------------------------------------------------*/
+/* Free cluster map - Note a change in a cluster's status                */
+/*-----------------------------------------------------------------------*/
+
+#define MAP_BIT(fs, clst) (((clst) - 2) >> (fs)->map_shift)	/* Bit in fmap[] for the cluster's group */
+
+static void map_mark (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* Cluster number */
+	int free		/* Has it been freed? */
+)
+{
+	DWORD b = MAP_BIT(fs, clst);
+
+
+	if (free) {
+		fs->fmap[b / 8] |= 1 << b % 8;
+#if FF_USE_FREESCAN
+		if (b == MAP_BIT(fs, fs->scan_clst)) fs->map_sfree = 1;	/* (So the scan does not clear it when it leaves the group) */
+#endif
+	} else {
+		if (fs->map_shift == 0) fs->fmap[b / 8] &= ~(1 << b % 8);	/* (Other clusters in a group may still be free) */
+	}
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Free cluster map - Find the next group that might have a free cluster */
+/*-----------------------------------------------------------------------*/
+
+static DWORD map_next (	/* First cluster at or after clst in such a group, end if there is none */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* Cluster to search from */
+	DWORD end		/* Cluster to search up to (not included) */
+)
+{
+	DWORD b, eb, c;
+
+
+	if (clst >= end) return end;
+	b = MAP_BIT(fs, clst); eb = MAP_BIT(fs, end - 1);
+	while (b <= eb) {
+		if (b % 8 == 0 && fs->fmap[b / 8] == 0) {	/* Skip a byte at a time */
+			b += 8; continue;
+		}
+		if (fs->fmap[b / 8] & (1 << b % 8)) {
+			c = 2 + (b << fs->map_shift);
+			return (c > clst) ? c : clst;
+		}
+		b++;
+	}
+	return end;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Free cluster map - Find a contiguous free cluster block in the map    */
+/*-----------------------------------------------------------------------*/
+
+static DWORD map_find_block (	/* 0:Not found, 2..:Cluster block found (only if map_exact) */
+	FATFS* fs,	/* Filesystem object */
+	DWORD clst,	/* Cluster number to scan from */
+	DWORD ncl	/* Number of contiguous clusters to find (1..) */
+)
+{
+	DWORD val, scl, ctr, n = fs->n_fatent - 2;
+
+
+	clst -= 2;	/* The first bit in the map corresponds to cluster #2 */
+	if (clst >= n) clst = 0;
+	scl = val = clst; ctr = 0;
+	for (;;) {
+		if (ctr == 0 && val % 8 == 0 && fs->fmap[val / 8] == 0	/* Skip a byte of clusters in use at a time */
+			&& val + 8 <= n && (clst <= val || clst >= val + 8)) {
+			val += 8;
+		} else {
+			if (fs->fmap[val / 8] & (1 << val % 8)) {	/* Is it a free cluster? */
+				if (++ctr == ncl) return scl + 2;
+			} else {
+				ctr = 0;
+			}
+			val++;
+		}
+		if (val >= n) val = 0;			/* Wrap-around (a block does not) */
+		if (ctr == 0 || val == 0) {		/* Restart the block here */
+			scl = val; ctr = 0;
+		}
+		if (val == clst) return 0;		/* All clusters scanned? */
+	}
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Free cluster map - Find a free cluster on the FAT volume              */
+/*-----------------------------------------------------------------------*/
+
+static DWORD map_find (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Free cluster# */
+	FFOBJID* obj,	/* Corresponding object */
+	DWORD scl		/* Cluster to search after, up to and wrapping around */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD ncl, end, gs, ge, cs;
+	int pass, whole;
+
+
+	for (pass = 0; pass < 2; pass++) {	/* After scl, and then from the top up to scl */
+		ncl = pass ? 2 : scl + 1;
+		end = pass ? scl + 1 : fs->n_fatent;
+		for (;;) {
+			ncl = map_next(fs, ncl, end);
+			if (ncl >= end) break;
+			if (fs->map_exact) return ncl;	/* The map is as good as the FAT */
+			gs = 2 + (MAP_BIT(fs, ncl) << fs->map_shift);	/* The group */
+			ge = gs + (1UL << fs->map_shift);
+			if (ge > fs->n_fatent) ge = fs->n_fatent;
+			whole = (ncl == gs && ge <= end);
+			if (ge > end) ge = end;
+			for ( ; ncl < ge; ncl++) {	/* Read the FAT entries of the group */
+				cs = get_fat(obj, ncl);
+				if (cs == 0) return ncl;
+				if (cs == 1 || cs == 0xFFFFFFFF) return cs;
+			}
+			if (whole) {	/* It has no free cluster after all */
+				fs->fmap[MAP_BIT(fs, gs) / 8] &= ~(1 << MAP_BIT(fs, gs) % 8);
+			}
+		}
+	}
+	return 0;
+}
+
+#endif
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* FAT access - Change value of an FAT entry                             */
@@ -1251,38 +1520,42 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 		switch (fs->fs_type) {
 		case FS_FAT12:
 			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
-			p = fs->win + bc++ % SS(fs);
+			res = FR_DISK_ERR;
+			if ((p = fat_sector(fs, fs->fatbase + (bc / SS(fs)), 1)) == 0) break;
+			p += bc++ % SS(fs);
 			*p = (clst & 1) ? ((*p & 0x0F) | ((BYTE)val << 4)) : (BYTE)val;	/* Update 1st byte */
-			fs->wflag = 1;
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
-			p = fs->win + bc % SS(fs);
+			if ((p = fat_sector(fs, fs->fatbase + (bc / SS(fs)), 1)) == 0) break;
+			p += bc % SS(fs);
 			*p = (clst & 1) ? (BYTE)(val >> 4) : ((*p & 0xF0) | ((BYTE)(val >> 8) & 0x0F));	/* Update 2nd byte */
-			fs->wflag = 1;
+			res = FR_OK;
 			break;
 
 		case FS_FAT16:
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 2)));
-			if (res != FR_OK) break;
-			st_word(fs->win + clst * 2 % SS(fs), (WORD)val);	/* Simple WORD array */
-			fs->wflag = 1;
+			res = FR_DISK_ERR;
+			if ((p = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 2)), 1)) == 0) break;
+			st_word(p + clst * 2 % SS(fs), (WORD)val);	/* Simple WORD array */
+			res = FR_OK;
 			break;
 
 		case FS_FAT32:
 #if FF_FS_EXFAT
 		case FS_EXFAT:
 #endif
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 4)));
-			if (res != FR_OK) break;
+			res = FR_DISK_ERR;
+			if ((p = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 4)), 1)) == 0) break;
+			p += clst * 4 % SS(fs);
 			if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
-				val = (val & 0x0FFFFFFF) | (ld_dword(fs->win + clst * 4 % SS(fs)) & 0xF0000000);
+				val = (val & 0x0FFFFFFF) | (ld_dword(p) & 0xF0000000);
 			}
-			st_dword(fs->win + clst * 4 % SS(fs), val);
-			fs->wflag = 1;
+			st_dword(p, val);
+			res = FR_OK;
 			break;
 		}
+#if FF_USE_FREEMAP
+		if (res == FR_OK && (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT)) {	/* (exFAT: See change_bitmap) */
+			map_mark(fs, clst, val == 0);
+		}
+#endif
 	}
 	return res;
 }
@@ -1312,6 +1585,9 @@ static DWORD find_bitmap (	/* 0:Not found, 2..:Cluster block found, 0xFFFFFFFF:D
 	DWORD val, scl, ctr;
 
 
+#if FF_USE_FREEMAP
+	if (fs->map_exact) return map_find_block(fs, clst, ncl);	/* Without reading the bitmap */
+#endif
 	clst -= 2;	/* The first bit in the bitmap corresponds to cluster #2 */
 	if (clst >= fs->n_fatent - 2) clst = 0;
 	scl = val = clst; ctr = 0;
@@ -1364,6 +1640,9 @@ static FRESULT change_bitmap (
 				if (bv == (int)((fs->win[i] & bm) != 0)) return FR_INT_ERR;	/* Is the bit expected value? */
 				fs->win[i] ^= bm;	/* Flip the bit */
 				fs->wflag = 1;
+#if FF_USE_FREEMAP
+				map_mark(fs, clst++ + 2, !bv);
+#endif
 				if (--ncl == 0) return FR_OK;	/* All bits processed? */
 			} while (bm <<= 1);		/* Next bit */
 			bm = 1;
@@ -1421,6 +1700,35 @@ static FRESULT fill_last_frag (
 
 
 
+#if !FF_FS_READONLY && FF_USE_FREESCAN
+/*-----------------------------------------------------------------------*/
+/* Free cluster scan - Count a change behind the scan                    */
+/*-----------------------------------------------------------------------*/
+
+static void scan_change (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* First cluster that has been allocated or freed */
+	DWORD ncl,		/* Number of clusters */
+	int freed		/* 0:Allocated, 1:Freed */
+)
+{
+	DWORD *rf;
+
+
+	for ( ; ncl && clst < fs->scan_clst; clst++, ncl--) {	/* Clusters not scanned yet are counted when they are */
+		rf = &fs->scan_rfree[(clst - 2) / fs->scan_rsize];
+		if (freed) {
+			fs->scan_free++; (*rf)++;
+		} else {
+			fs->scan_free--; (*rf)--;
+		}
+	}
+}
+
+#endif
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Remove a cluster chain                                 */
@@ -1464,6 +1772,9 @@ static FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 			fs->free_clst++;
 			fs->fsi_flag |= 1;
 		}
+#if FF_USE_FREESCAN
+		scan_change(fs, clst, 1, 1);
+#endif
 #if FF_FS_EXFAT || FF_USE_TRIM
 		if (ecl + 1 == nxt) {	/* Is next cluster contiguous? */
 			ecl = nxt;
@@ -1584,6 +1895,10 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 			}
 		}
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
+#if FF_USE_FREEMAP
+			ncl = map_find(obj, scl);			/* Skip what the map knows to be in use */
+			if (ncl < 2 || ncl == 0xFFFFFFFF) return ncl;
+#else
 			ncl = scl;	/* Start cluster */
 			for (;;) {
 				ncl++;							/* Next cluster */
@@ -1596,6 +1911,7 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
 				if (ncl == scl) return 0;		/* No free cluster found? */
 			}
+#endif
 		}
 		res = put_fat(fs, ncl, 0xFFFFFFFF);		/* Mark the new cluster 'EOC' */
 		if (res == FR_OK && clst != 0) {
@@ -1607,6 +1923,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 		fs->last_clst = ncl;
 		if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst--;
 		fs->fsi_flag |= 1;
+#if FF_USE_FREESCAN
+		scan_change(fs, ncl, 1, 0);
+#endif
 	} else {
 		ncl = (res == FR_DISK_ERR) ? 0xFFFFFFFF : 1;	/* Failed. Generate error status */
 	}
@@ -1645,6 +1964,32 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 	return cl + *tbl;	/* Return the cluster number */
 }
 
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Stretch the CLMT with a cluster added to the chain     */
+/*-----------------------------------------------------------------------*/
+
+static void clmt_stretch (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD clst		/* Cluster added at the end of the chain */
+)
+{
+	DWORD *tbl;
+
+
+	tbl = fp->cltbl + 1;	/* Top of CLMT */
+	if (*tbl != 0) {
+		while (tbl[2] != 0) tbl += 2;	/* Last fragment */
+	}
+	if (*tbl != 0 && tbl[1] + tbl[0] == clst) {	/* Contiguous with the last fragment? */
+		tbl[0]++;			/* Stretch the fragment */
+	} else {
+		fp->cltbl = 0;		/* A new fragment might not fit in the table: disable fast seek mode */
+	}
+}
+#endif
+
 #endif	/* FF_USE_FASTSEEK */
 
 
@@ -2377,12 +2722,98 @@ static FRESULT dir_read (
 
 
 
+#if FF_DIRCACHE_SLOTS
+/*-----------------------------------------------------------------------*/
+/* Directory cache - Hash of the directory and the name to find          */
+/*-----------------------------------------------------------------------*/
+
+#if FF_USE_LFN
+#define DC_SPAN	(SZDIRE * ((FF_MAX_LFN + 12) / 13))	/* Offset from the top of an entry block to its last entry, at most */
+#else
+#define DC_SPAN	0
+#endif
+#define DC_WAYS	4	/* Slots where a name can be (from key % FF_DIRCACHE_SLOTS on) */
+
+static DWORD dc_key (	/* FNV-1a hash */
+	DIR* dp				/* Pointer to the directory object with the file name */
+)
+{
+	DWORD h = 2166136261;
+	UINT i;
+#if FF_USE_LFN
+	WCHAR *lfn = dp->obj.fs->lfnbuf;
+#endif
+
+	h = (h ^ dp->obj.sclust) * 16777619;
+#if FF_USE_LFN
+	for (i = 0; lfn[i]; i++) h = (h ^ ff_wtoupper(lfn[i])) * 16777619;	/* The name is not case sensitive */
+#else
+	for (i = 0; i < 11; i++) h = (h ^ dp->fn[i]) * 16777619;
+#endif
+	return h;
+}
+
+
+static DWORD dc_where (	/* Offset of the entry block that the directory object points to */
+	DIR* dp
+)
+{
+#if FF_USE_LFN
+	if (dp->blk_ofs != 0xFFFFFFFF) return dp->blk_ofs;	/* Top of the LFN entries (FAT) or of the entry set (exFAT) */
+#endif
+	return dp->dptr;
+}
+
+
+static UINT dc_slot (	/* Slot that has the name (FF_DIRCACHE_SLOTS:none) */
+	DIR* dp,			/* Directory object */
+	DWORD key			/* dc_key() of the name */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	UINT i, w;
+
+
+	for (w = 0; w < DC_WAYS; w++) {
+		i = (key + w) % FF_DIRCACHE_SLOTS;
+		if (fs->dc_ofs[i] != 0xFFFFFFFF && fs->dc_key[i] == key && fs->dc_clust[i] == dp->obj.sclust) return i;
+	}
+	return FF_DIRCACHE_SLOTS;
+}
+
+
+static void dc_store (
+	DIR* dp,			/* Directory object */
+	DWORD key,			/* dc_key() of the name */
+	DWORD ofs			/* Offset of the entry block */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	UINT i, w;
+
+
+	i = dc_slot(dp, key);
+	for (w = 0; i == FF_DIRCACHE_SLOTS && w < DC_WAYS; w++) {	/* Else an empty slot */
+		if (fs->dc_ofs[(key + w) % FF_DIRCACHE_SLOTS] == 0xFFFFFFFF) i = (key + w) % FF_DIRCACHE_SLOTS;
+	}
+	if (i == FF_DIRCACHE_SLOTS) i = (key + fs->dc_next++ % DC_WAYS) % FF_DIRCACHE_SLOTS;	/* Else one in turn */
+	fs->dc_key[i] = key;
+	fs->dc_clust[i] = dp->obj.sclust;
+	fs->dc_ofs[i] = ofs;
+}
+
+#endif	/* FF_DIRCACHE_SLOTS */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
 
-static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp					/* Pointer to the directory object with the file name */
+static FRESULT dir_scan (	/* FR_OK(0):succeeded, FR_NO_FILE:not in the range, !=0:error */
+	DIR* dp,				/* Pointer to the directory object with the file name */
+	DWORD ofs,				/* Offset to start at */
+	DWORD end				/* Offset after which no entry block is looked at (0xFFFFFFFF:end of the directory) */
 )
 {
 	FRESULT res;
@@ -2392,7 +2823,7 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	BYTE a, ord, sum;
 #endif
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	res = dir_sdi(dp, ofs);			/* Rewind directory object */
 	if (res != FR_OK) return res;
 #if FF_FS_EXFAT
 	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
@@ -2401,6 +2832,7 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		WORD hash = xname_sum(fs->lfnbuf);		/* Hash value of the name to find */
 
 		while ((res = DIR_READ_FILE(dp)) == FR_OK) {	/* Read an item */
+			if (dp->blk_ofs > end) { res = FR_NO_FILE; break; }	/* Out of the range */
 #if FF_MAX_LFN < 255
 			if (fs->dirbuf[XDIR_NumName] > FF_MAX_LFN) continue;		/* Skip comparison if inaccessible object name */
 #endif
@@ -2419,6 +2851,7 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
 	do {
+		if (dp->dptr > end) { res = FR_NO_FILE; break; }	/* Out of the range */
 		res = move_window(fs, dp->sect);
 		if (res != FR_OK) break;
 		c = dp->dir[DIR_Name];
@@ -2455,6 +2888,34 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 }
 
 
+static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+#if FF_DIRCACHE_SLOTS
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	DWORD key;
+	UINT i;
+
+
+	if (dp->fn[NSFLAG] & NS_NOLFN) return dir_scan(dp, 0, 0xFFFFFFFF);	/* SFN collision check in dir_register() */
+	key = dc_key(dp);
+	i = dc_slot(dp, key);
+	if (i < FF_DIRCACHE_SLOTS) {	/* Is it in the cache? */
+		res = dir_scan(dp, fs->dc_ofs[i], fs->dc_ofs[i] + DC_SPAN);	/* Look where it was */
+		if (res == FR_OK || res == FR_DISK_ERR) return res;
+		fs->dc_ofs[i] = 0xFFFFFFFF;		/* Not there any more */
+	}
+	res = dir_scan(dp, 0, 0xFFFFFFFF);	/* Read the directory from the top */
+	if (res == FR_OK) dc_store(dp, key, dc_where(dp));
+	return res;
+#else
+	return dir_scan(dp, 0, 0xFFFFFFFF);
+#endif
+}
+
+
 
 
 #if !FF_FS_READONLY
@@ -2504,6 +2965,9 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 		}
 
 		create_xdir(fs->dirbuf, fs->lfnbuf);	/* Create on-memory directory block to be written later */
+#if FF_DIRCACHE_SLOTS
+		dc_store(dp, dc_key(dp), dp->blk_ofs);
+#endif
 		return FR_OK;
 	}
 #endif
@@ -2555,6 +3019,15 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 			fs->wflag = 1;
 		}
 	}
+#if FF_DIRCACHE_SLOTS
+	if (res == FR_OK) {
+#if FF_USE_LFN
+		dc_store(dp, dc_key(dp), dp->dptr - ((sn[NSFLAG] & NS_LFN) ? SZDIRE * ((len + 12) / 13) : 0));	/* Top of the LFN entries */
+#else
+		dc_store(dp, dc_key(dp), dp->dptr);
+#endif
+	}
+#endif
 
 	return res;
 }
@@ -2576,7 +3049,18 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 	FATFS *fs = dp->obj.fs;
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
+#endif
+#if FF_DIRCACHE_SLOTS
+	UINT i;
+	DWORD ofs = dc_where(dp);
+#endif
 
+#if FF_DIRCACHE_SLOTS
+	for (i = 0; i < FF_DIRCACHE_SLOTS; i++) {	/* Forget the entry */
+		if (fs->dc_ofs[i] == ofs && fs->dc_clust[i] == dp->obj.sclust) fs->dc_ofs[i] = 0xFFFFFFFF;
+	}
+#endif
+#if FF_USE_LFN
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -3586,6 +4070,27 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 #endif	/* !FF_FS_READONLY */
 	}
 
+#if FF_FATCACHE_LINES
+	memset(fs->fc_sect, 0, sizeof fs->fc_sect);		/* Empty the FAT cache */
+	memset(fs->fc_dirty, 0, sizeof fs->fc_dirty);
+#endif
+#if FF_DIRCACHE_SLOTS
+	memset(fs->dc_ofs, 0xFF, sizeof fs->dc_ofs);	/* Empty the directory cache */
+#endif
+#if !FF_FS_READONLY && FF_USE_FREESCAN
+	fs->scan_clst = 2;		/* Start the free cluster scan over */
+	fs->scan_free = 0;
+	fs->scan_rsize = (fs->n_fatent - 2 + FF_FREESCAN_REGIONS - 1) / FF_FREESCAN_REGIONS;
+	memset(fs->scan_rfree, 0, sizeof fs->scan_rfree);
+#endif
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+	for (fs->map_shift = 0; ((fs->n_fatent - 2 - 1) >> fs->map_shift) >= FF_FREEMAP_BYTES * 8; fs->map_shift++) ;	/* Clusters for each bit */
+	memset(fs->fmap, 0xFF, sizeof fs->fmap);	/* Any group might have a free cluster, until the scan has been there */
+	fs->map_exact = 0;
+#if FF_USE_FREESCAN
+	fs->map_sfree = 0;
+#endif
+#endif
 	fs->fs_type = (BYTE)fmt;/* FAT sub-type (the filesystem object gets valid) */
 	fs->id = ++Fsid;		/* Volume mount ID */
 #if FF_USE_LFN == 1
@@ -4049,6 +4554,10 @@ FRESULT f_write (
 #if FF_USE_FASTSEEK
 					if (fp->cltbl) {
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+						if (clst == 0) {		/* Past the end of the CLMT? */
+							clst = create_chain(&fp->obj, fp->clust);	/* Stretch cluster chain, and the CLMT with it */
+							if (clst >= 2 && clst != 0xFFFFFFFF) clmt_stretch(fp, clst);
+						}
 					} else
 #endif
 					{
@@ -4809,6 +5318,166 @@ FRESULT f_stat (
 
 
 #if !FF_FS_READONLY
+#if FF_USE_FREESCAN
+/*-----------------------------------------------------------------------*/
+/* Free cluster scan - Count a cluster                                   */
+/*-----------------------------------------------------------------------*/
+
+static void scan_count (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* Cluster number */
+	int free		/* Is it free? */
+)
+{
+#if FF_USE_FREEMAP
+	DWORD b = MAP_BIT(fs, clst);
+
+
+	if (free) {
+		fs->fmap[b / 8] |= 1 << b % 8;
+		fs->map_sfree = 1;
+	}
+	if (((clst - 2 + 1) & ((1UL << fs->map_shift) - 1)) == 0 || clst + 1 == fs->n_fatent) {	/* Out of the group (a chunk may end within one) */
+		if (!fs->map_sfree) fs->fmap[b / 8] &= ~(1 << b % 8);	/* It has no free cluster */
+		fs->map_sfree = 0;
+	}
+#endif
+	if (free) {
+		fs->scan_free++; fs->scan_rfree[(clst - 2) / fs->scan_rsize]++;
+	}
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Free cluster scan - Count the free clusters in the next chunk         */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT scan_step (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Filesystem object */
+	BYTE* buf,		/* Buffer for nsect sectors (null: use the window, one sector) */
+	UINT nsect		/* Number of sectors in the buffer */
+)
+{
+	FRESULT res;
+	DWORD clst, stat, ofs, lofs;
+	LBA_t sect, base;
+	UINT i, b, n;
+	FFOBJID obj;
+
+
+	clst = fs->scan_clst;
+	if (clst >= fs->n_fatent) return FR_OK;	/* Done */
+	if (fs->fs_type == FS_FAT12) {	/* FAT12: Bit field entries, and a small FAT to scan at once */
+		obj.fs = fs;
+		do {
+			stat = get_fat(&obj, clst);
+			if (stat == 0xFFFFFFFF) return FR_DISK_ERR;
+			if (stat == 1) return FR_INT_ERR;
+			scan_count(fs, clst, stat == 0);
+		} while (++clst < fs->n_fatent);
+	} else {
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {	/* exFAT: A bit for each cluster in the allocation bitmap */
+			base = fs->bitbase;
+			ofs = (clst - 2) / 8; lofs = (fs->n_fatent - 3) / 8;
+		} else
+#endif
+		{	/* FAT16/32: A WORD/DWORD entry for each cluster in the FAT */
+			base = fs->fatbase;
+			n = (fs->fs_type == FS_FAT16) ? 2 : 4;
+			ofs = clst * n; lofs = (fs->n_fatent - 1) * n;
+		}
+		sect = base + ofs / SS(fs);
+		n = (UINT)(lofs / SS(fs) - ofs / SS(fs) + 1);	/* Sectors left */
+		if (buf && nsect) {	/* Read as many as fit in the buffer with a multiple block read */
+			if (n > nsect) n = nsect;
+			if (disk_read(fs->pdrv, buf, sect, n) != RES_OK) return FR_DISK_ERR;
+			if (fs->winsect >= sect && fs->winsect < sect + n) {	/* The window may be newer than the disk */
+				memcpy(buf + (fs->winsect - sect) * SS(fs), fs->win, SS(fs));
+			}
+#if FF_FATCACHE_LINES
+			if (base == fs->fatbase) fc_overlay(fs, buf, sect, n);	/* So may the FAT cache */
+#endif
+		} else if (base == fs->fatbase) {	/* A FAT sector at a time */
+			buf = fat_sector(fs, sect, 0);
+			if (!buf) return FR_DISK_ERR;
+			n = 1;
+		} else {			/* A bitmap sector at a time in the window */
+			res = move_window(fs, sect);
+			if (res != FR_OK) return res;
+			buf = fs->win; n = 1;
+		}
+		n *= SS(fs);
+		i = ofs % SS(fs);
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {
+			for ( ; i < n && clst < fs->n_fatent; i++) {	/* (Chunks start on a byte boundary of the bitmap) */
+				for (b = 0; b < 8 && clst < fs->n_fatent; b++, clst++) {
+					scan_count(fs, clst, !(buf[i] & (1 << b)));
+				}
+			}
+		} else
+#endif
+		{
+			for ( ; i < n && clst < fs->n_fatent; clst++) {
+				if (fs->fs_type == FS_FAT16) {
+					stat = ld_word(buf + i);
+					i += 2;
+				} else {
+					stat = ld_dword(buf + i) & 0x0FFFFFFF;
+					i += 4;
+				}
+				scan_count(fs, clst, stat == 0);
+			}
+		}
+	}
+	fs->scan_clst = clst;
+	if (clst >= fs->n_fatent && fs->free_clst != fs->scan_free) {	/* Done: now free_clst is valid */
+		fs->free_clst = fs->scan_free;
+		fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
+	}
+#if FF_USE_FREEMAP
+	if (clst >= fs->n_fatent && fs->map_shift == 0) fs->map_exact = 1;	/* Now the map is as good as the FAT */
+#endif
+	return FR_OK;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Count Number of Free Clusters a Chunk at a Time                       */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_freescan (
+	const TCHAR* path,	/* Logical drive number */
+	void* work,			/* Pointer to working buffer (null: use the window, one sector) */
+	UINT len,			/* Size of working buffer [byte] */
+	DWORD* nclst		/* Pointer to return number of free clusters (0xFFFFFFFF: not done yet) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	/* Get logical drive */
+	res = mount_volume(&path, &fs, 0);
+	if (res == FR_OK) {
+		res = scan_step(fs, (BYTE*)work, len / SS(fs));
+		if (res == FR_OK) {
+			*nclst = (fs->scan_clst < fs->n_fatent) ? 0xFFFFFFFF : fs->free_clst;
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+#endif	/* FF_USE_FREESCAN */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
@@ -4821,10 +5490,13 @@ FRESULT f_getfree (
 {
 	FRESULT res;
 	FATFS *fs;
+#if !FF_USE_FREESCAN
 	DWORD nfree, clst, stat;
 	LBA_t sect;
 	UINT i;
+	BYTE *p = 0;
 	FFOBJID obj;
+#endif
 
 
 	/* Get logical drive */
@@ -4835,6 +5507,17 @@ FRESULT f_getfree (
 		if (fs->free_clst <= fs->n_fatent - 2) {
 			*nclst = fs->free_clst;
 		} else {
+#if FF_USE_FREESCAN
+			/* Finish the free cluster scan, from wherever f_freescan() left it */
+			while (res == FR_OK && fs->scan_clst < fs->n_fatent) {
+				res = scan_step(fs, 0, 0);
+			}
+			if (res == FR_OK) {
+				*nclst = fs->scan_free;	/* Return the free clusters */
+				fs->free_clst = fs->scan_free;
+				fs->fsi_flag |= 1;
+			}
+#else
 			/* Scan FAT to obtain number of free clusters */
 			nfree = 0;
 			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
@@ -4877,14 +5560,16 @@ FRESULT f_getfree (
 					i = 0;					/* Offset in the sector */
 					do {	/* Counts numbuer of entries with zero in the FAT */
 						if (i == 0) {	/* New sector? */
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
+							p = fat_sector(fs, sect++, 0);
+							if (!p) {
+								res = FR_DISK_ERR; break;
+							}
 						}
 						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;
+							if (ld_word(p + i) == 0) nfree++;
 							i += 2;
 						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
+							if ((ld_dword(p + i) & 0x0FFFFFFF) == 0) nfree++;
 							i += 4;
 						}
 						i %= SS(fs);
@@ -4896,6 +5581,7 @@ FRESULT f_getfree (
 				fs->free_clst = nfree;	/* Now free_clst is valid */
 				fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
 			}
+#endif
 		}
 	}
 
@@ -5601,6 +6287,12 @@ FRESULT f_expand (
 #endif
 	{
 		scl = clst = stcl; ncl = 0;
+#if FF_USE_FREEMAP
+		if (fs->map_exact) {	/* Find it without reading the FAT */
+			scl = map_find_block(fs, stcl, tcl);
+			if (scl == 0) res = FR_DENIED;
+		} else
+#endif
 		for (;;) {	/* Find a contiguous cluster block */
 			n = get_fat(&fp->obj, clst);
 			if (++clst >= fs->n_fatent) clst = 2;
@@ -5643,6 +6335,9 @@ FRESULT f_expand (
 				fs->free_clst -= tcl;
 				fs->fsi_flag |= 1;
 			}
+#if FF_USE_FREESCAN
+			scan_change(fs, scl, tcl, 0);
+#endif
 		}
 	}
 
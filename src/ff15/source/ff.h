@@ -32,6 +32,35 @@ extern "C" {
 #error Wrong configuration file (ffconf.h).
 #endif
 
+/* Options added since; for configuration files that predate them */
+#ifndef FF_USE_FREESCAN
+#define FF_USE_FREESCAN	0
+#endif
+#ifndef FF_FREESCAN_REGIONS
+#define FF_FREESCAN_REGIONS	32
+#endif
+#ifndef FF_USE_FREEMAP
+#define FF_USE_FREEMAP	0
+#endif
+#ifndef FF_FREEMAP_BYTES
+#define FF_FREEMAP_BYTES	1024
+#endif
+#if FF_USE_FREEMAP && !FF_USE_FREESCAN
+#error FF_USE_FREEMAP needs FF_USE_FREESCAN
+#endif
+#ifndef FF_FATCACHE_LINES
+#define FF_FATCACHE_LINES	0
+#endif
+#ifndef FF_FATCACHE_SPAN
+#define FF_FATCACHE_SPAN	4
+#endif
+#if FF_FATCACHE_LINES && (FF_FATCACHE_SPAN < 1 || FF_FATCACHE_SPAN > 32)
+#error Wrong FF_FATCACHE_SPAN setting
+#endif
+#ifndef FF_DIRCACHE_SLOTS
+#define FF_DIRCACHE_SLOTS	0
+#endif
+
 
 /* Integer types used for FatFs API */
 
@@ -151,6 +180,20 @@ typedef struct {
 #if !FF_FS_READONLY
 	DWORD	last_clst;		/* Last allocated cluster */
 	DWORD	free_clst;		/* Number of free clusters */
+#if FF_USE_FREESCAN
+	DWORD	scan_clst;		/* Free cluster scan: next cluster to scan (n_fatent: done) */
+	DWORD	scan_free;		/* Free cluster scan: number of free clusters below scan_clst */
+	DWORD	scan_rsize;		/* Free cluster scan: number of clusters in each region */
+	DWORD	scan_rfree[FF_FREESCAN_REGIONS];	/* Free cluster scan: number of free clusters in each region */
+#endif
+#if FF_USE_FREEMAP
+	BYTE	map_shift;		/* Free cluster map: clusters for each bit (log2) */
+	BYTE	map_exact;		/* Free cluster map: 1:A bit for each cluster, and all of them scanned */
+#if FF_USE_FREESCAN
+	BYTE	map_sfree;		/* Free cluster map: 1:A free cluster seen in the group being scanned */
+#endif
+	BYTE	fmap[FF_FREEMAP_BYTES];	/* Free cluster map: bit 1:Group might have a free cluster, 0:It has none */
+#endif
 #endif
 #if FF_FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
@@ -168,6 +211,19 @@ typedef struct {
 	LBA_t	database;		/* Data base sector */
 #if FF_FS_EXFAT
 	LBA_t	bitbase;		/* Allocation bitmap base sector */
+#endif
+#if FF_FATCACHE_LINES
+	DWORD	fc_clock;		/* FAT cache: access count */
+	LBA_t	fc_sect[FF_FATCACHE_LINES];		/* FAT cache: first sector of each line (0:empty) */
+	DWORD	fc_used[FF_FATCACHE_LINES];		/* FAT cache: fc_clock at the last access to each line */
+	DWORD	fc_dirty[FF_FATCACHE_LINES];	/* FAT cache: changed sectors of each line (bit0:first sector) */
+	BYTE	fc_buf[FF_FATCACHE_LINES][FF_FATCACHE_SPAN * FF_MAX_SS];	/* FAT cache: data of each line */
+#endif
+#if FF_DIRCACHE_SLOTS
+	UINT	dc_next;		/* Directory cache: turn of the slot to be replaced */
+	DWORD	dc_key[FF_DIRCACHE_SLOTS];		/* Directory cache: hash of the directory and the name in each slot */
+	DWORD	dc_clust[FF_DIRCACHE_SLOTS];	/* Directory cache: start cluster of the directory (0:root) */
+	DWORD	dc_ofs[FF_DIRCACHE_SLOTS];		/* Directory cache: offset of the entry block (0xFFFFFFFF:empty) */
 #endif
 	LBA_t	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
@@ -323,6 +379,7 @@ FRESULT f_chdir (const TCHAR* path);								/* Change current directory */
 FRESULT f_chdrive (const TCHAR* path);								/* Change current drive */
 FRESULT f_getcwd (TCHAR* buff, UINT len);							/* Get current directory */
 FRESULT f_getfree (const TCHAR* path, DWORD* nclst, FATFS** fatfs);	/* Get number of free clusters on the drive */
+FRESULT f_freescan (const TCHAR* path, void* work, UINT len, DWORD* nclst);	/* Count free clusters on the drive a chunk at a time */
 FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume label */
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
@@ -0,0 +1,65 @@
+/* host_stubs.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Replacements, for the Linux host, for the parts of the library
+that only make sense on the Pico: the SPI and SDIO drivers, crash.c and my_rtc.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+//
+#include "crash.h"
+#include "ff.h"
+#include "my_debug.h"
+#include "sd_card.h"
+
+/* The SPI and SDIO interfaces need the hardware */
+
+void sd_spi_ctor(sd_card_t *sd_card_p) {
+    (void)sd_card_p;
+    EMSG_PRINTF("SPI attached cards are not supported on the host\n");
+    myASSERT(false);
+}
+uint32_t sd_go_idle_state(sd_card_t *sd_card_p) {
+    (void)sd_card_p;
+    return 0;
+}
+bool my_spi_init(spi_t *spi_p) {
+    (void)spi_p;
+    return false;
+}
+void sd_sdio_ctor(sd_card_t *sd_card_p) {
+    (void)sd_card_p;
+    EMSG_PRINTF("SDIO attached cards are not supported on the host\n");
+    myASSERT(false);
+}
+
+/* crash.c */
+
+void capture_assert(const char *file, int line, const char *func, const char *pred) {
+    fprintf(stderr, "%s:%d: %s: assertion \"%s\" failed\n", file, line, func, pred);
+    fflush(stdout);
+    abort();
+}
+
+/* my_rtc.c */
+
+DWORD get_fattime(void) {
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    return ((DWORD)(tm.tm_year + 1900 - 1980) << 25) | ((DWORD)(tm.tm_mon + 1) << 21) |
+           ((DWORD)tm.tm_mday << 16) | ((DWORD)tm.tm_hour << 11) | ((DWORD)tm.tm_min << 5) |
+           ((DWORD)tm.tm_sec >> 1);
+}
@@ -0,0 +1,9 @@
+/* hardware/dma.h (host): types only */
+
+#pragma once
+
+#include "pico.h"
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
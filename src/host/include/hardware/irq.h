@@ -0,0 +1,13 @@
+/* hardware/irq.h (host)
+
+Only the GPIO bank interrupt does anything: see hardware/gpio.h. */
+
+#pragma once
+
+#include "pico.h"
+
+typedef void (*irq_handler_t)(void);
+
+enum { IO_IRQ_BANK0 = 13 };
+
+void irq_set_enabled(uint num, bool enabled);
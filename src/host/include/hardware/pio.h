@@ -0,0 +1,15 @@
+/* hardware/pio.h (host): types only */
+
+#pragma once
+
+#include "pico.h"
+
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t *PIO;
+
+typedef struct {
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+} pio_sm_config;
@@ -0,0 +1,7 @@
+/* hardware/spi.h (host): types only */
+
+#pragma once
+
+#include "pico.h"
+
+typedef struct spi_inst spi_inst_t;
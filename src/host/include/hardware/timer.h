@@ -0,0 +1,20 @@
+/* hardware/timer.h (host) */
+
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t time_us_64(void);
+static inline uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+
+void busy_wait_us(uint64_t delay_us);
+static inline void busy_wait_us_32(uint32_t delay_us) { busy_wait_us(delay_us); }
+static inline void busy_wait_ms(uint32_t delay_ms) { busy_wait_us(1000ULL * delay_ms); }
+
+#ifdef __cplusplus
+}
+#endif
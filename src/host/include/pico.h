@@ -0,0 +1,66 @@
+/* pico.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Minimal stand-in for the Pico SDK, for building the library on a Linux host.
+Only what the portable parts of the library (FatFs, glue.c, sd_card.c, the RAM driver,
+ff_stdio.c, f_util.c, ...) need is provided. */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+//
+#include "pico/types.h"
+
+#ifndef PICO_ON_DEVICE
+#define PICO_ON_DEVICE 0
+#endif
+
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) __attribute__((noinline)) func_name
+#define __in_flash(group)
+#define __uninitialized_ram(var) var
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+#define __compiler_memory_barrier() __asm__ volatile("" : : : "memory")
+
+#define __breakpoint() abort()
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void panic(const char *fmt, ...) __attribute__((noreturn, format(__printf__, 1, 2)));
+
+// With the virtual clock (see pico/time.h), each call advances time by 1 us,
+// so that spin loops waiting for time to pass terminate.
+void tight_loop_contents(void);
+
+// A thread stands in for a core: host_set_core_num(1) makes it core 1.
+extern __thread uint host_core_num;
+static inline uint get_core_num(void) { return host_core_num; }
+static inline void host_set_core_num(uint core) { host_core_num = core; }
+
+#ifdef __cplusplus
+}
+#endif
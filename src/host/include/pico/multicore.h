@@ -0,0 +1,27 @@
+/* pico/multicore.h (host): core 1 is a thread, and the inter-core FIFOs are queues
+
+multicore_launch_core1 starts a thread that is core 1 (see get_core_num in pico.h)
+and runs the entry function. As on the RP2040, each direction has an 8 word FIFO,
+and a push to a full FIFO (or a pop from an empty one) blocks.
+*/
+
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void multicore_launch_core1(void (*entry)(void));
+void multicore_reset_core1(void);  // Waits for the entry function to return
+
+bool multicore_fifo_rvalid(void);
+bool multicore_fifo_wready(void);
+void multicore_fifo_push_blocking(uint32_t data);
+uint32_t multicore_fifo_pop_blocking(void);
+void multicore_fifo_drain(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,46 @@
+/* pico/mutex.h (host): Pico SDK mutexes on POSIX threads */
+
+#pragma once
+
+#include <pthread.h>
+#include <time.h>
+//
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mutex {
+    pthread_mutex_t m;
+    bool initialized;
+} mutex_t;
+
+#define auto_init_mutex(name) static mutex_t name = {PTHREAD_MUTEX_INITIALIZER, true}
+
+static inline void mutex_init(mutex_t *mtx) {
+    pthread_mutex_init(&mtx->m, NULL);
+    mtx->initialized = true;
+}
+static inline bool mutex_is_initialized(mutex_t *mtx) { return mtx->initialized; }
+static inline void mutex_enter_blocking(mutex_t *mtx) { pthread_mutex_lock(&mtx->m); }
+static inline bool mutex_try_enter(mutex_t *mtx, uint32_t *owner_out) {
+    (void)owner_out;
+    return 0 == pthread_mutex_trylock(&mtx->m);
+}
+static inline bool mutex_enter_timeout_ms(mutex_t *mtx, uint32_t timeout_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return 0 == pthread_mutex_timedlock(&mtx->m, &ts);
+}
+static inline void mutex_exit(mutex_t *mtx) { pthread_mutex_unlock(&mtx->m); }
+
+#ifdef __cplusplus
+}
+#endif
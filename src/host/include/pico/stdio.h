@@ -0,0 +1,18 @@
+/* pico/stdio.h (host) */
+
+#pragma once
+
+#include <stdio.h>
+//
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline bool stdio_init_all(void) { return true; }
+static inline void stdio_flush(void) { fflush(stdout); }
+
+#ifdef __cplusplus
+}
+#endif
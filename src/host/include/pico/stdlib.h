@@ -0,0 +1,9 @@
+/* pico/stdlib.h (host) */
+
+#pragma once
+
+#include "pico.h"
+//
+#include "hardware/gpio.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
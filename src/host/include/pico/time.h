@@ -0,0 +1,44 @@
+/* pico/time.h (host)
+
+By default, time is the host's monotonic clock.
+With host_clock_set_virtual(true), time only advances when something
+sleeps or busy waits (e.g., the latency model of the RAM driver), which makes
+timings deterministic and independent of the speed of the host.
+*/
+
+#pragma once
+
+#include "pico.h"
+#include "hardware/timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline absolute_time_t get_absolute_time(void) { return time_us_64(); }
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) { return time_us_64() + us; }
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return time_us_64() + 1000ULL * ms;
+}
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) { return t + us; }
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) {
+    return t + 1000ULL * ms;
+}
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+static inline bool time_reached(absolute_time_t t) { return time_us_64() >= t; }
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void sleep_until(absolute_time_t target);
+
+// Host only
+void host_clock_set_virtual(bool virtual_clock);
+bool host_clock_is_virtual(void);
+void host_clock_advance_us(uint64_t us);
+
+#ifdef __cplusplus
+}
+#endif
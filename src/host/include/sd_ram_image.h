@@ -0,0 +1,42 @@
+/* sd_ram_image.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Back a RAM "SD card" (SD_IF_RAM) with a memory mapped image file (host only).
+The image can be, e.g., a dd copy of a real card, and the result can be
+examined with ordinary tools (e.g., mount -o loop, fsck.vfat). */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Map the image file at pathname into ram_if_p->data.
+If sectors is zero, the size of the medium is the size of the file;
+otherwise, the file is created or extended as necessary.
+Call before the card is initialized. */
+bool sd_ram_image_map(sd_ram_if_t *ram_if_p, const char *pathname, uint32_t sectors);
+
+/* Write back and unmap. Call after the card is deinitialized. */
+void sd_ram_image_unmap(sd_ram_if_t *ram_if_p);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,228 @@
+/* pico_host.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Implementation of the Pico SDK stand-in for Linux hosts. See include/pico.h. */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+//
+#include "hardware/gpio.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+
+/* Cores */
+
+__thread uint host_core_num;
+
+/* Time */
+
+static bool virtual_clock;
+static uint64_t virtual_us;  // Accessed with __atomic builtins: may be shared by threads
+static uint64_t boot_ns;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t time_us_64(void) {
+    if (virtual_clock) return __atomic_load_n(&virtual_us, __ATOMIC_SEQ_CST);
+    if (!boot_ns) boot_ns = monotonic_ns();
+    return (monotonic_ns() - boot_ns) / 1000;
+}
+
+void host_clock_set_virtual(bool virt) {
+    if (virt && !virtual_clock) __atomic_store_n(&virtual_us, time_us_64(), __ATOMIC_SEQ_CST);
+    virtual_clock = virt;
+}
+bool host_clock_is_virtual(void) { return virtual_clock; }
+
+void host_clock_advance_us(uint64_t us) {
+    __atomic_add_fetch(&virtual_us, us, __ATOMIC_SEQ_CST);
+}
+
+void tight_loop_contents(void) {
+    if (virtual_clock) host_clock_advance_us(1);
+}
+
+void busy_wait_us(uint64_t delay_us) {
+    if (virtual_clock) {
+        host_clock_advance_us(delay_us);
+        return;
+    }
+    uint64_t start = time_us_64();
+    while (time_us_64() - start < delay_us) tight_loop_contents();
+}
+
+void sleep_us(uint64_t us) {
+    if (virtual_clock) {
+        host_clock_advance_us(us);
+        return;
+    }
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (long)(us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+}
+void sleep_ms(uint32_t ms) { sleep_us(1000ULL * ms); }
+void sleep_until(absolute_time_t target) {
+    uint64_t now = time_us_64();
+    if (now < target) sleep_us(target - now);
+}
+
+/* GPIO */
+
+static bool gpio_levels[NUM_BANK0_GPIOS];
+static uint32_t gpio_irq_enables[NUM_BANK0_GPIOS];
+static uint32_t gpio_irq_events[NUM_BANK0_GPIOS];
+static irq_handler_t gpio_raw_handlers[4];
+static bool bank0_irq_enabled;
+
+void gpio_init(uint gpio) { (void)gpio; }
+void gpio_set_dir(uint gpio, bool out) { (void)gpio, (void)out; }
+void gpio_put(uint gpio, bool value) {
+    if (gpio >= NUM_BANK0_GPIOS || gpio_levels[gpio] == value) return;
+    gpio_levels[gpio] = value;
+    uint32_t const edge = value ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+    if (!(gpio_irq_enables[gpio] & edge)) return;
+    gpio_irq_events[gpio] |= edge;
+    if (!bank0_irq_enabled) return;
+    for (size_t i = 0; i < count_of(gpio_raw_handlers); ++i)
+        if (gpio_raw_handlers[i]) gpio_raw_handlers[i]();
+}
+bool gpio_get(uint gpio) { return gpio < NUM_BANK0_GPIOS ? gpio_levels[gpio] : false; }
+void gpio_set_pulls(uint gpio, bool up, bool down) {
+    // With nothing driving the pin, the pull decides the level
+    if (up != down) gpio_put(gpio, up);
+}
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled) {
+    if (gpio >= NUM_BANK0_GPIOS) return;
+    if (enabled)
+        gpio_irq_enables[gpio] |= event_mask;
+    else
+        gpio_irq_enables[gpio] &= ~event_mask;
+    gpio_irq_events[gpio] &= gpio_irq_enables[gpio];
+}
+void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler) {
+    gpio_add_raw_irq_handler_masked64(1ull << gpio, handler);
+}
+void gpio_add_raw_irq_handler_masked64(uint64_t gpio_mask, irq_handler_t handler) {
+    (void)gpio_mask;
+    for (size_t i = 0; i < count_of(gpio_raw_handlers); ++i) {
+        if (handler == gpio_raw_handlers[i]) return;
+        if (!gpio_raw_handlers[i]) {
+            gpio_raw_handlers[i] = handler;
+            return;
+        }
+    }
+    fprintf(stderr, "%s: too many handlers\n", __func__);
+    abort();
+}
+uint32_t gpio_get_irq_event_mask(uint gpio) {
+    return gpio < NUM_BANK0_GPIOS ? gpio_irq_events[gpio] : 0;
+}
+void gpio_acknowledge_irq(uint gpio, uint32_t event_mask) {
+    if (gpio < NUM_BANK0_GPIOS) gpio_irq_events[gpio] &= ~event_mask;
+}
+void irq_set_enabled(uint num, bool enabled) {
+    if (IO_IRQ_BANK0 == num) bank0_irq_enabled = enabled;
+}
+
+/* Multicore */
+
+#define FIFO_DEPTH 8
+
+static struct {
+    uint32_t words[FIFO_DEPTH];
+    unsigned head, count;
+} fifos[2];  // Indexed by the receiving core
+static pthread_mutex_t fifo_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fifo_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t core1_thread;
+static bool core1_launched;
+
+static void *core1_main(void *arg) {
+    host_set_core_num(1);
+    void (*entry)(void) = (void (*)(void))arg;
+    entry();
+    return NULL;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    if (core1_launched) multicore_reset_core1();
+    if (pthread_create(&core1_thread, NULL, core1_main, (void *)entry))
+        panic("%s: pthread_create failed", __func__);
+    core1_launched = true;
+}
+
+void multicore_reset_core1(void) {
+    if (!core1_launched) return;
+    pthread_join(core1_thread, NULL);
+    core1_launched = false;
+}
+
+bool multicore_fifo_rvalid(void) {
+    pthread_mutex_lock(&fifo_mutex);
+    bool valid = fifos[get_core_num()].count;
+    pthread_mutex_unlock(&fifo_mutex);
+    return valid;
+}
+
+bool multicore_fifo_wready(void) {
+    pthread_mutex_lock(&fifo_mutex);
+    bool ready = fifos[get_core_num() ^ 1].count < FIFO_DEPTH;
+    pthread_mutex_unlock(&fifo_mutex);
+    return ready;
+}
+
+void multicore_fifo_push_blocking(uint32_t data) {
+    pthread_mutex_lock(&fifo_mutex);
+    __typeof__(fifos[0]) *fifo_p = &fifos[get_core_num() ^ 1];
+    while (FIFO_DEPTH == fifo_p->count) pthread_cond_wait(&fifo_cond, &fifo_mutex);
+    fifo_p->words[(fifo_p->head + fifo_p->count++) % FIFO_DEPTH] = data;
+    pthread_cond_broadcast(&fifo_cond);
+    pthread_mutex_unlock(&fifo_mutex);
+}
+
+uint32_t multicore_fifo_pop_blocking(void) {
+    pthread_mutex_lock(&fifo_mutex);
+    __typeof__(fifos[0]) *fifo_p = &fifos[get_core_num()];
+    while (!fifo_p->count) pthread_cond_wait(&fifo_cond, &fifo_mutex);
+    uint32_t data = fifo_p->words[fifo_p->head];
+    fifo_p->head = (fifo_p->head + 1) % FIFO_DEPTH;
+    --fifo_p->count;
+    pthread_cond_broadcast(&fifo_cond);
+    pthread_mutex_unlock(&fifo_mutex);
+    return data;
+}
+
+void multicore_fifo_drain(void) {
+    pthread_mutex_lock(&fifo_mutex);
+    fifos[get_core_num()].count = 0;
+    pthread_cond_broadcast(&fifo_cond);
+    pthread_mutex_unlock(&fifo_mutex);
+}
+
+/* Runtime */
+
+void panic(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    abort();
+}
@@ -0,0 +1,70 @@
+/* sd_ram_image.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+//
+#include "my_debug.h"
+#include "sd_card_constants.h"
+//
+#include "sd_ram_image.h"
+
+bool sd_ram_image_map(sd_ram_if_t *ram_if_p, const char *pathname, uint32_t sectors) {
+    myASSERT(!ram_if_p->data);
+    int fd = open(pathname, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        EMSG_PRINTF("open(%s) failed: %s\n", pathname, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        EMSG_PRINTF("fstat(%s) failed: %s\n", pathname, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (!sectors) sectors = st.st_size / sd_block_size;
+    size_t size = (size_t)sectors * sd_block_size;
+    if (!size) {
+        EMSG_PRINTF("%s: empty image\n", pathname);
+        close(fd);
+        return false;
+    }
+    if ((size_t)st.st_size < size && ftruncate(fd, size) < 0) {
+        EMSG_PRINTF("ftruncate(%s) failed: %s\n", pathname, strerror(errno));
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping keeps the file open
+    if (MAP_FAILED == p) {
+        EMSG_PRINTF("mmap(%s) failed: %s\n", pathname, strerror(errno));
+        return false;
+    }
+    ram_if_p->data = p;
+    ram_if_p->sectors = sectors;
+    return true;
+}
+
+void sd_ram_image_unmap(sd_ram_if_t *ram_if_p) {
+    if (!ram_if_p->data) return;
+    size_t size = (size_t)ram_if_p->sectors * sd_block_size;
+    msync(ram_if_p->data, size, MS_SYNC);
+    munmap(ram_if_p->data, size);
+    ram_if_p->data = NULL;
+}
+/* [] END OF FILE */
@@ -68,6 +68,20 @@ extern const char m_Crc7Table[];
  */
 uint16_t crc16(uint8_t const *data, int const length);
 
+/**
+ * @brief Continue a CRC16 checksum over more data.
+ * 
+ * crc16_update(crc16(a, n), b, m) is the CRC16 of the n bytes at a followed by
+ * the m bytes at b. E.g., to preload the DMA sniffer with the CRC16 of the
+ * bytes of a block that were already received.
+ * 
+ * @param crc The CRC16 of the data so far (0 for none).
+ * @param data The data that follows.
+ * @param length The length of the data in bytes.
+ * @return The calculated checksum.
+ */
+uint16_t crc16_update(uint16_t crc, uint8_t const *data, int const length);
+
 #endif
 
 /* [] END OF FILE */
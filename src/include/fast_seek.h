@@ -0,0 +1,95 @@
+/* fast_seek.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Automatic fast seek for big files
+
+Without a cluster link map table (CLMT), f_lseek finds the cluster at the new
+position by following the file's cluster chain through the FAT from the start
+(or, going forward, from the current cluster), which takes a FAT read for every
+FAT sector that the chain passes through. With FF_USE_FASTSEEK, FatFs can use a
+CLMT instead: a list of the file's fragments (runs of contiguous clusters), in RAM.
+But the application has to provide the table, make it big enough, create the map
+with f_lseek(fp, CREATE_LINKMAP), and keep it in step with the file.
+
+These functions do that for files of at least FAST_SEEK_MIN_SIZE bytes.
+The C++ File class (FatFsSd.h) and ff_stdio.c (ff_fopen, ff_fseek, ...) use them.
+The map is created at the first seek (so that a file that is only read or
+written from start to end never needs one), in a table from a pool of
+FAST_SEEK_POOL_DWORDS DWORDs, allocated in chunks of FAST_SEEK_CHUNK_DWORDS.
+A table holds (chunks * FAST_SEEK_CHUNK_DWORDS - 2) / 2 fragments.
+
+When f_write stretches a file (see clmt_stretch in ff.c), the map grows with it
+as long as the new clusters are contiguous with the file's last fragment.
+When a new fragment is started, or the file is truncated, or extended by a seek
+past its end, the file leaves fast seek mode, and the map is created again,
+in a bigger table if need be, at the next seek.
+If the pool has no room (or FAST_SEEK_FILES files already have a table),
+f_lseek just follows the chain, as usual.
+
+Usage:
+    FIL fil;
+    f_open(&fil, path, FA_READ);
+    fast_seek_lseek(&fil, ofs);  // instead of f_lseek
+    ...
+    f_close(&fil);
+    fast_seek_release(&fil);  // Returns the table (if any) to the pool
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "ff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef FAST_SEEK_MIN_SIZE
+#define FAST_SEEK_MIN_SIZE (1024 * 1024)  // Bytes
+#endif
+#ifndef FAST_SEEK_POOL_DWORDS
+#define FAST_SEEK_POOL_DWORDS 1024
+#endif
+#ifndef FAST_SEEK_CHUNK_DWORDS
+#define FAST_SEEK_CHUNK_DWORDS 16
+#endif
+#ifndef FAST_SEEK_FILES
+#define FAST_SEEK_FILES 8  // Files that can have a table at the same time
+#endif
+
+typedef struct fast_seek_stats_t {
+    uint32_t maps_created;  // f_lseek(CREATE_LINKMAP) calls that succeeded
+    uint32_t no_room;       // Times that there was no table for a file that needed one
+    size_t chunks_used;     // Chunks of the pool in use now
+} fast_seek_stats_t;
+
+/* Like f_lseek. Creates the map first, if the file is big enough and does not have one. */
+FRESULT fast_seek_lseek(FIL *fp, FSIZE_t ofs);
+
+/* Like f_truncate; the file leaves fast seek mode until the next seek */
+FRESULT fast_seek_truncate(FIL *fp);
+
+/* Return the file's table (if any) to the pool, and leave fast seek mode.
+Call it after f_close (whatever it returns), or before reusing the FIL. */
+void fast_seek_release(FIL *fp);
+
+void fast_seek_get_stats(fast_seek_stats_t *stats_p);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
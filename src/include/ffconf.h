@@ -42,6 +42,33 @@
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
+#ifndef FF_USE_FREESCAN
+#define FF_USE_FREESCAN	0
+#endif
+#ifndef FF_FREESCAN_REGIONS
+#define FF_FREESCAN_REGIONS	32
+#endif
+/* This option switches f_freescan() function, which counts the free clusters a
+/  chunk at a time (e.g., from the idle loop), so that f_getfree() does not have to
+/  scan the whole FAT at once. It also keeps the number of free clusters in each of
+/  FF_FREESCAN_REGIONS equal parts of the volume. (0:Disable or 1:Enable) */
+
+
+#ifndef FF_USE_FREEMAP
+#define FF_USE_FREEMAP	0
+#endif
+#ifndef FF_FREEMAP_BYTES
+#define FF_FREEMAP_BYTES	1024
+#endif
+/* This option switches a map of the free clusters in RAM, which cluster allocation
+/  and f_expand() use instead of reading the FAT (or exFAT allocation bitmap). It takes
+/  FF_FREEMAP_BYTES in each filesystem object. When the volume has more clusters than
+/  there are bits, each bit stands for a group of clusters (e.g., all of the entries in
+/  a FAT sector), and allocation reads the FAT only for groups that might have a free
+/  cluster. The free cluster scan (see FF_USE_FREESCAN) fills in the map, so until it
+/  is done, allocation reads the FAT as usual. (0:Disable or 1:Enable) */
+
+
 #define FF_USE_CHMOD	0
 /* This option switches attribute manipulation functions, f_chmod() and f_utime().
 /  (0:Disable or 1:Enable) Also FF_FS_READONLY needs to be 0 to enable this option. */
@@ -166,7 +193,9 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
+#ifndef FF_VOLUMES
 # define FF_VOLUMES		4
+#endif
 /* Number of volumes (logical drives) to be used. (1-10) */
 
 
@@ -213,7 +242,7 @@
 /  f_fdisk function. 0x100000000 max. This option has no effect when FF_LBA64 == 0. */
 
 
-#define FF_USE_TRIM		0
+#define FF_USE_TRIM		1
 /* This option switches support for ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable Trim function, also CTRL_TRIM command should be implemented to the
 /  disk_ioctl() function. */
@@ -263,6 +292,36 @@
 */
 
 
+#ifndef FF_FATCACHE_LINES
+#define FF_FATCACHE_LINES	0
+#endif
+#ifndef FF_FATCACHE_SPAN
+#define FF_FATCACHE_SPAN	4
+#endif
+/* The option FF_FATCACHE_LINES switches a cache of FAT sectors in the filesystem
+/  object, apart from the window that FAT, directory and bitmap accesses otherwise
+/  share. It has FF_FATCACHE_LINES lines of FF_FATCACHE_SPAN (1 to 32) contiguous
+/  sectors each; a line is read with a multiple block read and replaces the least
+/  recently used one. Changed sectors are written back, to both FATs, a run of
+/  sectors at a time, when their line is replaced or the volume is synchronized.
+/  Following a long cluster chain (f_lseek(), remove_chain) then takes a disk read
+/  for every FF_FATCACHE_SPAN FAT sectors rather than for each one. It takes
+/  FF_FATCACHE_LINES * FF_FATCACHE_SPAN * FF_MAX_SS bytes. (0:Disable) */
+
+
+#ifndef FF_DIRCACHE_SLOTS
+#define FF_DIRCACHE_SLOTS	0
+#endif
+/* The option FF_DIRCACHE_SLOTS switches a cache of where names were found in their
+/  directories, in the filesystem object. Each of its FF_DIRCACHE_SLOTS slots holds
+/  a hash of a directory and a name, and the offset of the entry block; a name can
+/  be in any of the 4 slots from its hash on. A name that was found or created since
+/  the volume was mounted is then looked for there first, rather than by reading the
+/  directory from the top. Entries that are removed are forgotten, and an entry that
+/  is not where the cache says is looked for the usual way, so the cache never
+/  changes what is found. It takes FF_DIRCACHE_SLOTS * 12 bytes. (0:Disable) */
+
+
 #define FF_FS_LOCK		16
 /* The option FF_FS_LOCK switches file lock function to control duplicated file open
 /  and illegal operation to open objects. This option must be 0 when FF_FS_READONLY
@@ -5,6 +5,7 @@
 
 typedef struct {
     uint32_t sd_command;
+    uint32_t sd_erase;
     unsigned sd_command_retries;
     unsigned sd_lock;
     unsigned sd_spi_read;
@@ -0,0 +1,276 @@
+/* sd_card_fault.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Fault injecting virtual card. See sd_card_fault.h. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sd_card_constants.h"
+//
+#include "sd_card_fault.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+#define FAULT (*sd_card_p->fault_if_p)
+#define STATE sd_card_p->fault_if_p->state
+
+static char const *const kind_names[] = {"CRC", "timeout", "write reject", "busy", "removal"};
+
+char const *sd_fault_kind_name(sd_fault_kind_t kind) {
+    return kind < count_of(kind_names) ? kind_names[kind] : "?";
+}
+
+/* xorshift32: repeatable for a given seed */
+static uint32_t next_random(sd_card_t *sd_card_p) {
+    uint32_t x = STATE.rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    STATE.rng = x;
+    return x;
+}
+
+/* The first rule that fires for this request, if any.
+*lba_p gets the first block of the request in the rule's range. */
+static sd_fault_rule_t *fire(sd_card_t *sd_card_p, uint8_t op, uint32_t sector, uint32_t count,
+                             uint32_t *lba_p) {
+    uint32_t const last = sector + count - 1;
+    for (size_t i = 0; i < FAULT.num_rules; ++i) {
+        sd_fault_rule_t *rule_p = &FAULT.rules[i];
+        if (!(rule_p->ops & op)) continue;
+        if (last < rule_p->first_lba || sector > rule_p->last_lba) continue;
+        if (rule_p->max_fires && rule_p->fires >= rule_p->max_fires) continue;
+        if (next_random(sd_card_p) % 1000000 >= rule_p->rate_ppm) continue;
+        ++rule_p->fires;
+        ++STATE.injected[rule_p->kind];
+        *lba_p = sector > rule_p->first_lba ? sector : rule_p->first_lba;
+        TRACE_PRINTF("%s: %s at %lu\n", __func__, sd_fault_kind_name(rule_p->kind), *lba_p);
+        return rule_p;
+    }
+    return NULL;
+}
+
+static void remove_card(sd_card_t *sd_card_p) {
+    STATE.removed = true;
+    sd_card_p->state.m_Status |= STA_NODISK | STA_NOINIT;
+    sd_card_p->state.card_type = SDCARD_NONE;
+}
+
+static block_dev_err_t check_params(sd_card_t *sd_card_p, uint32_t sector, uint32_t count) {
+    if (STATE.removed) return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!count) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if ((uint64_t)sector + count > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static block_dev_err_t sd_fault_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
+                                            uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, ulSectorCount);
+    sd_lock(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, ulSectorCount);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) {
+        sd_unlock(sd_card_p);
+        return rc;
+    }
+    sd_card_t *member_p = FAULT.member;
+    uint32_t lba;
+    sd_fault_rule_t const *rule_p =
+        fire(sd_card_p, SD_FAULT_ON_READ, ulSectorNumber, ulSectorCount, &lba);
+    switch (rule_p ? rule_p->kind : SD_FAULT_KINDS) {
+        case SD_FAULT_CRC:
+            rc = member_p->read_blocks(member_p, buffer, ulSectorNumber, ulSectorCount);
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+                buffer[(lba - ulSectorNumber) * sd_block_size] ^= 0xFF;
+                rc = SD_BLOCK_DEVICE_ERROR_CRC;
+            }
+            break;
+        case SD_FAULT_TIMEOUT:
+            busy_wait_us(rule_p->time_us);
+            rc = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+            break;
+        case SD_FAULT_REMOVAL:
+            remove_card(sd_card_p);
+            rc = SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+            break;
+        case SD_FAULT_BUSY:
+            busy_wait_us(rule_p->time_us);
+            rc = member_p->read_blocks(member_p, buffer, ulSectorNumber, ulSectorCount);
+            break;
+        default:  // No fault (a write reject does not apply to reads)
+            rc = member_p->read_blocks(member_p, buffer, ulSectorNumber, ulSectorCount);
+    }
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static block_dev_err_t sd_fault_write_blocks(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                             uint32_t ulSectorNumber, uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_lock(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, blockCnt);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) {
+        sd_unlock(sd_card_p);
+        return rc;
+    }
+    sd_card_t *member_p = FAULT.member;
+    uint32_t lba;
+    sd_fault_rule_t const *rule_p =
+        fire(sd_card_p, SD_FAULT_ON_WRITE, ulSectorNumber, blockCnt, &lba);
+    switch (rule_p ? rule_p->kind : SD_FAULT_KINDS) {
+        case SD_FAULT_CRC:
+        case SD_FAULT_WRITE_REJECT:
+            // The blocks before the bad one made it
+            rc = SD_BLOCK_DEVICE_ERROR_NONE;
+            if (lba > ulSectorNumber)
+                rc = member_p->write_blocks(member_p, buffer, ulSectorNumber, lba - ulSectorNumber);
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+                rc = SD_FAULT_CRC == rule_p->kind ? SD_BLOCK_DEVICE_ERROR_CRC
+                                                  : SD_BLOCK_DEVICE_ERROR_WRITE;
+            break;
+        case SD_FAULT_TIMEOUT:
+            busy_wait_us(rule_p->time_us);
+            rc = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+            break;
+        case SD_FAULT_REMOVAL:
+            remove_card(sd_card_p);
+            rc = SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+            break;
+        case SD_FAULT_BUSY:
+            busy_wait_us(rule_p->time_us);
+            rc = member_p->write_blocks(member_p, buffer, ulSectorNumber, blockCnt);
+            break;
+        default:
+            rc = member_p->write_blocks(member_p, buffer, ulSectorNumber, blockCnt);
+    }
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static block_dev_err_t sd_fault_erase_blocks(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                             uint32_t blockCnt) {
+    sd_lock(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, blockCnt);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+        rc = FAULT.member->erase_blocks(FAULT.member, ulSectorNumber, blockCnt);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static block_dev_err_t sd_fault_sync(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    block_dev_err_t rc = STATE.removed ? SD_BLOCK_DEVICE_ERROR_NO_DEVICE
+                                       : FAULT.member->sync(FAULT.member);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static uint32_t sd_fault_get_num_sectors(sd_card_t *sd_card_p) {
+    return sd_card_p->state.sectors;
+}
+
+static bool sd_fault_get_sd_status(sd_card_t *sd_card_p, uint8_t status[64]) {
+    if (STATE.removed || !FAULT.member->get_sd_status) return false;
+    return FAULT.member->get_sd_status(FAULT.member, status);
+}
+
+static bool sd_fault_test_com(sd_card_t *sd_card_p) {
+    return !STATE.removed && FAULT.member->sd_test_com(FAULT.member);
+}
+
+static DSTATUS sd_fault_init(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    if (STATE.removed) {
+        sd_card_p->state.m_Status |= STA_NODISK | STA_NOINIT;
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    // Make sure there's a card in the socket before proceeding
+    sd_card_detect(sd_card_p);
+    if (sd_card_p->state.m_Status & STA_NODISK) {
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    sd_card_t *member_p = FAULT.member;
+    DSTATUS ds = member_p->init(member_p);
+    if (ds & (STA_NOINIT | STA_NODISK)) {
+        sd_card_p->state.m_Status |= STA_NOINIT;
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    sd_card_p->state.sectors = member_p->get_num_sectors(member_p);
+    sd_card_p->state.card_type = member_p->state.card_type;
+    memcpy(sd_card_p->state.CSD, member_p->state.CSD, sizeof(CSD_t));
+    memcpy(sd_card_p->state.CID, member_p->state.CID, sizeof(CID_t));
+
+    // The card is now initialized
+    sd_card_p->state.m_Status &= ~STA_NOINIT;
+
+    sd_unlock(sd_card_p);
+    return sd_card_p->state.m_Status;
+}
+
+static void sd_fault_deinit(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_card_p->state.card_type = SDCARD_NONE;
+    FAULT.member->deinit(FAULT.member);
+    sd_unlock(sd_card_p);
+}
+
+void sd_fault_insert(sd_card_t *sd_card_p) {
+    myASSERT(SD_IF_FAULT == sd_card_p->type);
+    sd_lock(sd_card_p);
+    STATE.removed = false;
+    sd_card_p->state.m_Status &= ~STA_NODISK;
+    sd_unlock(sd_card_p);
+}
+
+void sd_fault_reset(sd_card_t *sd_card_p) {
+    myASSERT(SD_IF_FAULT == sd_card_p->type);
+    sd_lock(sd_card_p);
+    for (size_t i = 0; i < FAULT.num_rules; ++i) FAULT.rules[i].fires = 0;
+    memset(STATE.injected, 0, sizeof STATE.injected);
+    STATE.rng = FAULT.seed ? FAULT.seed : 1;  // xorshift needs a nonzero state
+    sd_unlock(sd_card_p);
+}
+
+void sd_fault_ctor(sd_card_t *sd_card_p) {
+    myASSERT(sd_card_p->fault_if_p);  // Must have an interface object
+    myASSERT(FAULT.member);
+    myASSERT(count_of(kind_names) == SD_FAULT_KINDS);
+
+    sd_card_p->state.m_Status = STA_NOINIT;
+    STATE.rng = FAULT.seed ? FAULT.seed : 1;
+
+    sd_card_p->init = sd_fault_init;
+    sd_card_p->deinit = sd_fault_deinit;
+    sd_card_p->write_blocks = sd_fault_write_blocks;
+    sd_card_p->read_blocks = sd_fault_read_blocks;
+    sd_card_p->sync = sd_fault_sync;
+    sd_card_p->get_num_sectors = sd_fault_get_num_sectors;
+    sd_card_p->sd_test_com = sd_fault_test_com;
+    if (FAULT.member->erase_blocks) sd_card_p->erase_blocks = sd_fault_erase_blocks;
+    if (FAULT.member->get_sd_status) sd_card_p->get_sd_status = sd_fault_get_sd_status;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,107 @@
+/* sd_card_fault.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Fault injecting virtual card, for testing error paths and their cost
+
+It wraps another card (typically SD_IF_RAM, on the host) and fills the same
+sd_card_t vtable, passing the requests through, except when one of its rules fires:
+    * SD_FAULT_CRC: a read returns the data with a bad byte in the first faulty block,
+      or a write stops at it, with SD_BLOCK_DEVICE_ERROR_CRC.
+    * SD_FAULT_TIMEOUT: nothing is done; after time_us, SD_BLOCK_DEVICE_ERROR_NO_RESPONSE.
+    * SD_FAULT_WRITE_REJECT: a write stops at the first faulty block,
+      with SD_BLOCK_DEVICE_ERROR_WRITE (the card's Data Response token was not "accepted").
+    * SD_FAULT_BUSY: the card stays busy for another time_us, then carries on normally.
+    * SD_FAULT_REMOVAL: the card is gone (STA_NODISK) until sd_fault_insert.
+A rule fires for requests (of the kinds in ops) that touch its range of blocks,
+at a rate (in parts per million, with a seeded pseudo-random generator, so runs repeat),
+and for a limited number of times, or without limit.
+The time_us waits use busy_wait_us, so, with the host's virtual clock, they are
+charged to the modeled time without slowing the tests down.
+
+This is above the driver, so the driver's own retries are not exercised;
+what is exercised is everything on top: the cache, write queue, RAID, glue.c, FatFs,
+and the application's recovery. The rules can be changed on the fly.
+
+Configuration (hw_config.c):
+    static sd_fault_rule_t rules[] = {
+        {.kind = SD_FAULT_CRC, .ops = SD_FAULT_ON_READ, .last_lba = UINT32_MAX, .rate_ppm = 1000}
+    };
+    static sd_fault_if_t fault_if = {
+        .member = &ram_card,
+        .rules = rules,
+        .num_rules = count_of(rules),
+        .seed = 1
+    };
+    static sd_card_t sd_cards[] = {
+        {.type = SD_IF_FAULT, .fault_if_p = &fault_if}
+    };
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    SD_FAULT_CRC,
+    SD_FAULT_TIMEOUT,
+    SD_FAULT_WRITE_REJECT,
+    SD_FAULT_BUSY,
+    SD_FAULT_REMOVAL,
+    SD_FAULT_KINDS
+} sd_fault_kind_t;
+
+// sd_fault_rule_t.ops
+#define SD_FAULT_ON_READ 1
+#define SD_FAULT_ON_WRITE 2
+
+typedef struct sd_fault_rule_t {
+    sd_fault_kind_t kind;
+    uint8_t ops;          // SD_FAULT_ON_READ and/or SD_FAULT_ON_WRITE
+    uint32_t first_lba;   // Range of blocks
+    uint32_t last_lba;    // Inclusive; UINT32_MAX for all
+    uint32_t rate_ppm;    // Chance per request, in parts per million (1000000: always)
+    uint32_t max_fires;   // 0 for no limit
+    uint32_t time_us;     // SD_FAULT_TIMEOUT and SD_FAULT_BUSY
+
+    uint32_t fires;  // State: times fired
+} sd_fault_rule_t;
+
+typedef struct sd_fault_if_state_t {
+    uint32_t rng;
+    bool removed;
+    uint32_t injected[SD_FAULT_KINDS];  // Statistics
+} sd_fault_if_state_t;
+
+typedef struct sd_card_t sd_card_t;
+
+void sd_fault_ctor(sd_card_t *sd_card_p);  // Constructor for sd_card_t
+
+/* Put the card back after SD_FAULT_REMOVAL. It needs to be initialized again. */
+void sd_fault_insert(sd_card_t *sd_card_p);
+
+char const *sd_fault_kind_name(sd_fault_kind_t kind);
+
+/* Reset the rules' fire counts, the statistics, and the random sequence */
+void sd_fault_reset(sd_card_t *sd_card_p);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
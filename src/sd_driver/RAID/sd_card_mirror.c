@@ -0,0 +1,492 @@
+/* sd_card_mirror.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Mirrored (RAID-1) virtual card. See sd_card_mirror.h. */
+
+#include <string.h>
+//
+#include "diskio.h"
+#include "my_debug.h"
+#include "sd_async.h"
+#include "sd_card.h"
+#include "sd_card_constants.h"
+//
+#include "sd_card_mirror.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+#define MIRROR (*sd_card_p->mirror_if_p)
+#define STATE sd_card_p->mirror_if_p->state
+
+static sd_card_t *member(sd_card_t *sd_card_p, unsigned k) { return MIRROR.members[k]; }
+
+/* The dirty region bitmap: a set bit means the region is stale on the member
+that is not online. Only one member can be behind at a time. */
+
+static bool is_dirty(sd_card_t *sd_card_p, uint32_t region) {
+    return MIRROR.dirty_bitmap[region / 32] & (1UL << (region % 32));
+}
+static void set_dirty(sd_card_t *sd_card_p, uint32_t region) {
+    if (is_dirty(sd_card_p, region)) return;
+    MIRROR.dirty_bitmap[region / 32] |= 1UL << (region % 32);
+    ++STATE.dirty_regions;
+}
+static void clear_dirty(sd_card_t *sd_card_p, uint32_t region) {
+    if (!is_dirty(sd_card_p, region)) return;
+    MIRROR.dirty_bitmap[region / 32] &= ~(1UL << (region % 32));
+    --STATE.dirty_regions;
+}
+static void mark_dirty(sd_card_t *sd_card_p, uint32_t lba, uint32_t count) {
+    uint32_t const last = (lba + count - 1) >> STATE.region_shift;
+    for (uint32_t r = lba >> STATE.region_shift; r <= last; ++r) set_dirty(sd_card_p, r);
+}
+static void mark_all_dirty(sd_card_t *sd_card_p) {
+    for (uint32_t r = 0; r < STATE.regions; ++r) set_dirty(sd_card_p, r);
+}
+static bool range_clean(sd_card_t *sd_card_p, uint32_t lba, uint32_t count) {
+    if (!STATE.dirty_regions) return true;
+    uint32_t const last = (lba + count - 1) >> STATE.region_shift;
+    for (uint32_t r = lba >> STATE.region_shift; r <= last; ++r)
+        if (is_dirty(sd_card_p, r)) return false;
+    return true;
+}
+
+static bool readable(sd_card_t *sd_card_p, unsigned k, uint32_t lba, uint32_t count) {
+    return SD_MIRROR_ONLINE == STATE.member_state[k] ||
+           (SD_MIRROR_RESYNC == STATE.member_state[k] && range_clean(sd_card_p, lba, count));
+}
+
+static bool any_online(sd_card_t *sd_card_p) {
+    return SD_MIRROR_ONLINE == STATE.member_state[0] || SD_MIRROR_ONLINE == STATE.member_state[1];
+}
+
+static void take_offline(sd_card_t *sd_card_p, unsigned k, char const *why) {
+    if (SD_MIRROR_OFFLINE == STATE.member_state[k]) return;
+    EMSG_PRINTF("Mirror member %u offline: %s\n", k, why);
+    STATE.member_state[k] = SD_MIRROR_OFFLINE;
+    ++STATE.failovers;
+    // Without an online member, the drive has to be initialized again
+    if (!any_online(sd_card_p)) sd_card_p->state.m_Status |= STA_NOINIT;
+}
+
+/* Card Detect is just a GPIO read, so check it before each operation */
+static void check_removal(sd_card_t *sd_card_p) {
+    for (unsigned k = 0; k < 2; ++k)
+        if (SD_MIRROR_OFFLINE != STATE.member_state[k] &&
+            !sd_card_detect(member(sd_card_p, k)))
+            take_offline(sd_card_p, k, "removed");
+}
+
+static block_dev_err_t check_params(sd_card_t *sd_card_p, uint32_t sector, uint32_t count) {
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!count) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if ((uint64_t)sector + count > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/* A read on member k failed: try the other one */
+static block_dev_err_t read_failover(sd_card_t *sd_card_p, unsigned k, uint8_t *buffer,
+                                     uint32_t lba, uint32_t count, block_dev_err_t rc) {
+    unsigned const other = k ^ 1;
+    if (!readable(sd_card_p, other, lba, count)) return rc;
+    if (SD_MIRROR_ONLINE == STATE.member_state[other]) take_offline(sd_card_p, k, "read failed");
+    ++STATE.reads[other];
+    sd_card_t *m_p = member(sd_card_p, other);
+    return m_p->read_blocks(m_p, buffer, lba, count);
+}
+
+static block_dev_err_t read_balanced(sd_card_t *sd_card_p, uint8_t *buffer,
+                                     uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    unsigned k = STATE.next_read;
+    STATE.next_read ^= 1;
+    uint32_t const half = ulSectorCount / 2;
+    if (half && readable(sd_card_p, k, ulSectorNumber, half) &&
+        readable(sd_card_p, k ^ 1, ulSectorNumber + half, ulSectorCount - half)) {
+        // The first half from one member, the second half from the other, in parallel
+        sd_io_req_t reqs[2];
+        uint32_t const lba[2] = {ulSectorNumber, ulSectorNumber + half};
+        uint32_t const count[2] = {half, ulSectorCount - half};
+        block_dev_err_t rcs[2];
+        for (unsigned i = 0; i < 2; ++i) {
+            memset(&reqs[i], 0, sizeof reqs[i]);
+            ++STATE.reads[k ^ i];
+            rcs[i] = sd_read_blocks_async(member(sd_card_p, k ^ i), &reqs[i],
+                                          buffer + (size_t)i * half * sd_block_size, lba[i],
+                                          count[i]);
+        }
+        for (unsigned i = 0; i < 2; ++i)
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rcs[i]) rcs[i] = sd_io_wait(&reqs[i]);
+        for (unsigned i = 0; i < 2 && SD_BLOCK_DEVICE_ERROR_NONE == rc; ++i)
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rcs[i])
+                rc = read_failover(sd_card_p, k ^ i, buffer + (size_t)i * half * sd_block_size,
+                                   lba[i], count[i], rcs[i]);
+    } else {
+        if (!readable(sd_card_p, k, ulSectorNumber, ulSectorCount)) k ^= 1;
+        if (!readable(sd_card_p, k, ulSectorNumber, ulSectorCount))
+            return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+        ++STATE.reads[k];
+        sd_card_t *m_p = member(sd_card_p, k);
+        rc = m_p->read_blocks(m_p, buffer, ulSectorNumber, ulSectorCount);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc)
+            rc = read_failover(sd_card_p, k, buffer, ulSectorNumber, ulSectorCount, rc);
+    }
+    return rc;
+}
+
+static block_dev_err_t sd_mirror_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
+                                             uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, ulSectorCount);
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    check_removal(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, ulSectorCount);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+        rc = read_balanced(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+    sd_stats_record(sd_card_p, SD_STATS_READ_SINGLE, ulSectorCount, t0, rc);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+/* Sort out the results of a write or erase on the members.
+It succeeded if it made it to a member that is online.
+A member that failed goes offline, and the range goes into the bitmap. */
+static block_dev_err_t settle(sd_card_t *sd_card_p, block_dev_err_t const rcs[2],
+                              uint32_t lba, uint32_t count) {
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+    for (unsigned k = 0; k < 2; ++k) {
+        if (SD_MIRROR_ONLINE != STATE.member_state[k]) continue;
+        if (SD_BLOCK_DEVICE_ERROR_NONE == rcs[k]) {
+            rc = SD_BLOCK_DEVICE_ERROR_NONE;
+            break;
+        }
+        rc = rcs[k];
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    for (unsigned k = 0; k < 2; ++k) {
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rcs[k]) take_offline(sd_card_p, k, "write failed");
+        if (SD_MIRROR_OFFLINE == STATE.member_state[k]) mark_dirty(sd_card_p, lba, count);
+    }
+    return rc;
+}
+
+static block_dev_err_t sd_mirror_write_blocks(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                              uint32_t ulSectorNumber, uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    check_removal(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, blockCnt);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+        // Both at once
+        sd_io_req_t reqs[2];
+        block_dev_err_t rcs[2] = {SD_BLOCK_DEVICE_ERROR_NO_DEVICE, SD_BLOCK_DEVICE_ERROR_NO_DEVICE};
+        bool started[2] = {false, false};
+        for (unsigned k = 0; k < 2; ++k) {
+            if (SD_MIRROR_OFFLINE == STATE.member_state[k]) continue;
+            memset(&reqs[k], 0, sizeof reqs[k]);
+            rcs[k] = sd_write_blocks_async(member(sd_card_p, k), &reqs[k], buffer,
+                                           ulSectorNumber, blockCnt);
+            started[k] = SD_BLOCK_DEVICE_ERROR_NONE == rcs[k];
+        }
+        for (unsigned k = 0; k < 2; ++k)
+            if (started[k]) rcs[k] = sd_io_wait(&reqs[k]);
+        rc = settle(sd_card_p, rcs, ulSectorNumber, blockCnt);
+    }
+    sd_stats_record(sd_card_p, SD_STATS_WRITE_SINGLE, blockCnt, t0, rc);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static block_dev_err_t sd_mirror_erase_blocks(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                              uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_lock(sd_card_p);
+    check_removal(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, blockCnt);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+        block_dev_err_t rcs[2] = {SD_BLOCK_DEVICE_ERROR_NO_DEVICE, SD_BLOCK_DEVICE_ERROR_NO_DEVICE};
+        for (unsigned k = 0; k < 2; ++k) {
+            if (SD_MIRROR_OFFLINE == STATE.member_state[k]) continue;
+            sd_card_t *m_p = member(sd_card_p, k);
+            rcs[k] = m_p->erase_blocks(m_p, ulSectorNumber, blockCnt);
+        }
+        rc = settle(sd_card_p, rcs, ulSectorNumber, blockCnt);
+    }
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static block_dev_err_t sd_mirror_sync(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (!(sd_card_p->state.m_Status & STA_NOINIT)) {
+        block_dev_err_t rcs[2] = {SD_BLOCK_DEVICE_ERROR_NO_DEVICE, SD_BLOCK_DEVICE_ERROR_NO_DEVICE};
+        for (unsigned k = 0; k < 2; ++k) {
+            if (SD_MIRROR_OFFLINE == STATE.member_state[k]) continue;
+            sd_card_t *m_p = member(sd_card_p, k);
+            rcs[k] = m_p->sync(m_p);
+        }
+        rc = SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+        for (unsigned k = 0; k < 2; ++k) {
+            if (SD_MIRROR_ONLINE != STATE.member_state[k]) continue;
+            rc = rcs[k];
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rc) break;
+        }
+        // Whatever was in flight to a member that failed is suspect
+        for (unsigned k = 0; k < 2 && SD_BLOCK_DEVICE_ERROR_NONE == rc; ++k)
+            if (SD_MIRROR_OFFLINE != STATE.member_state[k] && SD_BLOCK_DEVICE_ERROR_NONE != rcs[k]) {
+                take_offline(sd_card_p, k, "sync failed");
+                mark_all_dirty(sd_card_p);
+            }
+    }
+    sd_stats_record(sd_card_p, SD_STATS_SYNC, 0, t0, rc);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static uint32_t sd_mirror_get_num_sectors(sd_card_t *sd_card_p) {
+    return sd_card_p->state.sectors;
+}
+
+static bool sd_mirror_test_com(sd_card_t *sd_card_p) {
+    bool ok = false;
+    for (unsigned k = 0; k < 2; ++k) {
+        sd_card_t *m_p = member(sd_card_p, k);
+        if (m_p->sd_test_com(m_p)) ok = true;
+    }
+    return ok;
+}
+
+/* Size the regions so that the drive fits in the bitmap */
+static void setup_bitmap(sd_card_t *sd_card_p, uint32_t sectors) {
+    uint64_t const bits = (uint64_t)MIRROR.dirty_bitmap_words * 32;
+    uint32_t shift = 0;
+    while ((1UL << shift) < SD_MIRROR_COPY_SECTORS) ++shift;
+    while ((((uint64_t)sectors + (1ULL << shift) - 1) >> shift) > bits) ++shift;
+    STATE.region_shift = shift;
+    STATE.regions = ((uint64_t)sectors + (1ULL << shift) - 1) >> shift;
+    memset(MIRROR.dirty_bitmap, 0, MIRROR.dirty_bitmap_words * sizeof(uint32_t));
+    STATE.dirty_regions = 0;
+    STATE.resync_region = 0;
+}
+
+/* Remember the card, and tell whether it is the one that was there before */
+static bool same_card(sd_card_t *sd_card_p, unsigned k) {
+    sd_card_t *m_p = member(sd_card_p, k);
+    bool same = STATE.cid_known[k] && 0 == memcmp(STATE.cid[k], m_p->state.CID, sizeof(CID_t));
+    memcpy(STATE.cid[k], m_p->state.CID, sizeof(CID_t));
+    STATE.cid_known[k] = true;
+    return same;
+}
+
+/* An offline member that initializes comes back to be resynced */
+static void rejoin(sd_card_t *sd_card_p, unsigned k) {
+    sd_card_t *m_p = member(sd_card_p, k);
+    DSTATUS ds = m_p->init(m_p);
+    if (ds & (STA_NOINIT | STA_NODISK)) return;
+    if (m_p->get_num_sectors(m_p) < sd_card_p->state.sectors) {
+        EMSG_PRINTF("Mirror member %u: card too small\n", k);
+        return;
+    }
+    if (!same_card(sd_card_p, k)) mark_all_dirty(sd_card_p);  // Different card: copy it all
+    STATE.member_state[k] = SD_MIRROR_RESYNC;
+    STATE.resync_region = 0;
+    IMSG_PRINTF("Mirror member %u is back; %lu of %lu regions to copy\n", k,
+                (unsigned long)STATE.dirty_regions, (unsigned long)STATE.regions);
+}
+
+static DSTATUS sd_mirror_init(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+
+    // Make sure there's a card in the socket before proceeding
+    sd_card_detect(sd_card_p);
+    if (sd_card_p->state.m_Status & STA_NODISK) {
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    DSTATUS ds[2];
+    for (unsigned k = 0; k < 2; ++k) {
+        sd_card_t *m_p = member(sd_card_p, k);
+        ds[k] = m_p->init(m_p) & (STA_NOINIT | STA_NODISK);
+    }
+    if (!STATE.regions) {
+        // The first time: the smaller member sets the size
+        uint32_t sectors = UINT32_MAX;
+        for (unsigned k = 0; k < 2; ++k) {
+            sd_card_t *m_p = member(sd_card_p, k);
+            if (!ds[k] && m_p->get_num_sectors(m_p) < sectors)
+                sectors = m_p->get_num_sectors(m_p);
+        }
+        if (ds[0] && ds[1]) {
+            EMSG_PRINTF("%s: no member initialized\n", __func__);
+            sd_unlock(sd_card_p);
+            return sd_card_p->state.m_Status;
+        }
+        sd_card_p->state.sectors = sectors;
+        setup_bitmap(sd_card_p, sectors);
+    }
+    for (unsigned k = 0; k < 2; ++k) {
+        sd_card_t *m_p = member(sd_card_p, k);
+        if (ds[k] || m_p->get_num_sectors(m_p) < sd_card_p->state.sectors) {
+            if (STATE.cid_known[k] || SD_MIRROR_OFFLINE != STATE.member_state[k])
+                take_offline(sd_card_p, k, "initialization failed");
+            STATE.member_state[k] = SD_MIRROR_OFFLINE;
+            continue;
+        }
+        bool const known = STATE.cid_known[k];
+        bool const same = same_card(sd_card_p, k);
+        if (SD_MIRROR_ONLINE == STATE.member_state[k]) {
+            // Swapped while the drive was down?
+            if (known && !same) {
+                mark_all_dirty(sd_card_p);
+                STATE.member_state[k] = SD_MIRROR_RESYNC;
+            }
+        } else {
+            if (!same) mark_all_dirty(sd_card_p);
+            STATE.member_state[k] = SD_MIRROR_RESYNC;
+        }
+    }
+    for (unsigned k = 0; k < 2; ++k)
+        if (SD_MIRROR_RESYNC == STATE.member_state[k] && !STATE.dirty_regions)
+            STATE.member_state[k] = SD_MIRROR_ONLINE;
+    if (!any_online(sd_card_p)) {
+        EMSG_PRINTF("%s: no member is in sync\n", __func__);
+        sd_card_p->state.m_Status |= STA_NOINIT;
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    sd_card_t *m_p = member(sd_card_p, SD_MIRROR_ONLINE == STATE.member_state[0] ? 0 : 1);
+    sd_card_p->state.card_type = m_p->state.card_type;
+    memcpy(sd_card_p->state.CSD, m_p->state.CSD, sizeof(CSD_t));
+    memcpy(sd_card_p->state.CID, m_p->state.CID, sizeof(CID_t));
+
+    // The card is now initialized
+    sd_card_p->state.m_Status &= ~STA_NOINIT;
+
+    sd_unlock(sd_card_p);
+    return sd_card_p->state.m_Status;
+}
+
+static void sd_mirror_deinit(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_card_p->state.card_type = SDCARD_NONE;
+    for (unsigned k = 0; k < 2; ++k) {
+        sd_card_t *m_p = member(sd_card_p, k);
+        m_p->deinit(m_p);
+    }
+    sd_unlock(sd_card_p);
+}
+
+/* Copy dirty regions from the other member to member k */
+static void copy_dirty(sd_card_t *sd_card_p, unsigned k, uint32_t max_regions) {
+    sd_card_t *src_p = member(sd_card_p, k ^ 1);
+    sd_card_t *dst_p = member(sd_card_p, k);
+    uint8_t *buf = (uint8_t *)STATE.copy_buf;
+    uint32_t copied = 0;
+    for (uint32_t scanned = 0;
+         copied < max_regions && STATE.dirty_regions && scanned < STATE.regions; ++scanned) {
+        uint32_t const r = STATE.resync_region;
+        STATE.resync_region = r + 1 < STATE.regions ? r + 1 : 0;
+        if (!is_dirty(sd_card_p, r)) continue;
+        uint32_t lba = r << STATE.region_shift;
+        uint32_t end = lba + (1UL << STATE.region_shift);
+        if (end > sd_card_p->state.sectors) end = sd_card_p->state.sectors;
+        while (lba < end) {
+            uint32_t n = end - lba;
+            if (n > SD_MIRROR_COPY_SECTORS) n = SD_MIRROR_COPY_SECTORS;
+            block_dev_err_t rc = src_p->read_blocks(src_p, buf, lba, n);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) {
+                EMSG_PRINTF("%s: read of %lu at %lu failed: %d\n", __func__, n, lba, rc);
+                return;  // Try again later
+            }
+            rc = dst_p->write_blocks(dst_p, buf, lba, n);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) {
+                take_offline(sd_card_p, k, "resync write failed");
+                return;
+            }
+            lba += n;
+        }
+        clear_dirty(sd_card_p, r);
+        ++STATE.regions_resynced;
+        ++copied;
+    }
+    if (!STATE.dirty_regions && SD_BLOCK_DEVICE_ERROR_NONE == dst_p->sync(dst_p)) {
+        STATE.member_state[k] = SD_MIRROR_ONLINE;
+        IMSG_PRINTF("Mirror member %u is in sync\n", k);
+    }
+}
+
+bool sd_mirror_resync(sd_card_t *sd_card_p, uint32_t max_regions) {
+    myASSERT(SD_IF_MIRROR == sd_card_p->type);
+    sd_lock(sd_card_p);
+    if (sd_card_p->state.m_Status & STA_NOINIT) {
+        sd_unlock(sd_card_p);
+        return false;
+    }
+    check_removal(sd_card_p);
+    for (unsigned k = 0; k < 2; ++k)
+        if (SD_MIRROR_OFFLINE == STATE.member_state[k] &&
+            SD_MIRROR_ONLINE == STATE.member_state[k ^ 1] &&
+            sd_card_detect(member(sd_card_p, k)))
+            rejoin(sd_card_p, k);
+    for (unsigned k = 0; k < 2; ++k)
+        if (SD_MIRROR_RESYNC == STATE.member_state[k] &&
+            SD_MIRROR_ONLINE == STATE.member_state[k ^ 1])
+            copy_dirty(sd_card_p, k, max_regions);
+    bool const in_sync = SD_MIRROR_ONLINE == STATE.member_state[0] &&
+                         SD_MIRROR_ONLINE == STATE.member_state[1];
+    sd_unlock(sd_card_p);
+    return in_sync;
+}
+
+void sd_mirror_rebuild(sd_card_t *sd_card_p, unsigned k) {
+    myASSERT(SD_IF_MIRROR == sd_card_p->type && k < 2);
+    sd_lock(sd_card_p);
+    if (STATE.regions && SD_MIRROR_ONLINE == STATE.member_state[k ^ 1]) {
+        mark_all_dirty(sd_card_p);
+        STATE.resync_region = 0;
+        if (SD_MIRROR_ONLINE == STATE.member_state[k])
+            STATE.member_state[k] = SD_MIRROR_RESYNC;
+    }
+    sd_unlock(sd_card_p);
+}
+
+void sd_mirror_ctor(sd_card_t *sd_card_p) {
+    myASSERT(sd_card_p->mirror_if_p);  // Must have an interface object
+    myASSERT(MIRROR.members[0] && MIRROR.members[1]);
+    myASSERT(MIRROR.dirty_bitmap && MIRROR.dirty_bitmap_words);
+
+    sd_card_p->state.m_Status = STA_NOINIT;
+    // Until the first init shows otherwise
+    STATE.member_state[0] = SD_MIRROR_ONLINE;
+    STATE.member_state[1] = SD_MIRROR_ONLINE;
+
+    sd_card_p->init = sd_mirror_init;
+    sd_card_p->deinit = sd_mirror_deinit;
+    sd_card_p->write_blocks = sd_mirror_write_blocks;
+    sd_card_p->read_blocks = sd_mirror_read_blocks;
+    sd_card_p->sync = sd_mirror_sync;
+    sd_card_p->get_num_sectors = sd_mirror_get_num_sectors;
+    sd_card_p->sd_test_com = sd_mirror_test_com;
+    if (MIRROR.members[0]->erase_blocks && MIRROR.members[1]->erase_blocks)
+        sd_card_p->erase_blocks = sd_mirror_erase_blocks;
+}
+
+/* [] END OF FILE */
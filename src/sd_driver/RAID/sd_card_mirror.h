@@ -0,0 +1,106 @@
+/* sd_card_mirror.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Mirrored (RAID-1) virtual card: one drive kept on two physical cards.
+
+It fills the same sd_card_t vtable as the SPI, SDIO, and RAM drivers,
+so it is a drive like any other, and FatFs is none the wiser.
+    * Writes (and erases) go to both members, started together as non-blocking
+      requests (sd_async.h), so members on separate buses work in parallel.
+    * Reads are shared out: a multiple block read is split in two halves,
+      one from each member, read in parallel; single block reads alternate.
+      If a read fails, it is retried on the other member.
+    * If a member fails a write, or its Card Detect (sd_card_detect) shows it
+      was removed, the drive carries on with the other member ("degraded"),
+      and the regions written meanwhile are marked in the dirty region bitmap.
+    * sd_mirror_resync, called periodically, brings a member back when it is
+      (re)inserted and initializes, then copies the dirty regions to it, a few at a time.
+      If it is a different card (by its CID), or a card that was missing
+      when the drive was initialized, all regions are copied.
+      Until then, reads of the regions that are clean on it can still use it.
+
+The bitmap is in RAM, with one bit per region; the region size is the smallest
+power of 2 (at least SD_MIRROR_COPY_SECTORS blocks) that fits the drive into the bitmap.
+The members are assumed to be in sync at power up.
+After swapping a card with the power off, use sd_mirror_rebuild.
+
+Configuration (hw_config.c):
+    static uint32_t dirty_bitmap[1024];  // 32768 regions
+    static sd_mirror_if_t mirror_if = {
+        .members = {&sdio_card, &spi_card},
+        .dirty_bitmap = dirty_bitmap,
+        .dirty_bitmap_words = count_of(dirty_bitmap)
+    };
+    static sd_card_t sd_cards[] = {
+        {.type = SD_IF_MIRROR, .mirror_if_p = &mirror_if}
+    };
+The members are configured like any other sd_card_t, typically with Card Detect,
+but are not in the drive table. Only the mirror's write queue, cache, and read-ahead are used.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "sd_regs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_MIRROR_COPY_SECTORS
+#  define SD_MIRROR_COPY_SECTORS 8  // Size of the resync copy buffer, in 512 byte blocks
+#endif
+
+typedef enum {
+    SD_MIRROR_OFFLINE,  // Missing or failed
+    SD_MIRROR_RESYNC,   // Back, but the dirty regions are stale
+    SD_MIRROR_ONLINE
+} sd_mirror_member_state_t;
+
+typedef struct sd_mirror_if_state_t {
+    sd_mirror_member_state_t member_state[2];
+    bool cid_known[2];
+    CID_t cid[2];           // Of the card that was last in sync
+    uint32_t region_shift;  // A region is 2^region_shift blocks
+    uint32_t regions;
+    uint32_t dirty_regions;   // Bits set in the bitmap
+    uint32_t resync_region;   // Where sd_mirror_resync continues
+    unsigned next_read;       // Member for the next single block read
+    uint32_t copy_buf[SD_MIRROR_COPY_SECTORS * 512 / sizeof(uint32_t)];
+
+    /* Statistics */
+    uint32_t reads[2];          // Read requests served by each member
+    uint32_t failovers;         // Members taken offline
+    uint32_t regions_resynced;  // Regions copied by sd_mirror_resync
+} sd_mirror_if_state_t;
+
+typedef struct sd_card_t sd_card_t;
+
+void sd_mirror_ctor(sd_card_t *sd_card_p);  // Constructor for sd_card_t
+
+/* Bring back a member that was offline, if it is present and initializes,
+and copy up to max_regions dirty regions to a member that is resyncing.
+Returns true if both members are online (nothing left to do). */
+bool sd_mirror_resync(sd_card_t *sd_card_p, uint32_t max_regions);
+
+/* Mark all regions of member (0 or 1) stale, e.g., after replacing it with the power off.
+sd_mirror_resync then copies everything to it from the other member. */
+void sd_mirror_rebuild(sd_card_t *sd_card_p, unsigned member);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,242 @@
+/* sd_card_stripe.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Striped (RAID-0) virtual card. See sd_card_stripe.h. */
+
+#include <string.h>
+//
+#include "diskio.h"
+#include "my_debug.h"
+#include "sd_async.h"
+#include "sd_card.h"
+#include "sd_card_constants.h"
+//
+#include "sd_card_stripe.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+#define STRIPE (*sd_card_p->stripe_if_p)
+
+/* The member holding lba, and the block on it */
+static sd_card_t *map(sd_card_t *sd_card_p, uint32_t lba, uint32_t *member_lba_p) {
+    uint32_t const stripe = lba / STRIPE.stripe_sectors;
+    *member_lba_p = stripe / STRIPE.num_members * STRIPE.stripe_sectors +
+                    lba % STRIPE.stripe_sectors;
+    return STRIPE.members[stripe % STRIPE.num_members];
+}
+
+static block_dev_err_t check_params(sd_card_t *sd_card_p, uint32_t sector, uint32_t count) {
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!count) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if ((uint64_t)sector + count > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/* Up to num_members consecutive pieces at a time, each on a different member,
+so no member gets a second request while it is busy with the first. */
+static block_dev_err_t transfer(sd_card_t *sd_card_p, sd_io_op_t op, uint8_t *buffer,
+                                uint32_t sector, uint32_t count) {
+    sd_io_req_t reqs[SD_STRIPE_MAX_MEMBERS];
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    uint32_t done = 0;
+    while (done < count && SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+        size_t started = 0;
+        while (started < STRIPE.num_members && done < count) {
+            uint32_t const lba = sector + done;
+            uint32_t n = STRIPE.stripe_sectors - lba % STRIPE.stripe_sectors;
+            if (n > count - done) n = count - done;
+            uint32_t member_lba;
+            sd_card_t *member_p = map(sd_card_p, lba, &member_lba);
+            sd_io_req_t *req_p = &reqs[started];
+            memset(req_p, 0, sizeof *req_p);
+            uint8_t *p = buffer + (size_t)done * sd_block_size;
+            TRACE_PRINTF("%s: %lu+%lu -> %p:%lu\n", __func__, lba, n, member_p, member_lba);
+            if (SD_IO_READ == op)
+                rc = sd_read_blocks_async(member_p, req_p, p, member_lba, n);
+            else
+                rc = sd_write_blocks_async(member_p, req_p, p, member_lba, n);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) break;
+            ++started;
+            done += n;
+        }
+        for (size_t i = 0; i < started; ++i) {
+            block_dev_err_t status = sd_io_wait(&reqs[i]);
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rc) rc = status;
+        }
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc)
+        EMSG_PRINTF("%s(%s, %lu, %lu) failed: %d\n", __func__,
+                    SD_IO_READ == op ? "read" : "write", sector, count, rc);
+    return rc;
+}
+
+static block_dev_err_t sd_stripe_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
+                                             uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, ulSectorCount);
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, ulSectorCount);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+        rc = transfer(sd_card_p, SD_IO_READ, buffer, ulSectorNumber, ulSectorCount);
+    sd_stats_record(sd_card_p, SD_STATS_READ_SINGLE, ulSectorCount, t0, rc);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static block_dev_err_t sd_stripe_write_blocks(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                              uint32_t ulSectorNumber, uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, blockCnt);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+        // Only read from; the cast is for sharing transfer()
+        rc = transfer(sd_card_p, SD_IO_WRITE, (uint8_t *)buffer, ulSectorNumber, blockCnt);
+    sd_stats_record(sd_card_p, SD_STATS_WRITE_SINGLE, blockCnt, t0, rc);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+/* On each member, the blocks of a range form one contiguous range:
+from the first block of the range on that member to the last. */
+static block_dev_err_t sd_stripe_erase_blocks(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                              uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_lock(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, blockCnt);
+    uint32_t const ss = STRIPE.stripe_sectors;
+    uint32_t const n = STRIPE.num_members;
+    uint32_t const last = ulSectorNumber + blockCnt - 1;
+    uint32_t const first_stripe = ulSectorNumber / ss;
+    uint32_t const last_stripe = last / ss;
+    for (uint32_t k = 0; k < n && SD_BLOCK_DEVICE_ERROR_NONE == rc; ++k) {
+        // The first and last stripes of the range on member k
+        uint32_t const s0 = first_stripe + (k + n - first_stripe % n) % n;
+        if (s0 > last_stripe) continue;
+        uint32_t const s1 = last_stripe - (last_stripe % n + n - k) % n;
+        uint32_t const lba0 = s0 == first_stripe ? ulSectorNumber : s0 * ss;
+        uint32_t const lba1 = s1 == last_stripe ? last : s1 * ss + ss - 1;
+        uint32_t m0, m1;
+        sd_card_t *member_p = map(sd_card_p, lba0, &m0);
+        map(sd_card_p, lba1, &m1);
+        rc = member_p->erase_blocks(member_p, m0, m1 - m0 + 1);
+    }
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static block_dev_err_t sd_stripe_sync(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    for (size_t i = 0; i < STRIPE.num_members; ++i) {
+        sd_card_t *member_p = STRIPE.members[i];
+        block_dev_err_t status = member_p->sync(member_p);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == rc) rc = status;
+    }
+    sd_stats_record(sd_card_p, SD_STATS_SYNC, 0, t0, rc);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static uint32_t sd_stripe_get_num_sectors(sd_card_t *sd_card_p) {
+    return sd_card_p->state.sectors;
+}
+
+static bool sd_stripe_test_com(sd_card_t *sd_card_p) {
+    bool ok = true;
+    for (size_t i = 0; i < STRIPE.num_members; ++i) {
+        sd_card_t *member_p = STRIPE.members[i];
+        if (!member_p->sd_test_com(member_p)) ok = false;
+    }
+    return ok;
+}
+
+static DSTATUS sd_stripe_init(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+
+    // Make sure there's a card in the socket before proceeding
+    sd_card_detect(sd_card_p);
+    if (sd_card_p->state.m_Status & STA_NODISK) {
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    // Always (re)initialize the members: one might have been swapped.
+    // The smallest member limits the size.
+    uint32_t member_sectors = UINT32_MAX;
+    for (size_t i = 0; i < STRIPE.num_members; ++i) {
+        sd_card_t *member_p = STRIPE.members[i];
+        DSTATUS ds = member_p->init(member_p);
+        if (ds & (STA_NOINIT | STA_NODISK)) {
+            EMSG_PRINTF("%s: member %zu initialization failed: 0x%x\n", __func__, i, ds);
+            sd_card_p->state.m_Status |= STA_NOINIT;
+            sd_unlock(sd_card_p);
+            return sd_card_p->state.m_Status;
+        }
+        uint32_t n = member_p->get_num_sectors(member_p);
+        if (n < member_sectors) member_sectors = n;
+    }
+    member_sectors -= member_sectors % STRIPE.stripe_sectors;
+    uint64_t sectors = (uint64_t)member_sectors * STRIPE.num_members;
+    if (sectors > UINT32_MAX) {
+        EMSG_PRINTF("%s: too many sectors: %llu\n", __func__, (unsigned long long)sectors);
+        sectors = UINT32_MAX / ((uint64_t)STRIPE.stripe_sectors * STRIPE.num_members) *
+                  STRIPE.stripe_sectors * STRIPE.num_members;
+    }
+    sd_card_p->state.sectors = sectors;
+    sd_card_p->state.card_type = STRIPE.members[0]->state.card_type;
+
+    // The card is now initialized
+    sd_card_p->state.m_Status &= ~STA_NOINIT;
+
+    sd_unlock(sd_card_p);
+    return sd_card_p->state.m_Status;
+}
+
+static void sd_stripe_deinit(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_card_p->state.card_type = SDCARD_NONE;
+    for (size_t i = 0; i < STRIPE.num_members; ++i) {
+        sd_card_t *member_p = STRIPE.members[i];
+        member_p->deinit(member_p);
+    }
+    sd_unlock(sd_card_p);
+}
+
+void sd_stripe_ctor(sd_card_t *sd_card_p) {
+    myASSERT(sd_card_p->stripe_if_p);  // Must have an interface object
+    myASSERT(1 < STRIPE.num_members && STRIPE.num_members <= SD_STRIPE_MAX_MEMBERS);
+    myASSERT(STRIPE.stripe_sectors);
+
+    sd_card_p->state.m_Status = STA_NOINIT;
+
+    sd_card_p->init = sd_stripe_init;
+    sd_card_p->deinit = sd_stripe_deinit;
+    sd_card_p->write_blocks = sd_stripe_write_blocks;
+    sd_card_p->read_blocks = sd_stripe_read_blocks;
+    sd_card_p->sync = sd_stripe_sync;
+    sd_card_p->get_num_sectors = sd_stripe_get_num_sectors;
+    sd_card_p->sd_test_com = sd_stripe_test_com;
+
+    // Erase only if all of the members can
+    sd_card_p->erase_blocks = sd_stripe_erase_blocks;
+    for (size_t i = 0; i < STRIPE.num_members; ++i)
+        if (!STRIPE.members[i]->erase_blocks) sd_card_p->erase_blocks = NULL;
+}
+
+/* [] END OF FILE */
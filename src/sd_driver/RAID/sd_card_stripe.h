@@ -0,0 +1,66 @@
+/* sd_card_stripe.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Striped (RAID-0) virtual card: one drive made of several physical cards.
+
+The blocks are dealt out to the member cards in stripes of stripe_sectors blocks:
+stripe 0 is on member 0, stripe 1 on member 1, ..., stripe n on member 0 again.
+It fills the same sd_card_t vtable as the SPI, SDIO, and RAM drivers,
+so it is one FatFs volume, with the sum of the capacities (the smallest member
+times the number of members) and, for large transfers, the sum of the bandwidths.
+
+A transfer is split at the stripe boundaries, and consecutive pieces,
+which are on different members, are started together as non-blocking requests
+(sd_async.h), then waited for. Members whose drivers overlap the transfer with
+the CPU (SDIO with DMA, RAM) work in parallel; others take their turn.
+On each member, the pieces of a transfer are contiguous, so
+multiple block writes continue from one piece to the next.
+
+Configuration (hw_config.c):
+    static sd_card_t *stripe_members[] = {&spi_card, &sdio_card};
+    static sd_stripe_if_t stripe_if = {
+        .members = stripe_members,
+        .num_members = count_of(stripe_members),
+        .stripe_sectors = 64  // 32 KiB
+    };
+    static sd_card_t sd_cards[] = {
+        {.type = SD_IF_STRIPE, .stripe_if_p = &stripe_if}
+    };
+The members are configured like any other sd_card_t, but are not in the
+drive table. Only the striped card's write queue, cache, and read-ahead are used.
+A stripe of at least a cluster keeps most single cluster transfers on one card,
+and a multiple of the cluster size keeps clusters from straddling cards.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_STRIPE_MAX_MEMBERS
+#  define SD_STRIPE_MAX_MEMBERS 4
+#endif
+
+typedef struct sd_card_t sd_card_t;
+
+void sd_stripe_ctor(sd_card_t *sd_card_p);  // Constructor for sd_card_t
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
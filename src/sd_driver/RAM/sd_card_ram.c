@@ -0,0 +1,368 @@
+/* sd_card_ram.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* RAM backed "SD card". See sd_card_ram.h. */
+
+#include <stdlib.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "diskio.h"
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sd_async.h"
+#include "sd_card_constants.h"
+#include "sd_init_cache.h"
+//
+#include "sd_card_ram.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+#define STATE sd_card_p->ram_if_p->state
+#define LATENCY sd_card_p->ram_if_p->latency
+
+/* Spend the modeled time.
+On the host, with the virtual clock, this just advances the clock.
+While a non-blocking request is being started, the time is only added up,
+and the request completes when it has passed. */
+static void charge(sd_card_t *sd_card_p, uint32_t us) {
+    if (!us) return;
+    STATE.modeled_us += us;
+    if (STATE.deferring)
+        STATE.deferred_us += us;
+    else
+        busy_wait_us_32(us);
+}
+
+/* The time as seen by the card */
+static uint64_t card_time(sd_card_t *sd_card_p) {
+    return time_us_64() + STATE.deferred_us;
+}
+
+/* How often the card is polled while it is busy; cf. SD_BUSY_POLL_BYTES in SPI */
+#define BUSY_POLL_US 40
+
+/* Wait for the card to finish programming; cf. sd_wait_ready in SPI.
+sd_busy_yield runs between polls, so what it does overlaps the programming
+(except while a non-blocking request is started: its caller is free anyway). */
+static void wait_ready(sd_card_t *sd_card_p) {
+    uint64_t const t0 = card_time(sd_card_p);
+    if (t0 >= STATE.busy_until_us) return;
+    uint64_t now = t0;
+    do {
+        uint64_t us = STATE.busy_until_us - now;
+        if (!STATE.deferring) {
+            sd_busy_yield(sd_card_p);
+            now = card_time(sd_card_p);
+            if (now >= STATE.busy_until_us) break;
+            us = STATE.busy_until_us - now;
+            if (us > BUSY_POLL_US) us = BUSY_POLL_US;
+        }
+        charge(sd_card_p, us);
+        now = card_time(sd_card_p);
+    } while (now < STATE.busy_until_us);
+    sd_stats_busy(sd_card_p, now - t0);
+}
+
+static void program_block(sd_card_t *sd_card_p, uint8_t const *buffer, uint32_t sector) {
+    wait_ready(sd_card_p);
+    charge(sd_card_p, LATENCY.block_wr_us);
+    memcpy(sd_card_p->ram_if_p->data + (size_t)sector * sd_block_size, buffer, sd_block_size);
+    ++STATE.blocks_wr;
+    STATE.busy_until_us = card_time(sd_card_p) + LATENCY.busy_wr_us;
+}
+
+static void stop_wr_tran(sd_card_t *sd_card_p) {
+    if (!STATE.ongoing_mlt_blk_wrt) return;
+    STATE.ongoing_mlt_blk_wrt = false;
+    ++STATE.cmd12_cnt;
+    SD_STATS_INC(sd_card_p, commands);
+    SD_STATS_INC(sd_card_p, stop_transmissions);
+    wait_ready(sd_card_p);
+    charge(sd_card_p, LATENCY.cmd12_us);
+}
+
+static block_dev_err_t check_params(sd_card_t *sd_card_p, uint32_t sector, uint32_t count) {
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!count) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if ((uint64_t)sector + count > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static void in_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer, uint32_t ulSectorNumber,
+                           uint32_t ulSectorCount) {
+    stop_wr_tran(sd_card_p);
+    wait_ready(sd_card_p);
+    SD_STATS_INC(sd_card_p, commands);
+    if (1 == ulSectorCount) {
+        ++STATE.cmd17_cnt;
+        charge(sd_card_p, LATENCY.cmd17_us);
+    } else {
+        ++STATE.cmd18_cnt;
+        charge(sd_card_p, LATENCY.cmd18_us);
+    }
+    charge(sd_card_p, ulSectorCount * LATENCY.block_rd_us);
+    memcpy(buffer, sd_card_p->ram_if_p->data + (size_t)ulSectorNumber * sd_block_size,
+           (size_t)ulSectorCount * sd_block_size);
+    STATE.blocks_rd += ulSectorCount;
+    if (1 < ulSectorCount) {
+        ++STATE.cmd12_cnt;
+        SD_STATS_INC(sd_card_p, commands);
+        SD_STATS_INC(sd_card_p, stop_transmissions);
+        charge(sd_card_p, LATENCY.cmd12_us);
+    }
+}
+
+static void in_write_blocks(sd_card_t *sd_card_p, const uint8_t *buffer,
+                            uint32_t ulSectorNumber, uint32_t blockCnt) {
+    if (1 == blockCnt) {
+        // Same as the SPI driver: a single block is written with CMD24
+        stop_wr_tran(sd_card_p);
+        wait_ready(sd_card_p);
+        ++STATE.cmd24_cnt;
+        SD_STATS_INC(sd_card_p, commands);
+        charge(sd_card_p, LATENCY.cmd24_us);
+    } else if (!STATE.ongoing_mlt_blk_wrt || STATE.cont_sector_wrt != ulSectorNumber) {
+        stop_wr_tran(sd_card_p);
+        wait_ready(sd_card_p);
+        ++STATE.cmd25_cnt;
+        SD_STATS_INC(sd_card_p, commands);
+        charge(sd_card_p, LATENCY.cmd25_us);
+        STATE.ongoing_mlt_blk_wrt = true;
+    }  // else continue the open multiblock write
+    for (uint32_t i = 0; i < blockCnt; ++i)
+        program_block(sd_card_p, buffer + (size_t)i * sd_block_size, ulSectorNumber + i);
+    STATE.cont_sector_wrt = ulSectorNumber + blockCnt;
+}
+
+static block_dev_err_t sd_ram_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
+                                          uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, ulSectorCount);
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, ulSectorCount);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+        in_read_blocks(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+    sd_stats_record(sd_card_p, SD_STATS_READ_SINGLE, ulSectorCount, t0, rc);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+static block_dev_err_t sd_ram_write_blocks(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                           uint32_t ulSectorNumber, uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, blockCnt);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+        in_write_blocks(sd_card_p, buffer, ulSectorNumber, blockCnt);
+    sd_stats_record(sd_card_p, SD_STATS_WRITE_SINGLE, blockCnt, t0, rc);
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+/* Erased blocks read as zeros (DATA_STAT_AFTER_ERASE = 0) */
+static block_dev_err_t sd_ram_erase_blocks(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                           uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_lock(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, ulSectorNumber, blockCnt);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+        stop_wr_tran(sd_card_p);
+        wait_ready(sd_card_p);
+        ++STATE.cmd38_cnt;
+        SD_STATS_ADD(sd_card_p, commands, 3);  // CMD32, CMD33, CMD38
+        charge(sd_card_p, LATENCY.erase_us);
+        memset(sd_card_p->ram_if_p->data + (size_t)ulSectorNumber * sd_block_size, 0,
+               (size_t)blockCnt * sd_block_size);
+        STATE.blocks_erased += blockCnt;
+    }
+    sd_unlock(sd_card_p);
+    return rc;
+}
+
+/* The data is moved at the start, but the request only completes
+when the modeled time has passed. The card stays locked until then. */
+static block_dev_err_t sd_ram_start_io(sd_card_t *sd_card_p, sd_io_req_t *req_p) {
+    sd_lock(sd_card_p);
+    block_dev_err_t rc = check_params(sd_card_p, req_p->sector, req_p->count);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) {
+        sd_unlock(sd_card_p);
+        return rc;
+    }
+    STATE.deferring = true;
+    if (SD_IO_READ == req_p->op)
+        in_read_blocks(sd_card_p, req_p->rd_buffer, req_p->sector, req_p->count);
+    else
+        in_write_blocks(sd_card_p, req_p->wr_buffer, req_p->sector, req_p->count);
+    STATE.io_done_us = card_time(sd_card_p);
+    STATE.deferring = false;
+    STATE.deferred_us = 0;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static block_dev_err_t sd_ram_poll_io(sd_card_t *sd_card_p, sd_io_req_t *req_p) {
+    if (time_us_64() < STATE.io_done_us) return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    sd_stats_record(sd_card_p, SD_IO_READ == req_p->op ? SD_STATS_READ_SINGLE : SD_STATS_WRITE_SINGLE,
+                    req_p->count, req_p->start_us, SD_BLOCK_DEVICE_ERROR_NONE);
+    sd_unlock(sd_card_p);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static block_dev_err_t sd_ram_sync(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    stop_wr_tran(sd_card_p);
+    wait_ready(sd_card_p);
+    sd_stats_record(sd_card_p, SD_STATS_SYNC, 0, t0, SD_BLOCK_DEVICE_ERROR_NONE);
+    sd_unlock(sd_card_p);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/* Only AU_SIZE is modeled */
+static bool sd_ram_get_sd_status(sd_card_t *sd_card_p, uint8_t status[64]) {
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK)) return false;
+    ++STATE.acmd13_cnt;
+    SD_STATS_INC(sd_card_p, commands);
+    charge(sd_card_p, LATENCY.reg_us);
+    memset(status, 0, 64);
+    status[10] = sd_card_p->ram_if_p->au_size << 4;  // Bits 431:428
+    return true;
+}
+
+static uint32_t sd_ram_get_num_sectors(sd_card_t *sd_card_p) {
+    return sd_card_p->state.sectors;
+}
+
+static bool sd_ram_test_com(sd_card_t *sd_card_p) {
+    return sd_card_detect(sd_card_p);
+}
+
+/* A CID that is the same for the same sd_ram_if_t, and differs between them */
+static void read_cid(sd_card_t *sd_card_p) {
+    ++STATE.cmd10_cnt;
+    SD_STATS_INC(sd_card_p, commands);
+    charge(sd_card_p, LATENCY.reg_us);
+    uint8_t *cid = sd_card_p->state.CID;
+    uint32_t psn = sd_card_p->ram_if_p->psn;
+    if (!psn) psn = (uint32_t)(uintptr_t)sd_card_p->ram_if_p ^ sd_card_p->ram_if_p->sectors;
+    memset(cid, 0, sizeof(CID_t));
+    memcpy(&cid[1], "RMRAMSD", 7);  // OID, PNM
+    cid[8] = 0x10;                  // PRV 1.0
+    cid[9] = psn >> 24;             // PSN
+    cid[10] = psn >> 16;
+    cid[11] = psn >> 8;
+    cid[12] = psn;
+    cid[15] = 1;
+}
+
+/* A version 2.0 CSD, with C_SIZE (bits 69:48) for the capacity */
+static void read_csd(sd_card_t *sd_card_p) {
+    ++STATE.cmd9_cnt;
+    SD_STATS_INC(sd_card_p, commands);
+    charge(sd_card_p, LATENCY.reg_us);
+    uint8_t *csd = sd_card_p->state.CSD;
+    uint32_t const c_size = sd_card_p->ram_if_p->sectors / 1024 - 1;
+    memset(csd, 0, sizeof(CSD_t));
+    csd[0] = 0x40;  // CSD_STRUCTURE 1
+    csd[7] = (c_size >> 16) & 0x3F;
+    csd[8] = c_size >> 8;
+    csd[9] = c_size;
+    csd[15] = 1;
+}
+
+static DSTATUS sd_ram_init(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+
+    // Make sure there's a card in the socket before proceeding
+    sd_card_detect(sd_card_p);
+    if (sd_card_p->state.m_Status & STA_NODISK) {
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    // Make sure we're not already initialized before proceeding
+    if (!(sd_card_p->state.m_Status & STA_NOINIT)) {
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    if (!sd_card_p->ram_if_p->sectors) {
+        EMSG_PRINTF("%s: no sectors configured\n", __func__);
+        sd_unlock(sd_card_p);
+        return sd_card_p->state.m_Status;
+    }
+    if (!sd_card_p->ram_if_p->data) {
+        sd_card_p->ram_if_p->data = calloc(sd_card_p->ram_if_p->sectors, sd_block_size);
+        if (!sd_card_p->ram_if_p->data) {
+            EMSG_PRINTF("%s: out of memory\n", __func__);
+            sd_unlock(sd_card_p);
+            return sd_card_p->state.m_Status;
+        }
+        STATE.allocated = true;
+    }
+    STATE.ongoing_mlt_blk_wrt = false;
+    STATE.busy_until_us = 0;
+    charge(sd_card_p, LATENCY.init_us);
+    read_cid(sd_card_p);
+    if (!sd_card_p->init_cache_p || !sd_init_cache_lookup(sd_card_p)) {
+        read_csd(sd_card_p);
+        // Not from the CSD, which can only express multiples of 512 KiB
+        sd_card_p->state.sectors = sd_card_p->ram_if_p->sectors;
+        if (sd_card_p->init_cache_p) sd_init_cache_store(sd_card_p);
+    }
+    sd_card_p->state.card_type = SDCARD_V2HC;
+
+    // The card is now initialized
+    sd_card_p->state.m_Status &= ~STA_NOINIT;
+
+    sd_unlock(sd_card_p);
+    return sd_card_p->state.m_Status;
+}
+
+static void sd_ram_deinit(sd_card_t *sd_card_p) {
+    sd_lock(sd_card_p);
+
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_card_p->state.card_type = SDCARD_NONE;
+    STATE.ongoing_mlt_blk_wrt = false;
+    if (STATE.allocated) {
+        free(sd_card_p->ram_if_p->data);
+        sd_card_p->ram_if_p->data = NULL;
+        STATE.allocated = false;
+    }
+    sd_unlock(sd_card_p);
+}
+
+void sd_ram_ctor(sd_card_t *sd_card_p) {
+    myASSERT(sd_card_p->ram_if_p);  // Must have an interface object
+
+    sd_card_p->state.m_Status = STA_NOINIT;
+
+    sd_card_p->init = sd_ram_init;
+    sd_card_p->deinit = sd_ram_deinit;
+    sd_card_p->write_blocks = sd_ram_write_blocks;
+    sd_card_p->read_blocks = sd_ram_read_blocks;
+    sd_card_p->sync = sd_ram_sync;
+    sd_card_p->erase_blocks = sd_ram_erase_blocks;
+    sd_card_p->get_num_sectors = sd_ram_get_num_sectors;
+    sd_card_p->get_sd_status = sd_ram_get_sd_status;
+    sd_card_p->sd_test_com = sd_ram_test_com;
+    sd_card_p->start_io = sd_ram_start_io;
+    sd_card_p->poll_io = sd_ram_poll_io;
+}
+
+/* [] END OF FILE */
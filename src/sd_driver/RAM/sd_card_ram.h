@@ -0,0 +1,94 @@
+/* sd_card_ram.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* RAM (or memory mapped image file) backed "SD card".
+
+This fills the same sd_card_t vtable as the SPI and SDIO drivers,
+but the medium is a plain memory buffer. It is intended for
+off-target testing (see src/host) and benchmarking of the layers above
+the driver (glue.c, FatFs), but it is portable and also runs on the Pico.
+
+A simple latency model makes it possible to project on-device performance:
+each command is charged a configurable fixed cost, each block a per-block
+transfer cost, and each written block leaves the card busy (programming)
+for a configurable time, which the next command must wait out.
+As with a real SPI card, a multi-block write (CMD25) is left open after
+write_blocks returns, and continued if the next write is contiguous.
+Non-blocking requests (sd_async.h) complete when the modeled time has passed.
+Initialization is charged for the power up sequence (CMD0, CMD8, ACMD41)
+and for reading the CID and the CSD, which are made up from the configuration.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sd_card_t sd_card_t;
+
+/* Latency model. All times are in microseconds.
+All zero (the default) means "as fast as memcpy". */
+typedef struct sd_ram_latency_t {
+    uint32_t cmd17_us;     // READ_SINGLE_BLOCK: command and access time
+    uint32_t cmd18_us;     // READ_MULTIPLE_BLOCK: command and access time
+    uint32_t cmd24_us;     // WRITE_BLOCK: command overhead
+    uint32_t cmd25_us;     // WRITE_MULTIPLE_BLOCK: command overhead
+    uint32_t cmd12_us;     // STOP_TRANSMISSION (or Stop Tran token)
+    uint32_t block_rd_us;  // Transfer time of one 512 byte block from the card
+    uint32_t block_wr_us;  // Transfer time of one 512 byte block to the card
+    uint32_t busy_wr_us;   // Card busy (programming) after each written block
+    uint32_t erase_us;     // CMD32, CMD33, and CMD38, and the erase itself
+    uint32_t init_us;      // Power up sequence at initialization: CMD0, CMD8, ACMD41 until ready
+    uint32_t reg_us;       // Reading a register: CID (CMD10), CSD (CMD9), or SD Status (ACMD13)
+} sd_ram_latency_t;
+
+typedef struct sd_ram_if_state_t {
+    bool allocated;  // data was allocated by init (and will be freed by deinit)
+
+    // Emulation of an open CMD25
+    bool ongoing_mlt_blk_wrt;
+    uint32_t cont_sector_wrt;
+    uint64_t busy_until_us;  // Card is programming until this time
+
+    // Non-blocking I/O
+    bool deferring;
+    uint64_t deferred_us;
+    uint64_t io_done_us;
+
+    // Command counters
+    uint32_t cmd12_cnt;
+    uint32_t cmd17_cnt;
+    uint32_t cmd18_cnt;
+    uint32_t cmd24_cnt;
+    uint32_t cmd25_cnt;
+    uint32_t cmd38_cnt;
+    uint32_t cmd9_cnt;
+    uint32_t cmd10_cnt;
+    uint32_t acmd13_cnt;
+    uint64_t blocks_rd;
+    uint64_t blocks_wr;
+    uint64_t blocks_erased;
+    uint64_t modeled_us;  // Total time charged by the latency model
+} sd_ram_if_state_t;
+
+void sd_ram_ctor(sd_card_t *sd_card_p);  // Constructor for sd_card_t
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -168,6 +168,7 @@ static void sdio_send_command(const sd_card_t *sd_card_p, uint8_t command, uint3
 
 sdio_status_t rp2040_sdio_command_R1(sd_card_t *sd_card_p, uint8_t command, uint32_t arg, uint32_t *response)
 {
+    SD_STATS_INC(sd_card_p, commands);
     sdio_send_command(sd_card_p, command, arg, response ? 48 : 0);
 
     // Wait for response
@@ -213,6 +214,7 @@ sdio_status_t rp2040_sdio_command_R1(sd_card_t *sd_card_p, uint8_t command, uint
         {
             // azdbg("rp2040_sdio_command_R1(", (int)command, "): CRC error, calculated ", crc, " packet has ", actual_crc);
             EMSG_PRINTF("rp2040_sdio_command_R1(%d): CRC error, calculated 0x%hx, packet has 0x%hx\n", command, crc, actual_crc);
+            SD_STATS_INC(sd_card_p, crc_errors);
             return SDIO_ERR_RESPONSE_CRC;
         }
 
@@ -428,6 +430,7 @@ static void sdio_verify_rx_checksums(sd_card_t *sd_card_p, uint32_t maxcount, si
         if (checksum != expected)
         {
             STATE.checksum_errors++;
+            SD_STATS_INC(sd_card_p, crc_errors);
             if (STATE.checksum_errors == 1)
             {
                 EMSG_PRINTF("SDIO checksum error in reception: block %d calculated 0x%llx expected 0x%llx\n",
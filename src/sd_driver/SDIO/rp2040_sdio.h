@@ -73,6 +73,10 @@ typedef struct sd_sdio_if_state_t {
     // Variables for extended block writes
     bool ongoing_wr_mlt_blk;
     uint32_t wr_mlt_blk_cnt_sector;
+
+    // Variables for non-blocking I/O (see sd_async.h)
+    bool io_completed; // Request was carried out synchronously by start_io
+    bool io_ok;
     
     // Variables for block reads
     // This is used to perform DMA into data buffers and checksum buffers separately.
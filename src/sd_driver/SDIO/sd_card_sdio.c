@@ -26,8 +26,10 @@
 #include "delays.h"
 #include "rp2040_sdio.h"
 #include "rp2040_sdio.pio.h"  // build\build\rp2040_sdio.pio.h
+#include "sd_async.h"
 #include "sd_card_constants.h"
 #include "sd_card.h"
+#include "sd_init_cache.h"
 #include "sd_timeouts.h"
 #include "SdioCard.h"
 #include "util.h"
@@ -157,14 +159,18 @@ bool sd_sdio_begin(sd_card_t *sd_card_p)
         return false;
     }
 
-    // Get CSD
+    // Get CSD, unless it is a card we know (see sd_init_cache.h)
     // Valid in "stby" state; stays in "stby" state
-    if (!checkReturnOk(rp2040_sdio_command_R2(sd_card_p, CMD9_SEND_CSD, STATE.rca, sd_card_p->state.CSD)))
+    if (!sd_card_p->init_cache_p || !sd_init_cache_lookup(sd_card_p))
     {
-        azdbg("SDIO failed to read CSD");
-        return false;
+        if (!checkReturnOk(rp2040_sdio_command_R2(sd_card_p, CMD9_SEND_CSD, STATE.rca, sd_card_p->state.CSD)))
+        {
+            azdbg("SDIO failed to read CSD");
+            return false;
+        }
+        sd_card_p->state.sectors = CSD_sectors(sd_card_p->state.CSD);
+        if (sd_card_p->init_cache_p) sd_init_cache_store(sd_card_p);
     }
-    sd_card_p->state.sectors = CSD_sectors(sd_card_p->state.CSD);
 
     // Select card
     // Valid in "stby" state; 
@@ -254,6 +260,7 @@ bool sd_sdio_stopTransmission(sd_card_t *sd_card_p, bool blocking)
 {
 
     STATE.ongoing_wr_mlt_blk = false;
+    SD_STATS_INC(sd_card_p, stop_transmissions);
 
     uint32_t reply;
     if (!checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD12_STOP_TRANSMISSION, 0, &reply)))
@@ -267,8 +274,12 @@ bool sd_sdio_stopTransmission(sd_card_t *sd_card_p, bool blocking)
     }
     else
     {
+        uint64_t const t0 = sd_stats_start();
         uint32_t start = millis();
-        while (millis() - start < 200 && sd_sdio_isBusy(sd_card_p));
+        bool const was_busy = sd_sdio_isBusy(sd_card_p);
+        while (millis() - start < 200 && sd_sdio_isBusy(sd_card_p))
+            sd_busy_yield(sd_card_p);
+        if (was_busy) sd_stats_busy(sd_card_p, time_us_64() - t0);
         if (sd_sdio_isBusy(sd_card_p))
         {
             EMSG_PRINTF("sd_sdio_stopTransmission() timeout\n");
@@ -596,46 +607,192 @@ static block_dev_err_t sd_sdio_write_blocks(sd_card_t *sd_card_p, const uint8_t
     bool ok = true;
 
     sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
 
     if (1 == blockCnt)
         ok = sd_sdio_writeSector(sd_card_p, ulSectorNumber, buffer);
     else
         ok = sd_sdio_writeSectors(sd_card_p, ulSectorNumber, buffer, blockCnt);
 
+    block_dev_err_t rc = ok ? SD_BLOCK_DEVICE_ERROR_NONE : SD_BLOCK_DEVICE_ERROR_WRITE;
+    sd_stats_record(sd_card_p, SD_STATS_WRITE_SINGLE, blockCnt, t0, rc);
     sd_unlock(sd_card_p);
 
-    if (ok)
-        return SD_BLOCK_DEVICE_ERROR_NONE;
-    else
-        return SD_BLOCK_DEVICE_ERROR_WRITE;
+    return rc;
 }
 static block_dev_err_t sd_sdio_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer, uint32_t ulSectorNumber,
                                            uint32_t ulSectorCount) {
     bool ok = true;
 
     sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
 
     if (1 == ulSectorCount)
         ok = sd_sdio_readSector(sd_card_p, ulSectorNumber, buffer);
     else
         ok = sd_sdio_readSectors(sd_card_p, ulSectorNumber, buffer, ulSectorCount);
 
+    block_dev_err_t rc = ok ? SD_BLOCK_DEVICE_ERROR_NONE : SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    sd_stats_record(sd_card_p, SD_STATS_READ_SINGLE, ulSectorCount, t0, rc);
     sd_unlock(sd_card_p);
 
-    if (ok)
-        return SD_BLOCK_DEVICE_ERROR_NONE;
-    else
-        return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    return rc;
+}
+/* Non-blocking I/O (see sd_async.h)
+The card stays locked from start_io until poll_io sees completion. */
+
+static block_dev_err_t sd_sdio_start_io(sd_card_t *sd_card_p, sd_io_req_t *req_p) {
+    uint32_t const sector = req_p->sector;
+    uint32_t const n = req_p->count;
+    uint32_t reply;
+    bool ok = true;
+
+    sd_lock(sd_card_p);
+    STATE.io_completed = false;
+
+    if (SD_IO_READ == req_p->op) {
+        if (((uint32_t)req_p->rd_buffer & 3) != 0 || sector + n >= sd_card_p->state.sectors) {
+            // Unaligned read or end-of-drive read: do it now, sector-by-sector
+            STATE.io_ok = sd_sdio_readSectors(sd_card_p, sector, req_p->rd_buffer, n);
+            STATE.io_completed = true;
+            return SD_BLOCK_DEVICE_ERROR_NONE;
+        }
+        if (STATE.ongoing_wr_mlt_blk)
+            // Stop any ongoing transmission
+            ok = sd_sdio_stopTransmission(sd_card_p, true);
+        ok = ok &&
+             checkReturnOk(rp2040_sdio_rx_start(sd_card_p, req_p->rd_buffer, n, SDIO_BLOCK_SIZE)) &&  // Prepare for reception
+             checkReturnOk(rp2040_sdio_command_R1(sd_card_p, 1 == n ? CMD17_READ_SINGLE_BLOCK : CMD18_READ_MULTIPLE_BLOCK,
+                                                  sector, &reply));
+    } else {
+        if (((uint32_t)req_p->wr_buffer & 3) != 0) {
+            // Unaligned write: do it now, sector-by-sector
+            STATE.io_ok = sd_sdio_writeSectors(sd_card_p, sector, req_p->wr_buffer, n);
+            STATE.io_completed = true;
+            return SD_BLOCK_DEVICE_ERROR_NONE;
+        }
+        if (1 < n && STATE.ongoing_wr_mlt_blk && sector == STATE.wr_mlt_blk_cnt_sector) {
+            /* Continue a multiblock write */
+            ok = checkReturnOk(rp2040_sdio_tx_start(sd_card_p, req_p->wr_buffer, n));
+        } else {
+            if (STATE.ongoing_wr_mlt_blk)
+                // Stop any ongoing write transmission
+                ok = sd_sdio_stopTransmission(sd_card_p, true);
+            ok = ok &&
+                 checkReturnOk(rp2040_sdio_command_R1(sd_card_p, 1 == n ? CMD24_WRITE_BLOCK : CMD25_WRITE_MULTIPLE_BLOCK,
+                                                      sector, &reply)) &&
+                 checkReturnOk(rp2040_sdio_tx_start(sd_card_p, req_p->wr_buffer, n));  // Start transmission
+        }
+    }
+    if (!ok) {
+        sd_unlock(sd_card_p);
+        return SD_IO_READ == req_p->op ? SD_BLOCK_DEVICE_ERROR_NO_RESPONSE : SD_BLOCK_DEVICE_ERROR_WRITE;
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static block_dev_err_t sd_sdio_poll_io(sd_card_t *sd_card_p, sd_io_req_t *req_p) {
+    uint32_t const sector = req_p->sector;
+    uint32_t const n = req_p->count;
+    bool ok;
+
+    if (STATE.io_completed) {
+        ok = STATE.io_ok;
+    } else if (SD_IO_READ == req_p->op) {
+        STATE.error = rp2040_sdio_rx_poll(sd_card_p, SDIO_WORDS_PER_BLOCK);
+        if (SDIO_BUSY == STATE.error) return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+        ok = SDIO_OK == STATE.error;
+        if (!ok)
+            EMSG_PRINTF("%s: read(%lu, %lu) failed: %s (%d)\n",
+                        __func__, sector, n, errstr(STATE.error), (int)STATE.error);
+        if (1 < n) ok = sd_sdio_stopTransmission(sd_card_p, true) && ok;
+    } else {
+        uint32_t bytes_done;
+        STATE.error = rp2040_sdio_tx_poll(sd_card_p, &bytes_done);
+        if (SDIO_BUSY == STATE.error) return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+        ok = SDIO_OK == STATE.error;
+        if (!ok) {
+            EMSG_PRINTF("%s: write(%lu, %lu) failed: %s (%d)\n",
+                        __func__, sector, n, errstr(STATE.error), (int)STATE.error);
+            if (1 < n) sd_sdio_stopTransmission(sd_card_p, true);
+        } else if (1 < n) {
+            // Leave the transmission open for a continuation; see sd_sdio_writeSectors
+            STATE.wr_mlt_blk_cnt_sector = sector + n;
+            STATE.ongoing_wr_mlt_blk = true;
+        }
+    }
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (!ok)
+        rc = SD_IO_READ == req_p->op ? SD_BLOCK_DEVICE_ERROR_NO_RESPONSE : SD_BLOCK_DEVICE_ERROR_WRITE;
+    sd_stats_record(sd_card_p, SD_IO_READ == req_p->op ? SD_STATS_READ_SINGLE : SD_STATS_WRITE_SINGLE,
+                    n, req_p->start_us, rc);
+    sd_unlock(sd_card_p);
+
+    return rc;
 }
+
 static block_dev_err_t sd_sync(sd_card_t *sd_card_p) {
     sd_lock(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
     block_dev_err_t err = SD_BLOCK_DEVICE_ERROR_NONE;
     if (STATE.ongoing_wr_mlt_blk)
         if (!sd_sdio_stopTransmission(sd_card_p, true))
             err = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    sd_stats_record(sd_card_p, SD_STATS_SYNC, 0, t0, err);
     sd_unlock(sd_card_p);
     return err;
 }
+
+/* CMD32 (ERASE_WR_BLK_START_ADDR), CMD33 (ERASE_WR_BLK_END_ADDR), CMD38 (ERASE).
+For best performance, the range should be aligned on allocation units. */
+static block_dev_err_t sd_sdio_erase_blocks(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                            uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!blockCnt || (uint64_t)ulSectorNumber + blockCnt > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    sd_lock(sd_card_p);
+    bool ok = true;
+    if (STATE.ongoing_wr_mlt_blk)
+        // Stop any ongoing write transmission
+        ok = sd_sdio_stopTransmission(sd_card_p, true);
+    uint32_t reply;
+    ok = ok &&
+         checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD32_ERASE_WR_BLK_START_ADDR, ulSectorNumber, &reply)) &&
+         checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD33_ERASE_WR_BLK_END_ADDR, ulSectorNumber + blockCnt - 1, &reply)) &&
+         checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD38_ERASE, 0, &reply));
+    if (ok) {
+        // R1b: the card holds D0 low until the erase is done
+        uint64_t const t0 = sd_stats_start();
+        uint32_t start = millis();
+        bool const was_busy = sd_sdio_isBusy(sd_card_p);
+        while (millis() - start < sd_timeouts.sd_erase && sd_sdio_isBusy(sd_card_p))
+            sd_busy_yield(sd_card_p);
+        if (was_busy) sd_stats_busy(sd_card_p, time_us_64() - t0);
+        if (sd_sdio_isBusy(sd_card_p)) {
+            EMSG_PRINTF("%s: timeout\n", __func__);
+            ok = false;
+        }
+    }
+    sd_unlock(sd_card_p);
+    if (ok)
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    else
+        return SD_BLOCK_DEVICE_ERROR_ERASE;
+}
+static bool sd_sdio_get_sd_status(sd_card_t *sd_card_p, uint8_t status[64]) {
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK)) return false;
+    sd_lock(sd_card_p);
+    bool ok = true;
+    if (STATE.ongoing_wr_mlt_blk)
+        // Stop any ongoing write transmission
+        ok = sd_sdio_stopTransmission(sd_card_p, true);
+    ok = ok && rp2040_sdio_get_sd_status(sd_card_p, status);
+    sd_unlock(sd_card_p);
+    return ok;
+}
 void sd_sdio_ctor(sd_card_t *sd_card_p) {
     myASSERT(sd_card_p->sdio_if_p); // Must have an interface object
     /*
@@ -659,6 +816,10 @@ void sd_sdio_ctor(sd_card_t *sd_card_p) {
     sd_card_p->write_blocks = sd_sdio_write_blocks;
     sd_card_p->read_blocks = sd_sdio_read_blocks;
     sd_card_p->sync = sd_sync;
+    sd_card_p->erase_blocks = sd_sdio_erase_blocks;
     sd_card_p->get_num_sectors = sd_sdio_sectorCount;
+    sd_card_p->get_sd_status = sd_sdio_get_sd_status;
     sd_card_p->sd_test_com = sd_sdio_test_com;
+    sd_card_p->start_io = sd_sdio_start_io;
+    sd_card_p->poll_io = sd_sdio_poll_io;
 }
@@ -28,6 +28,7 @@ specific language governing permissions and limitations under the License.
 #include "delays.h"
 #include "hw_config.h"
 #include "my_debug.h"
+#include "pio_spi.h"
 #include "util.h"
 //
 #include "my_spi.h"
@@ -36,7 +37,31 @@ specific language governing permissions and limitations under the License.
 #pragma GCC diagnostic ignored "-Wunused-variable"
 #endif
 
+/* The SPI's data register, or the state machine's FIFOs */
+static volatile void *tx_fifo(spi_t *spi_p) {
+    return spi_p->pio ? pio_spi_tx_fifo(spi_p) : &spi_get_hw(spi_p->hw_inst)->dr;
+}
+static volatile void *rx_fifo(spi_t *spi_p) {
+    return spi_p->pio ? pio_spi_rx_fifo(spi_p) : &spi_get_hw(spi_p->hw_inst)->dr;
+}
+static uint get_dreq(spi_t *spi_p, bool is_tx) {
+    return spi_p->pio ? pio_get_dreq(spi_p->pio, spi_p->pio_sm, is_tx)
+                      : spi_get_dreq(spi_p->hw_inst, is_tx);
+}
+/* Once the RX DMA channel is done, a state machine has clocked in the last bit */
+static bool is_busy(spi_t *spi_p) {
+    return spi_p->pio ? !pio_sm_is_tx_fifo_empty(spi_p->pio, spi_p->pio_sm)
+                      : spi_is_busy(spi_p->hw_inst);
+}
+
 static bool chk_spi(spi_t *spi_p) {
+    if (spi_p->pio) {
+        if (!pio_spi_is_idle(spi_p)) {
+            DBG_PRINTF("PIO SPI FIFOs are not empty\n");
+            return false;
+        }
+        return true;
+    }
     spi_inst_t *hw_spi = spi_p->hw_inst;
     bool ok = true;
     if (spi_get_const_hw(hw_spi)->sr & SPI_SSPSR_BSY_BITS) {
@@ -129,14 +154,14 @@ void spi_transfer_start(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t len
     }
 
     dma_channel_configure(spi_p->tx_dma, &spi_p->tx_dma_cfg,
-                          &spi_get_hw(spi_p->hw_inst)->dr,  // write address
+                          tx_fifo(spi_p),                   // write address
                           tx,                               // read address
                           length,                           // element count (each element is of
                                                             // size transfer_data_size)
                           false);                           // start
     dma_channel_configure(spi_p->rx_dma, &spi_p->rx_dma_cfg,
                           rx,                               // write address
-                          &spi_get_hw(spi_p->hw_inst)->dr,  // read address
+                          rx_fifo(spi_p),                   // read address
                           length,                           // element count (each element is of
                                                             // size transfer_data_size)
                           false);                           // start
@@ -150,6 +175,108 @@ void spi_transfer_start(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t len
     dma_start_channel_mask((1u << spi_p->tx_dma) | (1u << spi_p->rx_dma));
 }
 
+auto_init_mutex(sniffer_mutex);
+
+bool my_spi_sniffer_claim(void) {
+    uint32_t owner;
+    return mutex_try_enter(&sniffer_mutex, &owner);
+}
+void my_spi_sniffer_unclaim(void) { mutex_exit(&sniffer_mutex); }
+
+/**
+ * @brief Start a SPI transfer with the DMA sniffer computing the CRC16 of the data.
+ *
+ * @details The sniffer watches the RX channel if there is an rx buffer, else the
+ * TX channel. In CRC-16-CCITT mode, with the bytes and the result not reversed,
+ * its accumulator is the CRC16 that SD cards use, continued over each byte that
+ * the channel transfers. See spi_transfer_start for the parameters.
+ *
+ * @param crc The initial value of the accumulator.
+ * @return true if the sniffer is computing the CRC16: call spi_transfer_crc16 afterwards.
+ */
+bool spi_transfer_start_crc16(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length,
+                              uint16_t crc) {
+    bool const sniff = spi_p->use_dma_sniffer_crc && my_spi_sniffer_claim();
+    if (sniff) {
+        // The channel's SNIFF_EN is in its configuration, which spi_transfer_start writes
+        channel_config_set_sniff_enable(rx ? &spi_p->rx_dma_cfg : &spi_p->tx_dma_cfg, true);
+        dma_sniffer_enable(rx ? spi_p->rx_dma : spi_p->tx_dma, DMA_SNIFF_CTRL_CALC_VALUE_CRC16,
+                           false);
+        dma_sniffer_set_data_accumulator(crc);
+    }
+    spi_transfer_start(spi_p, tx, rx, length);
+    return sniff;
+}
+
+uint16_t spi_transfer_crc16(spi_t *spi_p) {
+    uint16_t const crc = (uint16_t)dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+    channel_config_set_sniff_enable(&spi_p->rx_dma_cfg, false);
+    channel_config_set_sniff_enable(&spi_p->tx_dma_cfg, false);
+    my_spi_sniffer_unclaim();
+    return crc;
+}
+
+/**
+ * @brief Start a chained SPI transfer: send a list of buffers as one transfer.
+ *
+ * @details The control DMA channel writes each control block in turn into the
+ * TX channel's Alias 3 TRANS_COUNT and READ_ADDR_TRIG registers, which starts it;
+ * when the TX channel finishes, it chains back to the control channel for the next
+ * block, until the null trigger at the end of the list. Meanwhile, the RX channel
+ * clocks in the same number of bytes, all to one place, so what is left there is
+ * the last byte received (e.g., a data response token).
+ * So, e.g., a start token, a data block, its CRC and the read of the response
+ * go out back to back, without the CPU.
+ *
+ * @param spi_p Pointer to the SPI object. spi_p->ctrl_dma must have been claimed.
+ * @param blocks Control blocks, ending with {0, NULL}. Must stay in place until the
+ * transfer is complete.
+ * @param length Total bytes in the control blocks.
+ * @param last_rx_p Where the last byte received goes.
+ */
+void spi_transfer_chain_start(spi_t *spi_p, const spi_ctrl_blk_t *blocks, size_t length,
+                              uint8_t *last_rx_p) {
+    myASSERT(spi_p);
+    myASSERT(spi_p->ctrl_dma_claimed);
+    myASSERT(blocks && last_rx_p);
+
+    uint const ctrl_dma = spi_p->ctrl_dma;
+
+    dma_channel_config tx_cfg = spi_p->tx_dma_cfg;
+    channel_config_set_read_increment(&tx_cfg, true);
+    channel_config_set_chain_to(&tx_cfg, ctrl_dma);
+    channel_config_set_irq_quiet(&tx_cfg, true);
+    dma_channel_configure(spi_p->tx_dma, &tx_cfg,
+                          tx_fifo(spi_p),                   // write address
+                          NULL,                             // read address: from the control blocks
+                          0,                                // element count: from the control blocks
+                          false);                           // start
+
+    dma_channel_config ctrl_cfg = dma_channel_get_default_config(ctrl_dma);
+    channel_config_set_transfer_data_size(&ctrl_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&ctrl_cfg, true);
+    channel_config_set_write_increment(&ctrl_cfg, true);
+    channel_config_set_ring(&ctrl_cfg, true, 3);  // Wrap the write address every 8 bytes
+    dma_channel_configure(ctrl_dma, &ctrl_cfg,
+                          &dma_hw->ch[spi_p->tx_dma].al3_transfer_count,  // write address
+                          blocks,                                         // read address
+                          2,                                              // one control block
+                          false);                                         // start
+
+    channel_config_set_write_increment(&spi_p->rx_dma_cfg, false);
+    dma_channel_configure(spi_p->rx_dma, &spi_p->rx_dma_cfg,
+                          last_rx_p,                        // write address
+                          rx_fifo(spi_p),                   // read address
+                          length,                           // element count
+                          false);                           // start
+
+    myASSERT(chk_dmas(spi_p));
+    myASSERT(chk_spi(spi_p));
+
+    dma_start_channel_mask((1u << ctrl_dma) | (1u << spi_p->rx_dma));
+}
+
 /**
  * Calculate the time in milliseconds to transfer the given number of blocks
  * over the SPI bus at the given baud rate.
@@ -162,7 +289,7 @@ uint32_t calculate_transfer_time_ms(spi_t *spi_p, uint32_t bytes) {
     uint32_t total_bits = bytes * 8;
 
     // Get the baud rate from the SPI interface
-    uint32_t baud_rate = spi_get_baudrate(spi_p->hw_inst);
+    uint32_t baud_rate = my_spi_get_baudrate(spi_p);
 
     // Calculate the time to transfer all bits in seconds
     float transfer_time_sec = (double)total_bits / baud_rate;
@@ -208,11 +335,11 @@ bool __not_in_flash_func(spi_transfer_wait_complete)(spi_t *spi_p, uint32_t time
     } else {
         // If the DMA channels are not busy, wait for the SPI peripheral to become idle
         start = millis();
-        while (spi_is_busy(spi_p->hw_inst) && millis() - start < timeout_ms)
+        while (is_busy(spi_p) && millis() - start < timeout_ms)
             tight_loop_contents();
 
         // Check if the SPI peripheral is still busy
-        timed_out = spi_is_busy(spi_p->hw_inst);
+        timed_out = is_busy(spi_p);
 
         // Print debug information if the SPI peripheral is still busy
         if (timed_out) {
@@ -230,12 +357,18 @@ bool __not_in_flash_func(spi_transfer_wait_complete)(spi_t *spi_p, uint32_t time
                    uint_binary_str(dma_hw->ch[spi_p->tx_dma].ctrl_trig));
         DBG_PRINTF("RX DMA CTRL_TRIG: 0b%s\n",
                    uint_binary_str(dma_hw->ch[spi_p->rx_dma].ctrl_trig));
-        DBG_PRINTF("SPI SSPCR0: 0b%s\n", uint_binary_str(spi_get_hw(spi_p->hw_inst)->cr0));
-        DBG_PRINTF("SPI SSPCR1: 0b%s\n", uint_binary_str(spi_get_hw(spi_p->hw_inst)->cr1));
-        DBG_PRINTF("SPI_SSPSR: 0b%s\n", uint_binary_str(spi_get_const_hw(spi_p->hw_inst)->sr));
-        DBG_PRINTF("SPI_SSPDMACR: 0b%s\n",
-                   uint_binary_str(spi_get_const_hw(spi_p->hw_inst)->dmacr));
+        if (spi_p->pio) {
+            DBG_PRINTF("PIO FSTAT: 0b%s\n", uint_binary_str(spi_p->pio->fstat));
+            DBG_PRINTF("PIO SM PC: %u\n", pio_sm_get_pc(spi_p->pio, spi_p->pio_sm));
+        } else {
+            DBG_PRINTF("SPI SSPCR0: 0b%s\n", uint_binary_str(spi_get_hw(spi_p->hw_inst)->cr0));
+            DBG_PRINTF("SPI SSPCR1: 0b%s\n", uint_binary_str(spi_get_hw(spi_p->hw_inst)->cr1));
+            DBG_PRINTF("SPI_SSPSR: 0b%s\n", uint_binary_str(spi_get_const_hw(spi_p->hw_inst)->sr));
+            DBG_PRINTF("SPI_SSPDMACR: 0b%s\n",
+                       uint_binary_str(spi_get_const_hw(spi_p->hw_inst)->dmacr));
+        }
 
+        if (spi_p->ctrl_dma_claimed) dma_channel_abort(spi_p->ctrl_dma);
         dma_channel_abort(spi_p->rx_dma);
         dma_channel_abort(spi_p->tx_dma);
     }
@@ -276,34 +409,43 @@ bool my_spi_init(spi_t *spi_p) {
         spi_lock(spi_p);
 
         // Defaults:
-        if (!spi_p->hw_inst) spi_p->hw_inst = spi0;
+        if (!spi_p->pio && !spi_p->hw_inst) spi_p->hw_inst = spi0;
         if (!spi_p->baud_rate) spi_p->baud_rate = clock_get_hz(clk_sys) / 12;
 
-        /* Configure component */
-        // Enable SPI at 100 kHz and connect to GPIOs
-        spi_init(spi_p->hw_inst, 100 * 1000);
-
-        myASSERT(spi_p->spi_mode < 4);
-        switch (spi_p->spi_mode) {
-            case 0:
-                spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
-                break;
-            case 1:
-                spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_0, SPI_CPHA_1, SPI_MSB_FIRST);
-                break;
-            case 2:
-                spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_1, SPI_CPHA_0, SPI_MSB_FIRST);
-                break;
-            case 3:
-                spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
-                break;
-            default:
-                spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
-                break;
+        if (spi_p->pio) {
+            // A state machine, at 100 kHz, on the GPIOs (SPI mode 0 only)
+            if (!pio_spi_init(spi_p)) {
+                spi_unlock(spi_p);
+                mutex_exit(&my_spi_init_mutex);
+                return false;
+            }
+        } else {
+            /* Configure component */
+            // Enable SPI at 100 kHz and connect to GPIOs
+            spi_init(spi_p->hw_inst, 100 * 1000);
+
+            myASSERT(spi_p->spi_mode < 4);
+            switch (spi_p->spi_mode) {
+                case 0:
+                    spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+                    break;
+                case 1:
+                    spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_0, SPI_CPHA_1, SPI_MSB_FIRST);
+                    break;
+                case 2:
+                    spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_1, SPI_CPHA_0, SPI_MSB_FIRST);
+                    break;
+                case 3:
+                    spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
+                    break;
+                default:
+                    spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+                    break;
+            }
+            gpio_set_function(spi_p->miso_gpio, GPIO_FUNC_SPI);
+            gpio_set_function(spi_p->mosi_gpio, GPIO_FUNC_SPI);
+            gpio_set_function(spi_p->sck_gpio, GPIO_FUNC_SPI);
         }
-        gpio_set_function(spi_p->miso_gpio, GPIO_FUNC_SPI);
-        gpio_set_function(spi_p->mosi_gpio, GPIO_FUNC_SPI);
-        gpio_set_function(spi_p->sck_gpio, GPIO_FUNC_SPI);
         // ss_gpio is initialized in sd_spi_ctor()
 
         // Slew rate limiting levels for GPIO outputs.
@@ -340,6 +482,20 @@ bool my_spi_init(spi_t *spi_p) {
             spi_p->tx_dma = dma_claim_unused_channel(true);
             spi_p->rx_dma = dma_claim_unused_channel(true);
         }
+        // For chained transfers (spi_transfer_chain_start), if wanted
+        if (spi_p->use_ctrl_dma) {
+            if (spi_p->use_static_dma_channels) {
+                dma_channel_claim(spi_p->ctrl_dma);
+                spi_p->ctrl_dma_claimed = true;
+            } else {
+                int const ctrl_dma = dma_claim_unused_channel(false);
+                if (ctrl_dma >= 0) {
+                    spi_p->ctrl_dma = (uint)ctrl_dma;
+                    spi_p->ctrl_dma_claimed = true;
+                }
+            }
+        }
+
         spi_p->tx_dma_cfg = dma_channel_get_default_config(spi_p->tx_dma);
         spi_p->rx_dma_cfg = dma_channel_get_default_config(spi_p->rx_dma);
         channel_config_set_transfer_data_size(&spi_p->tx_dma_cfg, DMA_SIZE_8);
@@ -349,14 +505,14 @@ bool my_spi_init(spi_t *spi_p) {
         // transmit FIFO paced by the SPI TX FIFO DREQ The default is for the
         // read address to increment every element (in this case 1 byte -
         // DMA_SIZE_8) and for the write address to remain unchanged.
-        channel_config_set_dreq(&spi_p->tx_dma_cfg, spi_get_dreq(spi_p->hw_inst, true));
+        channel_config_set_dreq(&spi_p->tx_dma_cfg, get_dreq(spi_p, true));
         channel_config_set_write_increment(&spi_p->tx_dma_cfg, false);
 
         // We set the inbound DMA to transfer from the SPI receive FIFO to a
         // memory buffer paced by the SPI RX FIFO DREQ We configure the read
         // address to remain unchanged for each element, but the write address
         // to increment (so data is written throughout the buffer)
-        channel_config_set_dreq(&spi_p->rx_dma_cfg, spi_get_dreq(spi_p->hw_inst, false));
+        channel_config_set_dreq(&spi_p->rx_dma_cfg, get_dreq(spi_p, false));
         channel_config_set_read_increment(&spi_p->rx_dma_cfg, false);
 
         LED_INIT();
@@ -368,4 +524,14 @@ bool my_spi_init(spi_t *spi_p) {
     return true;
 }
 
+uint my_spi_set_baudrate(spi_t *spi_p, uint baudrate) {
+    if (spi_p->pio) return pio_spi_set_baudrate(spi_p, baudrate);
+    return spi_set_baudrate(spi_p->hw_inst, baudrate);
+}
+
+uint my_spi_get_baudrate(spi_t *spi_p) {
+    if (spi_p->pio) return pio_spi_get_baudrate(spi_p);
+    return spi_get_baudrate(spi_p->hw_inst);
+}
+
 /* [] END OF FILE */
@@ -26,6 +26,7 @@ specific language governing permissions and limitations under the License.
 #include "hardware/dma.h"
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
+#include "hardware/pio.h"
 #include "hardware/spi.h"
 //
 #include "my_debug.h"
@@ -37,6 +38,13 @@ extern "C" {
 
 #define SPI_FILL_CHAR (0xFF)
 
+/* A control block for a chained transfer (spi_transfer_chain_start): 
+the layout of a DMA channel's Alias 3 TRANS_COUNT and READ_ADDR_TRIG registers */
+typedef struct spi_ctrl_blk_t {
+    uint32_t length;   // Bytes to send (0, with a NULL tx, ends the chain)
+    const void *tx;    // Bytes to send
+} spi_ctrl_blk_t;
+
 // "Class" representing SPIs
 typedef struct spi_t {
     spi_inst_t *hw_inst;    // SPI HW
@@ -72,9 +80,27 @@ typedef struct spi_t {
     uint tx_dma;
     uint rx_dma;
 
+    /* Send multiple block writes as chained DMA transfers, with a third DMA channel
+    for control: ctrl_dma, if use_static_dma_channels; otherwise, one claimed
+    with dma_claim_unused_channel, if one is free when the SPI is initialized. */
+    bool use_ctrl_dma;
+    uint ctrl_dma;
+
+    /* To run the SPI on a PIO state machine instead of an SPI controller (see pio_spi.h):
+    the PIO (e.g., pio1); hw_inst is then ignored. NULL: use hw_inst. */
+    PIO pio;
+
+    /* Have the DMA sniffer compute the CRC16 of data blocks as they are read
+    or written, instead of the CPU. The sniffer is one for all DMA channels:
+    while another SPI (or the application, see my_spi_sniffer_claim) has it,
+    the CRC16 is computed in software. */
+    bool use_dma_sniffer_crc;
+
     /* The following fields are not part of the configuration. They are dynamically assigned. */
     dma_channel_config tx_dma_cfg;
     dma_channel_config rx_dma_cfg;
+    bool ctrl_dma_claimed;  // ctrl_dma is ours, for chained transfers
+    uint pio_sm;            // The state machine, if pio
     mutex_t mutex;    
     bool initialized;  
 } spi_t;
@@ -83,8 +109,28 @@ void spi_transfer_start(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t len
 uint32_t calculate_transfer_time_ms(spi_t *spi_p, uint32_t bytes);
 bool spi_transfer_wait_complete(spi_t *spi_p, uint32_t timeout_ms);
 bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length);
+void spi_transfer_chain_start(spi_t *spi_p, const spi_ctrl_blk_t *blocks, size_t length,
+                              uint8_t *last_rx_p);
 bool my_spi_init(spi_t *spi_p);
 
+/* Start a transfer with the DMA sniffer computing the CRC16 of the data received
+(if rx) or else sent, continuing from crc (e.g., crc16_update of bytes received before).
+Returns true if it does; then call spi_transfer_crc16 when the transfer is complete
+(or has failed). Returns false, having started the transfer without the sniffer,
+if spi_p->use_dma_sniffer_crc is not set or the sniffer is in use. */
+bool spi_transfer_start_crc16(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length,
+                              uint16_t crc);
+// Returns the CRC16 and releases the sniffer
+uint16_t spi_transfer_crc16(spi_t *spi_p);
+/* For an application that uses the DMA sniffer itself, while SPIs might:
+returns false if it is in use. SPIs compute CRCs in software meanwhile. */
+bool my_spi_sniffer_claim(void);
+void my_spi_sniffer_unclaim(void);
+
+// For either an SPI controller or a PIO. Return the actual baud rate.
+uint my_spi_set_baudrate(spi_t *spi_p, uint baudrate);
+uint my_spi_get_baudrate(spi_t *spi_p);
+
 static inline void spi_lock(spi_t *spi_p) {
     myASSERT(mutex_is_initialized(&spi_p->mutex));
     mutex_enter_blocking(&spi_p->mutex);
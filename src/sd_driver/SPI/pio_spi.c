@@ -0,0 +1,100 @@
+/* pio_spi.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* SPI on a PIO state machine. See pio_spi.h. */
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+#include "pico/stdlib.h"
+//
+#include "my_debug.h"
+#include "pio_spi.pio.h"
+//
+#include "pio_spi.h"
+
+/* Where the program is on each PIO, once loaded.
+Only touched in my_spi_init, which serializes initialization. */
+static bool loaded[NUM_PIOS];
+static uint offsets[NUM_PIOS];
+
+bool pio_spi_init(spi_t *spi_p) {
+    PIO pio = spi_p->pio;
+    uint const idx = pio_get_index(pio);
+    myASSERT(spi_p->sck_gpio < 32 && spi_p->mosi_gpio < 32 && spi_p->miso_gpio < 32);
+    if (!loaded[idx]) {
+        if (!pio_can_add_program(pio, &pio_spi_cpha0_program)) {
+            EMSG_PRINTF("%s: no room for the program on PIO %u\n", __func__, idx);
+            return false;
+        }
+        offsets[idx] = pio_add_program(pio, &pio_spi_cpha0_program);
+        loaded[idx] = true;
+    }
+    int sm = pio_claim_unused_sm(pio, false);
+    if (sm < 0) {
+        EMSG_PRINTF("%s: no free state machine on PIO %u\n", __func__, idx);
+        return false;
+    }
+    spi_p->pio_sm = (uint)sm;
+    // Start slow (100 kHz), like the SPI controller
+    float const clkdiv = (float)clock_get_hz(clk_sys) / (4 * 100 * 1000);
+    pio_spi_cpha0_program_init(pio, spi_p->pio_sm, offsets[idx], clkdiv, spi_p->sck_gpio,
+                               spi_p->mosi_gpio, spi_p->miso_gpio);
+    return true;
+}
+
+uint pio_spi_set_baudrate(spi_t *spi_p, uint baudrate) {
+    float clkdiv = (float)clock_get_hz(clk_sys) / (4.0f * baudrate);
+    if (clkdiv < 1.0f) clkdiv = 1.0f;
+    if (clkdiv > 65535.0f) clkdiv = 65535.0f;
+    pio_sm_set_clkdiv(spi_p->pio, spi_p->pio_sm, clkdiv);
+    return pio_spi_get_baudrate(spi_p);
+}
+
+uint pio_spi_get_baudrate(spi_t *spi_p) {
+    // CLKDIV: 16 bit integer part, 8 bit fraction
+    uint32_t const div = spi_p->pio->sm[spi_p->pio_sm].clkdiv >> PIO_SM0_CLKDIV_FRAC_LSB;
+    uint64_t const hz = (uint64_t)clock_get_hz(clk_sys) * 256;
+    return (uint)(hz / (4 * (uint64_t)(div ? div : 1 << 24)));
+}
+
+void pio_spi_transfer_blocking(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
+    PIO pio = spi_p->pio;
+    uint const sm = spi_p->pio_sm;
+    // Byte accesses: a byte written is replicated across the word, and the OSR shifts
+    // out its top; the byte read is the bottom of the word, where the ISR shifted it in.
+    io_rw_8 *txfifo = (io_rw_8 *)&pio->txf[sm];
+    io_rw_8 *rxfifo = (io_rw_8 *)&pio->rxf[sm];
+    size_t tx_remain = length, rx_remain = length;
+    while (tx_remain || rx_remain) {
+        if (tx_remain && !pio_sm_is_tx_fifo_full(pio, sm)) {
+            *txfifo = tx ? *tx++ : SPI_FILL_CHAR;
+            --tx_remain;
+        }
+        if (rx_remain && !pio_sm_is_rx_fifo_empty(pio, sm)) {
+            uint8_t const b = *rxfifo;
+            if (rx) *rx++ = b;
+            --rx_remain;
+        }
+    }
+}
+
+bool pio_spi_is_idle(spi_t *spi_p) {
+    return pio_sm_is_tx_fifo_empty(spi_p->pio, spi_p->pio_sm) &&
+           pio_sm_is_rx_fifo_empty(spi_p->pio, spi_p->pio_sm);
+}
+
+/* [] END OF FILE */
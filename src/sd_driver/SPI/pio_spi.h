@@ -0,0 +1,67 @@
+/* pio_spi.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* SPI on a PIO state machine
+
+An alternative to the SPI controllers (spi0, spi1) for spi_t: set spi_t::pio
+(e.g., to pio1) and the SPI is run by a state machine on that PIO (see pio_spi.pio),
+on any GPIOs, and hw_inst is ignored. my_spi.c points the same DMA transfers at the
+state machine's FIFOs, so nothing else changes.
+    * There can be as many buses as free state machines (4 per PIO), e.g. beyond
+      the two SPI controllers, or next to an SDIO card on the same PIO.
+      The buses on a PIO share one copy of the program (2 instructions).
+    * SCK is clk_sys / (4 * clkdiv), with a fractional clkdiv, so the baud rate can
+      be set in much finer steps than the controller's (clk_peri divided by an even
+      number), e.g. 37.5 MHz from a 150 MHz clk_sys, where the card and wiring allow.
+    * Only SPI mode 0 (spi_t::spi_mode is ignored), and only GPIOs 0 to 31.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "my_spi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Claims a state machine on spi_p->pio, loads the program if needed and sets up the pins
+bool pio_spi_init(spi_t *spi_p);
+
+// Returns the actual baud rate
+uint pio_spi_set_baudrate(spi_t *spi_p, uint baudrate);
+uint pio_spi_get_baudrate(spi_t *spi_p);
+
+/* Transfer bytes through the FIFOs with the CPU, for exchanges too short for the DMA.
+tx can be NULL to send SPI_FILL_CHAR; rx can be NULL. Everything received is read out
+of the RX FIFO, even if it is not kept: the state machine stalls when it is full. */
+void pio_spi_transfer_blocking(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length);
+
+// Whether both FIFOs are empty
+bool pio_spi_is_idle(spi_t *spi_p);
+
+static inline volatile void *pio_spi_tx_fifo(spi_t *spi_p) {
+    return &spi_p->pio->txf[spi_p->pio_sm];
+}
+static inline volatile void *pio_spi_rx_fifo(spi_t *spi_p) {
+    return &spi_p->pio->rxf[spi_p->pio_sm];
+}
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
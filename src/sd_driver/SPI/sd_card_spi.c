@@ -178,6 +178,7 @@
 #include "delays.h"
 #include "sd_card.h"
 #include "sd_card_constants.h"
+#include "sd_init_cache.h"
 #include "sd_spi.h"
 #include "sd_timeouts.h"
 #include "util.h"
@@ -198,6 +199,18 @@
 #define SD_CRC_ENABLED 1
 #endif
 
+/* sd_wait_ready: bursts to poll with the CPU before handing the polling to the DMA,
+and bytes to poll in each DMA transfer (64 bytes take about 41 us at 12.5 MHz) */
+#ifndef SD_BUSY_SPIN_BURSTS
+#define SD_BUSY_SPIN_BURSTS 4
+#endif
+#ifndef SD_BUSY_POLL_BYTES
+#define SD_BUSY_POLL_BYTES 64
+#endif
+#if SD_BUSY_POLL_BYTES < SD_SPI_BURST
+#  error "SD_BUSY_POLL_BYTES must be at least SD_SPI_BURST"
+#endif
+
 #if SD_CRC_ENABLED
 static bool crc_on = true;
 #else
@@ -293,6 +306,8 @@ typedef enum {
  * should be discarded.
  */
 static uint8_t sd_cmd_spi(sd_card_t *sd_card_p, cmdSupported cmd, uint32_t arg) {
+    SD_STATS_INC(sd_card_p, commands);
+    if (CMD12_STOP_TRANSMISSION == cmd) SD_STATS_INC(sd_card_p, stop_transmissions);
     uint8_t cmd_packet[PACKET_SIZE] = {
         SPI_CMD(cmd),
         (arg >> 24),
@@ -319,26 +334,23 @@ static uint8_t sd_cmd_spi(sd_card_t *sd_card_p, cmdSupported cmd, uint32_t arg)
                 break;
         }
     }
-    // send a command
-    for (size_t i = 0; i < PACKET_SIZE; i++) {
-        sd_spi_write(sd_card_p, cmd_packet[i]);
-    }
-
+    /* Send the command, and clock in the first byte of the response, in one burst
+    through the FIFOs. The card takes at least one byte time (NCR) to respond, 
+    so no byte of the response beyond the first can be clocked in by mistake. */
+    uint8_t tx[PACKET_SIZE + 2], rx[PACKET_SIZE + 2];
+    size_t n = PACKET_SIZE;
+    memcpy(tx, cmd_packet, PACKET_SIZE);
     // The received byte immediately following CMD12 is a stuff byte,
     // it should be discarded before receive the response of the CMD12.
-    if (CMD12_STOP_TRANSMISSION == cmd) {
-        sd_spi_write(sd_card_p, SPI_FILL_CHAR);
-    }
+    if (CMD12_STOP_TRANSMISSION == cmd) tx[n++] = SPI_FILL_CHAR;
+    tx[n++] = SPI_FILL_CHAR;
+    sd_spi_burst(sd_card_p, tx, rx, n);
+    uint8_t response = rx[n - 1];
 
     // Loop for response: Response is sent back within command response time
     // (NCR), 0 to 8 bytes for SDC
-    uint8_t response;
-    for (size_t i = 0; i < 0x10; i++) {
+    for (size_t i = 1; i < 0x10 && (response & R1_RESPONSE_RECV); i++) {
         response = sd_spi_read(sd_card_p);
-        // Got the response
-        if (!(response & R1_RESPONSE_RECV)) {
-            break;
-        }
     }
 
     return response;
@@ -349,6 +361,9 @@ static uint8_t sd_cmd_spi(sd_card_t *sd_card_p, cmdSupported cmd, uint32_t arg)
  * @brief Wait for the SD card to be ready for the next command.
  *
  * Sends dummy clocks with DI held high until the card releases the DO line.
+ * Short waits (e.g., for a command) are polled by the CPU. Programming a block
+ * takes much longer: after SD_BUSY_SPIN_BURSTS bursts, the DMA clocks in
+ * SD_BUSY_POLL_BYTES at a time, and sd_busy_yield runs while it does.
  *
  * @param sd_card_p Pointer to the sd_card_t struct.
  * @param timeout The maximum time to wait for the card to become ready.
@@ -360,10 +375,32 @@ static bool sd_wait_ready(sd_card_t *sd_card_p, uint32_t timeout) {
 
     // Keep sending dummy clocks with DI held high until the card releases the
     // DO line
+    uint64_t const t0 = sd_stats_start();
     uint32_t start = millis();
-    do {
-        resp = sd_spi_write_read(sd_card_p, 0xFF);
-    } while (resp != 0xFF && millis() - start < timeout);
+    resp = sd_spi_write_read(sd_card_p, 0xFF);
+    if (resp != 0xFF) {
+        /* Busy: poll a burst at a time. Clocking a few bytes more than needed 
+        costs nothing when the card is ready, but a call for each byte does. */
+        uint8_t rx[SD_BUSY_POLL_BYTES];
+        for (size_t i = 0; i < SD_BUSY_SPIN_BURSTS && resp != 0xFF && millis() - start < timeout;
+             ++i) {
+            sd_spi_burst(sd_card_p, NULL, rx, SD_SPI_BURST);
+            resp = rx[SD_SPI_BURST - 1];
+        }
+        /* Still busy: programming. Let the DMA do the polling, and the caller 
+        do other work meanwhile. */
+        spi_t *spi_p = sd_card_p->spi_if_p->spi;
+        while (resp != 0xFF && millis() - start < timeout) {
+            spi_transfer_start(spi_p, NULL, rx, sizeof rx);
+            do {
+                sd_busy_yield(sd_card_p);
+            } while (dma_channel_is_busy(spi_p->rx_dma) && millis() - start < timeout);
+            if (!spi_transfer_wait_complete(spi_p, calculate_transfer_time_ms(spi_p, sizeof rx)))
+                break;
+            resp = rx[sizeof rx - 1];
+        }
+        sd_stats_busy(sd_card_p, time_us_64() - t0);
+    }
     /* Checking for 0xFF provides a little extra margin to 
     make sure that DO has gone high and stayed there.
     (the alternative is to accept the first non-zero byte) */
@@ -566,6 +603,7 @@ static block_dev_err_t sd_cmd(sd_card_t *sd_card_p, const cmdSupported cmd, uint
         }
     }
     for (unsigned i = 0; i < sd_timeouts.sd_command_retries; i++) {
+        if (i) SD_STATS_INC(sd_card_p, retries);
         // Send CMD55 for APP command first
         if (isAcmd) {
             response = sd_cmd_spi(sd_card_p, CMD55_APP_CMD, 0x0);
@@ -593,6 +631,7 @@ static block_dev_err_t sd_cmd(sd_card_t *sd_card_p, const cmdSupported cmd, uint
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
     if (response & R1_COM_CRC_ERROR && ACMD23_SET_WR_BLK_ERASE_COUNT != cmd) {
+        SD_STATS_INC(sd_card_p, crc_errors);
         DBG_PRINTF("CRC error CMD:%d response 0x%" PRIx32 "\n", cmd, response);
         return SD_BLOCK_DEVICE_ERROR_CRC;  // CRC error
     }
@@ -622,17 +661,20 @@ static block_dev_err_t sd_cmd(sd_card_t *sd_card_p, const cmdSupported cmd, uint
             DBG_PRINTF("V2-Version Card\n");
             sd_card_p->state.card_type = SDCARD_V2;  // fallthrough
             // Note: No break here, need to read rest of the response
-        case CMD58_READ_OCR:  // Response R3
-            response = (sd_spi_read(sd_card_p) << 24);
-            response |= (sd_spi_read(sd_card_p) << 16);
-            response |= (sd_spi_read(sd_card_p) << 8);
-            response |= sd_spi_read(sd_card_p);
+        case CMD58_READ_OCR: {  // Response R3
+            uint8_t r[4];
+            sd_spi_burst(sd_card_p, NULL, r, sizeof r);
+            response = ((uint32_t)r[0] << 24) | ((uint32_t)r[1] << 16) | ((uint32_t)r[2] << 8) | r[3];
             DBG_PRINTF("R3/R7: 0x%" PRIx32 "\n", response);
             break;
+        }
         case CMD12_STOP_TRANSMISSION:  // Response R1b
-        case CMD38_ERASE:
             sd_wait_ready(sd_card_p, sd_timeouts.sd_command);
             break;
+        case CMD38_ERASE:  // Response R1b
+            if (!sd_wait_ready(sd_card_p, sd_timeouts.sd_erase))
+                status = SD_BLOCK_DEVICE_ERROR_ERASE;
+            break;
         case CMD13_SEND_STATUS:  // Response R2
             response <<= 8;
             response |= sd_spi_read(sd_card_p);
@@ -721,6 +763,9 @@ static uint32_t in_sd_spi_sectors(sd_card_t *sd_card_p) {
  *          releasing the card.
  */
 uint32_t sd_spi_sectors(sd_card_t *sd_card_p) {
+    // The CSD was read (or found in the init cache) at initialization
+    if (!(sd_card_p->state.m_Status & STA_NOINIT) && sd_card_p->state.sectors)
+        return sd_card_p->state.sectors;
     sd_acquire(sd_card_p);
     uint32_t sectors = in_sd_spi_sectors(sd_card_p);
     sd_release(sd_card_p);
@@ -728,40 +773,61 @@ uint32_t sd_spi_sectors(sd_card_t *sd_card_p) {
 }
 
 /**
- * @brief Wait for the card to become ready and send a given token.
+ * @brief Wait for the start token of a data block, reading a burst at a time.
  *
  * @param sd_card_p A pointer to the sd_card_t structure for the card.
- * @param token The token to be sent once the card is ready.
+ * @param token The token to wait for.
+ * @param buffer Where the data block goes.
+ * @param length The length of the data block.
  *
- * @return True if the card became ready and the token was sent, false otherwise.
+ * @return The number of bytes of the data block that came in the same burst
+ *         as the token (and are already in buffer), or -1 on timeout.
  *
- * @details The function waits until the card is ready and then sends the given
- *          token. If the card doesn't become ready within the timeout period,
- *          the function returns false.
+ * @details The bytes before the token (the access time, NAC, can be long)
+ *          are polled up to SD_SPI_BURST at a time, rather than with a call
+ *          for each byte. Bursts are kept short enough that they cannot run
+ *          past the end of the data block.
  */
-static bool sd_wait_token(sd_card_t *sd_card_p, uint8_t token) {
-    //TRACE_PRINTF("%s(0x%02x)\n", __FUNCTION__, token);
-
+static int sd_wait_token(sd_card_t *sd_card_p, uint8_t token, uint8_t *buffer,
+                               size_t length) {
+    uint8_t rx[SD_SPI_BURST];
+    size_t const n = length + 1 < sizeof rx ? length + 1 : sizeof rx;
     uint32_t start = millis();
     do {
-        if (token == sd_spi_read(sd_card_p)) {
-            return true;
+        sd_spi_burst(sd_card_p, NULL, rx, n);
+        for (size_t i = 0; i < n; ++i) {
+            if (token == rx[i]) {
+                memcpy(buffer, rx + i + 1, n - i - 1);
+                return n - i - 1;
+            }
         }
     } while (millis() - start < sd_timeouts.sd_command);
 
-    DBG_PRINTF("sd_wait_token: timeout\n");
-    return false;
+    DBG_PRINTF("%s: timeout\n", __func__);
+    return -1;
+}
+
+/* Read the CRC16 trailer of a data block */
+static uint16_t sd_read_crc16(sd_card_t *sd_card_p) {
+    uint8_t crc[2];
+    sd_spi_burst(sd_card_p, NULL, crc, sizeof crc);
+    return (crc[0] << 8) | crc[1];
+}
+
+/* Verify a received checksum against the computed one */
+static bool cmp_crc16(sd_card_t *sd_card_p, uint16_t crc_result, uint16_t crc) {
+    if (crc_result != crc) {
+        SD_STATS_INC(sd_card_p, crc_errors);
+        DBG_PRINTF("%s: Invalid CRC received: 0x%" PRIx16 " computed: 0x%" PRIx16 "\n",
+                __func__, crc, crc_result);
+    }
+    return (crc_result == crc);
 }
 
-static bool chk_crc16(uint8_t *buffer, size_t length, uint16_t crc) {
+static bool chk_crc16(sd_card_t *sd_card_p, uint8_t *buffer, size_t length, uint16_t crc) {
     if (crc_on) {
-        uint16_t crc_result;
         // Compute and verify checksum
-        crc_result = crc16(buffer, length);
-        if (crc_result != crc)
-            DBG_PRINTF("%s: Invalid CRC received: 0x%" PRIx16 " computed: 0x%" PRIx16 "\n",
-                    __func__, crc, crc_result);
-        return (crc_result == crc);
+        return cmp_crc16(sd_card_p, crc16(buffer, length), crc);
     }
     return true;
 }
@@ -774,18 +840,20 @@ static block_dev_err_t read_bytes(sd_card_t *sd_card_p, uint8_t *buffer, uint32_
     uint16_t crc;
 
     // read until start byte (0xFE)
-    if (false == sd_wait_token(sd_card_p, SPI_START_BLOCK)) {
+    int got = sd_wait_token(sd_card_p, SPI_START_BLOCK, buffer, length);
+    if (got < 0) {
         DBG_PRINTF("%s:%d Read timeout\n", __func__, __LINE__);
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
-    bool ok = sd_spi_transfer(sd_card_p, NULL, buffer, length);
-    if (!ok) return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    if ((uint32_t)got < length) {
+        bool ok = sd_spi_transfer(sd_card_p, NULL, buffer + got, length - got);
+        if (!ok) return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    }
 
     // Read the CRC16 checksum for the data block
-    crc = (sd_spi_read(sd_card_p) << 8);
-    crc |= sd_spi_read(sd_card_p);
+    crc = sd_read_crc16(sd_card_p);
 
-    if (!chk_crc16(buffer, length, crc)) {
+    if (!chk_crc16(sd_card_p, buffer, length, crc)) {
         DBG_PRINTF("%s: Invalid CRC received: 0x%" PRIx16 "\n", __func__, crc);
         return SD_BLOCK_DEVICE_ERROR_CRC;
     }
@@ -850,17 +918,24 @@ static block_dev_err_t in_sd_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
     // receive the data : one block at a time
     while (blk_cnt) {
         // read until start byte (0xFE)
-        if (!sd_wait_token(sd_card_p, SPI_START_BLOCK)) {
+        int got = sd_wait_token(sd_card_p, SPI_START_BLOCK, buffer, sd_block_size);
+        if (got < 0) {
             DBG_PRINTF("%s:%d Read timeout\n", __func__, __LINE__);
             return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
         }
-        // read data
-        sd_spi_transfer_start(sd_card_p, NULL, buffer, sd_block_size);
+        /* read (the rest of the) data, 
+        with the DMA sniffer computing the CRC16 (from that of the bytes already in) if it can */
+        bool sniffed = false;
+        if (crc_on)
+            sniffed = sd_spi_transfer_start_crc16(sd_card_p, NULL, buffer + got,
+                                                  sd_block_size - got, crc16_update(0, buffer, got));
+        else
+            sd_spi_transfer_start(sd_card_p, NULL, buffer + got, sd_block_size - got);
 
         // Check the CRC16 checksum for the previous data block
         if (prev_buffer_addr) {
             // Check previous block's CRC:
-            if (!chk_crc16(prev_buffer_addr, sd_block_size, prev_block_crc)) {
+            if (!chk_crc16(sd_card_p, prev_buffer_addr, sd_block_size, prev_block_crc)) {
                 DBG_PRINTF("%s: Invalid CRC received: 0x%" PRIx16 "\n", __func__,
                            prev_block_crc);
                 return SD_BLOCK_DEVICE_ERROR_CRC;
@@ -869,12 +944,18 @@ static block_dev_err_t in_sd_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
         
         uint32_t timeout = calculate_transfer_time_ms(sd_card_p->spi_if_p->spi, sd_block_size);
         bool ok = sd_spi_transfer_wait_complete(sd_card_p, timeout);
+        uint16_t const sniffed_crc = sniffed ? sd_spi_transfer_crc16(sd_card_p) : 0;
         if (!ok) return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
 
         // Read the CRC16 checksum for the data block
-        prev_block_crc = sd_spi_read(sd_card_p) << 8;
-        prev_block_crc |= sd_spi_read(sd_card_p);
-        prev_buffer_addr = buffer;
+        prev_block_crc = sd_read_crc16(sd_card_p);
+        if (sniffed) {
+            // Checked already
+            if (!cmp_crc16(sd_card_p, sniffed_crc, prev_block_crc)) return SD_BLOCK_DEVICE_ERROR_CRC;
+            prev_buffer_addr = NULL;
+        } else {
+            prev_buffer_addr = buffer;
+        }
         buffer += sd_block_size;
         --blk_cnt;
     }
@@ -885,7 +966,8 @@ static block_dev_err_t in_sd_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
         if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
     }
     // Check final block's CRC:
-    if (!chk_crc16(prev_buffer_addr, sd_block_size, prev_block_crc)) {
+    if (prev_buffer_addr &&
+        !chk_crc16(sd_card_p, prev_buffer_addr, sd_block_size, prev_block_crc)) {
         DBG_PRINTF("%s: Invalid CRC received: 0x%" PRIx16 "\n", __func__, prev_block_crc);
         return SD_BLOCK_DEVICE_ERROR_CRC;
     }
@@ -895,6 +977,7 @@ static block_dev_err_t sd_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
                                       uint32_t data_address, uint32_t num_rd_blks) {
     TRACE_PRINTF("sd_read_blocks(0x%p, 0x%lx, 0x%lx)\n", buffer, data_address, num_rd_blks);
     sd_acquire(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
     unsigned retries = sd_timeouts.sd_command_retries;
     block_dev_err_t status;
     do {
@@ -903,8 +986,10 @@ static block_dev_err_t sd_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer,
             if (SD_BLOCK_DEVICE_ERROR_NONE !=
                     sd_cmd(sd_card_p, CMD12_STOP_TRANSMISSION, 0x0, false, 0))
                 break;
+            if (retries > 1) SD_STATS_INC(sd_card_p, retries);
         }
     } while (--retries && status != SD_BLOCK_DEVICE_ERROR_NONE);
+    sd_stats_record(sd_card_p, SD_STATS_READ_SINGLE, num_rd_blks, t0, status);
     sd_release(sd_card_p);
     return status;
 }
@@ -948,6 +1033,44 @@ static block_dev_err_t get_num_wr_blocks(sd_card_t *sd_card_p, uint32_t *num_p)
     return SD_BLOCK_DEVICE_ERROR_NONE;
 }
 
+/**
+ * @brief Check the data response token that follows a block written to the card.
+ *
+ * @param sd_card_p Pointer to the SD card object.
+ * @param response The data response token.
+ *
+ * @return SD_BLOCK_DEVICE_ERROR_NONE if the data was accepted, otherwise
+ *         SD_BLOCK_DEVICE_ERROR_WRITE.
+ */
+static block_dev_err_t chk_data_response(sd_card_t *sd_card_p, uint8_t response) {
+    // Only CRC and general write error are communicated via response token
+    if ((response & SPI_DATA_RESPONSE_MASK) != SPI_DATA_ACCEPTED) {
+        EMSG_PRINTF("%s: Block Write not accepted. Response token: 0x%x, "
+                "status bits: %d%d%d\n",
+                sd_get_drive_prefix(sd_card_p),
+                response,
+                response & 0b1000 ? 1 : 0,
+                response & 0b0100 ? 1 : 0,
+                response & 0b0010 ? 1 : 0
+                );
+        if ((response & SPI_DATA_RESPONSE_MASK) == SPI_DATA_CRC_ERROR)
+            SD_STATS_INC(sd_card_p, crc_errors);
+        /*
+         * The meaning of the status bits (bits 3, 2 & 1)
+         * is defined as follows:
+         *   '010' - Data accepted.
+         *   '101' - Data rejected due to a CRC error.
+         *   '110' - Data Rejected due to a Write Error
+         * In case of any error (CRC or Write Error) during Write Multiple Block operation, the
+         * host shall stop the data transmission using CMD12. In case of a Write Error (response
+         * '110'), the host may send CMD13 (SEND_STATUS) in order to get the cause of the write
+         * problem. ACMD22 can be used to find the number of well written write blocks.
+         */
+        return SD_BLOCK_DEVICE_ERROR_WRITE;
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
 /**
  * @brief Send a single block of data to the SD card.
  *
@@ -977,8 +1100,9 @@ static block_dev_err_t send_block(sd_card_t *sd_card_p, const uint8_t *buffer, u
         return SD_BLOCK_DEVICE_ERROR_WRITE;
     }
 
-    // Write the data
-    sd_spi_transfer_start(sd_card_p, buffer, NULL, length);
+    // Write the data, with the DMA sniffer computing the CRC16 if it can
+    bool const sniffed = crc_on && sd_spi_transfer_start_crc16(sd_card_p, buffer, NULL, length, 0);
+    if (!crc_on) sd_spi_transfer_start(sd_card_p, buffer, NULL, length);
 
     /* Optimization:
     While the DMA is busy transfering the block data,
@@ -989,47 +1113,23 @@ static block_dev_err_t send_block(sd_card_t *sd_card_p, const uint8_t *buffer, u
 
     uint16_t crc = (~0);
     // While DMA transfers the block, compute CRC:
-    if (crc_on) {
+    if (crc_on && !sniffed) {
         // Compute CRC
         crc = crc16((void *)buffer, length);
     }
     uint32_t timeout = calculate_transfer_time_ms(sd_card_p->spi_if_p->spi, length);
     bool ok = sd_spi_transfer_wait_complete(sd_card_p, timeout);
+    if (sniffed) crc = sd_spi_transfer_crc16(sd_card_p);
     if (!ok) return SD_BLOCK_DEVICE_ERROR_WRITE;
 
     // Write the checksum CRC16
     sd_spi_write(sd_card_p, crc >> 8);
     sd_spi_write(sd_card_p, crc);
 
-    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
-
     // Check the response token
     response = sd_spi_read(sd_card_p);
+    block_dev_err_t rc = chk_data_response(sd_card_p, response);
 
-    // Only CRC and general write error are communicated via response token
-    if ((response & SPI_DATA_RESPONSE_MASK) != SPI_DATA_ACCEPTED) {
-        EMSG_PRINTF("%s: Block Write not accepted. Response token: 0x%x, "
-                "status bits: %d%d%d\n",
-                sd_get_drive_prefix(sd_card_p),
-                response,
-                response & 0b1000 ? 1 : 0,
-                response & 0b0100 ? 1 : 0,
-                response & 0b0010 ? 1 : 0
-                );
-        /*
-         * The meaning of the status bits (bits 3, 2 & 1)
-         * is defined as follows:
-         *   '010' - Data accepted.
-         *   '101' - Data rejected due to a CRC error.
-         *   '110' - Data Rejected due to a Write Error
-         * In case of any error (CRC or Write Error) during Write Multiple Block operation, the
-         * host shall stop the data transmission using CMD12. In case of a Write Error (response
-         * '110'), the host may send CMD13 (SEND_STATUS) in order to get the cause of the write
-         * problem. ACMD22 can be used to find the number of well written write blocks.
-         */
-
-        rc = SD_BLOCK_DEVICE_ERROR_WRITE;
-    }
     // Wait while card is busy programming
     if (false == sd_wait_ready(sd_card_p, sd_timeouts.sd_command)) {
         DBG_PRINTF("%s:%d: Card not ready yet\n", __func__, __LINE__);
@@ -1037,6 +1137,71 @@ static block_dev_err_t send_block(sd_card_t *sd_card_p, const uint8_t *buffer, u
     }
     return rc;
 }
+/* The CRC16 of a block, big-endian, as it goes on the wire */
+static void put_crc16(uint8_t crc_be[2], const uint8_t *buffer) {
+    uint16_t crc = crc_on ? crc16((void *)buffer, sd_block_size) : (uint16_t)~0;
+    crc_be[0] = crc >> 8;
+    crc_be[1] = crc;
+}
+
+/**
+ * @brief Send the blocks of a multiple block write with chained DMA.
+ *
+ * @details Each block goes out as one chained transfer (spi_transfer_chain_start):
+ * the start block token, the data, the CRC16 (computed beforehand) and the read
+ * of the data response token, back to back, without the CPU.
+ * While a block is on the wire, the CPU computes the CRC16 of the next one.
+ * Between blocks, it checks the data response token and waits for the card to
+ * finish programming, which the card signals on DO and which cannot be chained.
+ *
+ * @param sd_card_p Pointer to the SD card object.
+ * @param buffer_p Pointer to the pointer to the data; advanced past each block sent.
+ * @param data_address_p Pointer to the block address; advanced with each block sent.
+ * @param num_wrt_blks_p Pointer to the number of blocks left to send.
+ *
+ * @return SD_BLOCK_DEVICE_ERROR_NONE if all blocks were sent and accepted,
+ *         otherwise SD_BLOCK_DEVICE_ERROR_WRITE.
+ */
+static block_dev_err_t send_blocks_chained(sd_card_t *sd_card_p, const uint8_t *buffer_p[],
+                                           uint32_t *const data_address_p,
+                                           uint32_t *const num_wrt_blks_p) {
+    static const uint8_t token = SPI_START_BLK_MUL_WRITE;
+    static const uint8_t fill = SPI_FILL_CHAR;
+    spi_t *spi_p = sd_card_p->spi_if_p->spi;
+    uint8_t crc_be[2][2];  // One being sent, one being computed
+    uint8_t response = 0;
+    size_t const length = 1 + sd_block_size + 2 + 1;
+    uint32_t const timeout = calculate_transfer_time_ms(spi_p, length);
+    unsigned i = 0;
+
+    put_crc16(crc_be[0], *buffer_p);
+    do {
+        spi_ctrl_blk_t const blocks[] = {
+            {1, &token},
+            {sd_block_size, *buffer_p},
+            {2, crc_be[i % 2]},
+            {1, &fill},  // Clocks in the data response token
+            {0, NULL}};
+        spi_transfer_chain_start(spi_p, blocks, length, &response);
+
+        // While the DMA sends this block, compute the CRC of the next
+        if (*num_wrt_blks_p > 1) put_crc16(crc_be[(i + 1) % 2], *buffer_p + sd_block_size);
+
+        if (!spi_transfer_wait_complete(spi_p, timeout)) return SD_BLOCK_DEVICE_ERROR_WRITE;
+        block_dev_err_t status = chk_data_response(sd_card_p, response);
+        // Wait while card is busy programming
+        if (false == sd_wait_ready(sd_card_p, sd_timeouts.sd_command)) {
+            DBG_PRINTF("%s:%d: Card not ready yet\n", __func__, __LINE__);
+            status = SD_BLOCK_DEVICE_ERROR_WRITE;
+        }
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+        *buffer_p += sd_block_size;
+        ++*data_address_p;
+        ++i;
+    } while (--*num_wrt_blks_p);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
 /**
  * @brief Send all blocks of data, one block at a time.
  * 
@@ -1063,12 +1228,16 @@ static block_dev_err_t send_all_blocks(sd_card_t *sd_card_p, const uint8_t *buff
         uint32_t * const num_wrt_blks_p)
 {
     block_dev_err_t status;
-    do {
-        status = send_block(sd_card_p, *buffer_p, SPI_START_BLK_MUL_WRITE, sd_block_size);
-        if (SD_BLOCK_DEVICE_ERROR_NONE != status) break;
-        *buffer_p += sd_block_size;
-        ++*data_address_p;
-    } while (--*num_wrt_blks_p);
+    if (sd_card_p->spi_if_p->spi->ctrl_dma_claimed) {
+        status = send_blocks_chained(sd_card_p, buffer_p, data_address_p, num_wrt_blks_p);
+    } else {
+        do {
+            status = send_block(sd_card_p, *buffer_p, SPI_START_BLK_MUL_WRITE, sd_block_size);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != status) break;
+            *buffer_p += sd_block_size;
+            ++*data_address_p;
+        } while (--*num_wrt_blks_p);
+    }
     if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
         myASSERT(!*num_wrt_blks_p);
         sd_card_p->spi_if_p->state.cont_sector_wrt = *data_address_p;
@@ -1145,6 +1314,7 @@ static block_dev_err_t in_sd_write_blocks(sd_card_t *sd_card_p,
 }
 static block_dev_err_t stop_wr_tran(sd_card_t *sd_card_p) {
     sd_card_p->spi_if_p->state.ongoing_mlt_blk_wrt = false;
+    SD_STATS_INC(sd_card_p, stop_transmissions);
     /* In a Multiple Block write operation, the stop transmission will be
      * done by sending 'Stop Tran' token instead of 'Start Block' token at
      * the beginning of the next block
@@ -1257,6 +1427,8 @@ static block_dev_err_t sd_write_blocks(sd_card_t *sd_card_p, uint8_t const buffe
 
     // Acquire the SD card
     sd_acquire(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
+    uint32_t const blocks = num_wrt_blks;
 
     block_dev_err_t status;
 
@@ -1267,12 +1439,16 @@ static block_dev_err_t sd_write_blocks(sd_card_t *sd_card_p, uint8_t const buffe
         // If writing multiple blocks, retry the operation until it succeeds or reaches the maximum number of retries
         unsigned retries = sd_timeouts.sd_command_retries;
         do {
-            if (retries < sd_timeouts.sd_command_retries) DBG_PRINTF("Retrying\n");
+            if (retries < sd_timeouts.sd_command_retries) {
+                SD_STATS_INC(sd_card_p, retries);
+                DBG_PRINTF("Retrying\n");
+            }
             status = in_sd_write_blocks(sd_card_p, &buffer, &data_address, &num_wrt_blks);
             if (SD_BLOCK_DEVICE_ERROR_WRITE == status)
                 DBG_PRINTF("%s status=0x%x data_address=%lu num_wrt_blks=%lu\n", sd_get_drive_prefix(sd_card_p), status, data_address, num_wrt_blks);
         } while (SD_BLOCK_DEVICE_ERROR_WRITE == status && --retries && num_wrt_blks);
     }
+    sd_stats_record(sd_card_p, SD_STATS_WRITE_SINGLE, blocks, t0, status);
 
     // Release the SD card
     sd_release(sd_card_p);
@@ -1300,12 +1476,85 @@ static block_dev_err_t sd_write_blocks(sd_card_t *sd_card_p, uint8_t const buffe
 static block_dev_err_t sd_sync(sd_card_t *sd_card_p) {
     block_dev_err_t status = SD_BLOCK_DEVICE_ERROR_NONE;
     sd_acquire(sd_card_p);
+    uint64_t const t0 = sd_stats_start();
     // Stop any ongoing transmission
     if (sd_card_p->spi_if_p->state.ongoing_mlt_blk_wrt) status = stop_wr_tran(sd_card_p);
+    sd_stats_record(sd_card_p, SD_STATS_SYNC, 0, t0, status);
     sd_release(sd_card_p);
     return status;
 }
 
+/**
+ * @brief Erase blocks
+ *
+ * @param[in] sd_card_p Pointer to the SD card
+ * @param[in] data_address Logical Address of the first block to erase (LBA)
+ * @param[in] num_blks Number of blocks to erase
+ *
+ * @return
+ * - SD_BLOCK_DEVICE_ERROR_NONE on success
+ * - SD_BLOCK_DEVICE_ERROR_PARAMETER if an invalid parameter was passed
+ * - SD_BLOCK_DEVICE_ERROR_ERASE if there was an erase error or timeout
+ * - other error codes from sd_cmd
+ *
+ * @details Sends CMD32 (ERASE_WR_BLK_START_ADDR), CMD33 (ERASE_WR_BLK_END_ADDR)
+ * and CMD38 (ERASE), and waits up to sd_timeouts.sd_erase for the card
+ * to finish. For best performance, the range should be aligned on
+ * allocation units (see CTRL_TRIM in glue.c).
+ */
+static block_dev_err_t sd_erase_blocks(sd_card_t *sd_card_p, uint32_t data_address,
+                                       uint32_t num_blks) {
+    TRACE_PRINTF("%s(0x%p, 0x%lx, 0x%lx)\n", __func__, sd_card_p, data_address, num_blks);
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (!num_blks || (uint64_t)data_address + num_blks > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    sd_acquire(sd_card_p);
+    block_dev_err_t status = SD_BLOCK_DEVICE_ERROR_NONE;
+    // Stop any ongoing transmission
+    if (sd_card_p->spi_if_p->state.ongoing_mlt_blk_wrt) status = stop_wr_tran(sd_card_p);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_cmd(sd_card_p, CMD32_ERASE_WR_BLK_START_ADDR, data_address, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_cmd(sd_card_p, CMD33_ERASE_WR_BLK_END_ADDR, data_address + num_blks - 1, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_cmd(sd_card_p, CMD38_ERASE, 0, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        // Check the results of the erase
+        uint32_t stat = 0;
+        status = sd_cmd(sd_card_p, CMD13_SEND_STATUS, 0, false, &stat);
+    }
+    sd_release(sd_card_p);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status)
+        EMSG_PRINTF("%s(%lu, %lu) failed: 0x%x\n", __func__, data_address, num_blks, status);
+    return status;
+}
+
+/**
+ * @brief Read the SD Status register
+ *
+ * @param[in] sd_card_p Pointer to the SD card
+ * @param[out] status The 512 bit (64 byte) SD Status, most significant byte first
+ *
+ * @return true on success
+ *
+ * @details Sends ACMD13 (SD_STATUS). In SPI mode the response is R2,
+ * followed by a 64 byte data block.
+ */
+static bool sd_spi_get_sd_status(sd_card_t *sd_card_p, uint8_t status[64]) {
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK)) return false;
+    sd_acquire(sd_card_p);
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    // Stop any ongoing transmission
+    if (sd_card_p->spi_if_p->state.ongoing_mlt_blk_wrt) rc = stop_wr_tran(sd_card_p);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) rc = sd_cmd(sd_card_p, ACMD13_SD_STATUS, 0, true, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) rc = read_bytes(sd_card_p, status, 64);
+    sd_release(sd_card_p);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) EMSG_PRINTF("ACMD13 failed: %d\n", rc);
+    return SD_BLOCK_DEVICE_ERROR_NONE == rc;
+}
+
 /*!< Number of retries for sending CMDO */
 #define SD_CMD0_GO_IDLE_STATE_RETRIES 10
 
@@ -1639,14 +1888,7 @@ DSTATUS sd_card_spi_init(sd_card_t *sd_card_p) {
     // Set SCK for data transfer
     sd_spi_go_high_frequency(sd_card_p);
 
-    // Get the number of sectors on the card
-    sd_card_p->state.sectors = in_sd_spi_sectors(sd_card_p);
-    if (0 == sd_card_p->state.sectors) {
-        // CMD9 failed
-        sd_release(sd_card_p);
-        return sd_card_p->state.m_Status;
-    }
-    // Get the CID of the card
+    // Get the CID of the card (first: it is the key to the init cache)
     if (SD_BLOCK_DEVICE_ERROR_NONE != sd_cmd(sd_card_p, CMD10_SEND_CID, 0x0, false, 0)) {
         DBG_PRINTF("Didn't get a response from the disk\n");
         sd_release(sd_card_p);
@@ -1657,6 +1899,16 @@ DSTATUS sd_card_spi_init(sd_card_t *sd_card_p) {
         sd_release(sd_card_p);
         return sd_card_p->state.m_Status;
     }
+    // Get the number of sectors on the card, unless it is a card we know
+    if (!sd_card_p->init_cache_p || !sd_init_cache_lookup(sd_card_p)) {
+        sd_card_p->state.sectors = in_sd_spi_sectors(sd_card_p);
+        if (0 == sd_card_p->state.sectors) {
+            // CMD9 failed
+            sd_release(sd_card_p);
+            return sd_card_p->state.m_Status;
+        }
+        if (sd_card_p->init_cache_p) sd_init_cache_store(sd_card_p);
+    }
 
     // Set the block length to 512 (CMD16)
     if (SD_BLOCK_DEVICE_ERROR_NONE !=
@@ -1710,9 +1962,11 @@ void sd_spi_ctor(sd_card_t *sd_card_p) {
     sd_card_p->write_blocks = sd_write_blocks;
     sd_card_p->read_blocks = sd_read_blocks;
     sd_card_p->sync = sd_sync;
+    sd_card_p->erase_blocks = sd_erase_blocks;
     sd_card_p->init = sd_card_spi_init;
     sd_card_p->deinit = sd_deinit;
     sd_card_p->get_num_sectors = sd_spi_sectors;
+    sd_card_p->get_sd_status = sd_spi_get_sd_status;
     sd_card_p->sd_test_com = sd_spi_test_com;
 
     // Chip select is active-low, so we'll initialise it to a
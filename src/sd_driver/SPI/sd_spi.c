@@ -33,11 +33,11 @@ specific language governing permissions and limitations under the License.
 // #define TRACE_PRINTF printf
 
 void sd_spi_go_high_frequency(sd_card_t *sd_card_p) {
-    uint actual = spi_set_baudrate(sd_card_p->spi_if_p->spi->hw_inst, sd_card_p->spi_if_p->spi->baud_rate);
+    uint actual = my_spi_set_baudrate(sd_card_p->spi_if_p->spi, sd_card_p->spi_if_p->spi->baud_rate);
     DBG_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
 }
 void sd_spi_go_low_frequency(sd_card_t *sd_card_p) {
-    uint actual = spi_set_baudrate(sd_card_p->spi_if_p->spi->hw_inst, 400 * 1000); // Actual frequency: 398089
+    uint actual = my_spi_set_baudrate(sd_card_p->spi_if_p->spi, 400 * 1000); // Actual frequency: 398089
     DBG_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
 }
 
@@ -21,6 +21,7 @@ specific language governing permissions and limitations under the License.
 #include "delays.h"
 #include "my_debug.h"
 #include "my_spi.h"
+#include "pio_spi.h"
 #include "sd_card.h"
 #include "sd_timeouts.h"
 
@@ -48,6 +49,10 @@ void sd_spi_send_initializing_sequence(sd_card_t *sd_card_p);
 
 static inline uint8_t sd_spi_read(sd_card_t *sd_card_p) {
     uint8_t received = SPI_FILL_CHAR;
+    if (sd_card_p->spi_if_p->spi->pio) {
+        pio_spi_transfer_blocking(sd_card_p->spi_if_p->spi, NULL, &received, 1);
+        return received;
+    }
     uint32_t start = millis();
     while (!spi_is_writable(sd_card_p->spi_if_p->spi->hw_inst) &&
            millis() - start < sd_timeouts.sd_spi_read)
@@ -59,6 +64,10 @@ static inline uint8_t sd_spi_read(sd_card_t *sd_card_p) {
 }
 
 static inline void sd_spi_write(sd_card_t *sd_card_p, const uint8_t value) {
+    if (sd_card_p->spi_if_p->spi->pio) {
+        pio_spi_transfer_blocking(sd_card_p->spi_if_p->spi, &value, NULL, 1);
+        return;
+    }
     uint32_t start = millis();
     while (!spi_is_writable(sd_card_p->spi_if_p->spi->hw_inst) &&
            millis() - start < sd_timeouts.sd_spi_write)
@@ -69,6 +78,10 @@ static inline void sd_spi_write(sd_card_t *sd_card_p, const uint8_t value) {
 }
 static inline uint8_t sd_spi_write_read(sd_card_t *sd_card_p, const uint8_t value) {
     uint8_t received = SPI_FILL_CHAR;
+    if (sd_card_p->spi_if_p->spi->pio) {
+        pio_spi_transfer_blocking(sd_card_p->spi_if_p->spi, &value, &received, 1);
+        return received;
+    }
     uint32_t start = millis();
     while (!spi_is_writable(sd_card_p->spi_if_p->spi->hw_inst) &&
            millis() - start < sd_timeouts.sd_spi_write_read)
@@ -79,6 +92,35 @@ static inline uint8_t sd_spi_write_read(sd_card_t *sd_card_p, const uint8_t valu
     return received;
 }
 
+// Depth of the SPI's TX and RX FIFOs
+#define SD_SPI_BURST 8
+
+/* Transfer a few bytes (up to SD_SPI_BURST, typically) in one go through the FIFOs,
+without the cost of setting up the DMA or of a call for each byte:
+e.g., a command packet and the first byte of its response.
+tx can be NULL to send SPI_FILL_CHAR; rx can be NULL (but not both). */
+static inline void sd_spi_burst(sd_card_t *sd_card_p, const uint8_t *tx, uint8_t *rx,
+                                size_t length) {
+    myASSERT(tx || rx);
+    if (sd_card_p->spi_if_p->spi->pio) {
+        pio_spi_transfer_blocking(sd_card_p->spi_if_p->spi, tx, rx, length);
+        return;
+    }
+    spi_inst_t *hw_inst = sd_card_p->spi_if_p->spi->hw_inst;
+    uint32_t start = millis();
+    while (!spi_is_writable(hw_inst) && millis() - start < sd_timeouts.sd_spi_write_read)
+        tight_loop_contents();
+    myASSERT(spi_is_writable(hw_inst));
+    int num;
+    if (tx && rx)
+        num = spi_write_read_blocking(hw_inst, tx, rx, length);
+    else if (tx)
+        num = spi_write_blocking(hw_inst, tx, length);
+    else
+        num = spi_read_blocking(hw_inst, SPI_FILL_CHAR, rx, length);
+    myASSERT(length == (size_t)num);
+}
+
 // Would do nothing if sd_card_p->spi_if_p->ss_gpio were set to GPIO_FUNC_SPI.
 static inline void sd_spi_select(sd_card_t *sd_card_p) {
     if ((uint)-1 == sd_card_p->spi_if_p->ss_gpio) return;
@@ -118,6 +160,14 @@ static inline void sd_spi_transfer_start(sd_card_t *sd_card_p, const uint8_t *tx
                                          size_t length) {
     return spi_transfer_start(sd_card_p->spi_if_p->spi, tx, rx, length);
 }
+// See spi_transfer_start_crc16 and spi_transfer_crc16
+static inline bool sd_spi_transfer_start_crc16(sd_card_t *sd_card_p, const uint8_t *tx,
+                                               uint8_t *rx, size_t length, uint16_t crc) {
+    return spi_transfer_start_crc16(sd_card_p->spi_if_p->spi, tx, rx, length, crc);
+}
+static inline uint16_t sd_spi_transfer_crc16(sd_card_t *sd_card_p) {
+    return spi_transfer_crc16(sd_card_p->spi_if_p->spi);
+}
 static inline bool sd_spi_transfer_wait_complete(sd_card_t *sd_card_p, uint32_t timeout_ms) {
     return spi_transfer_wait_complete(sd_card_p->spi_if_p->spi, timeout_ms);
 }
@@ -4,24 +4,43 @@
 //
 #include "dma_interrupts.h"
 
+static void card_irq_handler(sd_card_t *sd_card_p, const uint DMA_IRQ_num,
+                             io_rw_32 *dma_hw_ints_p) {
+    // The members of a striped, mirrored, or fault injecting card are not in the drive table
+    if (SD_IF_STRIPE == sd_card_p->type) {
+        for (size_t i = 0; i < sd_card_p->stripe_if_p->num_members; ++i)
+            card_irq_handler(sd_card_p->stripe_if_p->members[i], DMA_IRQ_num, dma_hw_ints_p);
+        return;
+    }
+    if (SD_IF_MIRROR == sd_card_p->type) {
+        for (size_t i = 0; i < count_of(sd_card_p->mirror_if_p->members); ++i)
+            card_irq_handler(sd_card_p->mirror_if_p->members[i], DMA_IRQ_num, dma_hw_ints_p);
+        return;
+    }
+    if (SD_IF_FAULT == sd_card_p->type) {
+        card_irq_handler(sd_card_p->fault_if_p->member, DMA_IRQ_num, dma_hw_ints_p);
+        return;
+    }
+    uint irq_num = 0, channel = 0;
+    if (SD_IF_SDIO == sd_card_p->type) {
+        irq_num = sd_card_p->sdio_if_p->DMA_IRQ_num;
+        channel = sd_card_p->sdio_if_p->state.SDIO_DMA_CHB;
+    }
+    // Is this channel requesting interrupt?
+    if (irq_num == DMA_IRQ_num && (*dma_hw_ints_p & (1 << channel))) {
+        *dma_hw_ints_p = 1 << channel;  // Clear it.
+        if (SD_IF_SDIO == sd_card_p->type) {
+            sdio_irq_handler(sd_card_p);
+        }
+    }
+}
 static void dma_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p) {
     // Iterate through all of the SD cards
     for (size_t i = 0; i < sd_get_num(); ++i) {
         sd_card_t *sd_card_p = sd_get_by_num(i);
         if (!sd_card_p)
             continue;
-        uint irq_num = 0, channel = 0;
-        if (SD_IF_SDIO == sd_card_p->type) {
-            irq_num = sd_card_p->sdio_if_p->DMA_IRQ_num;
-            channel = sd_card_p->sdio_if_p->state.SDIO_DMA_CHB;
-        }
-        // Is this channel requesting interrupt?
-        if (irq_num == DMA_IRQ_num && (*dma_hw_ints_p & (1 << channel))) {
-            *dma_hw_ints_p = 1 << channel;  // Clear it.
-            if (SD_IF_SDIO == sd_card_p->type) {
-                sdio_irq_handler(sd_card_p);
-            }
-        }
+        card_irq_handler(sd_card_p, DMA_IRQ_num, dma_hw_ints_p);
     }
 }
 static void __not_in_flash_func(dma_irq_handler_0)() {
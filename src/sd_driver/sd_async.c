@@ -0,0 +1,78 @@
+/* sd_async.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include "pico/stdlib.h"
+//
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "sd_async.h"
+
+static block_dev_err_t start(sd_io_req_t *req_p) {
+    sd_card_t *sd_card_p = req_p->sd_card_p;
+    req_p->done = false;
+    req_p->status = SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    if (!req_p->count) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    req_p->start_us = sd_stats_start();
+
+    if (sd_card_p->start_io) return sd_card_p->start_io(sd_card_p, req_p);
+
+    // No native support: do it now, and report completion at the first poll
+    if (SD_IO_READ == req_p->op)
+        req_p->status = sd_card_p->read_blocks(sd_card_p, req_p->rd_buffer, req_p->sector,
+                                               req_p->count);
+    else
+        req_p->status = sd_card_p->write_blocks(sd_card_p, req_p->wr_buffer, req_p->sector,
+                                                req_p->count);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+block_dev_err_t sd_read_blocks_async(sd_card_t *sd_card_p, sd_io_req_t *req_p, uint8_t *buffer,
+                                     uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    req_p->sd_card_p = sd_card_p;
+    req_p->op = SD_IO_READ;
+    req_p->rd_buffer = buffer;
+    req_p->sector = ulSectorNumber;
+    req_p->count = ulSectorCount;
+    return start(req_p);
+}
+
+block_dev_err_t sd_write_blocks_async(sd_card_t *sd_card_p, sd_io_req_t *req_p,
+                                      const uint8_t *buffer, uint32_t ulSectorNumber,
+                                      uint32_t blockCnt) {
+    req_p->sd_card_p = sd_card_p;
+    req_p->op = SD_IO_WRITE;
+    req_p->wr_buffer = buffer;
+    req_p->sector = ulSectorNumber;
+    req_p->count = blockCnt;
+    return start(req_p);
+}
+
+bool sd_io_poll(sd_io_req_t *req_p) {
+    if (req_p->done) return true;
+    sd_card_t *sd_card_p = req_p->sd_card_p;
+    block_dev_err_t status = req_p->status;
+    if (sd_card_p->poll_io) status = sd_card_p->poll_io(sd_card_p, req_p);
+    if (SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK == status) return false;
+    req_p->status = status;
+    req_p->done = true;
+    if (req_p->callback) req_p->callback(req_p);
+    return true;
+}
+
+block_dev_err_t sd_io_wait(sd_io_req_t *req_p) {
+    while (!sd_io_poll(req_p)) tight_loop_contents();
+    return req_p->status;
+}
+/* [] END OF FILE */
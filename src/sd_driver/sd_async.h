@@ -0,0 +1,96 @@
+/* sd_async.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Non-blocking block device API
+
+For example,
+
+    sd_io_req_t req = {.callback = on_done, .context = &my_stuff};
+    block_dev_err_t rc = sd_read_blocks_async(sd_card_p, &req, buf, lba, 8);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+        while (!sd_io_poll(&req)) {
+            // Do something useful, e.g., tud_task()
+        }
+        rc = req.status;
+    }
+
+A card does one thing at a time: it is locked (see sd_lock) from the start of a request
+until its completion is seen by sd_io_poll or sd_io_wait, which must be called
+from the same core (or thread) that started the request.
+Until then, the buffer belongs to the driver.
+
+Drivers that can overlap transfers with the CPU (SDIO, RAM) implement
+the start_io and poll_io members of sd_card_t.
+For the others (SPI), the request is carried out synchronously when it is started,
+and completes at the first poll.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    SD_IO_READ,
+    SD_IO_WRITE,
+    SD_IO_SYNC  // Only through the submission rings (sd_ring.h)
+} sd_io_op_t;
+
+typedef void (*sd_io_callback_t)(sd_io_req_t *req_p);
+
+struct sd_io_req_t {
+    /* Set by the caller before starting the request (optional) */
+    // Called once, from sd_io_poll or sd_io_wait, when the request completes.
+    // Not called if the request could not be started.
+    sd_io_callback_t callback;
+    void *context;  // For the caller's use
+
+    /* The following fields are assigned when the request is started */
+    sd_card_t *sd_card_p;
+    sd_io_op_t op;
+    union {
+        uint8_t *rd_buffer;
+        const uint8_t *wr_buffer;
+    };
+    uint32_t sector;
+    uint32_t count;
+    uint64_t start_us;  // For the statistics (sd_stats.h)
+
+    volatile bool done;
+    block_dev_err_t status;  // Valid when done
+};
+
+/* Start a request. If this returns an error, the request was not started. */
+block_dev_err_t sd_read_blocks_async(sd_card_t *sd_card_p, sd_io_req_t *req_p, uint8_t *buffer,
+                                     uint32_t ulSectorNumber, uint32_t ulSectorCount);
+block_dev_err_t sd_write_blocks_async(sd_card_t *sd_card_p, sd_io_req_t *req_p,
+                                      const uint8_t *buffer, uint32_t ulSectorNumber,
+                                      uint32_t blockCnt);
+
+/* Make progress. Returns true if and only if the request is complete. */
+bool sd_io_poll(sd_io_req_t *req_p);
+
+/* Wait for completion, and return the status of the request */
+block_dev_err_t sd_io_wait(sd_io_req_t *req_p);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
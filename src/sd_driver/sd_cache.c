@@ -0,0 +1,245 @@
+/* sd_cache.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-drive write-back sector cache. See sd_cache.h. */
+
+#include <string.h>
+//
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sd_read_ahead.h"
+#include "sd_wr_queue.h"
+//
+#include "diskio.h"  // STA_NOINIT, STA_NODISK
+//
+#include "sd_cache.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+/* The layer below: the read-ahead, the write queue, or the driver */
+static block_dev_err_t lower_read(sd_card_t *sd_card_p, uint8_t *buffer,
+                                  uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    if (sd_card_p->read_ahead_p)
+        return sd_read_ahead_read(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+    if (sd_card_p->wr_queue_p)
+        return sd_wr_queue_read(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+    return sd_card_p->read_blocks(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+}
+static block_dev_err_t lower_write(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                   uint32_t ulSectorNumber, uint32_t blockCnt) {
+    if (sd_card_p->read_ahead_p)
+        return sd_read_ahead_write(sd_card_p, buffer, ulSectorNumber, blockCnt);
+    if (sd_card_p->wr_queue_p)
+        return sd_wr_queue_write(sd_card_p, buffer, ulSectorNumber, blockCnt);
+    return sd_card_p->write_blocks(sd_card_p, buffer, ulSectorNumber, blockCnt);
+}
+static block_dev_err_t lower_erase(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                   uint32_t blockCnt) {
+    if (sd_card_p->read_ahead_p) return sd_read_ahead_erase(sd_card_p, ulSectorNumber, blockCnt);
+    if (sd_card_p->wr_queue_p) return sd_wr_queue_erase(sd_card_p, ulSectorNumber, blockCnt);
+    if (!sd_card_p->erase_blocks) return SD_BLOCK_DEVICE_ERROR_UNSUPPORTED;
+    return sd_card_p->erase_blocks(sd_card_p, ulSectorNumber, blockCnt);
+}
+
+static sd_cache_class_t classify(sd_card_t *sd_card_p, const uint8_t *buffer, uint32_t lba) {
+    FATFS *fs_p = &sd_card_p->state.fatfs;
+    if (fs_p->fs_type && fs_p->fatbase <= lba &&
+        lba < fs_p->fatbase + (LBA_t)fs_p->fsize * fs_p->n_fats)
+        return SD_CACHE_FAT;
+    if (buffer == fs_p->win) return SD_CACHE_DIR;
+    return SD_CACHE_DATA;
+}
+
+static sd_cache_line_t *lookup(sd_cache_t *c_p, uint32_t lba) {
+    sd_cache_line_t *set_p = &c_p->lines[(lba & (c_p->sets - 1)) * c_p->ways];
+    for (uint32_t w = 0; w < c_p->ways; ++w)
+        if (set_p[w].valid && set_p[w].lba == lba) return &set_p[w];
+    return NULL;
+}
+
+static block_dev_err_t write_back(sd_card_t *sd_card_p, sd_cache_line_t *line_p) {
+    block_dev_err_t rc = lower_write(sd_card_p, line_p->data, line_p->lba, 1);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+        line_p->dirty = false;
+        ++sd_card_p->cache_p->write_backs;
+    }
+    return rc;
+}
+
+/* Find a line for lba: an invalid one, or else the least recently used one,
+which is written back if it is dirty. */
+static block_dev_err_t allocate(sd_card_t *sd_card_p, uint32_t lba, sd_cache_line_t **line_pp) {
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    sd_cache_line_t *set_p = &c_p->lines[(lba & (c_p->sets - 1)) * c_p->ways];
+    sd_cache_line_t *victim_p = &set_p[0];
+    for (uint32_t w = 0; w < c_p->ways; ++w) {
+        if (!set_p[w].valid) {
+            victim_p = &set_p[w];
+            break;
+        }
+        if (set_p[w].last_use < victim_p->last_use) victim_p = &set_p[w];
+    }
+    if (victim_p->valid && victim_p->dirty) {
+        block_dev_err_t rc = write_back(sd_card_p, victim_p);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    }
+    victim_p->valid = false;
+    victim_p->lba = lba;
+    *line_pp = victim_p;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static block_dev_err_t read_one(sd_card_t *sd_card_p, uint8_t *buffer, uint32_t lba) {
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    sd_cache_class_t cls = classify(sd_card_p, buffer, lba);
+    sd_cache_line_t *line_p = lookup(c_p, lba);
+    if (line_p) {
+        ++c_p->hits[cls];
+    } else {
+        ++c_p->misses[cls];
+        block_dev_err_t rc = allocate(sd_card_p, lba, &line_p);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+        rc = lower_read(sd_card_p, line_p->data, lba, 1);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+        line_p->valid = true;
+        line_p->dirty = false;
+    }
+    line_p->last_use = ++c_p->clock;
+    memcpy(buffer, line_p->data, sd_block_size);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static block_dev_err_t write_one(sd_card_t *sd_card_p, const uint8_t *buffer, uint32_t lba) {
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    sd_cache_class_t cls = classify(sd_card_p, buffer, lba);
+    sd_cache_line_t *line_p = lookup(c_p, lba);
+    if (line_p) {
+        ++c_p->hits[cls];
+    } else {
+        ++c_p->misses[cls];
+        block_dev_err_t rc = allocate(sd_card_p, lba, &line_p);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+        line_p->valid = true;
+    }
+    line_p->last_use = ++c_p->clock;
+    memcpy(line_p->data, buffer, sd_block_size);
+    line_p->dirty = true;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static block_dev_err_t flush(sd_card_t *sd_card_p) {
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    uint32_t const n = c_p->sets * c_p->ways;
+    // In order of LBA, to give the write queue and the card a sequential stream
+    for (;;) {
+        sd_cache_line_t *next_p = NULL;
+        for (uint32_t i = 0; i < n; ++i) {
+            sd_cache_line_t *line_p = &c_p->lines[i];
+            if (line_p->valid && line_p->dirty && (!next_p || line_p->lba < next_p->lba))
+                next_p = line_p;
+        }
+        if (!next_p) return SD_BLOCK_DEVICE_ERROR_NONE;
+        block_dev_err_t rc = write_back(sd_card_p, next_p);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    }
+}
+
+block_dev_err_t sd_cache_read(sd_card_t *sd_card_p, uint8_t *buffer, uint32_t ulSectorNumber,
+                              uint32_t ulSectorCount) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, ulSectorCount);
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    myASSERT(c_p && c_p->lines && c_p->ways);
+    myASSERT(c_p->sets && !(c_p->sets & (c_p->sets - 1)));  // Power of 2
+    if (!ulSectorCount) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    mutex_enter_blocking(&c_p->mutex);
+    block_dev_err_t rc;
+    if (1 == ulSectorCount) {
+        rc = read_one(sd_card_p, buffer, ulSectorNumber);
+    } else {
+        rc = lower_read(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+        // The cache might have newer data
+        for (uint32_t i = 0; SD_BLOCK_DEVICE_ERROR_NONE == rc && i < ulSectorCount; ++i) {
+            sd_cache_line_t *line_p = lookup(c_p, ulSectorNumber + i);
+            if (line_p && line_p->dirty)
+                memcpy(buffer + (size_t)i * sd_block_size, line_p->data, sd_block_size);
+        }
+    }
+    mutex_exit(&c_p->mutex);
+    return rc;
+}
+
+block_dev_err_t sd_cache_write(sd_card_t *sd_card_p, const uint8_t *buffer,
+                               uint32_t ulSectorNumber, uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    myASSERT(c_p && c_p->lines && c_p->ways);
+    myASSERT(c_p->sets && !(c_p->sets & (c_p->sets - 1)));  // Power of 2
+    // Check here what the driver would check, since it might not see the sector until later
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK)) return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!blockCnt) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if ((uint64_t)ulSectorNumber + blockCnt > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    mutex_enter_blocking(&c_p->mutex);
+    block_dev_err_t rc;
+    if (1 == blockCnt) {
+        rc = write_one(sd_card_p, buffer, ulSectorNumber);
+    } else {
+        rc = lower_write(sd_card_p, buffer, ulSectorNumber, blockCnt);
+        // Keep cached copies up to date
+        for (uint32_t i = 0; SD_BLOCK_DEVICE_ERROR_NONE == rc && i < blockCnt; ++i) {
+            sd_cache_line_t *line_p = lookup(c_p, ulSectorNumber + i);
+            if (line_p) {
+                memcpy(line_p->data, buffer + (size_t)i * sd_block_size, sd_block_size);
+                line_p->dirty = false;
+            }
+        }
+    }
+    mutex_exit(&c_p->mutex);
+    return rc;
+}
+
+block_dev_err_t sd_cache_erase(sd_card_t *sd_card_p, uint32_t ulSectorNumber, uint32_t blockCnt) {
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    myASSERT(c_p);
+    mutex_enter_blocking(&c_p->mutex);
+    for (uint32_t i = 0; i < c_p->sets * c_p->ways; ++i) {
+        sd_cache_line_t *line_p = &c_p->lines[i];
+        if (line_p->valid && ulSectorNumber <= line_p->lba && line_p->lba - ulSectorNumber < blockCnt)
+            line_p->valid = false;  // Even if dirty: the data is no longer wanted
+    }
+    block_dev_err_t rc = lower_erase(sd_card_p, ulSectorNumber, blockCnt);
+    mutex_exit(&c_p->mutex);
+    return rc;
+}
+
+block_dev_err_t sd_cache_flush(sd_card_t *sd_card_p) {
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    myASSERT(c_p);
+    mutex_enter_blocking(&c_p->mutex);
+    block_dev_err_t rc = flush(sd_card_p);
+    mutex_exit(&c_p->mutex);
+    return rc;
+}
+
+void sd_cache_invalidate(sd_card_t *sd_card_p) {
+    sd_cache_t *c_p = sd_card_p->cache_p;
+    myASSERT(c_p);
+    mutex_enter_blocking(&c_p->mutex);
+    for (uint32_t i = 0; i < c_p->sets * c_p->ways; ++i) c_p->lines[i].valid = false;
+    mutex_exit(&c_p->mutex);
+}
+/* [] END OF FILE */
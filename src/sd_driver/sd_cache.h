@@ -0,0 +1,101 @@
+/* sd_cache.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-drive write-back sector cache
+
+FatFs keeps only one sector of FAT or directory (FATFS::win) per volume,
+so metadata heavy operations (f_mkdir, f_open on deep paths, f_getfree,
+following cluster chains) read the same sectors from the card again and again.
+
+This is an N-way set-associative cache of single sectors,
+in front of the write queue (sd_wr_queue.h), if any, and the driver.
+    * Single sector reads and writes go through the cache.
+      Writes are write-back: a dirty line goes to the card when it is evicted or flushed.
+    * Multiple sector transfers (typically file data) bypass it,
+      but stay coherent: a read picks up dirty cached sectors, and
+      a write updates cached copies.
+The cache is flushed at CTRL_SYNC (e.g. from f_sync or f_close),
+and invalidated when the card is (re)initialized.
+
+Hits and misses are counted separately for sectors of the FAT, sectors read
+into FATFS::win outside of the FAT (directories and other metadata),
+and the rest (data). The FAT region and FATFS::win are those of the
+FATFS object in sd_card_t::state.
+
+To enable it for an SD card, provide the lines in the hardware configuration:
+
+    static sd_cache_line_t cache_lines[16 * 4];
+    static sd_cache_t cache = {
+        .lines = cache_lines,
+        .sets = 16,  // Must be a power of 2
+        .ways = 4    // .lines must have sets * ways elements
+    };
+    static sd_card_t sd_card = {
+        ...
+        .cache_p = &cache
+    };
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "pico/mutex.h"
+//
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { SD_CACHE_FAT, SD_CACHE_DIR, SD_CACHE_DATA, SD_CACHE_NUM_CLASSES } sd_cache_class_t;
+
+typedef struct sd_cache_line_t {
+    uint8_t data[512] __attribute__((aligned(4)));
+    uint32_t lba;
+    uint32_t last_use;  // For LRU replacement
+    bool valid;
+    bool dirty;
+} sd_cache_line_t;
+
+struct sd_cache_t {
+    sd_cache_line_t *lines;  // sets * ways lines
+    uint32_t sets;           // Must be a power of 2
+    uint32_t ways;
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    mutex_t mutex;
+    uint32_t clock;  // Use counter, for LRU
+
+    // Statistics
+    uint32_t hits[SD_CACHE_NUM_CLASSES];
+    uint32_t misses[SD_CACHE_NUM_CLASSES];
+    uint32_t write_backs;  // Dirty lines written to the card
+};
+
+block_dev_err_t sd_cache_read(sd_card_t *sd_card_p, uint8_t *buffer, uint32_t ulSectorNumber,
+                              uint32_t ulSectorCount);
+block_dev_err_t sd_cache_write(sd_card_t *sd_card_p, const uint8_t *buffer,
+                               uint32_t ulSectorNumber, uint32_t blockCnt);
+block_dev_err_t sd_cache_flush(sd_card_t *sd_card_p);  // Write back all dirty lines
+// Drop cached sectors in the range, and erase it (see sd_card_t::erase_blocks)
+block_dev_err_t sd_cache_erase(sd_card_t *sd_card_p, uint32_t ulSectorNumber, uint32_t blockCnt);
+void sd_cache_invalidate(sd_card_t *sd_card_p);        // Drop everything, dirty or not
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -21,13 +21,22 @@ specific language governing permissions and limitations under the License.
 //
 #include "pico/mutex.h"
 //
+#include "FAULT/sd_card_fault.h"
+#include "RAID/sd_card_mirror.h"
+#include "RAID/sd_card_stripe.h"
 #include "SDIO/SdioCard.h"
 #include "SPI/sd_card_spi.h"
 #include "hw_config.h"  // Hardware Configuration of the SPI and SD Card "objects"
 #include "my_debug.h"
+#include "sd_cache.h"
 #include "sd_card_constants.h"
+#include "sd_hotplug.h"
+#include "sd_init_cache.h"
+#include "sd_io_core.h"
+#include "sd_read_ahead.h"
 #include "sd_regs.h"
 #include "sd_timeouts.h"
+#include "sd_wr_queue.h"
 #include "util.h"
 //
 #include "diskio.h" /* Declarations of disk functions */  // Needed for STA_NOINIT, ...
@@ -58,6 +67,8 @@ bool sd_is_locked(sd_card_t *sd_card_p) {
     return !mutex_try_enter(&sd_card_p->state.mutex, &owner_out);
 }
 
+void __attribute__((weak)) sd_busy_yield(sd_card_t *sd_card_p) { (void)sd_card_p; }
+
 sd_card_t *sd_get_by_drive_prefix(const char *const drive_prefix) {
     // Numeric drive number is always valid
     if (2 == strlen(drive_prefix) && isdigit((unsigned char)drive_prefix[0]) &&
@@ -122,6 +133,97 @@ char const *sd_get_drive_prefix(sd_card_t *sd_card_p) {
     return sd_card_p->state.drive_prefix;
 }
 
+/* Set up one card: the state, Card Detect, and the interface driver.
+For a striped, mirrored, or fault injecting card, the member cards too. */
+static bool card_ctor(sd_card_t *sd_card_p) {
+    bool ok = true;
+    myASSERT(sd_card_p->type);
+
+    if (!mutex_is_initialized(&sd_card_p->state.mutex))
+        mutex_init(&sd_card_p->state.mutex);
+    if (sd_card_p->wr_queue_p && !mutex_is_initialized(&sd_card_p->wr_queue_p->mutex))
+        mutex_init(&sd_card_p->wr_queue_p->mutex);
+    if (sd_card_p->cache_p && !mutex_is_initialized(&sd_card_p->cache_p->mutex))
+        mutex_init(&sd_card_p->cache_p->mutex);
+    if (sd_card_p->read_ahead_p && !mutex_is_initialized(&sd_card_p->read_ahead_p->mutex))
+        mutex_init(&sd_card_p->read_ahead_p->mutex);
+    if (sd_card_p->init_cache_p && !mutex_is_initialized(&sd_card_p->init_cache_p->mutex))
+        mutex_init(&sd_card_p->init_cache_p->mutex);
+    sd_lock(sd_card_p);
+
+    sd_card_p->state.m_Status = STA_NOINIT;
+
+    // Set up Card Detect
+    if (sd_card_p->use_card_detect) {
+        if (sd_card_p->card_detect_use_pull) {
+            if (sd_card_p->card_detect_pull_hi) {
+                gpio_pull_up(sd_card_p->card_detect_gpio);
+            } else {
+                gpio_pull_down(sd_card_p->card_detect_gpio);
+            }
+        }
+        gpio_init(sd_card_p->card_detect_gpio);
+    }
+    if (sd_card_p->hotplug_p) sd_hotplug_ctor(sd_card_p);
+
+    switch (sd_card_p->type) {
+        case SD_IF_NONE:
+            myASSERT(false);
+            break;
+        case SD_IF_SPI:
+            myASSERT(sd_card_p->spi_if_p);  // Must have an interface object
+            myASSERT(sd_card_p->spi_if_p->spi);
+            sd_spi_ctor(sd_card_p);
+            if (!my_spi_init(sd_card_p->spi_if_p->spi)) {
+                ok = false;
+            }
+            /* At power up the SD card CD/DAT3 / CS  line has a 50KOhm pull up enabled
+             * in the card. This resistor serves two functions Card detection and Mode
+             * Selection. For Mode Selection, the host can drive the line high or let it
+             * be pulled high to select SD mode. If the host wants to select SPI mode it
+             * should drive the line low.
+             *
+             * There is an important thing needs to be considered that the MMC/SDC is
+             * initially NOT the SPI device. Some bus activity to access another SPI
+             * device can cause a bus conflict due to an accidental response of the
+             * MMC/SDC. Therefore the MMC/SDC should be initialized to put it into the
+             * SPI mode prior to access any other device attached to the same SPI bus.
+             */
+            sd_go_idle_state(sd_card_p);
+            break;
+        case SD_IF_SDIO:
+            myASSERT(sd_card_p->sdio_if_p);
+            sd_sdio_ctor(sd_card_p);
+            break;
+        case SD_IF_RAM:
+            myASSERT(sd_card_p->ram_if_p);
+            sd_ram_ctor(sd_card_p);
+            break;
+        case SD_IF_STRIPE:
+            myASSERT(sd_card_p->stripe_if_p);
+            for (size_t i = 0; i < sd_card_p->stripe_if_p->num_members; ++i)
+                if (!card_ctor(sd_card_p->stripe_if_p->members[i])) ok = false;
+            sd_stripe_ctor(sd_card_p);
+            break;
+        case SD_IF_MIRROR:
+            myASSERT(sd_card_p->mirror_if_p);
+            for (size_t i = 0; i < count_of(sd_card_p->mirror_if_p->members); ++i)
+                if (!card_ctor(sd_card_p->mirror_if_p->members[i])) ok = false;
+            sd_mirror_ctor(sd_card_p);
+            break;
+        case SD_IF_FAULT:
+            myASSERT(sd_card_p->fault_if_p);
+            if (!card_ctor(sd_card_p->fault_if_p->member)) ok = false;
+            sd_fault_ctor(sd_card_p);
+            break;
+        default:
+            myASSERT(false);
+    }  // switch (sd_card_p->type)
+
+    sd_unlock(sd_card_p);
+    return ok;
+}
+
 bool sd_init_driver() {
     auto_init_mutex(initialized_mutex);
     mutex_enter_blocking(&initialized_mutex);
@@ -131,65 +233,13 @@ bool sd_init_driver() {
         for (size_t i = 0; i < sd_get_num(); ++i) {
             sd_card_t *sd_card_p = sd_get_by_num(i);
             if (!sd_card_p) continue;
-
-            myASSERT(sd_card_p->type);
-
-            if (!mutex_is_initialized(&sd_card_p->state.mutex))
-                mutex_init(&sd_card_p->state.mutex);
-            sd_lock(sd_card_p);
-
-            sd_card_p->state.m_Status = STA_NOINIT;
-
             sd_set_drive_prefix(sd_card_p, i);
-
-            // Set up Card Detect
-            if (sd_card_p->use_card_detect) {
-                if (sd_card_p->card_detect_use_pull) {
-                    if (sd_card_p->card_detect_pull_hi) {
-                        gpio_pull_up(sd_card_p->card_detect_gpio);
-                    } else {
-                        gpio_pull_down(sd_card_p->card_detect_gpio);
-                    }
-                }
-                gpio_init(sd_card_p->card_detect_gpio);
-            }
-
-            switch (sd_card_p->type) {
-                case SD_IF_NONE:
-                    myASSERT(false);
-                    break;
-                case SD_IF_SPI:
-                    myASSERT(sd_card_p->spi_if_p);  // Must have an interface object
-                    myASSERT(sd_card_p->spi_if_p->spi);
-                    sd_spi_ctor(sd_card_p);
-                    if (!my_spi_init(sd_card_p->spi_if_p->spi)) {
-                        ok = false;
-                    }
-                    /* At power up the SD card CD/DAT3 / CS  line has a 50KOhm pull up enabled
-                     * in the card. This resistor serves two functions Card detection and Mode
-                     * Selection. For Mode Selection, the host can drive the line high or let it
-                     * be pulled high to select SD mode. If the host wants to select SPI mode it
-                     * should drive the line low.
-                     *
-                     * There is an important thing needs to be considered that the MMC/SDC is
-                     * initially NOT the SPI device. Some bus activity to access another SPI
-                     * device can cause a bus conflict due to an accidental response of the
-                     * MMC/SDC. Therefore the MMC/SDC should be initialized to put it into the
-                     * SPI mode prior to access any other device attached to the same SPI bus.
-                     */
-                    sd_go_idle_state(sd_card_p);
-                    break;
-                case SD_IF_SDIO:
-                    myASSERT(sd_card_p->sdio_if_p);
-                    sd_sdio_ctor(sd_card_p);
-                    break;
-                default:
-                    myASSERT(false);
-            }  // switch (sd_card_p->type)
-
-            sd_unlock(sd_card_p);
+            if (!card_ctor(sd_card_p)) ok = false;
         }  // for
         driver_initialized = true;
+#if USE_SD_IO_CORE
+        sd_io_core_start();  // See sd_io_core.h
+#endif
     }
     mutex_exit(&initialized_mutex);
     return ok;
@@ -318,12 +368,23 @@ void csdDmp(sd_card_t *sd_card_p, printer_t printer) {
 
 /* AU (Allocation Unit):
 is a physical boundary of the card and consists of one or more blocks and its
-size depends on each card. */
+size depends on each card. Read from the SD Status once per initialization
+(or once per card, with an init cache), since TRIM asks for it every time. */
 bool sd_allocation_unit(sd_card_t *sd_card_p, size_t *au_size_bytes_p) {
-    if (SD_IF_SPI == sd_card_p->type) return false;  // SPI can't do full SD Status
+    if (sd_card_p->state.au_known && !(sd_card_p->state.m_Status & STA_NOINIT)) {
+        *au_size_bytes_p = sd_card_p->state.au_size_bytes;
+        return true;
+    }
+    if (sd_card_p->init_cache_p && !(sd_card_p->state.m_Status & STA_NOINIT) &&
+        sd_init_cache_get_au(sd_card_p, au_size_bytes_p)) {
+        sd_card_p->state.au_size_bytes = *au_size_bytes_p;
+        sd_card_p->state.au_known = true;
+        return true;  // No need to read the SD Status again
+    }
+    if (!sd_card_p->get_sd_status) return false;
 
     uint8_t status[64] = {0};
-    bool ok = rp2040_sdio_get_sd_status(sd_card_p, status);
+    bool ok = sd_card_p->get_sd_status(sd_card_p, status);
     if (!ok) return false;
     // 431:428 AU_SIZE
     uint8_t au_size = ext_bits(64, status, 431, 428);
@@ -380,6 +441,35 @@ bool sd_allocation_unit(sd_card_t *sd_card_p, size_t *au_size_bytes_p) {
         default:
             myASSERT(false);
     }
+    if (sd_card_p->init_cache_p) sd_init_cache_set_au(sd_card_p, *au_size_bytes_p);
+    sd_card_p->state.au_size_bytes = *au_size_bytes_p;
+    sd_card_p->state.au_known = true;
+    return true;
+}
+
+/* f_mkfs parameters that match the AU:
+the data area starts on an AU boundary, and clusters divide the AU,
+so writing a cluster never makes the card copy part of an AU.
+The cluster size is that of the SD Association's SD Memory Card Formatter,
+32 KiB (128 KiB for SDXC, which gets exFAT), but no bigger than the AU.
+Returns false if the AU is not known. */
+bool sd_au_mkfs_parm(sd_card_t *sd_card_p, MKFS_PARM *opt_p) {
+    size_t au_size_bytes;
+    if (!sd_allocation_unit(sd_card_p, &au_size_bytes) || !au_size_bytes) return false;
+    // 12 MB and 24 MB AUs are not powers of 2. Use the largest power of 2 that divides them.
+    uint32_t align = au_size_bytes / sd_block_size;
+    align &= -align;
+    if (align > 32768) align = 32768;  // f_mkfs limit
+    uint32_t cluster = sd_card_p->state.sectors > 32 * (uint64_t)KB * MB / sd_block_size
+                           ? 128 * KB
+                           : 32 * KB;
+    if (cluster > align * sd_block_size) cluster = align * sd_block_size;
+
+    opt_p->fmt = FM_ANY;
+    opt_p->n_fat = 2;
+    opt_p->align = align;
+    opt_p->n_root = 0;
+    opt_p->au_size = cluster;
     return true;
 }
 
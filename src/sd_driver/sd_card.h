@@ -28,19 +28,24 @@ specific language governing permissions and limitations under the License.
 //
 #include "ff.h"
 //
+#include "FAULT/sd_card_fault.h"
+#include "RAID/sd_card_mirror.h"
+#include "RAID/sd_card_stripe.h"
+#include "RAM/sd_card_ram.h"
 #include "SDIO/rp2040_sdio.h"
 #include "SPI/my_spi.h"
 #include "SPI/sd_card_spi.h"
 #include "diskio.h"
 #include "sd_card_constants.h"
 #include "sd_regs.h"
+#include "sd_stats.h"
 #include "util.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef enum { SD_IF_NONE, SD_IF_SPI, SD_IF_SDIO } sd_if_t;
+typedef enum { SD_IF_NONE, SD_IF_SPI, SD_IF_SDIO, SD_IF_RAM, SD_IF_STRIPE, SD_IF_MIRROR, SD_IF_FAULT } sd_if_t;
 
 typedef struct sd_spi_if_state_t {
     bool ongoing_mlt_blk_wrt;
@@ -92,16 +97,66 @@ typedef struct sd_sdio_if_t {
     sd_sdio_if_state_t state;
 } sd_sdio_if_t;
 
+typedef struct sd_ram_if_t {
+    // Backing store of at least sectors * 512 bytes,
+    // e.g., a static array or a memory mapped image file.
+    // If NULL, init allocates (and zeroes) one.
+    uint8_t *data;
+    uint32_t sectors;          // Size of the medium in 512 byte blocks
+    sd_ram_latency_t latency;  // See RAM/sd_card_ram.h
+    uint8_t au_size;           // AU_SIZE code reported in the SD Status (see sd_allocation_unit)
+    uint32_t psn;              // Product serial number in the CID; 0: made up from this struct's address
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    sd_ram_if_state_t state;
+} sd_ram_if_t;
+
+typedef struct sd_stripe_if_t {
+    // The physical cards, each with its own interface (SPI, SDIO, ...).
+    // They must not also be in the drive table (sd_get_by_num).
+    sd_card_t **members;
+    size_t num_members;       // 2 to SD_STRIPE_MAX_MEMBERS
+    uint32_t stripe_sectors;  // Stripe size in 512 byte blocks, e.g., 64 for 32 KiB
+} sd_stripe_if_t;
+
+typedef struct sd_mirror_if_t {
+    // The two physical cards. They must not also be in the drive table.
+    sd_card_t *members[2];
+    // Dirty region bitmap (see RAID/sd_card_mirror.h); more words make smaller regions
+    uint32_t *dirty_bitmap;
+    size_t dirty_bitmap_words;
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    sd_mirror_if_state_t state;
+} sd_mirror_if_t;
+
+typedef struct sd_fault_if_t {
+    // The card to pass the requests to. It must not also be in the drive table.
+    sd_card_t *member;
+    sd_fault_rule_t *rules;  // See FAULT/sd_card_fault.h
+    size_t num_rules;
+    uint32_t seed;  // For the fault rates
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    sd_fault_if_state_t state;
+} sd_fault_if_t;
+
 typedef struct sd_card_state_t {
     DSTATUS m_Status;       // Card status
     card_type_t card_type;  // Assigned dynamically
     CSD_t CSD;              // Card-Specific Data register.
     CID_t CID;              // Card IDentification register
     uint32_t sectors;       // Assigned dynamically
+    size_t au_size_bytes;   // See sd_allocation_unit; valid if au_known
+    bool au_known;          // Cleared when an uninitialized card is initialized
 
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+    sd_stats_t stats;  // See sd_stats.h
 #if FF_STR_VOLUME_ID
     char drive_prefix[32];
 #else
@@ -110,6 +165,13 @@ typedef struct sd_card_state_t {
 } sd_card_state_t;
 
 typedef struct sd_card_t sd_card_t;
+typedef struct sd_io_req_t sd_io_req_t;  // See sd_async.h
+typedef struct sd_wr_queue_t sd_wr_queue_t;  // See sd_wr_queue.h
+typedef struct sd_cache_t sd_cache_t;        // See sd_cache.h
+typedef struct sd_read_ahead_t sd_read_ahead_t;  // See sd_read_ahead.h
+typedef struct sd_ring_t sd_ring_t;              // See sd_ring.h
+typedef struct sd_hotplug_t sd_hotplug_t;        // See sd_hotplug.h
+typedef struct sd_init_cache_t sd_init_cache_t;  // See sd_init_cache.h
 
 // "Class" representing SD Cards
 struct sd_card_t {
@@ -117,12 +179,22 @@ struct sd_card_t {
     union {
         sd_spi_if_t *spi_if_p;
         sd_sdio_if_t *sdio_if_p;
+        sd_ram_if_t *ram_if_p;
+        sd_stripe_if_t *stripe_if_p;
+        sd_mirror_if_t *mirror_if_p;
+        sd_fault_if_t *fault_if_p;
     };
     bool use_card_detect;
     uint card_detect_gpio;    // Card detect; ignored if !use_card_detect
     uint card_detected_true;  // Varies with card socket; ignored if !use_card_detect
     bool card_detect_use_pull;
     bool card_detect_pull_hi;
+    sd_wr_queue_t *wr_queue_p;  // Optional write queue (see sd_wr_queue.h); NULL for none
+    sd_cache_t *cache_p;        // Optional sector cache (see sd_cache.h); NULL for none
+    sd_read_ahead_t *read_ahead_p;  // Optional read-ahead (see sd_read_ahead.h); NULL for none
+    sd_ring_t *ring_p;              // Optional submission rings (see sd_ring.h); NULL for none
+    sd_hotplug_t *hotplug_p;        // Optional hot-plug handling (see sd_hotplug.h); NULL for none
+    sd_init_cache_t *init_cache_p;  // Optional init cache (see sd_init_cache.h); NULL for none
 
     /* The following fields are state variables and not part of the configuration.
     They are dynamically assigned. */
@@ -135,22 +207,41 @@ struct sd_card_t {
     block_dev_err_t (*read_blocks)(sd_card_t *sd_card_p, uint8_t *buffer,
                                    uint32_t ulSectorNumber, uint32_t ulSectorCount);
     block_dev_err_t (*sync)(sd_card_t *sd_card_p);
+    // Optional: erase (CMD32/CMD33/CMD38) blockCnt blocks. NULL if not supported.
+    block_dev_err_t (*erase_blocks)(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                    uint32_t blockCnt);
     uint32_t (*get_num_sectors)(sd_card_t *sd_card_p);
+    // Optional: read the 512 bit SD Status register (ACMD13). NULL if not supported.
+    bool (*get_sd_status)(sd_card_t *sd_card_p, uint8_t status[64]);
 
     // Useful when use_card_detect is false - call periodically to check for presence of SD card
     // Returns true if and only if SD card was sensed on the bus
     bool (*sd_test_com)(sd_card_t *sd_card_p);
+
+    // Optional: non-blocking I/O (see sd_async.h). NULL if not supported.
+    // start_io starts the transfer described by req_p;
+    // poll_io returns SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK until it is complete.
+    block_dev_err_t (*start_io)(sd_card_t *sd_card_p, sd_io_req_t *req_p);
+    block_dev_err_t (*poll_io)(sd_card_t *sd_card_p, sd_io_req_t *req_p);
 };
 
 void sd_lock(sd_card_t *sd_card_p);
 void sd_unlock(sd_card_t *sd_card_p);
 bool sd_is_locked(sd_card_t *sd_card_p);
 
+/* Called over and over while a driver waits for the card to finish programming
+(or erasing), which can take milliseconds after each written block.
+The default does nothing. Define it to do other work meanwhile (e.g., tud_task()),
+a little at a time: the driver only sees that the card is ready after it returns.
+It is called with the card (and its SPI) locked, so it must not use them. */
+void sd_busy_yield(sd_card_t *sd_card_p);
+
 bool sd_init_driver();
 bool sd_card_detect(sd_card_t *sd_card_p);
 void cidDmp(sd_card_t *sd_card_p, printer_t printer);
 void csdDmp(sd_card_t *sd_card_p, printer_t printer);
 bool sd_allocation_unit(sd_card_t *sd_card_p, size_t *au_size_bytes_p);
+bool sd_au_mkfs_parm(sd_card_t *sd_card_p, MKFS_PARM *opt_p);
 sd_card_t *sd_get_by_drive_prefix(const char *const name);
 
 // sd_init_driver() must be called before this:
@@ -0,0 +1,198 @@
+/* sd_hotplug.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Hot-plug aware card management. See sd_hotplug.h. */
+
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+//
+#include "f_util.h"
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_cache.h"
+#include "sd_read_ahead.h"
+#include "sd_wr_queue.h"
+//
+#include "diskio.h"
+//
+#include "sd_hotplug.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+#define CD_EDGES (GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE)
+
+static struct {
+    sd_hotplug_callback_t callback;
+    void *context;
+} subscribers[SD_HOTPLUG_SUBSCRIBERS];
+
+/* Shared by all of the Card Detect GPIOs. Only notes the change. */
+static void card_detect_irq_handler(void) {
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *sd_card_p = sd_get_by_num(i);
+        if (!sd_card_p || !sd_card_p->hotplug_p || !sd_card_p->use_card_detect) continue;
+        uint32_t const events = gpio_get_irq_event_mask(sd_card_p->card_detect_gpio) & CD_EDGES;
+        if (!events) continue;
+        gpio_acknowledge_irq(sd_card_p->card_detect_gpio, events);
+        sd_card_p->hotplug_p->changed_us = time_us_32();  // Restarts the debounce
+        sd_card_p->hotplug_p->changed = true;
+    }
+}
+
+/* Register the shared handler once, for the Card Detect GPIOs of all of the hot-plug cards,
+so that the SDK's GPIO callback (gpio_set_irq_callback) leaves their edges to it */
+static void add_irq_handler(void) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *sd_card_p = sd_get_by_num(i);
+        if (!sd_card_p || !sd_card_p->hotplug_p || !sd_card_p->use_card_detect) continue;
+        myASSERT(sd_card_p->card_detect_gpio < NUM_BANK0_GPIOS);
+        mask |= 1ull << sd_card_p->card_detect_gpio;
+    }
+#if NUM_BANK0_GPIOS > 32
+    gpio_add_raw_irq_handler_masked64(mask, card_detect_irq_handler);
+#else
+    gpio_add_raw_irq_handler_masked((uint32_t)mask, card_detect_irq_handler);
+#endif
+}
+
+void sd_hotplug_ctor(sd_card_t *sd_card_p) {
+    static bool handler_added;
+    sd_hotplug_t *hp_p = sd_card_p->hotplug_p;
+    myASSERT(hp_p);
+    hp_p->ready = false;
+    hp_p->changed_us = time_us_32();
+    hp_p->changed = true;  // Bring it up
+    if (!sd_card_p->use_card_detect) return;
+    if (!handler_added) {
+        add_irq_handler();
+        handler_added = true;
+    }
+    gpio_acknowledge_irq(sd_card_p->card_detect_gpio, CD_EDGES);
+    gpio_set_irq_enabled(sd_card_p->card_detect_gpio, CD_EDGES, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+static uint32_t debounce_us(sd_hotplug_t *hp_p) {
+    return 1000 * (hp_p->debounce_ms ? hp_p->debounce_ms : SD_HOTPLUG_DEBOUNCE_MS);
+}
+
+static void notify(sd_card_t *sd_card_p, sd_hotplug_event_t event) {
+    for (size_t i = 0; i < SD_HOTPLUG_SUBSCRIBERS; ++i)
+        if (subscribers[i].callback)
+            subscribers[i].callback(sd_card_p, event, subscribers[i].context);
+}
+
+static void take_down(sd_card_t *sd_card_p) {
+    TRACE_PRINTF("%s(%s)\n", __func__, sd_get_drive_prefix(sd_card_p));
+    if (sd_card_p->state.mounted) {
+        FRESULT fr = f_unmount(sd_get_drive_prefix(sd_card_p));
+        if (FR_OK != fr)
+            EMSG_PRINTF("f_unmount(%s) error: %s (%d)\n", sd_get_drive_prefix(sd_card_p),
+                        FRESULT_str(fr), fr);
+        sd_card_p->state.mounted = false;
+    }
+    // Whatever was in RAM for the old card is of no use for the next one
+    if (sd_card_p->wr_queue_p) sd_wr_queue_discard(sd_card_p);
+    if (sd_card_p->cache_p) sd_cache_invalidate(sd_card_p);
+    if (sd_card_p->read_ahead_p) sd_read_ahead_invalidate(sd_card_p);
+    sd_lock(sd_card_p);
+    sd_card_p->state.m_Status |= STA_NOINIT;
+    sd_unlock(sd_card_p);
+}
+
+static bool bring_up(sd_card_t *sd_card_p, BYTE pdrv) {
+    TRACE_PRINTF("%s(%s)\n", __func__, sd_get_drive_prefix(sd_card_p));
+    DSTATUS ds = disk_initialize(pdrv);
+    if (ds & (STA_NOINIT | STA_NODISK)) {
+        EMSG_PRINTF("%s: disk_initialize(%u) failed: 0x%x\n", __func__, pdrv, ds);
+        return false;
+    }
+    if (!sd_card_p->hotplug_p->mount) return true;
+    FRESULT fr = f_mount(&sd_card_p->state.fatfs, sd_get_drive_prefix(sd_card_p), 1);
+    if (FR_OK != fr) {
+        EMSG_PRINTF("f_mount(%s) error: %s (%d)\n", sd_get_drive_prefix(sd_card_p),
+                    FRESULT_str(fr), fr);
+        return false;
+    }
+    sd_card_p->state.mounted = true;
+    return true;
+}
+
+void sd_hotplug_task(void) {
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *sd_card_p = sd_get_by_num(i);
+        if (!sd_card_p || !sd_card_p->hotplug_p) continue;
+        sd_hotplug_t *hp_p = sd_card_p->hotplug_p;
+        if (!hp_p->changed) continue;
+        if (time_us_32() - hp_p->changed_us < debounce_us(hp_p)) continue;  // Still bouncing
+        // An edge from here on is a new change, for the next time around
+        hp_p->changed = false;
+        __dmb();
+        if (hp_p->ready) {
+            hp_p->ready = false;
+            take_down(sd_card_p);
+            ++hp_p->removals;
+            notify(sd_card_p, SD_HOTPLUG_REMOVED);
+        }
+        if (!sd_card_detect(sd_card_p)) continue;
+        if (bring_up(sd_card_p, i)) {
+            hp_p->ready = true;
+            ++hp_p->insertions;
+            IMSG_PRINTF("%s is ready\n", sd_get_drive_prefix(sd_card_p));
+            notify(sd_card_p, SD_HOTPLUG_READY);
+        } else {
+            ++hp_p->failures;
+            notify(sd_card_p, SD_HOTPLUG_FAILED);
+        }
+    }
+}
+
+bool sd_hotplug_ready(sd_card_t *sd_card_p) {
+    sd_hotplug_t *hp_p = sd_card_p->hotplug_p;
+    myASSERT(hp_p);
+    return hp_p->ready && !hp_p->changed;
+}
+
+void sd_hotplug_rescan(sd_card_t *sd_card_p) {
+    sd_hotplug_t *hp_p = sd_card_p->hotplug_p;
+    myASSERT(hp_p);
+    hp_p->changed_us = time_us_32() - debounce_us(hp_p);  // No need to wait
+    hp_p->changed = true;
+}
+
+bool sd_hotplug_subscribe(sd_hotplug_callback_t callback, void *context) {
+    for (size_t i = 0; i < SD_HOTPLUG_SUBSCRIBERS; ++i) {
+        if (!subscribers[i].callback) {
+            subscribers[i].callback = callback;
+            subscribers[i].context = context;
+            return true;
+        }
+    }
+    return false;
+}
+
+void sd_hotplug_unsubscribe(sd_hotplug_callback_t callback, void *context) {
+    for (size_t i = 0; i < SD_HOTPLUG_SUBSCRIBERS; ++i) {
+        if (callback == subscribers[i].callback && context == subscribers[i].context) {
+            subscribers[i].callback = NULL;
+            subscribers[i].context = NULL;
+        }
+    }
+}
+
+/* [] END OF FILE */
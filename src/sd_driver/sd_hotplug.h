@@ -0,0 +1,120 @@
+/* sd_hotplug.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Hot-plug aware card management
+
+Without this, Card Detect (use_card_detect) is only looked at when disk_status is called,
+and bringing a card back up after it is reinserted is left to the application:
+typically, a disk_initialize or f_mount in the middle of whatever it was doing
+(e.g., a USB Mass Storage tud_msc_test_unit_ready_cb).
+
+With a hot-plug record, the Card Detect GPIO's edges raise an interrupt,
+and all the interrupt handler does is note the time.
+sd_hotplug_task, called from the application's main loop, does the rest,
+once the switch has been quiet for debounce_ms:
+    * If the card was up, it is taken down: the volume is unmounted,
+      the write queue's pending sectors (sd_wr_queue.h) and the contents of
+      the cache (sd_cache.h) and the read-ahead buffer (sd_read_ahead.h) are dropped,
+      and the card is marked uninitialized. The subscribers get SD_HOTPLUG_REMOVED.
+      Any change does this, even if a card is back in the socket by now:
+      it might be a different card.
+    * If there is a card in the socket, it is initialized and, if mount is set,
+      its volume is mounted on the card's state.fatfs. The subscribers get
+      SD_HOTPLUG_READY, or SD_HOTPLUG_FAILED.
+The card is also brought up by the first sd_hotplug_task after sd_init_driver.
+
+sd_hotplug_ready only looks at flags, so, e.g., tud_msc_test_unit_ready_cb can
+answer at once, card or not, instead of waiting for the card to initialize.
+
+Without Card Detect, there are no interrupts; the card is brought up once,
+and again after each sd_hotplug_rescan.
+
+The subscriber callbacks run in sd_hotplug_task.
+
+To enable it for an SD card, point hotplug_p at an instance in the hardware configuration:
+
+    static sd_hotplug_t hotplug = {.mount = true};
+    static sd_card_t sd_card = {
+        ...
+        .use_card_detect = true,
+        .card_detect_gpio = 9,
+        .card_detected_true = 0,
+        .hotplug_p = &hotplug
+    };
+
+and call sd_hotplug_task in the main loop.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_HOTPLUG_DEBOUNCE_MS
+#  define SD_HOTPLUG_DEBOUNCE_MS 100
+#endif
+#ifndef SD_HOTPLUG_SUBSCRIBERS
+#  define SD_HOTPLUG_SUBSCRIBERS 4
+#endif
+
+typedef enum {
+    SD_HOTPLUG_REMOVED,  // The card was up and has been taken down
+    SD_HOTPLUG_READY,    // The card is initialized (and, if configured, mounted)
+    SD_HOTPLUG_FAILED    // There is a card, but it could not be initialized or mounted
+} sd_hotplug_event_t;
+
+typedef void (*sd_hotplug_callback_t)(sd_card_t *sd_card_p, sd_hotplug_event_t event,
+                                      void *context);
+
+struct sd_hotplug_t {
+    bool mount;            // Mount the volume; otherwise, just initialize the card
+    uint32_t debounce_ms;  // 0: SD_HOTPLUG_DEBOUNCE_MS
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    volatile bool changed;        // A change is waiting for sd_hotplug_task
+    volatile uint32_t changed_us;  // time_us_32 of the last Card Detect edge
+    bool ready;
+
+    // Statistics
+    uint32_t insertions;  // SD_HOTPLUG_READY events
+    uint32_t removals;    // SD_HOTPLUG_REMOVED events
+    uint32_t failures;    // SD_HOTPLUG_FAILED events
+};
+
+void sd_hotplug_ctor(sd_card_t *sd_card_p);  // Called by sd_init_driver
+
+/* Handle the changes that have settled. Call it from the main loop. */
+void sd_hotplug_task(void);
+
+/* Is the card up? Quick: no card access. */
+bool sd_hotplug_ready(sd_card_t *sd_card_p);
+
+/* Take the card down and bring it up again (at the next sd_hotplug_task) */
+void sd_hotplug_rescan(sd_card_t *sd_card_p);
+
+/* Returns false if there are already SD_HOTPLUG_SUBSCRIBERS */
+bool sd_hotplug_subscribe(sd_hotplug_callback_t callback, void *context);
+void sd_hotplug_unsubscribe(sd_hotplug_callback_t callback, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
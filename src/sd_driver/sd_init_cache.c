@@ -0,0 +1,147 @@
+/* sd_init_cache.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Card identity keyed cache of initialization results. See sd_init_cache.h. */
+
+#include <string.h>
+//
+#include "crc.h"
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "sd_init_cache.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+static uint16_t entry_crc(sd_init_cache_entry_t const *e_p) {
+    return crc16((uint8_t const *)e_p, offsetof(sd_init_cache_entry_t, crc));
+}
+
+static bool entry_valid(sd_init_cache_entry_t const *e_p) {
+    return SD_INIT_CACHE_MAGIC == e_p->magic && entry_crc(e_p) == e_p->crc;
+}
+
+static void save(sd_init_cache_t *ic_p) {
+    if (!ic_p->save) return;
+    if (!ic_p->save(ic_p->entries, ic_p->num_entries * sizeof ic_p->entries[0]))
+        EMSG_PRINTF("%s: save failed\n", __func__);
+    ++ic_p->saves;
+}
+
+/* Load on first use; drop whatever does not check out */
+static void load(sd_init_cache_t *ic_p) {
+    if (ic_p->loaded) return;
+    ic_p->loaded = true;
+    if (!ic_p->load || !ic_p->load(ic_p->entries, ic_p->num_entries * sizeof ic_p->entries[0]))
+        memset(ic_p->entries, 0, ic_p->num_entries * sizeof ic_p->entries[0]);
+    for (size_t i = 0; i < ic_p->num_entries; ++i) {
+        sd_init_cache_entry_t *e_p = &ic_p->entries[i];
+        if (!entry_valid(e_p)) {
+            memset(e_p, 0, sizeof *e_p);
+            continue;
+        }
+        if (e_p->last_use > ic_p->clock) ic_p->clock = e_p->last_use;
+    }
+}
+
+/* Caller holds the mutex */
+static sd_init_cache_entry_t *find(sd_card_t *sd_card_p) {
+    sd_init_cache_t *ic_p = sd_card_p->init_cache_p;
+    load(ic_p);
+    for (size_t i = 0; i < ic_p->num_entries; ++i) {
+        sd_init_cache_entry_t *e_p = &ic_p->entries[i];
+        if (SD_INIT_CACHE_MAGIC == e_p->magic &&
+            !memcmp(e_p->CID, sd_card_p->state.CID, sizeof(CID_t)))
+            return e_p;
+    }
+    return NULL;
+}
+
+static void seal(sd_init_cache_t *ic_p, sd_init_cache_entry_t *e_p) {
+    e_p->last_use = ++ic_p->clock;
+    e_p->crc = entry_crc(e_p);
+}
+
+bool sd_init_cache_lookup(sd_card_t *sd_card_p) {
+    sd_init_cache_t *ic_p = sd_card_p->init_cache_p;
+    myASSERT(ic_p && ic_p->entries && ic_p->num_entries);
+    mutex_enter_blocking(&ic_p->mutex);
+    sd_init_cache_entry_t *e_p = find(sd_card_p);
+    if (e_p) {
+        memcpy(sd_card_p->state.CSD, e_p->CSD, sizeof(CSD_t));
+        sd_card_p->state.sectors = e_p->sectors;
+        seal(ic_p, e_p);
+        ++ic_p->hits;
+    } else {
+        ++ic_p->misses;
+    }
+    mutex_exit(&ic_p->mutex);
+    TRACE_PRINTF("%s: %s\n", __func__, e_p ? "hit" : "miss");
+    return e_p;
+}
+
+void sd_init_cache_store(sd_card_t *sd_card_p) {
+    sd_init_cache_t *ic_p = sd_card_p->init_cache_p;
+    myASSERT(ic_p && ic_p->entries && ic_p->num_entries);
+    mutex_enter_blocking(&ic_p->mutex);
+    sd_init_cache_entry_t *e_p = find(sd_card_p);
+    if (!e_p) {
+        // A free entry, or else the least recently used one
+        e_p = &ic_p->entries[0];
+        for (size_t i = 0; i < ic_p->num_entries; ++i) {
+            sd_init_cache_entry_t *c_p = &ic_p->entries[i];
+            if (SD_INIT_CACHE_MAGIC != c_p->magic) {
+                e_p = c_p;
+                break;
+            }
+            if (c_p->last_use < e_p->last_use) e_p = c_p;
+        }
+    }
+    memset(e_p, 0, sizeof *e_p);
+    e_p->magic = SD_INIT_CACHE_MAGIC;
+    memcpy(e_p->CID, sd_card_p->state.CID, sizeof(CID_t));
+    memcpy(e_p->CSD, sd_card_p->state.CSD, sizeof(CSD_t));
+    e_p->sectors = sd_card_p->state.sectors;
+    seal(ic_p, e_p);
+    save(ic_p);
+    mutex_exit(&ic_p->mutex);
+}
+
+bool sd_init_cache_get_au(sd_card_t *sd_card_p, size_t *au_size_bytes_p) {
+    sd_init_cache_t *ic_p = sd_card_p->init_cache_p;
+    myASSERT(ic_p);
+    mutex_enter_blocking(&ic_p->mutex);
+    sd_init_cache_entry_t *e_p = find(sd_card_p);
+    bool const known = e_p && e_p->au_known;
+    if (known) *au_size_bytes_p = e_p->au_size_bytes;
+    mutex_exit(&ic_p->mutex);
+    return known;
+}
+
+void sd_init_cache_set_au(sd_card_t *sd_card_p, size_t au_size_bytes) {
+    sd_init_cache_t *ic_p = sd_card_p->init_cache_p;
+    myASSERT(ic_p);
+    mutex_enter_blocking(&ic_p->mutex);
+    sd_init_cache_entry_t *e_p = find(sd_card_p);
+    if (e_p && (!e_p->au_known || e_p->au_size_bytes != au_size_bytes)) {
+        e_p->au_size_bytes = au_size_bytes;
+        e_p->au_known = true;
+        seal(ic_p, e_p);
+        save(ic_p);
+    }
+    mutex_exit(&ic_p->mutex);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,120 @@
+/* sd_init_cache.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Card identity keyed cache of what initialization learns about a card
+
+Some of what the driver reads from a card never changes for that card:
+the CSD (CMD9), which gives the capacity, and the AU size in the SD Status (ACMD13),
+which sd_allocation_unit reads for f_mkfs and TRIM (CTRL_TRIM, see glue.c), once per initialization.
+The CID identifies the card: it has the manufacturer, the product name and revision,
+the serial number, and the manufacturing date.
+
+With an init cache, the driver reads the CID first. For a card that is in the cache,
+the CSD and the capacity come from the cache, and CMD9 is skipped;
+and sd_allocation_unit reads the SD Status only once per card, ever, rather than once per initialization.
+A cache can be shared by several cards, since it is keyed by CID,
+and the least recently used entry makes room for a new card.
+
+What is not skipped: the power up sequence (CMD0, CMD8, ACMD41, which is most of the
+initialization time, and the card needs it anyway), the CID itself,
+and what FatFs reads to mount the volume.
+
+By default, the cache is in RAM, so it helps with reinitialization
+(e.g., after a card swap, see sd_hotplug.h, or an error) and with TRIM.
+To keep it across resets, provide load and save functions,
+e.g., for a flash sector or a reserved area on another medium.
+They get the whole entries array. Each entry carries a CRC,
+so an erased or garbled image just makes for misses.
+save is called when an entry is added or changed, which is rare:
+once for each new card, and once more when its AU is first read.
+
+The CSD has a few writable bits (e.g., TMP_WRITE_PROTECT),
+which are not seen while a card's CSD comes from the cache.
+
+Configuration (hw_config.c):
+    static sd_init_cache_entry_t init_cache_entries[4];
+    static sd_init_cache_t init_cache = {
+        .entries = init_cache_entries,
+        .num_entries = count_of(init_cache_entries),
+        .load = my_load,  // Optional
+        .save = my_save   // Optional
+    };
+    static sd_card_t sd_card = {
+        ...
+        .init_cache_p = &init_cache
+    };
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+#include "pico/mutex.h"
+//
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SD_INIT_CACHE_MAGIC 0x53444331  // "SDC1"
+
+typedef struct sd_init_cache_entry_t {
+    uint32_t magic;  // SD_INIT_CACHE_MAGIC if the entry is in use
+    CID_t CID;       // The key
+    CSD_t CSD;
+    uint32_t sectors;
+    uint32_t au_size_bytes;  // See sd_allocation_unit; valid if au_known
+    uint32_t last_use;       // For LRU replacement
+    uint8_t au_known;
+    uint8_t reserved;
+    uint16_t crc;  // CRC16 of the above
+} sd_init_cache_entry_t;
+
+struct sd_init_cache_t {
+    sd_init_cache_entry_t *entries;
+    size_t num_entries;
+    // Optional: fill buffer from storage. Returns false if there is nothing there.
+    bool (*load)(void *buffer, size_t size);
+    // Optional: write buffer to storage
+    bool (*save)(void const *buffer, size_t size);
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    mutex_t mutex;
+    bool loaded;
+    uint32_t clock;  // Use counter, for LRU
+
+    // Statistics
+    uint32_t hits;    // Initializations that skipped CMD9
+    uint32_t misses;  // Initializations of cards not in the cache
+    uint32_t saves;
+};
+
+/* For the drivers: call with sd_card_p->state.CID read from the card.
+On a hit, fills sd_card_p->state.CSD and sd_card_p->state.sectors, and returns true. */
+bool sd_init_cache_lookup(sd_card_t *sd_card_p);
+/* For the drivers: after a miss, remember sd_card_p->state.CID, CSD, and sectors */
+void sd_init_cache_store(sd_card_t *sd_card_p);
+
+/* For sd_allocation_unit */
+bool sd_init_cache_get_au(sd_card_t *sd_card_p, size_t *au_size_bytes_p);
+void sd_init_cache_set_au(sd_card_t *sd_card_p, size_t au_size_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
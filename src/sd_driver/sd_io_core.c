@@ -0,0 +1,128 @@
+/* sd_io_core.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Dedicated I/O core. See sd_io_core.h. */
+
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+//
+#include "my_debug.h"
+//
+#include "sd_io_core.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+#define IO_CORE 1
+#define STOP SD_IO_CORE_SLOTS  // A FIFO word that is not a slot
+
+/* Core 0 fills a free slot; core 1 empties it when the message is done. */
+static sd_io_msg_t *volatile slots[SD_IO_CORE_SLOTS];
+static volatile bool running;
+static volatile uint32_t handled;
+
+static void handle(sd_io_msg_t *msg_p) {
+    TRACE_PRINTF("%s: op %d, drive %d, %lu+%u\n", __func__, msg_p->op, msg_p->pdrv,
+                 (unsigned long)msg_p->sector, msg_p->count);
+    switch (msg_p->op) {
+        case SD_IO_MSG_STATUS:
+            msg_p->result = disk_status(msg_p->pdrv);
+            break;
+        case SD_IO_MSG_INITIALIZE:
+            msg_p->result = disk_initialize(msg_p->pdrv);
+            break;
+        case SD_IO_MSG_READ:
+            msg_p->result = disk_read(msg_p->pdrv, msg_p->rd_buffer, msg_p->sector, msg_p->count);
+            break;
+#if FF_FS_READONLY == 0
+        case SD_IO_MSG_WRITE:
+            msg_p->result = disk_write(msg_p->pdrv, msg_p->wr_buffer, msg_p->sector, msg_p->count);
+            break;
+#endif
+        case SD_IO_MSG_IOCTL:
+            msg_p->result = disk_ioctl(msg_p->pdrv, msg_p->cmd, msg_p->ioctl_buffer);
+            break;
+        default:
+            msg_p->result = RES_PARERR;
+    }
+    ++handled;
+}
+
+static void io_core_main(void) {
+    for (;;) {
+        uint32_t const slot = multicore_fifo_pop_blocking();  // Sleeps in __wfe
+        if (STOP == slot) break;
+        myASSERT(slot < SD_IO_CORE_SLOTS);
+        sd_io_msg_t *msg_p = slots[slot];
+        __dmb();
+        handle(msg_p);
+        if (msg_p->callback) msg_p->callback(msg_p);
+        // Free the slot before marking the message done: once it is, the caller may reuse it at once
+        __dmb();
+        slots[slot] = NULL;
+        msg_p->done = true;
+        __sev();
+    }
+    __dmb();
+    running = false;
+}
+
+void sd_io_core_start(void) {
+    if (running) return;
+    for (size_t i = 0; i < SD_IO_CORE_SLOTS; ++i) slots[i] = NULL;
+    running = true;
+    __dmb();
+    multicore_launch_core1(io_core_main);
+    IMSG_PRINTF("SD card I/O on core %d\n", IO_CORE);
+}
+
+void sd_io_core_stop(void) {
+    if (!running || IO_CORE == get_core_num()) return;
+    multicore_fifo_push_blocking(STOP);
+    while (running) tight_loop_contents();
+    multicore_reset_core1();
+}
+
+bool sd_io_core_running(void) { return running; }
+
+bool sd_io_core_offload(void) { return running && IO_CORE != get_core_num(); }
+
+void sd_io_core_send(sd_io_msg_t *msg_p) {
+    myASSERT(sd_io_core_offload());
+    msg_p->done = false;
+    // Claim a free slot. Only this core fills slots, so a free one stays free.
+    size_t slot = 0;
+    while (slots[slot]) {
+        if (++slot == SD_IO_CORE_SLOTS) {
+            slot = 0;
+            tight_loop_contents();
+        }
+    }
+    slots[slot] = msg_p;
+    __dmb();
+    multicore_fifo_push_blocking(slot);
+}
+
+int sd_io_core_call(sd_io_msg_t *msg_p) {
+    msg_p->callback = NULL;
+    sd_io_core_send(msg_p);
+    while (!msg_p->done) tight_loop_contents();
+    __dmb();
+    return msg_p->result;
+}
+
+uint32_t sd_io_core_handled(void) { return handled; }
+
+/* [] END OF FILE */
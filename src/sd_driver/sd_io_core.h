@@ -0,0 +1,116 @@
+/* sd_io_core.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Dedicated I/O core: all SD card traffic on core 1
+
+With USE_SD_IO_CORE defined to 1, sd_init_driver starts an I/O service loop
+on core 1 (multicore_launch_core1), and from then on core 1 owns every sd_card_t:
+disk_status, disk_initialize, disk_read, disk_write, and disk_ioctl (glue.c),
+called on core 0, become messages to core 1, which carries them out
+(through the cache, read-ahead, and write queue, if configured) and reports back.
+Core 0 is left free for, e.g., tud_task, while core 1 waits on the card.
+(Alternatively, call sd_io_core_start after sd_init_driver.)
+
+A message (sd_io_msg_t) describes a diskio call. It is not copied, and neither is the buffer:
+core 0 passes the index of the message in a table of SD_IO_CORE_SLOTS outstanding messages
+through the multicore FIFO, and core 1 works on the caller's message and buffer directly.
+    * Blocking callers (e.g., FatFs through disk_read) send the message and wait for done.
+    * Asynchronous callers send a message with a callback (sd_io_core_send),
+      and carry on. The callback runs on core 1, when the call is done,
+      so it should be short (e.g., set a flag, or push to a queue).
+      Until done is set, the message and the buffer belong to core 1.
+
+The messages come from core 0, and not from interrupt handlers.
+Calls made on core 1 (e.g., from a callback) run directly.
+Core 1 can still do other work, as long as it is driven by interrupts.
+(On the host, core 1 is a thread: see pico/multicore.h there.)
+The Pico SDK's multicore_lockout and any other user of the inter-core FIFO
+can not be used alongside.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "ff.h"
+//
+#include "diskio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef USE_SD_IO_CORE
+#  define USE_SD_IO_CORE 0
+#endif
+#ifndef SD_IO_CORE_SLOTS
+#  define SD_IO_CORE_SLOTS 8  // Maximum number of outstanding messages
+#endif
+
+typedef enum {
+    SD_IO_MSG_STATUS,      // disk_status
+    SD_IO_MSG_INITIALIZE,  // disk_initialize
+    SD_IO_MSG_READ,        // disk_read
+    SD_IO_MSG_WRITE,       // disk_write
+    SD_IO_MSG_IOCTL        // disk_ioctl
+} sd_io_msg_op_t;
+
+typedef struct sd_io_msg_t sd_io_msg_t;
+typedef void (*sd_io_msg_callback_t)(sd_io_msg_t *msg_p);
+
+struct sd_io_msg_t {
+    /* Set by the caller */
+    sd_io_msg_op_t op;
+    BYTE pdrv;
+    union {
+        BYTE *rd_buffer;        // SD_IO_MSG_READ
+        const BYTE *wr_buffer;  // SD_IO_MSG_WRITE
+        void *ioctl_buffer;     // SD_IO_MSG_IOCTL
+    };
+    LBA_t sector;
+    UINT count;
+    BYTE cmd;                       // SD_IO_MSG_IOCTL
+    sd_io_msg_callback_t callback;  // Optional; runs on core 1 (see above)
+    void *context;                  // For the caller's use
+
+    /* Set by core 1 */
+    int result;  // DSTATUS for SD_IO_MSG_STATUS and SD_IO_MSG_INITIALIZE; otherwise, DRESULT
+    volatile bool done;
+};
+
+/* Start the I/O service loop on core 1. Called by sd_init_driver if USE_SD_IO_CORE. */
+void sd_io_core_start(void);
+
+/* Stop the I/O service loop, when all of the messages sent so far are done */
+void sd_io_core_stop(void);
+
+bool sd_io_core_running(void);
+
+/* True if a diskio call made here should be sent to core 1 */
+bool sd_io_core_offload(void);
+
+/* Send a message, and return at once. Blocks while SD_IO_CORE_SLOTS messages are outstanding. */
+void sd_io_core_send(sd_io_msg_t *msg_p);
+
+/* Send a message, wait until it is done, and return its result */
+int sd_io_core_call(sd_io_msg_t *msg_p);
+
+/* Number of messages carried out by core 1 */
+uint32_t sd_io_core_handled(void);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
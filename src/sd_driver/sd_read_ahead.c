@@ -0,0 +1,188 @@
+/* sd_read_ahead.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-drive read-ahead. See sd_read_ahead.h. */
+
+#include <string.h>
+//
+#include "my_debug.h"
+#include "sd_async.h"
+#include "sd_card.h"
+#include "sd_wr_queue.h"
+//
+#include "sd_read_ahead.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+/* The layer below: the write queue, if any, or the driver */
+static block_dev_err_t lower_read(sd_card_t *sd_card_p, uint8_t *buffer,
+                                  uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    if (sd_card_p->wr_queue_p)
+        return sd_wr_queue_read(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+    return sd_card_p->read_blocks(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+}
+static block_dev_err_t lower_write(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                   uint32_t ulSectorNumber, uint32_t blockCnt) {
+    if (sd_card_p->wr_queue_p)
+        return sd_wr_queue_write(sd_card_p, buffer, ulSectorNumber, blockCnt);
+    return sd_card_p->write_blocks(sd_card_p, buffer, ulSectorNumber, blockCnt);
+}
+static block_dev_err_t lower_erase(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                   uint32_t blockCnt) {
+    if (sd_card_p->wr_queue_p) return sd_wr_queue_erase(sd_card_p, ulSectorNumber, blockCnt);
+    if (!sd_card_p->erase_blocks) return SD_BLOCK_DEVICE_ERROR_UNSUPPORTED;
+    return sd_card_p->erase_blocks(sd_card_p, ulSectorNumber, blockCnt);
+}
+
+static bool overlaps_buffer(sd_read_ahead_t *ra_p, uint32_t lba, uint32_t count) {
+    return ra_p->buf_count && lba < ra_p->buf_lba + ra_p->buf_count &&
+           ra_p->buf_lba < lba + count;
+}
+
+static bool in_buffer(sd_read_ahead_t *ra_p, uint32_t lba) {
+    return ra_p->buf_count && ra_p->buf_lba <= lba && lba - ra_p->buf_lba < ra_p->buf_count;
+}
+
+static void discard(sd_read_ahead_t *ra_p) {
+    ra_p->sectors_wasted += ra_p->buf_count - ra_p->buf_used;
+    ra_p->buf_count = 0;
+    ra_p->buf_used = 0;
+}
+
+/* Complete the prefetch in flight, if any. Returns false if it is still in flight. */
+static bool complete(sd_read_ahead_t *ra_p, bool block) {
+    if (!ra_p->in_flight) return true;
+    if (block)
+        sd_io_wait(&ra_p->req);
+    else if (!sd_io_poll(&ra_p->req))
+        return false;
+    ra_p->in_flight = false;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != ra_p->req.status) {
+        EMSG_PRINTF("%s: prefetch of %lu sectors at %lu failed: %d\n", __func__,
+                    ra_p->req.count, ra_p->req.sector, ra_p->req.status);
+        ra_p->buf_count = 0;
+        ra_p->buf_used = 0;
+    }
+    return true;
+}
+
+static void prefetch(sd_card_t *sd_card_p, uint32_t lba) {
+    sd_read_ahead_t *ra_p = sd_card_p->read_ahead_p;
+    if (lba >= sd_card_p->state.sectors) return;
+    uint32_t n = ra_p->sectors;
+    if (n > sd_card_p->state.sectors - lba) n = sd_card_p->state.sectors - lba;
+    TRACE_PRINTF("%s(%lu, %lu)\n", __func__, lba, n);
+
+    discard(ra_p);
+    ra_p->buf_lba = lba;
+    ++ra_p->prefetches;
+    ra_p->sectors_prefetched += n;
+    if (sd_card_p->wr_queue_p) {
+        // The write queue might hold newer data, so go through it
+        if (SD_BLOCK_DEVICE_ERROR_NONE == sd_wr_queue_read(sd_card_p, ra_p->buffer, lba, n))
+            ra_p->buf_count = n;
+        return;
+    }
+    memset(&ra_p->req, 0, sizeof ra_p->req);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == sd_read_blocks_async(sd_card_p, &ra_p->req, ra_p->buffer, lba, n)) {
+        ra_p->buf_count = n;  // Valid once complete
+        ra_p->in_flight = true;
+    }
+}
+
+block_dev_err_t sd_read_ahead_read(sd_card_t *sd_card_p, uint8_t *buffer,
+                                   uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, ulSectorCount);
+    sd_read_ahead_t *ra_p = sd_card_p->read_ahead_p;
+    myASSERT(ra_p && ra_p->buffer && ra_p->sectors);
+    if (!ulSectorCount) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    mutex_enter_blocking(&ra_p->mutex);
+    complete(ra_p, true);
+
+    // A stream continues where the previous read ended, or at the end of the buffer
+    bool const sequential = ulSectorNumber == ra_p->next_lba ||
+                            (ra_p->buf_count && ulSectorNumber == ra_p->buf_lba + ra_p->buf_count);
+    uint32_t done = 0;
+    if (in_buffer(ra_p, ulSectorNumber)) {
+        uint32_t const offset = ulSectorNumber - ra_p->buf_lba;
+        done = ra_p->buf_count - offset;
+        if (done > ulSectorCount) done = ulSectorCount;
+        memcpy(buffer, ra_p->buffer + (size_t)offset * sd_block_size, (size_t)done * sd_block_size);
+        ra_p->sectors_hit += done;
+        if (offset + done > ra_p->buf_used) ra_p->buf_used = offset + done;
+    }
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (done < ulSectorCount)
+        rc = lower_read(sd_card_p, buffer + (size_t)done * sd_block_size, ulSectorNumber + done,
+                        ulSectorCount - done);
+    ra_p->next_lba = ulSectorNumber + ulSectorCount;
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc && sequential && !in_buffer(ra_p, ra_p->next_lba))
+        prefetch(sd_card_p, ra_p->next_lba);
+
+    mutex_exit(&ra_p->mutex);
+    return rc;
+}
+
+block_dev_err_t sd_read_ahead_write(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                    uint32_t ulSectorNumber, uint32_t blockCnt) {
+    TRACE_PRINTF("%s(,,%lu,%lu)\n", __func__, ulSectorNumber, blockCnt);
+    sd_read_ahead_t *ra_p = sd_card_p->read_ahead_p;
+    myASSERT(ra_p);
+    mutex_enter_blocking(&ra_p->mutex);
+    complete(ra_p, true);
+    if (overlaps_buffer(ra_p, ulSectorNumber, blockCnt)) discard(ra_p);
+    block_dev_err_t rc = lower_write(sd_card_p, buffer, ulSectorNumber, blockCnt);
+    mutex_exit(&ra_p->mutex);
+    return rc;
+}
+
+block_dev_err_t sd_read_ahead_erase(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                    uint32_t blockCnt) {
+    sd_read_ahead_t *ra_p = sd_card_p->read_ahead_p;
+    myASSERT(ra_p);
+    mutex_enter_blocking(&ra_p->mutex);
+    complete(ra_p, true);
+    if (overlaps_buffer(ra_p, ulSectorNumber, blockCnt)) discard(ra_p);
+    block_dev_err_t rc = lower_erase(sd_card_p, ulSectorNumber, blockCnt);
+    mutex_exit(&ra_p->mutex);
+    return rc;
+}
+
+void sd_read_ahead_poll(sd_card_t *sd_card_p) {
+    sd_read_ahead_t *ra_p = sd_card_p->read_ahead_p;
+    myASSERT(ra_p);
+    mutex_enter_blocking(&ra_p->mutex);
+    complete(ra_p, false);
+    mutex_exit(&ra_p->mutex);
+}
+
+void sd_read_ahead_wait(sd_card_t *sd_card_p) {
+    sd_read_ahead_t *ra_p = sd_card_p->read_ahead_p;
+    myASSERT(ra_p);
+    mutex_enter_blocking(&ra_p->mutex);
+    complete(ra_p, true);
+    mutex_exit(&ra_p->mutex);
+}
+
+void sd_read_ahead_invalidate(sd_card_t *sd_card_p) {
+    sd_read_ahead_t *ra_p = sd_card_p->read_ahead_p;
+    myASSERT(ra_p);
+    mutex_enter_blocking(&ra_p->mutex);
+    complete(ra_p, true);
+    discard(ra_p);
+    mutex_exit(&ra_p->mutex);
+}
+/* [] END OF FILE */
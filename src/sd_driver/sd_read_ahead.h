@@ -0,0 +1,96 @@
+/* sd_read_ahead.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-drive read-ahead for sequential reads
+
+f_read reads exactly the sectors it needs, when it needs them,
+so a streaming reader with a small buffer (ff_fgetc, ff_fgets, file_stream.c)
+pays for a whole read command for each sector.
+
+When disk_read sees a read that starts where the previous one ended,
+this reads the next `sectors` sectors into `buffer` in the background
+(with sd_read_blocks_async; see sd_async.h), and serves subsequent reads from there.
+It prefetches again when the reader reaches the end of the buffer.
+
+While a prefetch is in flight, the card is locked (see sd_async.h),
+so the card must only be accessed through disk_read, disk_write, and disk_ioctl (glue.c),
+which wait for the prefetch to complete first.
+Call sd_read_ahead_poll from time to time to have the prefetch complete (and the card
+unlocked) sooner, or sd_read_ahead_wait before accessing the card directly.
+With a write queue (sd_wr_queue.h), prefetches are synchronous,
+since the queue might hold newer data.
+
+To enable it for an SD card, provide a buffer in the hardware configuration:
+
+    static uint8_t read_ahead_buf[8 * 512] __attribute__((aligned(4)));
+    static sd_read_ahead_t read_ahead = {
+        .buffer = read_ahead_buf,
+        .sectors = 8
+    };
+    static sd_card_t sd_card = {
+        ...
+        .read_ahead_p = &read_ahead
+    };
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "pico/mutex.h"
+//
+#include "sd_async.h"
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sd_read_ahead_t {
+    uint8_t *buffer;   // sectors * 512 bytes, aligned on a 4 byte boundary
+    uint32_t sectors;  // How far to read ahead
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    mutex_t mutex;
+    uint32_t next_lba;  // Where the previous read ended
+    uint32_t buf_lba;   // First sector in the buffer
+    uint32_t buf_count; // Number of sectors in the buffer; 0 if empty
+    uint32_t buf_used;  // High water mark of sectors served from the buffer
+    bool in_flight;
+    sd_io_req_t req;
+
+    // Statistics
+    uint32_t prefetches;          // Number of prefetches started
+    uint32_t sectors_prefetched;
+    uint32_t sectors_hit;         // Sectors served from the buffer
+    uint32_t sectors_wasted;      // Prefetched sectors discarded unused
+};
+
+block_dev_err_t sd_read_ahead_read(sd_card_t *sd_card_p, uint8_t *buffer,
+                                   uint32_t ulSectorNumber, uint32_t ulSectorCount);
+block_dev_err_t sd_read_ahead_write(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                    uint32_t ulSectorNumber, uint32_t blockCnt);
+// Drop buffered sectors in the range, and erase it (see sd_card_t::erase_blocks)
+block_dev_err_t sd_read_ahead_erase(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                    uint32_t blockCnt);
+void sd_read_ahead_poll(sd_card_t *sd_card_p);        // Make progress; doesn't block
+void sd_read_ahead_wait(sd_card_t *sd_card_p);        // Complete any prefetch in flight
+void sd_read_ahead_invalidate(sd_card_t *sd_card_p);  // ... and empty the buffer
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,165 @@
+/* sd_ring.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Lock-free command submission rings. See sd_ring.h. */
+
+#include <string.h>
+//
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+//
+#include "my_debug.h"
+//
+#include "sd_ring.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+/* The producer fills the slot before it publishes the new head,
+and the consumer is done with the slot before it publishes the new tail.
+The indices are free running; only the producer writes head, and only the consumer writes tail. */
+
+static bool push(sd_spsc_ring_t *ring_p, sd_io_req_t *req_p) {
+    uint32_t const head = ring_p->head;
+    if (head - ring_p->tail >= SD_RING_DEPTH) return false;
+    ring_p->slots[head % SD_RING_DEPTH] = req_p;
+    __dmb();
+    ring_p->head = head + 1;
+    return true;
+}
+
+static sd_io_req_t *pop(sd_spsc_ring_t *ring_p) {
+    uint32_t const tail = ring_p->tail;
+    if (ring_p->head == tail) return NULL;
+    __dmb();
+    sd_io_req_t *req_p = ring_p->slots[tail % SD_RING_DEPTH];
+    __dmb();
+    ring_p->tail = tail + 1;
+    return req_p;
+}
+
+static block_dev_err_t submit(sd_card_t *sd_card_p, sd_io_req_t *req_p) {
+    myASSERT(sd_card_p->ring_p);
+    unsigned const core = get_core_num();
+    sd_spsc_ring_t *sub_p = &sd_card_p->ring_p->sub[core];
+    /* This core writes sub.head and cpl.tail, so it alone can tell how many of its
+    requests are outstanding. Limiting that to the depth guarantees the owner
+    room in the completion ring. */
+    if (sub_p->head - sd_card_p->ring_p->cpl[core].tail >= SD_RING_DEPTH)
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    req_p->sd_card_p = sd_card_p;
+    req_p->done = false;
+    req_p->status = SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    bool ok = push(sub_p, req_p);
+    myASSERT(ok);
+    (void)ok;
+    __sev();  // In case the owner is waiting for an event
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+block_dev_err_t sd_ring_read_blocks(sd_card_t *sd_card_p, sd_io_req_t *req_p, uint8_t *buffer,
+                                    uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    if (!ulSectorCount) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    req_p->op = SD_IO_READ;
+    req_p->rd_buffer = buffer;
+    req_p->sector = ulSectorNumber;
+    req_p->count = ulSectorCount;
+    return submit(sd_card_p, req_p);
+}
+
+block_dev_err_t sd_ring_write_blocks(sd_card_t *sd_card_p, sd_io_req_t *req_p,
+                                     const uint8_t *buffer, uint32_t ulSectorNumber,
+                                     uint32_t blockCnt) {
+    if (!blockCnt) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    req_p->op = SD_IO_WRITE;
+    req_p->wr_buffer = buffer;
+    req_p->sector = ulSectorNumber;
+    req_p->count = blockCnt;
+    return submit(sd_card_p, req_p);
+}
+
+block_dev_err_t sd_ring_sync(sd_card_t *sd_card_p, sd_io_req_t *req_p) {
+    req_p->op = SD_IO_SYNC;
+    req_p->count = 0;
+    return submit(sd_card_p, req_p);
+}
+
+sd_io_req_t *sd_ring_reap(sd_card_t *sd_card_p) {
+    myASSERT(sd_card_p->ring_p);
+    sd_io_req_t *req_p = pop(&sd_card_p->ring_p->cpl[get_core_num()]);
+    if (!req_p) return NULL;
+    req_p->done = true;
+    if (req_p->callback) req_p->callback(req_p);
+    return req_p;
+}
+
+block_dev_err_t sd_ring_wait(sd_card_t *sd_card_p, sd_io_req_t *req_p) {
+    while (!req_p->done)
+        if (!sd_ring_reap(sd_card_p)) tight_loop_contents();
+    return req_p->status;
+}
+
+/* Hand the finished request back to the core that submitted it */
+static void complete(sd_ring_t *ring_p, block_dev_err_t status) {
+    sd_io_req_t *req_p = ring_p->active_p;
+    TRACE_PRINTF("%s: core %u, %lu+%lu: %d\n", __func__, ring_p->active_core, req_p->sector,
+                 req_p->count, status);
+    req_p->status = status;
+    bool ok = push(&ring_p->cpl[ring_p->active_core], req_p);
+    myASSERT(ok);  // See submit()
+    (void)ok;
+    __sev();
+    ring_p->active_p = NULL;
+    ++ring_p->serviced;
+}
+
+/* Start the next request, taking the cores in turn. Returns false if there is none. */
+static bool start_next(sd_card_t *sd_card_p) {
+    sd_ring_t *ring_p = sd_card_p->ring_p;
+    for (unsigned i = 0; i < SD_RING_CORES; ++i) {
+        unsigned const core = (ring_p->next_core + i) % SD_RING_CORES;
+        sd_io_req_t *req_p = pop(&ring_p->sub[core]);
+        if (!req_p) continue;
+        ring_p->next_core = (core + 1) % SD_RING_CORES;
+        ring_p->active_p = req_p;
+        ring_p->active_core = core;
+        if (SD_IO_SYNC == req_p->op) {
+            complete(ring_p, sd_card_p->sync(sd_card_p));
+            return true;
+        }
+        memset(&ring_p->io, 0, sizeof ring_p->io);
+        block_dev_err_t rc;
+        if (SD_IO_READ == req_p->op)
+            rc = sd_read_blocks_async(sd_card_p, &ring_p->io, req_p->rd_buffer, req_p->sector,
+                                      req_p->count);
+        else
+            rc = sd_write_blocks_async(sd_card_p, &ring_p->io, req_p->wr_buffer, req_p->sector,
+                                       req_p->count);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) complete(ring_p, rc);
+        return true;
+    }
+    return false;
+}
+
+bool sd_ring_service(sd_card_t *sd_card_p) {
+    sd_ring_t *ring_p = sd_card_p->ring_p;
+    myASSERT(ring_p);
+    if (ring_p->active_p) {
+        if (!sd_io_poll(&ring_p->io)) return true;
+        complete(ring_p, ring_p->io.status);
+    }
+    return start_next(sd_card_p);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,118 @@
+/* sd_ring.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Lock-free command submission rings, for sharing a card between the two cores
+
+With both cores doing I/O on a card through sd_lock, one core spins
+while the other has the card. With a ring, one context, the owner,
+does all of the I/O on the card, and the others hand it requests:
+
+    * Each core has its own submission ring and its own completion ring
+      for each card. Each ring has exactly one producer and one consumer,
+      so a pair of indices and memory barriers make it safe
+      without any locks or atomic read-modify-write instructions
+      (which the Cortex-M0+ of the RP2040 does not have).
+    * Any core submits a request (sd_io_req_t, see sd_async.h) with
+      sd_ring_read_blocks, sd_ring_write_blocks, or sd_ring_sync,
+      and picks up completions for its own requests with sd_ring_reap or sd_ring_wait.
+      The request's callback, if any, runs in sd_ring_reap, on the submitting core.
+    * The owner calls sd_ring_service over and over. It takes requests from
+      the submission rings in turn, runs them one at a time with the
+      non-blocking API (sd_async.h), and posts each one to the completion ring
+      of the core that submitted it. Since it never waits on the card,
+      it can run in a loop on one core alongside other work (e.g., tud_task),
+      or from a periodic or DMA completion interrupt.
+
+Zero copy: the buffer is handed over with the request, and belongs to the owner until
+the request is reaped. The same goes for the request itself.
+Up to SD_RING_DEPTH requests per core can be outstanding (submitted and not yet reaped);
+beyond that, submitting returns SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK.
+
+On each core, only one context (e.g., the main loop, not an interrupt handler too)
+may submit and reap. While a ring is in use, all I/O on the card should go through it:
+the card's mutex is still taken by the drivers, but then only the owner takes it.
+
+To enable it for an SD card, point ring_p at an instance in the hardware configuration:
+
+    static sd_ring_t ring;
+    static sd_card_t sd_card = {
+        ...
+        .ring_p = &ring
+    };
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "sd_async.h"
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_RING_DEPTH
+#  define SD_RING_DEPTH 8  // Power of 2
+#endif
+#if SD_RING_DEPTH < 1 || (SD_RING_DEPTH & (SD_RING_DEPTH - 1))
+#  error SD_RING_DEPTH must be a power of 2 (the free running indices wrap at 2^32)
+#endif
+#define SD_RING_CORES 2
+
+/* Single producer, single consumer */
+typedef struct sd_spsc_ring_t {
+    sd_io_req_t *volatile slots[SD_RING_DEPTH];
+    volatile uint32_t head;  // Written only by the producer
+    volatile uint32_t tail;  // Written only by the consumer
+} sd_spsc_ring_t;
+
+struct sd_ring_t {
+    sd_spsc_ring_t sub[SD_RING_CORES];  // Core n to the owner
+    sd_spsc_ring_t cpl[SD_RING_CORES];  // The owner to core n
+
+    /* Only touched by the owner */
+    sd_io_req_t io;          // The request in progress, as run by the owner
+    sd_io_req_t *active_p;   // The submitted request behind io; NULL if idle
+    unsigned active_core;    // Where it came from
+    unsigned next_core;      // Round robin
+    uint32_t serviced;       // Requests completed
+};
+
+/* Submit a request. The request and the buffer belong to the owner until the request is reaped.
+Returns SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK if SD_RING_DEPTH requests are outstanding on this core. */
+block_dev_err_t sd_ring_read_blocks(sd_card_t *sd_card_p, sd_io_req_t *req_p, uint8_t *buffer,
+                                    uint32_t ulSectorNumber, uint32_t ulSectorCount);
+block_dev_err_t sd_ring_write_blocks(sd_card_t *sd_card_p, sd_io_req_t *req_p,
+                                     const uint8_t *buffer, uint32_t ulSectorNumber,
+                                     uint32_t blockCnt);
+block_dev_err_t sd_ring_sync(sd_card_t *sd_card_p, sd_io_req_t *req_p);
+
+/* Pick up one completion for this core, if there is one:
+set its done flag, call its callback, and return it. Otherwise, return NULL. */
+sd_io_req_t *sd_ring_reap(sd_card_t *sd_card_p);
+
+/* Reap until req_p is done, and return its status.
+Not on the owner's core, unless the owner is an interrupt handler. */
+block_dev_err_t sd_ring_wait(sd_card_t *sd_card_p, sd_io_req_t *req_p);
+
+/* For the owner only: make progress.
+Returns false if there was nothing to do (no request in progress, none waiting). */
+bool sd_ring_service(sd_card_t *sd_card_p);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
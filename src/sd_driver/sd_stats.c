@@ -0,0 +1,107 @@
+/* sd_stats.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-card I/O statistics. See sd_stats.h. */
+
+#include <inttypes.h>
+#include <string.h>
+//
+#include "sd_card.h"
+//
+#include "sd_stats.h"
+
+#if USE_SD_STATS
+
+void sd_stats_record(sd_card_t *sd_card_p, sd_stats_op_t op, uint32_t blocks,
+                     uint64_t start_us, int rc) {
+    uint64_t const elapsed = time_us_64() - start_us;
+    uint32_t const us = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+    if (SD_STATS_SYNC != op && blocks > 1) ++op;  // _SINGLE -> _MULTI
+    sd_stats_op_stats_t *s_p = &sd_card_p->state.stats.ops[op];
+    ++s_p->count;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) ++s_p->errors;
+    s_p->blocks += blocks;
+    s_p->total_us += us;
+    if (us > s_p->max_us) s_p->max_us = us;
+    unsigned bucket = us ? 32 - __builtin_clz(us) : 0;
+    if (bucket >= SD_STATS_BUCKETS) bucket = SD_STATS_BUCKETS - 1;
+    ++s_p->hist[bucket];
+}
+
+void sd_stats_busy(sd_card_t *sd_card_p, uint64_t us) {
+    sd_stats_t *s_p = &sd_card_p->state.stats;
+    s_p->busy_wait_us += us;
+    ++s_p->busy_waits;
+    if (us > s_p->busy_max_us) s_p->busy_max_us = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+#endif
+
+/* The statistics are updated with the card locked. But the lock is held for as long as
+a transfer is in flight, which can outlast the call that started it (e.g., a read-ahead
+prefetch, see sd_read_ahead.h), and the caller might be the one to complete it.
+So don't wait for the lock: if it is taken, go ahead without it. */
+static bool try_lock(sd_card_t *sd_card_p) {
+    uint32_t owner_out;
+    return mutex_try_enter(&sd_card_p->state.mutex, &owner_out);
+}
+
+void sd_stats_reset(sd_card_t *sd_card_p) {
+    bool const locked = try_lock(sd_card_p);
+    memset(&sd_card_p->state.stats, 0, sizeof sd_card_p->state.stats);
+    if (locked) sd_unlock(sd_card_p);
+}
+
+void sd_stats_get(sd_card_t *sd_card_p, sd_stats_t *stats_p) {
+    bool const locked = try_lock(sd_card_p);
+    *stats_p = sd_card_p->state.stats;
+    if (locked) sd_unlock(sd_card_p);
+}
+
+void sd_stats_dump(sd_card_t *sd_card_p, printer_t printer) {
+    static const char *const op_names[SD_STATS_NUM_OPS] = {
+        "Read (single block)", "Read (multiple block)", "Write (single block)",
+        "Write (multiple block)", "Sync"};
+    static sd_stats_t stats;  // Too big for some stacks
+    sd_stats_get(sd_card_p, &stats);
+
+    (*printer)("Commands: %" PRIu32 ", retries: %" PRIu32 ", CRC errors: %" PRIu32
+               ", stop transmissions: %" PRIu32 "\n",
+               stats.commands, stats.retries, stats.crc_errors, stats.stop_transmissions);
+    uint64_t const blocks_wr =
+        stats.ops[SD_STATS_WRITE_SINGLE].blocks + stats.ops[SD_STATS_WRITE_MULTI].blocks;
+    (*printer)("Busy wait: %" PRIu64 " us in %" PRIu32 " waits, max %" PRIu32 " us",
+               stats.busy_wait_us, stats.busy_waits, stats.busy_max_us);
+    if (blocks_wr)
+        (*printer)(", %" PRIu64 " us per block written", stats.busy_wait_us / blocks_wr);
+    (*printer)("\n");
+    for (unsigned op = 0; op < SD_STATS_NUM_OPS; ++op) {
+        sd_stats_op_stats_t const *s_p = &stats.ops[op];
+        if (!s_p->count) continue;
+        (*printer)("%s: %" PRIu32 " ops, %" PRIu32 " errors, %" PRIu64 " blocks, "
+                   "latency avg %" PRIu64 " us, max %" PRIu32 " us\n",
+                   op_names[op], s_p->count, s_p->errors, s_p->blocks,
+                   s_p->total_us / s_p->count, s_p->max_us);
+        for (unsigned b = 0; b < SD_STATS_BUCKETS; ++b) {
+            if (!s_p->hist[b]) continue;
+            if (!b)
+                (*printer)("\t       < 1 us: %" PRIu32 "\n", s_p->hist[b]);
+            else if (SD_STATS_BUCKETS - 1 == b)
+                (*printer)("\t>= %8lu us: %" PRIu32 "\n", 1UL << (b - 1), s_p->hist[b]);
+            else
+                (*printer)("\t < %8lu us: %" PRIu32 "\n", 1UL << b, s_p->hist[b]);
+        }
+    }
+}
+/* [] END OF FILE */
@@ -0,0 +1,127 @@
+/* sd_stats.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-card I/O statistics
+
+Each sd_card_t has an sd_stats_t in its state (sd_card_t::state.stats),
+updated by the drivers (SPI, SDIO, RAM):
+    * Counters of commands sent, command retries, CRC errors,
+      stop transmissions (CMD12 or Stop Tran token),
+      and the time spent waiting for the card to be ready (busy): in all, in how many
+      waits the card was busy, and the longest wait. Divided by the number of blocks
+      written, the total gives the busy (programming) time per written block.
+    * For reads and writes (single and multiple block separately) and syncs:
+      the number of operations, errors, blocks, and the total and maximum latency,
+      and a histogram of the latency with log2 buckets:
+      bucket 0 counts latencies under 1 us, bucket i latencies of 2^(i-1) to 2^i - 1 us,
+      and the last bucket everything longer.
+      The latency is measured from the driver call to its return
+      (for non-blocking requests, sd_async.h, from the start to the poll that sees completion).
+
+Recording an operation costs two reads of the timer, a count leading zeros, and a
+few adds, so the statistics can stay enabled. To compile them out, define USE_SD_STATS as 0.
+The statistics only cover operations that reach the driver: hits in the
+sector cache (sd_cache.h) or the read-ahead (sd_read_ahead.h) are not counted here.
+*/
+
+#pragma once
+
+#include <stdint.h>
+//
+#include "pico/time.h"
+//
+#include "util.h"  // printer_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef USE_SD_STATS
+#  define USE_SD_STATS 1
+#endif
+
+#define SD_STATS_BUCKETS 24  // Up to 2^22 us (about 4 s), and the rest
+
+typedef enum {
+    SD_STATS_READ_SINGLE,
+    SD_STATS_READ_MULTI,
+    SD_STATS_WRITE_SINGLE,
+    SD_STATS_WRITE_MULTI,
+    SD_STATS_SYNC,
+    SD_STATS_NUM_OPS
+} sd_stats_op_t;
+
+typedef struct sd_stats_op_stats_t {
+    uint32_t count;
+    uint32_t errors;
+    uint64_t blocks;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t hist[SD_STATS_BUCKETS];
+} sd_stats_op_stats_t;
+
+typedef struct sd_stats_t {
+    sd_stats_op_stats_t ops[SD_STATS_NUM_OPS];
+    uint32_t commands;            // Commands sent to the card
+    uint32_t retries;             // Commands or transfers retried
+    uint32_t crc_errors;          // In responses or data
+    uint32_t stop_transmissions;  // CMD12 or Stop Tran token
+    uint64_t busy_wait_us;        // Time spent waiting for the card to be ready
+    uint32_t busy_waits;          // Waits in which the card was busy
+    uint32_t busy_max_us;         // Longest of them
+} sd_stats_t;
+
+typedef struct sd_card_t sd_card_t;
+
+void sd_stats_reset(sd_card_t *sd_card_p);
+// Copies the statistics: consistently, unless a transfer is in flight
+// (then, an operation might be partly recorded)
+void sd_stats_get(sd_card_t *sd_card_p, sd_stats_t *stats_p);
+void sd_stats_dump(sd_card_t *sd_card_p, printer_t printer);
+
+#if USE_SD_STATS
+
+#  define SD_STATS_INC(sd_card_p, counter) (++(sd_card_p)->state.stats.counter)
+#  define SD_STATS_ADD(sd_card_p, counter, n) ((sd_card_p)->state.stats.counter += (n))
+
+static inline uint64_t sd_stats_start(void) { return time_us_64(); }
+
+// rc is a block_dev_err_t. For reads and writes, pass the _SINGLE op;
+// it is switched to _MULTI if blocks > 1.
+void sd_stats_record(sd_card_t *sd_card_p, sd_stats_op_t op, uint32_t blocks,
+                     uint64_t start_us, int rc);
+
+// A wait of us microseconds for the card to be ready (after it was found busy)
+void sd_stats_busy(sd_card_t *sd_card_p, uint64_t us);
+
+#else
+
+#  define SD_STATS_INC(sd_card_p, counter) ((void)(sd_card_p))
+#  define SD_STATS_ADD(sd_card_p, counter, n) ((void)(sd_card_p))
+
+static inline uint64_t sd_stats_start(void) { return 0; }
+static inline void sd_stats_record(sd_card_t *sd_card_p, sd_stats_op_t op, uint32_t blocks,
+                                   uint64_t start_us, int rc) {
+    (void)sd_card_p, (void)op, (void)blocks, (void)start_us, (void)rc;
+}
+static inline void sd_stats_busy(sd_card_t *sd_card_p, uint64_t us) {
+    (void)sd_card_p, (void)us;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
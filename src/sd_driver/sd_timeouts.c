@@ -4,6 +4,7 @@
 sd_timeouts_t sd_timeouts __attribute__((weak)) = {
     .sd_command = 2000, // Timeout in ms for response
     .sd_command_retries = 3, // Times SPI cmd is retried when there is no response
+    .sd_erase = 60000, // Timeout in ms for an erase (CMD38) to complete
     .sd_lock = 8000, // Timeout in ms for response
     .sd_spi_read = 1000, // Timeout in ms for response
     .sd_spi_write = 1000, // Timeout in ms for response
@@ -0,0 +1,197 @@
+/* sd_wr_queue.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-drive write queue. See sd_wr_queue.h. */
+
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "diskio.h"  // STA_NOINIT, STA_NODISK
+//
+#include "sd_wr_queue.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+static void swap_slots(sd_wr_queue_t *q_p, uint32_t i, uint32_t j) {
+    uint32_t t = q_p->lba[i];
+    q_p->lba[i] = q_p->lba[j];
+    q_p->lba[j] = t;
+    uint32_t *a = (uint32_t *)q_p->data[i];
+    uint32_t *b = (uint32_t *)q_p->data[j];
+    for (size_t k = 0; k < sizeof q_p->data[0] / sizeof(uint32_t); ++k) {
+        t = a[k];
+        a[k] = b[k];
+        b[k] = t;
+    }
+}
+
+/* Sort by LBA (selection sort: at most count - 1 slot swaps),
+so that runs of contiguous sectors are contiguous in the buffer,
+and write each run with one write_blocks call. If a run fails,
+go on with the rest, and return the first error. */
+static block_dev_err_t flush(sd_card_t *sd_card_p) {
+    sd_wr_queue_t *q_p = sd_card_p->wr_queue_p;
+    if (!q_p->count) return SD_BLOCK_DEVICE_ERROR_NONE;
+    TRACE_PRINTF("%s: %lu sectors\n", __func__, q_p->count);
+
+    for (uint32_t i = 0; i + 1 < q_p->count; ++i) {
+        uint32_t min = i;
+        for (uint32_t j = i + 1; j < q_p->count; ++j)
+            if (q_p->lba[j] < q_p->lba[min]) min = j;
+        if (min != i) swap_slots(q_p, i, min);
+    }
+    ++q_p->flushes;
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    uint32_t i = 0;
+    while (i < q_p->count) {
+        uint32_t n = 1;
+        while (i + n < q_p->count && q_p->lba[i + n] == q_p->lba[i] + n) ++n;
+        block_dev_err_t const err =
+            sd_card_p->write_blocks(sd_card_p, q_p->data[i], q_p->lba[i], n);
+        ++q_p->transfers;
+        if (SD_BLOCK_DEVICE_ERROR_NONE != err) {
+            EMSG_PRINTF("%s: write_blocks(%lu, %lu) failed: %d; %lu sectors lost\n", __func__,
+                        q_p->lba[i], n, err, n);
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rc) rc = err;
+        }
+        i += n;
+    }
+    q_p->count = 0;
+    return rc;
+}
+
+static bool deadline_passed(sd_wr_queue_t *q_p) {
+    return q_p->count && q_p->deadline_ms &&
+           time_us_64() - q_p->oldest_us >= (uint64_t)q_p->deadline_ms * 1000;
+}
+
+static bool is_queued(sd_wr_queue_t *q_p, uint32_t sector, uint32_t count) {
+    for (uint32_t i = 0; i < q_p->count; ++i)
+        if (sector <= q_p->lba[i] && q_p->lba[i] - sector < count) return true;
+    return false;
+}
+
+block_dev_err_t sd_wr_queue_write(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                  uint32_t ulSectorNumber, uint32_t blockCnt) {
+    sd_wr_queue_t *q_p = sd_card_p->wr_queue_p;
+    myASSERT(q_p);
+    // Check here what the driver would check, since it won't see the sectors until later
+    if (sd_card_p->state.m_Status & (STA_NOINIT | STA_NODISK)) return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!blockCnt) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if ((uint64_t)ulSectorNumber + blockCnt > sd_card_p->state.sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    mutex_enter_blocking(&q_p->mutex);
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (blockCnt >= SD_WR_QUEUE_SECTORS) {
+        // Big enough to go straight to the card
+        rc = flush(sd_card_p);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+            rc = sd_card_p->write_blocks(sd_card_p, buffer, ulSectorNumber, blockCnt);
+        mutex_exit(&q_p->mutex);
+        return rc;
+    }
+    for (uint32_t i = 0; i < blockCnt && SD_BLOCK_DEVICE_ERROR_NONE == rc; ++i) {
+        uint32_t const sector = ulSectorNumber + i;
+        uint32_t slot;
+        for (slot = 0; slot < q_p->count; ++slot)
+            if (q_p->lba[slot] == sector) break;
+        if (slot < q_p->count) {
+            ++q_p->sectors_coalesced;
+        } else {
+            if (SD_WR_QUEUE_SECTORS == q_p->count) {
+                rc = flush(sd_card_p);
+                if (SD_BLOCK_DEVICE_ERROR_NONE != rc) break;
+            }
+            if (!q_p->count) q_p->oldest_us = time_us_64();
+            slot = q_p->count++;
+            q_p->lba[slot] = sector;
+        }
+        memcpy(q_p->data[slot], buffer + (size_t)i * sd_block_size, sd_block_size);
+        ++q_p->sectors_queued;
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc && deadline_passed(q_p)) rc = flush(sd_card_p);
+    mutex_exit(&q_p->mutex);
+    return rc;
+}
+
+block_dev_err_t sd_wr_queue_read(sd_card_t *sd_card_p, uint8_t *buffer,
+                                 uint32_t ulSectorNumber, uint32_t ulSectorCount) {
+    sd_wr_queue_t *q_p = sd_card_p->wr_queue_p;
+    myASSERT(q_p);
+    mutex_enter_blocking(&q_p->mutex);
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (deadline_passed(q_p) || is_queued(q_p, ulSectorNumber, ulSectorCount))
+        rc = flush(sd_card_p);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+        rc = sd_card_p->read_blocks(sd_card_p, buffer, ulSectorNumber, ulSectorCount);
+    mutex_exit(&q_p->mutex);
+    return rc;
+}
+
+block_dev_err_t sd_wr_queue_erase(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                  uint32_t blockCnt) {
+    sd_wr_queue_t *q_p = sd_card_p->wr_queue_p;
+    myASSERT(q_p);
+    if (!sd_card_p->erase_blocks) return SD_BLOCK_DEVICE_ERROR_UNSUPPORTED;
+    mutex_enter_blocking(&q_p->mutex);
+    // Queued writes to the range are moot
+    for (uint32_t i = 0; i < q_p->count;) {
+        if (ulSectorNumber <= q_p->lba[i] && q_p->lba[i] - ulSectorNumber < blockCnt) {
+            --q_p->count;
+            if (i != q_p->count) {
+                q_p->lba[i] = q_p->lba[q_p->count];
+                memcpy(q_p->data[i], q_p->data[q_p->count], sd_block_size);
+            }
+        } else {
+            ++i;
+        }
+    }
+    block_dev_err_t rc = sd_card_p->erase_blocks(sd_card_p, ulSectorNumber, blockCnt);
+    mutex_exit(&q_p->mutex);
+    return rc;
+}
+
+block_dev_err_t sd_wr_queue_flush(sd_card_t *sd_card_p) {
+    sd_wr_queue_t *q_p = sd_card_p->wr_queue_p;
+    myASSERT(q_p);
+    mutex_enter_blocking(&q_p->mutex);
+    block_dev_err_t rc = flush(sd_card_p);
+    mutex_exit(&q_p->mutex);
+    return rc;
+}
+
+void sd_wr_queue_discard(sd_card_t *sd_card_p) {
+    sd_wr_queue_t *q_p = sd_card_p->wr_queue_p;
+    myASSERT(q_p);
+    mutex_enter_blocking(&q_p->mutex);
+    q_p->count = 0;
+    mutex_exit(&q_p->mutex);
+}
+
+block_dev_err_t sd_wr_queue_poll(sd_card_t *sd_card_p) {
+    sd_wr_queue_t *q_p = sd_card_p->wr_queue_p;
+    myASSERT(q_p);
+    mutex_enter_blocking(&q_p->mutex);
+    block_dev_err_t rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (deadline_passed(q_p)) rc = flush(sd_card_p);
+    mutex_exit(&q_p->mutex);
+    return rc;
+}
+/* [] END OF FILE */
@@ -0,0 +1,102 @@
+/* sd_wr_queue.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-drive write queue with elevator merging
+
+FatFs writes one sector at a time for FAT and directory updates,
+interleaved with the file data. Sent straight to the card,
+each of these is a separate transaction, and each one ends
+the open multiple block write (CMD25) of the data stream.
+
+With a write queue, disk_write (glue.c) collects the sectors instead.
+Rewrites of a queued sector just replace its contents.
+When the queue is flushed, the sectors are sorted by LBA and
+runs of contiguous sectors go out as single multiple block writes.
+
+The queue is flushed when
+    * it is full,
+    * FatFs syncs (CTRL_SYNC, e.g. from f_sync or f_close),
+    * disk_read reads a queued sector,
+    * a write of SD_WR_QUEUE_SECTORS or more sectors comes along (it is not queued), or
+    * the oldest pending sector has been waiting for deadline_ms
+      (checked at each disk_read and disk_write, and by sd_wr_queue_poll).
+
+Until they are flushed, the queued sectors are only in RAM.
+If a run fails to write, its sectors are lost, the rest are still written,
+and the (first) error is reported by the call that triggered the flush.
+
+To enable it for an SD card, point wr_queue_p at an instance in the hardware configuration:
+
+    static sd_wr_queue_t wr_queue = {.deadline_ms = 500};
+    static sd_card_t sd_card = {
+        ...
+        .wr_queue_p = &wr_queue
+    };
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "pico/mutex.h"
+//
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Capacity of each queue, in 512 byte sectors
+#ifndef SD_WR_QUEUE_SECTORS
+#  define SD_WR_QUEUE_SECTORS 16
+#endif
+
+struct sd_wr_queue_t {
+    uint32_t deadline_ms;  // 0: no deadline
+
+    /* The following fields are not part of the configuration.
+    They are state variables, and are dynamically assigned. */
+    mutex_t mutex;
+    uint32_t count;      // Number of queued sectors
+    uint64_t oldest_us;  // When the first of the queued sectors was queued
+    uint32_t lba[SD_WR_QUEUE_SECTORS];
+    uint8_t data[SD_WR_QUEUE_SECTORS][512] __attribute__((aligned(4)));
+
+    // Statistics
+    uint32_t sectors_queued;     // Sectors passed to sd_wr_queue_write and queued
+    uint32_t sectors_coalesced;  // Sectors rewritten while queued
+    uint32_t flushes;
+    uint32_t transfers;          // write_blocks calls made by flushes
+};
+
+block_dev_err_t sd_wr_queue_write(sd_card_t *sd_card_p, const uint8_t *buffer,
+                                  uint32_t ulSectorNumber, uint32_t blockCnt);
+block_dev_err_t sd_wr_queue_read(sd_card_t *sd_card_p, uint8_t *buffer,
+                                 uint32_t ulSectorNumber, uint32_t ulSectorCount);
+block_dev_err_t sd_wr_queue_flush(sd_card_t *sd_card_p);
+// Drop queued sectors in the range, and erase it (see sd_card_t::erase_blocks)
+block_dev_err_t sd_wr_queue_erase(sd_card_t *sd_card_p, uint32_t ulSectorNumber,
+                                  uint32_t blockCnt);
+// Drop all queued sectors without writing them (e.g., the card has been removed)
+void sd_wr_queue_discard(sd_card_t *sd_card_p);
+
+/* Flush if the deadline has passed. Call periodically if the application
+might be idle for long with data pending. */
+block_dev_err_t sd_wr_queue_poll(sd_card_t *sd_card_p);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,190 @@
+/* fast_seek.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <string.h>
+//
+#include "pico/mutex.h"
+//
+#include "f_util.h"
+#include "my_debug.h"
+//
+#include "fast_seek.h"
+
+#define TRACE_PRINTF(fmt, args...) {}
+//#define TRACE_PRINTF printf
+
+#if FF_USE_FASTSEEK
+
+#define NUM_CHUNKS (FAST_SEEK_POOL_DWORDS / FAST_SEEK_CHUNK_DWORDS)
+
+typedef struct fast_seek_rec_t {
+    FIL *fp;        // Null: free record
+    size_t first;   // First chunk of the table
+    size_t chunks;  // Size of the table in chunks (0: none)
+    size_t need;    // Chunks needed when there was no room (0: none)
+} fast_seek_rec_t;
+
+static DWORD pool[NUM_CHUNKS * FAST_SEEK_CHUNK_DWORDS];
+static bool chunk_used[NUM_CHUNKS];
+static fast_seek_rec_t recs[FAST_SEEK_FILES];
+static fast_seek_stats_t stats;
+auto_init_mutex(fast_seek_mutex);
+
+/* Caller holds the mutex. Returns the first of n free chunks in a row, or NUM_CHUNKS. */
+static size_t find_run(size_t n) {
+    size_t run = 0;
+    for (size_t i = 0; i < NUM_CHUNKS; ++i) {
+        run = chunk_used[i] ? 0 : run + 1;
+        if (run == n) return i + 1 - n;
+    }
+    return NUM_CHUNKS;
+}
+
+/* Caller holds the mutex */
+static void free_table(fast_seek_rec_t *rec_p) {
+    for (size_t i = 0; i < rec_p->chunks; ++i) chunk_used[rec_p->first + i] = false;
+    stats.chunks_used -= rec_p->chunks;
+    rec_p->chunks = 0;
+}
+
+/* Caller holds the mutex. Finds the file's record, or (if add) takes a free one. */
+static fast_seek_rec_t *find_rec(FIL *fp, bool add) {
+    fast_seek_rec_t *free_p = NULL;
+    for (size_t i = 0; i < FAST_SEEK_FILES; ++i) {
+        if (recs[i].fp == fp) return &recs[i];
+        if (!recs[i].fp && !free_p) free_p = &recs[i];
+    }
+    if (add && free_p) {
+        memset(free_p, 0, sizeof *free_p);
+        free_p->fp = fp;
+        return free_p;
+    }
+    return NULL;
+}
+
+/* Give the file a table of (at least) n chunks, keeping the one it has if it is big enough */
+static DWORD *get_table(FIL *fp, size_t n) {
+    DWORD *tbl = NULL;
+    mutex_enter_blocking(&fast_seek_mutex);
+    fast_seek_rec_t *rec_p = find_rec(fp, true);
+    if (rec_p) {
+        if (rec_p->chunks < n) {
+            free_table(rec_p);
+            size_t const first = find_run(n);
+            if (first < NUM_CHUNKS) {
+                for (size_t i = 0; i < n; ++i) chunk_used[first + i] = true;
+                stats.chunks_used += n;
+                rec_p->first = first;
+                rec_p->chunks = n;
+                rec_p->need = 0;
+            } else {
+                rec_p->need = n;
+                ++stats.no_room;
+            }
+        }
+        if (rec_p->chunks) {
+            tbl = &pool[rec_p->first * FAST_SEEK_CHUNK_DWORDS];
+            tbl[0] = rec_p->chunks * FAST_SEEK_CHUNK_DWORDS;  // Table size for CREATE_LINKMAP
+        }
+    }
+    mutex_exit(&fast_seek_mutex);
+    return tbl;
+}
+
+/* Whether it is worth walking the chain to create the map: not if the last try found
+no room, and the pool still has none */
+static bool worth_trying(FIL *fp) {
+    mutex_enter_blocking(&fast_seek_mutex);
+    fast_seek_rec_t *rec_p = find_rec(fp, false);
+    bool const worth = !rec_p || !rec_p->need || find_run(rec_p->need) < NUM_CHUNKS;
+    mutex_exit(&fast_seek_mutex);
+    return worth;
+}
+
+static FRESULT create_map(FIL *fp) {
+    size_t n = 1;
+    for (;;) {
+        DWORD *tbl = get_table(fp, n);
+        if (!tbl) return FR_OK;  // No room: just follow the chain
+        fp->cltbl = tbl;
+        FRESULT fr = f_lseek(fp, CREATE_LINKMAP);
+        if (FR_OK == fr) {
+            TRACE_PRINTF("%s: %lu fragments\n", __func__, (unsigned long)(tbl[0] - 2) / 2);
+            mutex_enter_blocking(&fast_seek_mutex);
+            ++stats.maps_created;
+            mutex_exit(&fast_seek_mutex);
+            return FR_OK;
+        }
+        fp->cltbl = 0;
+        if (FR_NOT_ENOUGH_CORE != fr) return fr;
+        // tbl[0] has the number of items needed
+        n = (tbl[0] + FAST_SEEK_CHUNK_DWORDS - 1) / FAST_SEEK_CHUNK_DWORDS;
+        if (n > NUM_CHUNKS) {
+            mutex_enter_blocking(&fast_seek_mutex);
+            fast_seek_rec_t *rec_p = find_rec(fp, false);
+            if (rec_p) {
+                free_table(rec_p);
+                rec_p->need = n;
+            }
+            ++stats.no_room;
+            mutex_exit(&fast_seek_mutex);
+            return FR_OK;
+        }
+    }
+}
+
+FRESULT fast_seek_lseek(FIL *fp, FSIZE_t ofs) {
+    if (ofs > f_size(fp) && (fp->flag & FA_WRITE)) {
+        // In fast seek mode, f_lseek clips at the file size; only following the chain
+        // stretches it. The map is created again at the next seek.
+        fp->cltbl = 0;
+    } else if (!fp->cltbl && f_size(fp) >= FAST_SEEK_MIN_SIZE && ofs != f_tell(fp) &&
+               worth_trying(fp)) {
+        FRESULT fr = create_map(fp);
+        if (FR_OK != fr) return fr;
+    }
+    return f_lseek(fp, ofs);
+}
+
+FRESULT fast_seek_truncate(FIL *fp) {
+    fp->cltbl = 0;  // The map would still have the clusters that are removed
+    return f_truncate(fp);
+}
+
+void fast_seek_release(FIL *fp) {
+    fp->cltbl = 0;
+    mutex_enter_blocking(&fast_seek_mutex);
+    fast_seek_rec_t *rec_p = find_rec(fp, false);
+    if (rec_p) {
+        free_table(rec_p);
+        rec_p->fp = NULL;
+    }
+    mutex_exit(&fast_seek_mutex);
+}
+
+void fast_seek_get_stats(fast_seek_stats_t *stats_p) {
+    mutex_enter_blocking(&fast_seek_mutex);
+    *stats_p = stats;
+    mutex_exit(&fast_seek_mutex);
+}
+
+#else
+
+FRESULT fast_seek_lseek(FIL *fp, FSIZE_t ofs) { return f_lseek(fp, ofs); }
+FRESULT fast_seek_truncate(FIL *fp) { return f_truncate(fp); }
+void fast_seek_release(FIL *fp) { (void)fp; }
+void fast_seek_get_stats(fast_seek_stats_t *stats_p) { memset(stats_p, 0, sizeof *stats_p); }
+
+#endif
+/* [] END OF FILE */
@@ -23,6 +23,7 @@ specific language governing permissions and limitations under the License.
 #include "my_debug.h"
 //
 #include "f_util.h"
+#include "fast_seek.h"
 #include "ff_stdio.h"
 
 #define TRACE_PRINTF(fmt, args...) {}
@@ -118,6 +119,7 @@ int ff_fclose(FF_FILE *pxStream) {
     if (FR_OK != fr)
         TRACE_PRINTF("%s error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     errno = fresult2errno(fr);
+    fast_seek_release(pxStream);
     free(pxStream);
     if (FR_OK == fr)
         return 0;
@@ -323,15 +325,15 @@ int ff_fseek(FF_FILE *pxStream, int iOffset, int iWhence) {
     switch (iWhence) {
         case FF_SEEK_CUR:  // The current file position.
             if ((int)f_tell(pxStream) + iOffset < 0) return -1;
-            fr = f_lseek(pxStream, f_tell(pxStream) + iOffset);
+            fr = fast_seek_lseek(pxStream, f_tell(pxStream) + iOffset);
             break;
         case FF_SEEK_END:  // The end of the file.
             if ((int)f_size(pxStream) + iOffset < 0) return -1;
-            fr = f_lseek(pxStream, f_size(pxStream) + iOffset);
+            fr = fast_seek_lseek(pxStream, f_size(pxStream) + iOffset);
             break;
         case FF_SEEK_SET:  // The beginning of the file.
             if (iOffset < 0) return -1;
-            fr = f_lseek(pxStream, iOffset);
+            fr = fast_seek_lseek(pxStream, iOffset);
             break;
         default:
             myASSERT(!"Bad iWhence");
@@ -417,12 +419,12 @@ FF_FILE *ff_truncate(const char *pcFileName, long lTruncateSize) {
         errno = fresult2errno(fr);
         if (1 != bw) return NULL;
     }
-    fr = f_lseek(fp, lTruncateSize);
+    fr = fast_seek_lseek(fp, lTruncateSize);
     errno = fresult2errno(fr);
     if (FR_OK != fr)
         EMSG_PRINTF("%s: f_lseek error: %s (%d)\n", __func__, FRESULT_str(fr), fr);
     if (FR_OK != fr) return NULL;
-    fr = f_truncate(fp);
+    fr = fast_seek_truncate(fp);
     if (FR_OK != fr)
         EMSG_PRINTF("%s: f_truncate error: %s (%d)\n", __func__, FRESULT_str(fr),
                fr);
@@ -434,7 +436,7 @@ FF_FILE *ff_truncate(const char *pcFileName, long lTruncateSize) {
 }
 int ff_seteof(FF_FILE *pxStream) {
     TRACE_PRINTF("%s\n", __func__);
-    FRESULT fr = f_truncate(pxStream);
+    FRESULT fr = fast_seek_truncate(pxStream);
     errno = fresult2errno(fr);
     if (FR_OK == fr)
         return 0;
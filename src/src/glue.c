@@ -23,7 +23,11 @@ specific language governing permissions and limitations under the License.
 //
 #include "hw_config.h"
 #include "my_debug.h"
+#include "sd_cache.h"
 #include "sd_card.h"
+#include "sd_io_core.h"
+#include "sd_read_ahead.h"
+#include "sd_wr_queue.h"
 //
 #include "diskio.h" /* Declarations of disk functions */
 
@@ -37,6 +41,8 @@ specific language governing permissions and limitations under the License.
 DSTATUS disk_status(BYTE pdrv /* Physical drive number to identify the drive */
 ) {
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
+    if (sd_io_core_offload())  // See sd_io_core.h
+        return sd_io_core_call(&(sd_io_msg_t){.op = SD_IO_MSG_STATUS, .pdrv = pdrv});
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
     sd_card_detect(sd_card_p);   // Fast: just a GPIO read
@@ -54,12 +60,23 @@ DSTATUS disk_initialize(
 
     bool ok = sd_init_driver();
     if (!ok) return RES_NOTRDY;
+    if (sd_io_core_offload())
+        return sd_io_core_call(&(sd_io_msg_t){.op = SD_IO_MSG_INITIALIZE, .pdrv = pdrv});
 
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
     DSTATUS ds = disk_status(pdrv);
     if (STA_NODISK & ds) 
         return ds;
+    if (STA_NOINIT & ds) sd_card_p->state.au_known = false;  // It might be a different card
+    if (sd_card_p->cache_p && (STA_NOINIT & ds))
+        sd_cache_invalidate(sd_card_p);
+    if (sd_card_p->read_ahead_p) {
+        if (STA_NOINIT & ds)
+            sd_read_ahead_invalidate(sd_card_p);
+        else
+            sd_read_ahead_wait(sd_card_p);  // init takes the card lock
+    }
     // See http://elm-chan.org/fsw/ff/doc/dstat.html
     return sd_card_p->init(sd_card_p);  
 }
@@ -97,9 +114,20 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive number to identify the drive */
                   UINT count    /* Number of sectors to read */
 ) {
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
+    if (sd_io_core_offload())
+        return sd_io_core_call(&(sd_io_msg_t){
+            .op = SD_IO_MSG_READ, .pdrv = pdrv, .rd_buffer = buff, .sector = sector, .count = count});
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
-    int rc = sd_card_p->read_blocks(sd_card_p, buff, sector, count);
+    int rc;
+    if (sd_card_p->cache_p)
+        rc = sd_cache_read(sd_card_p, buff, sector, count);
+    else if (sd_card_p->read_ahead_p)
+        rc = sd_read_ahead_read(sd_card_p, buff, sector, count);
+    else if (sd_card_p->wr_queue_p)
+        rc = sd_wr_queue_read(sd_card_p, buff, sector, count);
+    else
+        rc = sd_card_p->read_blocks(sd_card_p, buff, sector, count);
     return sdrc2dresult(rc);
 }
 
@@ -115,9 +143,20 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive number to identify the drive */
                    UINT count        /* Number of sectors to write */
 ) {
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
+    if (sd_io_core_offload())
+        return sd_io_core_call(&(sd_io_msg_t){
+            .op = SD_IO_MSG_WRITE, .pdrv = pdrv, .wr_buffer = buff, .sector = sector, .count = count});
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
-    int rc = sd_card_p->write_blocks(sd_card_p, buff, sector, count);
+    int rc;
+    if (sd_card_p->cache_p)
+        rc = sd_cache_write(sd_card_p, buff, sector, count);
+    else if (sd_card_p->read_ahead_p)
+        rc = sd_read_ahead_write(sd_card_p, buff, sector, count);
+    else if (sd_card_p->wr_queue_p)
+        rc = sd_wr_queue_write(sd_card_p, buff, sector, count);
+    else
+        rc = sd_card_p->write_blocks(sd_card_p, buff, sector, count);
     return sdrc2dresult(rc);
 }
 
@@ -132,8 +171,13 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive number (0..) */
                    void *buff /* Buffer to send/receive control data */
 ) {
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
+    if (sd_io_core_offload())
+        return sd_io_core_call(&(sd_io_msg_t){
+            .op = SD_IO_MSG_IOCTL, .pdrv = pdrv, .cmd = cmd, .ioctl_buffer = buff});
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
+    if (sd_card_p->read_ahead_p)
+        sd_read_ahead_wait(sd_card_p);  // A prefetch in flight holds the card lock
     switch (cmd) {
         case GET_SECTOR_COUNT: {  // Retrieves number of available sectors, the
                                   // largest allowable LBA + 1, on the drive
@@ -157,13 +201,56 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive number (0..) */
                                 // f_mkfs function and it attempts to align data
                                 // area on the erase block boundary. It is
                                 // required when FF_USE_MKFS == 1.
-            static DWORD bs = 1;
+            // The allocation unit (AU) is the SD card's erase block
+            DWORD bs = 1;
+            size_t au_bytes = 0;
+            if (sd_allocation_unit(sd_card_p, &au_bytes) && au_bytes) {
+                bs = au_bytes / sd_block_size;
+                bs &= -bs;  // 12 MB and 24 MB AUs are not powers of 2
+                if (bs > 32768) bs = 32768;
+            }
             *(DWORD *)buff = bs;
             return RES_OK;
         }
         case CTRL_SYNC:
+            if (sd_card_p->cache_p) {
+                int rc = sd_cache_flush(sd_card_p);
+                if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return sdrc2dresult(rc);
+            }
+            if (sd_card_p->wr_queue_p) {
+                int rc = sd_wr_queue_flush(sd_card_p);
+                if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return sdrc2dresult(rc);
+            }
             sd_card_p->sync(sd_card_p);
             return RES_OK;
+        case CTRL_TRIM: {  // Informs the device that the data on the block of
+                           // sectors specified by the LBA_t array
+                           // {start, end} pointed by buff is no longer
+                           // needed. Used when FF_USE_TRIM == 1.
+            LBA_t const *range = buff;
+            LBA_t start = range[0];
+            LBA_t end = range[1] + 1;  // Exclusive
+            if (!sd_card_p->erase_blocks)  // (What the layers below erase with, too)
+                return sdrc2dresult(SD_BLOCK_DEVICE_ERROR_UNSUPPORTED);
+            // Erase whole allocation units only, if the AU is known
+            size_t au_bytes = 0;
+            if (sd_allocation_unit(sd_card_p, &au_bytes) && au_bytes) {
+                LBA_t const au = au_bytes / sd_block_size;
+                start = (start + au - 1) / au * au;
+                end = end / au * au;
+            }
+            if (start >= end) return RES_OK;
+            int rc;
+            if (sd_card_p->cache_p)
+                rc = sd_cache_erase(sd_card_p, start, end - start);
+            else if (sd_card_p->read_ahead_p)
+                rc = sd_read_ahead_erase(sd_card_p, start, end - start);
+            else if (sd_card_p->wr_queue_p)
+                rc = sd_wr_queue_erase(sd_card_p, start, end - start);
+            else
+                rc = sd_card_p->erase_blocks(sd_card_p, start, end - start);
+            return sdrc2dresult(rc);
+        }
         default:
             return RES_PARERR;
     }